@@ -1,4 +1,5 @@
 #include <iostream>
+#include <sstream>
 #include <boost/asio.hpp>
 #include <boost/asio/local/stream_protocol.hpp>
 #include <boost/asio/posix/stream_descriptor.hpp>
@@ -39,6 +40,8 @@ CLI_Client::CLI_Client( boost::asio::io_context &i, const std::string &path ):
     map.emplace( "show version", CONTENT::SHOW_VER );
     map.emplace( "show table", CONTENT::SHOW_TABLE );
     map.emplace( "show neighbour", CONTENT::SHOW_NEI );
+    map.emplace( "subscribe", CONTENT::SUBSCRIBE );
+    map.emplace( "reload", CONTENT::RELOAD );
     sock.async_connect( ep, std::bind( &CLI_Client::on_connect, this, std::placeholders::_1 ) );
     std::cout << "Connecting to bgp daemon..." << std::endl;
 }
@@ -52,28 +55,40 @@ void CLI_Client::on_connect( const boost::system::error_code &ec ) {
     read_cli_cmd();
 }
 
-std::string CLI_Client::sync_send( std::string out ) {
-    sock.send( boost::asio::buffer( out ) );
-    auto len = sock.receive( boost::asio::buffer( buf ) );
-    return { buf.data(), buf.data() + len };
+std::string CLI_Client::sync_send( const std::string &frame ) {
+    boost::asio::write( sock, boost::asio::buffer( frame ) );
+    return receive_frame();
 }
 
-void CLI_Client::read_cli_cmd() {
-    std::cout << "bgp# ";
-    std::cout.flush();
-    boost::system::error_code ec;
-    auto len = input.read_some( boost::asio::buffer( buf ), ec );
-    if( ec ) {
-        std::cerr << ec.message() << std::endl;
-        exit( -1 );
+std::string CLI_Client::receive_frame() {
+    std::array<uint8_t,CLI_FRAME_HEADER> header;
+    boost::asio::read( sock, boost::asio::buffer( header ) );
+    auto len = frame_length( header.data() );
+    if( len > CLI_MAX_FRAME ) {
+        throw std::runtime_error( "Too long response from daemon" );
     }
-    std::string in { buf.data(), buf.data() + len - 1 };
-    try{
-        parse_cmd( in );
-    } catch( std::exception &e ) {
-        std::cerr << e.what() << std::endl;
+    std::string data( len, '\0' );
+    boost::asio::read( sock, boost::asio::buffer( data ) );
+    return data;
+}
+
+void CLI_Client::read_cli_cmd() {
+    while( true ) {
+        std::cout << "bgp# ";
+        std::cout.flush();
+        boost::system::error_code ec;
+        auto len = input.read_some( boost::asio::buffer( buf ), ec );
+        if( ec ) {
+            std::cerr << ec.message() << std::endl;
+            exit( -1 );
+        }
+        std::string in { buf.data(), buf.data() + len - 1 };
+        try{
+            parse_cmd( in );
+        } catch( std::exception &e ) {
+            std::cerr << e.what() << std::endl;
+        }
     }
-    read_cli_cmd();
 }
 
 void CLI_Client::parse_cmd( const std::string &cmd ) {
@@ -81,61 +96,163 @@ void CLI_Client::parse_cmd( const std::string &cmd ) {
         map.begin(),
         map.end(),
         [ &cmd ]( const std::pair<std::string,CONTENT> &v ) -> bool {
-            return v.first.find( cmd ) == 0;
+            // command with arguments or abbreviated command
+            return cmd.find( v.first ) == 0 || v.first.find( cmd ) == 0;
         }
     );
     if( it == map.end() ) {
         std::cout << "Invalid command" << std::endl;
         return;
     }
-    Message outMsg;
-    outMsg.type = TYPE::REQ;
-    outMsg.cont = it->second;
+    auto args = cmd.substr( std::min( it->first.size(), cmd.size() ) );
+    cli_writer out( TYPE::REQ, it->second );
     switch( it->second ) {
-    case CONTENT::SHOW_NEI: {
-        auto args = cmd.substr( it->first.size() );
-        auto req = cmd_parse<Show_Neighbour_Req>( args );
-        outMsg.data = serialize( req );
+    case CONTENT::SHOW_NEI:
+        out & cmd_parse<Show_Neighbour_Req>( args );
         break;
-    }
     case CONTENT::SHOW_VER: break;
-    case CONTENT::SHOW_TABLE: {
-        auto args = cmd.substr( it->first.size() );
-        auto req = cmd_parse<Show_Table_Req>( args );
-        outMsg.data = serialize( req );
+    case CONTENT::RELOAD: break;
+    case CONTENT::SHOW_TABLE:
+        out & cmd_parse<Show_Table_Req>( args );
+        break;
+    case CONTENT::SUBSCRIBE:
+        out & cmd_parse<Subscribe_Req>( args );
         break;
     }
-    }
-    auto outData = serialize( outMsg );
-    sock.send( boost::asio::buffer( outData ) );
-    auto len = sock.receive( boost::asio::buffer( buf ) );
-    std::string inData { buf.data(), buf.data() + len };
-    auto inMsg = deserialize<Message>( inData );
-    if( inMsg.type != TYPE::RESP ) {
+    // responses refer to frame, which is kept until they are printed
+    auto frame = sync_send( out.finish() );
+    cli_reader in( frame );
+    if( in.type != TYPE::RESP ) {
         std::cout << "Invalid type in response message" << std::endl;
         return;
     }
-    switch( inMsg.cont ) {
-    case CONTENT::SHOW_NEI: {
-        auto resp = deserialize<Show_Neighbour_Resp>( inMsg.data );
-        std::cout << resp << std::endl;
+    switch( in.cont ) {
+    case CONTENT::SHOW_NEI:
+        std::cout << in.read<Show_Neighbour_Resp>() << std::endl;
         break;
-    }
     case CONTENT::SHOW_VER: break;
+    case CONTENT::RELOAD: {
+        auto resp = in.read<Reload_Resp>();
+        if( resp.error ) {
+            std::cout << "Error: " << *resp.error << std::endl;
+            break;
+        }
+        for( auto const &change: resp.changes ) {
+            std::cout << change << std::endl;
+        }
+        std::cout << "Configuration is reloaded" << std::endl;
+        break;
+    }
     case CONTENT::SHOW_TABLE: {
-        auto resp = deserialize<Show_Table_Resp>( inMsg.data );
-        std::cout << resp << std::endl;
+        // table comes in chunks, which are printed as they arrive
+        auto resp = in.read<Show_Table_Resp>();
+        if( resp.error ) {
+            std::cout << "Error: " << *resp.error << std::endl;
+            break;
+        }
+        std::cout << table_header;
+        std::size_t count = 0;
+        while( true ) {
+            std::cout << resp;
+            count += resp.entries.size() / sizeof( cli_table_entry );
+            if( resp.last ) {
+                break;
+            }
+            frame = receive_frame();
+            resp = cli_reader( frame ).read<Show_Table_Resp>();
+        }
+        std::cout << "Total entries: " << count << std::endl;
+        if( resp.cursor ) {
+            std::cout << "More entries after: " << *resp.cursor << std::endl;
+        }
         break;
     }
+    case CONTENT::SUBSCRIBE: {
+        // events are printed until daemon closes connection or client is interrupted
+        auto resp = in.read<Subscribe_Resp>();
+        if( resp.error ) {
+            std::cout << "Error: " << *resp.error << std::endl;
+            break;
+        }
+        while( true ) {
+            std::cout << resp;
+            std::cout.flush();
+            frame = receive_frame();
+            resp = cli_reader( frame ).read<Subscribe_Resp>();
+        }
+    }
     }
 }
 
+// arguments are pairs of keyword and value: prefix P, longest P, longer P,
+// neighbour A, nexthop A, as N, community C, limit N, page N, cursor P
 template<>
 Show_Table_Req cmd_parse<Show_Table_Req>( const std::string &args ) {
-    return {};
+    Show_Table_Req req;
+    std::istringstream ss( args );
+    std::string key;
+    std::string value;
+    while( ss >> key ) {
+        if( !( ss >> value ) ) {
+            throw std::runtime_error( "Missing value of " + key );
+        }
+        if( key == "prefix" || key == "longest" || key == "longer" ) {
+            req.prefix = value;
+            if( key == "longest" ) {
+                req.match = PREFIX_MATCH::LONGEST;
+            } else if( key == "longer" ) {
+                req.match = PREFIX_MATCH::MORE_SPECIFIC;
+            }
+        } else if( key == "neighbour" ) {
+            req.neighbour = value;
+        } else if( key == "nexthop" ) {
+            req.nexthop = value;
+        } else if( key == "as" ) {
+            req.as = std::stoul( value );
+        } else if( key == "community" ) {
+            req.community = value;
+        } else if( key == "limit" ) {
+            req.limit = std::stoul( value );
+        } else if( key == "page" ) {
+            req.page = std::stoul( value );
+        } else if( key == "cursor" ) {
+            req.cursor = value;
+        } else {
+            throw std::runtime_error( "Unknown argument: " + key );
+        }
+    }
+    return req;
 }
 
 template<>
 Show_Neighbour_Req cmd_parse<Show_Neighbour_Req>( const std::string &args ) {
-    return {};
-}
\ No newline at end of file
+    Show_Neighbour_Req req;
+    std::istringstream ss( args );
+    std::string address;
+    if( ss >> address ) {
+        req.address = address;
+    }
+    return req;
+}
+
+// arguments are pairs of keyword and value: prefix P, neighbour A
+template<>
+Subscribe_Req cmd_parse<Subscribe_Req>( const std::string &args ) {
+    Subscribe_Req req;
+    std::istringstream ss( args );
+    std::string key;
+    std::string value;
+    while( ss >> key ) {
+        if( !( ss >> value ) ) {
+            throw std::runtime_error( "Missing value of " + key );
+        }
+        if( key == "prefix" ) {
+            req.prefix = value;
+        } else if( key == "neighbour" ) {
+            req.neighbour = value;
+        } else {
+            throw std::runtime_error( "Unknown argument: " + key );
+        }
+    }
+    return req;
+}
@@ -7,6 +7,7 @@
 enum class CONTENT: uint8_t;
 struct Show_Table_Req;
 struct Show_Neighbour_Req;
+struct Subscribe_Req;
 
 enum class TOKEN: uint8_t {
     CONT,
@@ -26,8 +27,11 @@ struct CLI_Token {
 class CLI_Client {
 public:
     CLI_Client( boost::asio::io_context &i, const std::string &path );
-    std::string sync_send( std::string out );
+    // frame is written by cli_writer, response frame is returned without its length
+    std::string sync_send( const std::string &frame );
 private:
+    // reads one length prefixed message
+    std::string receive_frame();
     void on_connect( const boost::system::error_code &ec );
     void read_cli_cmd();
     void parse_cmd( const std::string &cmd );
@@ -49,4 +53,7 @@ Show_Table_Req cmd_parse<Show_Table_Req>( const std::string &args );
 template<>
 Show_Neighbour_Req cmd_parse<Show_Neighbour_Req>( const std::string &args );
 
+template<>
+Subscribe_Req cmd_parse<Subscribe_Req>( const std::string &args );
+
 #endif
\ No newline at end of file
@@ -4,11 +4,6 @@
 #include <boost/asio/signal_set.hpp>
 #include <boost/optional.hpp>
 #include <boost/program_options.hpp>
-#include <boost/serialization/serialization.hpp>
-#include <boost/serialization/vector.hpp>
-#include <boost/serialization/optional.hpp>
-#include <boost/archive/binary_iarchive.hpp>
-#include <boost/archive/binary_oarchive.hpp>
 
 #include "main.hpp"
 #include "string_utils.hpp"
@@ -17,7 +12,7 @@
 
 bool interrupted { false };
 
-void sighandler( boost::system::error_code ec, int signal ) {
+void sighandler( boost::system::error_code, int ) {
     interrupted = true;
 }
 
@@ -57,22 +52,22 @@ int main(int argc, char *argv[])
     {
         Show_Table_Req st;
         st.prefix.emplace( "10.0.0.0/24" );
-        Message msg;
-        msg.cont = CONTENT::SHOW_TABLE;
-        msg.type = TYPE::REQ;
-        auto inner = serialize( st );
-        msg.data = inner;
-        binary_data = serialize( msg );
+        cli_writer out( TYPE::REQ, CONTENT::SHOW_TABLE );
+        out & st;
+        binary_data = out.finish().substr( CLI_FRAME_HEADER );
     }
 
     {
-        auto msg = deserialize<Message>( binary_data );
-        std::cout << msg << std::endl;
+        cli_reader msg( binary_data );
+        std::cout << "Type: " << msg.type << std::endl;
+        std::cout << "Content: " << msg.cont << std::endl;
         switch( msg.cont ) {
         case CONTENT::SHOW_NEI: break;
         case CONTENT::SHOW_VER: break;
+        case CONTENT::SUBSCRIBE: break;
+        case CONTENT::RELOAD: break;
         case CONTENT::SHOW_TABLE: {
-            auto st = deserialize<Show_Table_Req>( msg.data );
+            auto st = msg.read<Show_Table_Req>();
             std::cout << st << std::endl;
             break;
         }
@@ -1,6 +1,10 @@
 #include <iostream>
 #include <iomanip>
+#include <array>
 #include <vector>
+#include <ctime>
+#include <stdexcept>
+#include <boost/asio/ip/address.hpp>
 
 #include "string_utils.hpp"
 #include "message.hpp"
@@ -30,23 +34,19 @@ std::ostream& operator<<( std::ostream &os, const CONTENT &cont ) {
     case CONTENT::SHOW_VER: os << "SHOW_VER"; break;
     case CONTENT::SHOW_TABLE: os << "SHOW_TABLE"; break;
     case CONTENT::SHOW_NEI: os << "SHOW_NEI"; break;
+    case CONTENT::SUBSCRIBE: os << "SUBSCRIBE"; break;
+    case CONTENT::RELOAD: os << "RELOAD"; break;
     default: os << "UNKNOWN"; break;
     }
     return os;
 }
 
-std::ostream& operator<<( std::ostream &os, const Message &msg ) {
-    os << "Type: " << msg.type << std::endl;
-    os << "Content: " << msg.cont;
-    return os;
-}
-
 std::ostream& operator<<( std::ostream &os, const Show_Table_Req &msg ) {
     os << "Prefix: " << msg.prefix.value_or( "N/A" );
     return os;
 }
 
-std::ostream& operator<<( std::ostream &os, const Show_Table_Resp &msg ) {
+std::ostream& table_header( std::ostream &os ) {
     auto flags = os.flags();
     os << std::left << std::setw( 20 ) << "Prefix";
     os << std::setw( 16 ) << "Nexthop";
@@ -54,14 +54,59 @@ std::ostream& operator<<( std::ostream &os, const Show_Table_Resp &msg ) {
     os << std::setw( 30 ) << "Since";
     os << "AS Path";
     os << std::endl;
-    for( auto const &entry: msg.entries ) {
-        os << std::setw( 1 ) << ( entry.valid ? '*' : ' ' );
-        os << std::setw( 1 ) << ( entry.best ? '>' : ' ' );
-        os << std::setw( 18 ) << entry.prefix;
-        os << std::setw( 16 ) << entry.nexthop;
-        os << std::setw( 16 ) << entry.local_pref;
-        os << std::setw( 30 ) << entry.time;
-        os << entry.as_path;
+    os.flags( flags );
+    return os;
+}
+
+// address of family given by its length, n first bytes are used, others are zero
+static std::string to_address( const uint8_t *data, std::size_t n, std::size_t family_len ) {
+    boost::asio::ip::address_v6::bytes_type bytes {};
+    std::copy( data, data + std::min( n, bytes.size() ), bytes.begin() );
+    if( family_len == 4 ) {
+        return boost::asio::ip::address_v4( { bytes[ 0 ], bytes[ 1 ], bytes[ 2 ], bytes[ 3 ] } ).to_string();
+    }
+    return boost::asio::ip::address_v6( bytes ).to_string();
+}
+
+std::ostream& operator<<( std::ostream &os, const Show_Table_Resp &msg ) {
+    // records are read in place, attribute sets are indexed first
+    std::vector<const cli_attr_set*> attr_sets;
+    for( std::size_t pos = 0; pos < msg.attr_sets.size(); ) {
+        if( msg.attr_sets.size() - pos < sizeof( cli_attr_set ) ) {
+            throw std::runtime_error( "Truncated attribute set" );
+        }
+        auto set = reinterpret_cast<const cli_attr_set*>( msg.attr_sets.data() + pos );
+        pos += sizeof( cli_attr_set ) + set->as_path_len * sizeof( uint32_t );
+        if( pos > msg.attr_sets.size() ) {
+            throw std::runtime_error( "Truncated attribute set" );
+        }
+        attr_sets.push_back( set );
+    }
+    auto entries = reinterpret_cast<const cli_table_entry*>( msg.entries.data() );
+    auto count = msg.entries.size() / sizeof( cli_table_entry );
+    auto flags = os.flags();
+    os << std::left;
+    for( std::size_t i = 0; i < count; i++ ) {
+        auto const &entry = entries[ i ];
+        if( entry.attr_index >= attr_sets.size() ) {
+            throw std::runtime_error( "Invalid attribute set of entry" );
+        }
+        auto const &attrs = *attr_sets[ entry.attr_index ];
+        std::size_t family_len = entry.afi == 1 ? 4 : 16;
+        auto prefix = to_address( entry.prefix.data(), ( entry.prefix_len + 7 ) / 8, family_len ) + "/" + std::to_string( entry.prefix_len );
+        auto nexthop = attrs.nexthop_len > 0 ? to_address( attrs.nexthop.data(), attrs.nexthop_len, attrs.nexthop_len ) : std::string();
+        std::time_t time = entry.time;
+        std::array<char,32> since;
+        std::strftime( since.data(), since.size(), "%Y-%m-%d %X", std::localtime( &time ) );
+        os << std::setw( 1 ) << ( entry.flags & CLI_ENTRY_VALID ? '*' : ' ' );
+        os << std::setw( 1 ) << ( entry.flags & CLI_ENTRY_BEST ? '>' : ' ' );
+        os << std::setw( 18 ) << prefix;
+        os << std::setw( 16 ) << nexthop;
+        os << std::setw( 16 ) << attrs.local_pref;
+        os << std::setw( 30 ) << since.data();
+        for( uint16_t j = 0; j < attrs.as_path_len; j++ ) {
+            os << attrs.as_path[ j ] << " ";
+        }
         os << std::endl;
     }
     os.flags( flags );
@@ -94,4 +139,62 @@ std::ostream& operator<<( std::ostream &os, const Show_Neighbour_Resp &msg ) {
     }
     os.flags( flags );
     return os;
-}
\ No newline at end of file
+}
+
+// reads big endian integer of n bytes from events
+static uint32_t get( std::string_view data, std::size_t &pos, std::size_t n ) {
+    if( pos + n > data.size() ) {
+        throw std::runtime_error( "Truncated event" );
+    }
+    uint32_t value = 0;
+    for( std::size_t i = 0; i < n; i++ ) {
+        value = ( value << 8 ) | static_cast<uint8_t>( data[ pos++ ] );
+    }
+    return value;
+}
+
+// address of family given by its length, n first bytes are read, others are zero
+static std::string get_address( std::string_view data, std::size_t &pos, std::size_t n, std::size_t family_len ) {
+    boost::asio::ip::address_v6::bytes_type bytes {};
+    for( std::size_t i = 0; i < n; i++ ) {
+        bytes[ i ] = get( data, pos, 1 );
+    }
+    return to_address( bytes.data(), n, family_len );
+}
+
+std::ostream& operator<<( std::ostream &os, const Subscribe_Resp &msg ) {
+    auto data = msg.events;
+    std::size_t pos = 0;
+    while( pos < data.size() ) {
+        auto type = static_cast<RIB_EVENT>( get( data, pos, 1 ) );
+        // AFI 1 is IPv4, 2 is IPv6
+        auto afi = get( data, pos, 1 );
+        auto len = get( data, pos, 1 );
+        std::size_t family_len = afi == 1 ? 4 : 16;
+        if( len > family_len * 8 ) {
+            throw std::runtime_error( "Invalid prefix length in event" );
+        }
+        auto prefix = get_address( data, pos, ( len + 7 ) / 8, family_len );
+        os << ( type == RIB_EVENT::ANNOUNCE ? "+ " : "- " ) << prefix << "/" << len;
+        if( type == RIB_EVENT::ANNOUNCE ) {
+            auto peer = get_address( data, pos, 4, 4 );
+            auto nexthop_len = get( data, pos, 1 );
+            if( nexthop_len != 0 && nexthop_len != 4 && nexthop_len != 16 ) {
+                throw std::runtime_error( "Invalid next hop in event" );
+            }
+            auto nexthop = nexthop_len > 0 ? get_address( data, pos, nexthop_len, nexthop_len ) : std::string( "-" );
+            auto local_pref = get( data, pos, 4 );
+            auto med = get( data, pos, 4 );
+            os << " from " << peer << " via " << nexthop << " local_pref " << local_pref << " med " << med << " as_path";
+            auto count = get( data, pos, 2 );
+            for( uint32_t i = 0; i < count; i++ ) {
+                os << " " << get( data, pos, 4 );
+            }
+        }
+        os << std::endl;
+    }
+    if( msg.coalesced > 0 ) {
+        os << "(" << msg.coalesced << " changes coalesced)" << std::endl;
+    }
+    return os;
+}
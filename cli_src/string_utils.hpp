@@ -5,17 +5,21 @@
 
 enum class TYPE: uint8_t;
 enum class CONTENT: uint8_t;
-struct Message;
 struct Show_Table_Req;
 struct Show_Table_Resp;
 struct Show_Neighbour_Resp;
+struct Subscribe_Resp;
 
 std::ostream& operator<<( std::ostream &os, const std::vector<uint8_t> &data );
 std::ostream& operator<<( std::ostream &os, const TYPE &typ );
 std::ostream& operator<<( std::ostream &os, const CONTENT &cont );
-std::ostream& operator<<( std::ostream &os, const Message &msg );
 std::ostream& operator<<( std::ostream &os, const Show_Table_Req &msg );
+// entries of one chunk, without column names
 std::ostream& operator<<( std::ostream &os, const Show_Table_Resp &msg );
+// column names of table
+std::ostream& table_header( std::ostream &os );
 std::ostream& operator<<( std::ostream &os, const Show_Neighbour_Resp &msg );
+// one line per event
+std::ostream& operator<<( std::ostream &os, const Subscribe_Resp &msg );
 
 #endif
\ No newline at end of file
@@ -1,14 +1,19 @@
 #ifndef MESSAGE_HPP
 #define MESSAGE_HPP
 
+#include <array>
+#include <string>
 #include <vector>
-#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
 #include <boost/optional.hpp>
-#include <boost/serialization/serialization.hpp>
-#include <boost/serialization/vector.hpp>
-#include <boost/serialization/optional.hpp>
-#include <boost/archive/binary_iarchive.hpp>
-#include <boost/archive/binary_oarchive.hpp>
+
+// Messages on CLI socket are frames prefixed with length in network byte order.
+// Frame starts with TYPE and CONTENT, then fields of request or response follow
+// in order of their fields() function. Both ends run on the same host, so
+// integers are in host byte order and records are read in place from frame.
 
 enum class TYPE: uint8_t {
     REQ,
@@ -18,69 +23,110 @@ enum class TYPE: uint8_t {
 enum class CONTENT: uint8_t {
     SHOW_VER,
     SHOW_TABLE,
-    SHOW_NEI
+    SHOW_NEI,
+    SUBSCRIBE,
+    RELOAD
 };
 
-struct Message {
-    TYPE type;
-    CONTENT cont;
-    std::string data;
-
-    template<class Archive>
-    void serialize( Archive &archive, const unsigned int version ) {
-        archive & type;
-        archive & cont;
-        archive & data;
-    }
+// how prefix of table request is matched against table
+enum class PREFIX_MATCH: uint8_t {
+    EXACT,
+    // most specific prefix which covers request, address is prefix of full length
+    LONGEST,
+    // prefix and all its more specifics
+    MORE_SPECIFIC
 };
 
+// filters are combined, only paths which match all of them are returned
 struct Show_Table_Req {
     boost::optional<std::string> prefix;
+    PREFIX_MATCH match { PREFIX_MATCH::EXACT };
+    // address of neighbour, which is source of path
+    boost::optional<std::string> neighbour;
+    boost::optional<std::string> nexthop;
+    // AS anywhere in AS path
+    boost::optional<uint32_t> as;
+    boost::optional<std::string> community;
+    // at most limit prefixes are returned, zero is no limit
+    uint32_t limit { 0U };
+    // start from page * limit prefix, or after cursor prefix of previous response
+    uint32_t page { 0U };
+    boost::optional<std::string> cursor;
 
-    template<class Archive>
-    void serialize( Archive &archive, const unsigned int version ) {
-        archive & prefix;
+    template<class Stream>
+    void fields( Stream &s ) {
+        s & prefix;
+        s & match;
+        s & neighbour;
+        s & nexthop;
+        s & as;
+        s & community;
+        s & limit;
+        s & page;
+        s & cursor;
     }
 };
 
-struct BGP_Entry {
-    std::string prefix;
-    std::string nexthop;
-    uint32_t local_pref { 0U };
-    std::string source;
-    std::string time;
-    std::string as_path;
-    bool best { false };
-    bool valid { false };
-
-    template<class Archive>
-    void serialize( Archive &archive, const unsigned int version ) {
-        archive & prefix;
-        archive & nexthop;
-        archive & local_pref;
-        archive & source;
-        archive & time;
-        archive & as_path;
-        archive & best;
-        archive & valid;
-    }
-};
+static constexpr uint8_t CLI_ENTRY_BEST = 1;
+static constexpr uint8_t CLI_ENTRY_VALID = 2;
+
+// path in Show_Table_Resp
+struct cli_table_entry {
+    std::array<uint8_t,16> prefix;
+    // 1 is IPv4, 2 is IPv6
+    uint8_t afi;
+    uint8_t prefix_len;
+    uint8_t flags;
+    uint8_t reserved;
+    // position of attribute set in response
+    uint32_t attr_index;
+    // address of neighbour, zero for local routes
+    uint32_t source;
+    // seconds since epoch
+    int64_t time;
+}__attribute__((__packed__));
 
+static_assert( sizeof( cli_table_entry ) == 36, "size of cli_table_entry should be equal 36 bytes" );
+
+// attributes shared by paths of Show_Table_Resp, AS path follows the record
+struct cli_attr_set {
+    std::array<uint8_t,16> nexthop;
+    uint8_t nexthop_len;
+    uint8_t reserved;
+    uint16_t as_path_len;
+    uint32_t local_pref;
+    uint32_t as_path[0];
+}__attribute__((__packed__));
+
+// Table is streamed as several responses, each of them is one chunk of paths.
+// Attribute sets are sent once per chunk, paths refer to them by position.
 struct Show_Table_Resp {
-    std::vector<BGP_Entry> entries;
+    bool last { true };
+    // set in last chunk if limit is reached, next page starts after this prefix
+    boost::optional<std::string> cursor;
+    // request is rejected, no entries are sent
+    boost::optional<std::string> error;
+    // cli_attr_set records
+    std::string_view attr_sets;
+    // cli_table_entry records
+    std::string_view entries;
 
-    template<class Archive>
-    void serialize( Archive &archive, const unsigned int version ) {
-        archive & entries;
+    template<class Stream>
+    void fields( Stream &s ) {
+        s & last;
+        s & cursor;
+        s & error;
+        s & attr_sets;
+        s & entries;
     }
 };
 
 struct Show_Neighbour_Req {
     boost::optional<std::string> address;
 
-    template<class Archive>
-    void serialize( Archive &archive, const unsigned int version ) {
-        archive & address;
+    template<class Stream>
+    void fields( Stream &s ) {
+        s & address;
     }
 };
 
@@ -91,42 +137,232 @@ struct BGP_Neighbour_Info {
     std::vector<std::string> caps;
     boost::optional<uint32_t> socket;
 
-    template<class Archive>
-    void serialize( Archive &archive, const unsigned int version ) {
-        archive & address;
-        archive & remote_as;
-        archive & hold_time;
-        archive & caps;
-        archive & socket;
+    template<class Stream>
+    void fields( Stream &s ) {
+        s & address;
+        s & remote_as;
+        s & hold_time;
+        s & caps;
+        s & socket;
     }
 };
 
 struct Show_Neighbour_Resp {
     std::vector<BGP_Neighbour_Info> entries;
 
-    template<class Archive>
-    void serialize( Archive &archive, const unsigned int version ) {
-        archive & entries;
+    template<class Stream>
+    void fields( Stream &s ) {
+        s & entries;
     }
 };
 
-static auto const ser_flags = boost::archive::no_header | boost::archive::no_tracking;
+// best path changes of prefix and its more specifics, or of paths from neighbour
+struct Subscribe_Req {
+    boost::optional<std::string> prefix;
+    boost::optional<std::string> neighbour;
 
-template<typename T>
-std::string serialize( const T &val ) {
-    std::stringstream ss;
-    boost::archive::binary_oarchive ser( ss, ser_flags );
-    ser << val;
-    return ss.str();
-}
+    template<class Stream>
+    void fields( Stream &s ) {
+        s & prefix;
+        s & neighbour;
+    }
+};
+
+// Event in Subscribe_Resp, integers are in network byte order:
+// type, AFI (1 byte), prefix length, significant bytes of prefix, and for ANNOUNCE
+// neighbour address (4 bytes, zero for local routes), next hop length and next hop,
+// LOCAL_PREF (4 bytes), MED (4 bytes), number of AS path entries (2 bytes) and entries (4 bytes each)
+enum class RIB_EVENT: uint8_t {
+    ANNOUNCE,
+    WITHDRAW
+};
 
-template<typename T>
-T deserialize( const std::string &val ) {
-    T out;
-    std::istringstream ss( val );
-    boost::archive::binary_iarchive deser{ ss, ser_flags };
-    deser >> out;
-    return out;
+// Subscription is a stream of responses. Current best paths are sent first,
+// then their changes. Events which aren't sent yet are replaced by newer events
+// of the same prefix, so slow client gets latest state instead of every change.
+struct Subscribe_Resp {
+    // concatenated events
+    std::string_view events;
+    // number of events replaced since previous response
+    uint64_t coalesced { 0U };
+    // request is rejected, stream ends with this response
+    boost::optional<std::string> error;
+
+    template<class Stream>
+    void fields( Stream &s ) {
+        s & events;
+        s & coalesced;
+        s & error;
+    }
+};
+
+// configuration file is loaded again, request has no fields
+struct Reload_Resp {
+    // configuration is rejected, nothing is changed
+    boost::optional<std::string> error;
+    // applied changes
+    std::vector<std::string> changes;
+
+    template<class Stream>
+    void fields( Stream &s ) {
+        s & error;
+        s & changes;
+    }
+};
+
+static constexpr std::size_t CLI_FRAME_HEADER = 4;
+static constexpr uint32_t CLI_MAX_FRAME = 16 * 1024 * 1024;
+
+inline uint32_t frame_length( const uint8_t *header ) {
+    uint32_t len = 0;
+    for( std::size_t i = 0; i < CLI_FRAME_HEADER; i++ ) {
+        len = ( len << 8 ) | header[ i ];
+    }
+    return len;
 }
 
-#endif
\ No newline at end of file
+// builds one frame, values are appended as they are written
+class cli_writer {
+public:
+    cli_writer( TYPE type, CONTENT cont ):
+        buf( CLI_FRAME_HEADER, '\0' )
+    {
+        *this & type;
+        *this & cont;
+    }
+
+    template<typename T>
+    cli_writer &operator&( const T &value ) {
+        if constexpr( std::is_arithmetic_v<T> || std::is_enum_v<T> ) {
+            append( &value, sizeof( value ) );
+        } else {
+            const_cast<T&>( value ).fields( *this );
+        }
+        return *this;
+    }
+
+    cli_writer &operator&( std::string_view value ) {
+        uint32_t len = value.size();
+        *this & len;
+        append( value.data(), len );
+        return *this;
+    }
+
+    cli_writer &operator&( const std::string &value ) {
+        return *this & std::string_view( value );
+    }
+
+    template<typename T>
+    cli_writer &operator&( const boost::optional<T> &value ) {
+        *this & value.has_value();
+        if( value ) {
+            *this & *value;
+        }
+        return *this;
+    }
+
+    template<typename T>
+    cli_writer &operator&( const std::vector<T> &values ) {
+        *this & static_cast<uint32_t>( values.size() );
+        for( auto const &value: values ) {
+            *this & value;
+        }
+        return *this;
+    }
+
+    void append( const void *data, std::size_t len ) {
+        buf.append( static_cast<const char*>( data ), len );
+    }
+
+    // frame with length, writer is empty after this
+    std::string finish() {
+        uint32_t len = buf.size() - CLI_FRAME_HEADER;
+        for( std::size_t i = 0; i < CLI_FRAME_HEADER; i++ ) {
+            buf[ i ] = static_cast<char>( len >> ( 8 * ( CLI_FRAME_HEADER - 1 - i ) ) );
+        }
+        return std::move( buf );
+    }
+private:
+    std::string buf;
+};
+
+// Reads fields of frame without its length. Strings are copied, string_view
+// fields point into frame, so frame must outlive them.
+class cli_reader {
+public:
+    explicit cli_reader( std::string_view d ):
+        data( d ),
+        pos( 0 )
+    {
+        *this & type;
+        *this & cont;
+    }
+
+    template<typename T>
+    T read() {
+        T value;
+        *this & value;
+        return value;
+    }
+
+    template<typename T>
+    cli_reader &operator&( T &value ) {
+        if constexpr( std::is_arithmetic_v<T> || std::is_enum_v<T> ) {
+            std::memcpy( &value, take( sizeof( value ) ), sizeof( value ) );
+        } else {
+            value.fields( *this );
+        }
+        return *this;
+    }
+
+    cli_reader &operator&( std::string_view &value ) {
+        auto len = read<uint32_t>();
+        value = std::string_view( take( len ), len );
+        return *this;
+    }
+
+    cli_reader &operator&( std::string &value ) {
+        std::string_view view;
+        *this & view;
+        value.assign( view );
+        return *this;
+    }
+
+    template<typename T>
+    cli_reader &operator&( boost::optional<T> &value ) {
+        if( read<bool>() ) {
+            value.emplace();
+            *this & *value;
+        } else {
+            value.reset();
+        }
+        return *this;
+    }
+
+    template<typename T>
+    cli_reader &operator&( std::vector<T> &values ) {
+        auto count = read<uint32_t>();
+        values.clear();
+        for( uint32_t i = 0; i < count; i++ ) {
+            *this & values.emplace_back();
+        }
+        return *this;
+    }
+
+    TYPE type;
+    CONTENT cont;
+private:
+    const char *take( std::size_t len ) {
+        if( len > data.size() - pos ) {
+            throw std::runtime_error( "Truncated CLI message" );
+        }
+        auto ptr = data.data() + pos;
+        pos += len;
+        return ptr;
+    }
+
+    std::string_view data;
+    std::size_t pos;
+};
+
+#endif
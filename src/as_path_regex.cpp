@@ -0,0 +1,332 @@
+#include <map>
+#include <bitset>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "as_path_regex.hpp"
+#include "packet.hpp"
+
+namespace {
+
+// Thompson NFA, which is converted to DFA after parsing
+struct nfa_state {
+    enum kind_t { SYMBOL, SPLIT, MATCH } kind;
+    std::bitset<13> symbols;
+    int32_t out;
+    int32_t out1;
+};
+
+struct fragment {
+    int32_t start;
+    // dangling transitions: state and which of its outputs
+    std::vector<std::pair<int32_t,int>> outs;
+};
+
+class regex_parser {
+public:
+    explicit regex_parser( const std::string &p ):
+        pattern( p ),
+        pos( 0 )
+    {}
+
+    int32_t compile() {
+        auto f = parse_alt();
+        if( pos != pattern.size() ) {
+            error( "unbalanced ')'" );
+        }
+        patch( f, add( nfa_state::MATCH, {} ) );
+        return f.start;
+    }
+
+    std::vector<nfa_state> states;
+private:
+    static constexpr int SPACE = 10;
+    static constexpr int START = 11;
+    static constexpr int END = 12;
+
+    [[noreturn]] void error( const std::string &what ) const {
+        throw std::runtime_error( "Invalid AS path regex '" + pattern + "': " + what );
+    }
+
+    int32_t add( nfa_state::kind_t kind, std::bitset<13> symbols ) {
+        states.push_back( nfa_state { kind, symbols, -1, -1 } );
+        return states.size() - 1;
+    }
+
+    void patch( const fragment &f, int32_t target ) {
+        for( auto const &[ state, which ]: f.outs ) {
+            ( which == 0 ? states[ state ].out : states[ state ].out1 ) = target;
+        }
+    }
+
+    fragment symbol( std::bitset<13> symbols ) {
+        auto s = add( nfa_state::SYMBOL, symbols );
+        return { s, { { s, 0 } } };
+    }
+
+    bool at_end() const {
+        return pos >= pattern.size();
+    }
+
+    fragment parse_alt() {
+        auto f = parse_concat();
+        while( !at_end() && pattern[ pos ] == '|' ) {
+            pos++;
+            auto g = parse_concat();
+            auto s = add( nfa_state::SPLIT, {} );
+            states[ s ].out = f.start;
+            states[ s ].out1 = g.start;
+            f.start = s;
+            f.outs.insert( f.outs.end(), g.outs.begin(), g.outs.end() );
+        }
+        return f;
+    }
+
+    fragment parse_concat() {
+        if( at_end() || pattern[ pos ] == '|' || pattern[ pos ] == ')' ) {
+            // empty expression
+            auto s = add( nfa_state::SPLIT, {} );
+            return { s, { { s, 0 } } };
+        }
+        auto f = parse_repeat();
+        while( !at_end() && pattern[ pos ] != '|' && pattern[ pos ] != ')' ) {
+            auto g = parse_repeat();
+            patch( f, g.start );
+            f.outs = std::move( g.outs );
+        }
+        return f;
+    }
+
+    fragment parse_repeat() {
+        auto f = parse_atom();
+        while( !at_end() && ( pattern[ pos ] == '*' || pattern[ pos ] == '+' || pattern[ pos ] == '?' ) ) {
+            auto op = pattern[ pos++ ];
+            auto s = add( nfa_state::SPLIT, {} );
+            states[ s ].out = f.start;
+            if( op == '*' ) {
+                patch( f, s );
+                f = { s, { { s, 1 } } };
+            } else if( op == '+' ) {
+                patch( f, s );
+                f.outs = { { s, 1 } };
+            } else {
+                f.start = s;
+                f.outs.push_back( { s, 1 } );
+            }
+        }
+        return f;
+    }
+
+    fragment parse_atom() {
+        std::bitset<13> any_char;
+        for( int i = 0; i <= SPACE; i++ ) {
+            any_char.set( i );
+        }
+        auto c = pattern[ pos++ ];
+        switch( c ) {
+        case '(': {
+            auto f = parse_alt();
+            if( at_end() || pattern[ pos ] != ')' ) {
+                error( "missing ')'" );
+            }
+            pos++;
+            return f;
+        }
+        case '[':
+            return symbol( parse_class() );
+        case '.':
+            return symbol( any_char );
+        case '_': {
+            std::bitset<13> s;
+            s.set( SPACE ).set( START ).set( END );
+            return symbol( s );
+        }
+        case '^':
+            return symbol( std::bitset<13>().set( START ) );
+        case '$':
+            return symbol( std::bitset<13>().set( END ) );
+        case ' ':
+            return symbol( std::bitset<13>().set( SPACE ) );
+        default:
+            if( c >= '0' && c <= '9' ) {
+                return symbol( std::bitset<13>().set( c - '0' ) );
+            }
+            error( std::string( "unexpected character '" ) + c + "'" );
+        }
+    }
+
+    std::bitset<13> parse_class() {
+        std::bitset<13> s;
+        bool negate = !at_end() && pattern[ pos ] == '^';
+        if( negate ) {
+            pos++;
+        }
+        while( !at_end() && pattern[ pos ] != ']' ) {
+            auto c = pattern[ pos++ ];
+            if( c == ' ' || c == '_' ) {
+                s.set( SPACE );
+                continue;
+            }
+            if( c < '0' || c > '9' ) {
+                error( std::string( "unexpected character '" ) + c + "' in class" );
+            }
+            auto last = c;
+            if( pos + 1 < pattern.size() && pattern[ pos ] == '-' && pattern[ pos + 1 ] != ']' ) {
+                last = pattern[ pos + 1 ];
+                pos += 2;
+                if( last < c || last > '9' ) {
+                    error( "invalid range in class" );
+                }
+            }
+            for( auto d = c; d <= last; d++ ) {
+                s.set( d - '0' );
+            }
+        }
+        if( at_end() ) {
+            error( "missing ']'" );
+        }
+        pos++;
+        if( negate ) {
+            for( int i = 0; i <= SPACE; i++ ) {
+                s.flip( i );
+            }
+        }
+        return s;
+    }
+
+    const std::string &pattern;
+    std::size_t pos;
+};
+
+// adds states reachable without consuming input, only symbol and match states are kept
+void closure( const std::vector<nfa_state> &states, int32_t start, std::vector<int32_t> &set ) {
+    std::vector<int32_t> stack { start };
+    std::vector<bool> seen( states.size() );
+    while( !stack.empty() ) {
+        auto s = stack.back();
+        stack.pop_back();
+        if( s < 0 || seen[ s ] ) {
+            continue;
+        }
+        seen[ s ] = true;
+        if( states[ s ].kind == nfa_state::SPLIT ) {
+            stack.push_back( states[ s ].out );
+            stack.push_back( states[ s ].out1 );
+        } else {
+            set.push_back( s );
+        }
+    }
+}
+
+}
+
+as_path_regex::as_path_regex( const std::string &pattern ) {
+    regex_parser parser( pattern );
+    auto nfa_start = parser.compile();
+    auto const &states = parser.states;
+
+    // pattern may match anywhere in path, so start set is added after every symbol
+    std::vector<int32_t> start_set;
+    closure( states, nfa_start, start_set );
+
+    std::map<std::vector<int32_t>,int32_t> ids;
+    std::vector<std::vector<int32_t>> sets;
+    auto intern = [ & ]( std::vector<int32_t> set ) -> int32_t {
+        std::sort( set.begin(), set.end() );
+        set.erase( std::unique( set.begin(), set.end() ), set.end() );
+        auto it = ids.find( set );
+        if( it != ids.end() ) {
+            return it->second;
+        }
+        if( sets.size() >= AS_PATH_REGEX_MAX_STATES ) {
+            throw std::runtime_error( "AS path regex '" + pattern + "' is too complex" );
+        }
+        ids.emplace( set, sets.size() );
+        sets.push_back( std::move( set ) );
+        return sets.size() - 1;
+    };
+
+    intern( start_set );
+    for( std::size_t i = 0; i < sets.size(); i++ ) {
+        dfa_state d;
+        d.accepting = std::any_of( sets[ i ].begin(), sets[ i ].end(), [ &states ]( int32_t s ) {
+            return states[ s ].kind == nfa_state::MATCH;
+        });
+        for( int sym = 0; sym < SYMBOLS; sym++ ) {
+            if( d.accepting ) {
+                // match is found, rest of path doesn't matter
+                d.next[ sym ] = i;
+                continue;
+            }
+            auto moved = start_set;
+            for( auto s: sets[ i ] ) {
+                if( states[ s ].kind == nfa_state::SYMBOL && states[ s ].symbols.test( sym ) ) {
+                    closure( states, states[ s ].out, moved );
+                }
+            }
+            d.next[ sym ] = intern( std::move( moved ) );
+        }
+        dfa.push_back( d );
+    }
+}
+
+int32_t as_path_regex::feed_asn( int32_t state, uint32_t asn ) const {
+    std::array<uint8_t,10> digits;
+    int n = 0;
+    do {
+        digits[ n++ ] = asn % 10;
+        asn /= 10;
+    } while( asn > 0 );
+    while( n > 0 ) {
+        state = dfa[ state ].next[ digits[ --n ] ];
+    }
+    return state;
+}
+
+// Boundary symbols are fed twice, so '_' and '^' or '$' may both match at path
+// start or end, as in "^65001_" for single AS path or "(65001_)+$".
+bool as_path_regex::match( const path_attr_t *attr ) const {
+    int32_t state = dfa[ dfa[ 0 ].next[ SYM_START ] ].next[ SYM_START ];
+    bool first = true;
+    if( attr != nullptr ) {
+        std::size_t asn_size = attr->four_byte_asn ? 4 : 2;
+        auto const &bytes = attr->bytes;
+        std::size_t offset = 0;
+        while( offset + 2 <= bytes.size() ) {
+            std::size_t count = bytes[ offset + 1 ];
+            offset += 2;
+            if( offset + count * asn_size > bytes.size() ) {
+                break;
+            }
+            for( std::size_t i = 0; i < count; i++, offset += asn_size ) {
+                uint32_t asn = 0;
+                for( std::size_t b = 0; b < asn_size; b++ ) {
+                    asn = ( asn << 8 ) | bytes[ offset + b ];
+                }
+                if( !first ) {
+                    state = dfa[ state ].next[ SYM_SPACE ];
+                }
+                first = false;
+                state = feed_asn( state, asn );
+            }
+        }
+    }
+    state = dfa[ dfa[ state ].next[ SYM_END ] ].next[ SYM_END ];
+    return dfa[ state ].accepting;
+}
+
+bool as_path_regex::match( const std::vector<uint32_t> &path ) const {
+    int32_t state = dfa[ dfa[ 0 ].next[ SYM_START ] ].next[ SYM_START ];
+    for( std::size_t i = 0; i < path.size(); i++ ) {
+        if( i > 0 ) {
+            state = dfa[ state ].next[ SYM_SPACE ];
+        }
+        state = feed_asn( state, path[ i ] );
+    }
+    state = dfa[ dfa[ state ].next[ SYM_END ] ].next[ SYM_END ];
+    return dfa[ state ].accepting;
+}
@@ -0,0 +1,43 @@
+#ifndef AS_PATH_REGEX_HPP_
+#define AS_PATH_REGEX_HPP_
+
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct path_attr_t;
+
+// limit of DFA size, patterns which need more states are rejected
+static constexpr std::size_t AS_PATH_REGEX_MAX_STATES = 4096;
+
+// AS path regular expression in the syntax of router CLIs. Path is matched as
+// text of space separated AS numbers: '_' matches separator or path boundary,
+// '^' and '$' anchor to path start and end, '.', '[]', '*', '+', '?', '|' and
+// '()' have usual meaning. Pattern is compiled to DFA, so matching is one
+// table lookup per character.
+class as_path_regex {
+public:
+    // throws std::runtime_error on invalid pattern
+    explicit as_path_regex( const std::string &pattern );
+    // attr is AS_PATH attribute, nullptr is empty path
+    bool match( const path_attr_t *attr ) const;
+    bool match( const std::vector<uint32_t> &path ) const;
+private:
+    // input alphabet: digits, separator, path start and end
+    static constexpr int SYMBOLS = 13;
+    static constexpr int SYM_SPACE = 10;
+    static constexpr int SYM_START = 11;
+    static constexpr int SYM_END = 12;
+
+    struct dfa_state {
+        std::array<int32_t,SYMBOLS> next;
+        bool accepting;
+    };
+
+    int32_t feed_asn( int32_t state, uint32_t asn ) const;
+
+    std::vector<dfa_state> dfa;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "attr_registry.hpp"
+#include "packet.hpp"
+#include "community.hpp"
+
+// registry is swept when number of entries doubles since last sweep
+static constexpr std::size_t ATTR_REGISTRY_MIN_SWEEP = 1024;
+
+attr_registry::attr_registry():
+    sweep_at( ATTR_REGISTRY_MIN_SWEEP )
+{}
+
+std::size_t attr_registry::hash( const std::vector<path_attr_t> &attrs ) {
+    // FNV-1a over attribute type, flags and value
+    std::size_t h = 14695981039346656037ULL;
+    auto mix = [ &h ]( uint8_t b ) {
+        h = ( h ^ b ) * 1099511628211ULL;
+    };
+    for( auto const &attr: attrs ) {
+        mix( static_cast<uint8_t>( attr.type ) );
+        mix( ( attr.optional << 3 ) | ( attr.transitive << 2 ) | ( attr.partial << 1 ) | attr.extended_length );
+        for( auto b: attr.bytes ) {
+            mix( b );
+        }
+        if( attr.communities ) {
+            h = ( h ^ attr.communities->hash() ) * 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+std::shared_ptr<std::vector<path_attr_t>> attr_registry::intern( std::vector<path_attr_t> attrs ) {
+    auto h = hash( attrs );
+    auto range = sets.equal_range( h );
+    for( auto it = range.first; it != range.second; ) {
+        auto set = it->second.lock();
+        if( !set ) {
+            it = sets.erase( it );
+            continue;
+        }
+        if( *set == attrs ) {
+            return set;
+        }
+        it++;
+    }
+    auto set = std::make_shared<std::vector<path_attr_t>>( std::move( attrs ) );
+    sets.emplace( h, set );
+    if( sets.size() >= sweep_at ) {
+        sweep();
+    }
+    return set;
+}
+
+std::size_t attr_registry::size() const {
+    std::size_t count = 0;
+    for( auto const &[ h, set ]: sets ) {
+        if( !set.expired() ) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void attr_registry::sweep() {
+    for( auto it = sets.begin(); it != sets.end(); ) {
+        if( it->second.expired() ) {
+            it = sets.erase( it );
+        } else {
+            it++;
+        }
+    }
+    sweep_at = std::max( ATTR_REGISTRY_MIN_SWEEP, sets.size() * 2 );
+}
@@ -0,0 +1,28 @@
+#ifndef ATTR_REGISTRY_HPP_
+#define ATTR_REGISTRY_HPP_
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+struct path_attr_t;
+
+// Interned path attribute sets. All paths with equal attributes share one set
+// object, so sets are compared by pointer and the pointer can be used as cache
+// key. Interned sets must not be modified.
+class attr_registry {
+public:
+    attr_registry();
+    std::shared_ptr<std::vector<path_attr_t>> intern( std::vector<path_attr_t> attrs );
+    // number of alive sets
+    std::size_t size() const;
+private:
+    static std::size_t hash( const std::vector<path_attr_t> &attrs );
+    void sweep();
+
+    // sets aren't owned by registry, expired entries are removed on lookup and by sweep
+    std::unordered_multimap<std::size_t,std::weak_ptr<std::vector<path_attr_t>>> sets;
+    std::size_t sweep_at;
+};
+
+#endif
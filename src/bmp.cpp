@@ -0,0 +1,385 @@
+#include <iterator>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "bmp.hpp"
+#include "evloop.hpp"
+#include "fsm.hpp"
+#include "table.hpp"
+#include "table_v6.hpp"
+#include "rib_snapshot.hpp"
+#include "packet.hpp"
+#include "config.hpp"
+#include "log.hpp"
+#include "string_utils.hpp"
+
+extern Logger logger;
+extern std::shared_ptr<EVLoop> runtime;
+
+// queue limit per collector, when it is exceeded we drop everything and resync from table
+static constexpr std::size_t BMP_MAX_QUEUE_BYTES = 64 * 1024 * 1024;
+static constexpr std::size_t BMP_WRITE_BATCH_BYTES = 1024 * 1024;
+static constexpr std::size_t BMP_DUMP_LOW_WATERMARK = 1024 * 1024;
+static constexpr std::size_t BMP_DUMP_CHUNK = 1000;
+
+bmp_session::bmp_session( boost::asio::io_context &i, bmp_exporter &e, const bmp_collector_v4 &c ):
+    io( i ),
+    exporter( e ),
+    ep( c.address, c.port ),
+    sock( i ),
+    reconnect_timer( i ),
+    connected( false ),
+    writing( false ),
+    queued_bytes( 0 ),
+    dumping( false ),
+    held_bytes( 0 )
+{}
+
+void bmp_session::start() {
+    connect();
+}
+
+bool bmp_session::is_connected() const {
+    return connected;
+}
+
+void bmp_session::connect() {
+    sock.async_connect( ep, std::bind( &bmp_session::on_connect, shared_from_this(), std::placeholders::_1 ) );
+}
+
+void bmp_session::on_connect( const boost::system::error_code &ec ) {
+    if( ec ) {
+        logger.logError() << LOGS::BMP << "Cannot connect to collector " << ep.address().to_string() << ": " << ec.message() << std::endl;
+        sock.close();
+        reconnect_timer.expires_after( std::chrono::seconds( 5 ) );
+        reconnect_timer.async_wait( std::bind( &bmp_session::on_reconnect_timer, shared_from_this(), std::placeholders::_1 ) );
+        return;
+    }
+    logger.logInfo() << LOGS::BMP << "Connected to collector " << ep.address().to_string() << std::endl;
+    connected = true;
+    for( auto &msg: exporter.make_session_start() ) {
+        queue.push_back( msg );
+        queued_bytes += msg->size();
+    }
+    dumping = true;
+    dump_cursor.reset();
+    dump_snapshot = exporter.make_dump_snapshot();
+    do_write();
+}
+
+void bmp_session::on_reconnect_timer( const boost::system::error_code &ec ) {
+    if( ec ) {
+        return;
+    }
+    connect();
+}
+
+void bmp_session::enqueue( std::shared_ptr<std::vector<uint8_t>> msg ) {
+    if( !connected ) {
+        return;
+    }
+    if( queued_bytes + held_bytes + msg->size() > BMP_MAX_QUEUE_BYTES ) {
+        drop_to_resync();
+        return;
+    }
+    if( dumping ) {
+        held_bytes += msg->size();
+        held.push_back( std::move( msg ) );
+        return;
+    }
+    queued_bytes += msg->size();
+    queue.push_back( std::move( msg ) );
+    do_write();
+}
+
+void bmp_session::drop_to_resync() {
+    logger.logError() << LOGS::BMP << "Collector " << ep.address().to_string() << " is too slow, dropping " << queued_bytes << " bytes and resyncing" << std::endl;
+    connected = false;
+    dumping = false;
+    dump_snapshot.reset();
+    queue.clear();
+    held.clear();
+    queued_bytes = 0;
+    held_bytes = 0;
+    sock.close();
+    reconnect_timer.expires_after( std::chrono::seconds( 1 ) );
+    reconnect_timer.async_wait( std::bind( &bmp_session::on_reconnect_timer, shared_from_this(), std::placeholders::_1 ) );
+}
+
+void bmp_session::continue_dump() {
+    bool finished = false;
+    for( auto &msg: exporter.make_dump_chunk( *dump_snapshot, dump_cursor, finished ) ) {
+        queued_bytes += msg->size();
+        queue.push_back( std::move( msg ) );
+    }
+    if( finished ) {
+        logger.logInfo() << LOGS::BMP << "Finished table dump to collector " << ep.address().to_string() << std::endl;
+        dumping = false;
+        dump_cursor.reset();
+        dump_snapshot.reset();
+        queue.insert( queue.end(), std::make_move_iterator( held.begin() ), std::make_move_iterator( held.end() ) );
+        queued_bytes += held_bytes;
+        held.clear();
+        held_bytes = 0;
+    }
+}
+
+void bmp_session::do_write() {
+    if( writing || !connected ) {
+        return;
+    }
+    if( dumping && queued_bytes < BMP_DUMP_LOW_WATERMARK ) {
+        continue_dump();
+    }
+    if( queue.empty() ) {
+        return;
+    }
+    // gather as much queued messages as possible in one write
+    std::vector<boost::asio::const_buffer> buffers;
+    std::size_t batch = 0;
+    while( !queue.empty() && batch < BMP_WRITE_BATCH_BYTES ) {
+        auto &msg = queue.front();
+        batch += msg->size();
+        buffers.emplace_back( boost::asio::buffer( *msg ) );
+        inflight.push_back( std::move( msg ) );
+        queue.pop_front();
+    }
+    queued_bytes -= batch;
+    writing = true;
+    boost::asio::async_write( sock, buffers, std::bind( &bmp_session::on_write, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) );
+}
+
+void bmp_session::on_write( const boost::system::error_code &ec, std::size_t ) {
+    writing = false;
+    inflight.clear();
+    if( ec ) {
+        if( !connected ) {
+            return;
+        }
+        logger.logError() << LOGS::BMP << "Error on sending to collector " << ep.address().to_string() << ": " << ec.message() << std::endl;
+        drop_to_resync();
+        return;
+    }
+    do_write();
+}
+
+bmp_exporter::bmp_exporter( boost::asio::io_context &i, GlobalConf &c, bgp_table_v4 &t ):
+    io( i ),
+    conf( c ),
+    table( t ),
+    stats_timer( i )
+{
+    for( auto const &col: conf.bmp_collectors ) {
+        sessions.emplace_back( std::make_shared<bmp_session>( io, *this, col ) );
+    }
+}
+
+void bmp_exporter::start() {
+    for( auto &s: sessions ) {
+        s->start();
+    }
+    start_stats_timer();
+}
+
+bool bmp_exporter::has_listeners() const {
+    return std::any_of( sessions.begin(), sessions.end(), []( const std::shared_ptr<bmp_session> &s ) { return s->is_connected(); } );
+}
+
+void bmp_exporter::broadcast( std::shared_ptr<std::vector<uint8_t>> msg ) {
+    for( auto &s: sessions ) {
+        s->enqueue( msg );
+    }
+}
+
+std::shared_ptr<std::vector<uint8_t>> bmp_exporter::make_message( BMP_MSG_TYPE type, bgp_fsm *peer, std::size_t body_len, bool post_policy ) {
+    auto msg = std::make_shared<std::vector<uint8_t>>();
+    auto header_len = sizeof( bmp_common_header ) + ( peer != nullptr ? sizeof( bmp_peer_header ) : 0 );
+    msg->reserve( header_len + body_len );
+    msg->resize( header_len );
+
+    auto common = reinterpret_cast<bmp_common_header*>( msg->data() );
+    common->version = 3;
+    common->length = header_len + body_len;
+    common->type = type;
+
+    if( peer == nullptr ) {
+        return msg;
+    }
+    auto header = reinterpret_cast<bmp_peer_header*>( msg->data() + sizeof( bmp_common_header ) );
+    auto cap_it = std::find_if( peer->caps.begin(), peer->caps.end(), []( const bgp_cap_t &val ) -> bool { return val.code == BGP_CAP_CODE::FOUR_OCT_AS; } );
+    if( cap_it == peer->caps.end() ) {
+        header->flags |= BMP_PEER_FLAG_LEGACY_AS_PATH;
+    }
+    if( post_policy ) {
+        header->flags |= BMP_PEER_FLAG_POST_POLICY;
+    }
+    auto address = peer->conf.address.to_bytes();
+    std::copy( address.begin(), address.end(), header->address.end() - address.size() );
+    header->as = peer->conf.remote_as;
+    if( peer->received_open.size() >= sizeof( bgp_header ) + sizeof( bgp_open ) ) {
+        auto open = reinterpret_cast<const bgp_open*>( peer->received_open.data() + sizeof( bgp_header ) );
+        header->bgp_id = open->bgp_id.native();
+    }
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    auto sec = std::chrono::duration_cast<std::chrono::seconds>( now );
+    header->ts_sec = static_cast<uint32_t>( sec.count() );
+    header->ts_usec = static_cast<uint32_t>( std::chrono::duration_cast<std::chrono::microseconds>( now - sec ).count() );
+    return msg;
+}
+
+std::shared_ptr<std::vector<uint8_t>> bmp_exporter::make_peer_up( bgp_fsm &peer ) {
+    bmp_peer_up up {};
+    if( peer.sock.has_value() ) {
+        boost::system::error_code ec;
+        auto local = peer.sock->local_endpoint( ec );
+        if( !ec && local.address().is_v4() ) {
+            auto address = local.address().to_v4().to_bytes();
+            std::copy( address.begin(), address.end(), up.local_address.end() - address.size() );
+            up.local_port = local.port();
+        }
+        auto remote = peer.sock->remote_endpoint( ec );
+        if( !ec ) {
+            up.remote_port = remote.port();
+        }
+    }
+    auto msg = make_message( BMP_MSG_TYPE::PEER_UP, &peer, sizeof( up ) + peer.sent_open.size() + peer.received_open.size() );
+    auto up_ptr = reinterpret_cast<uint8_t*>( &up );
+    msg->insert( msg->end(), up_ptr, up_ptr + sizeof( up ) );
+    msg->insert( msg->end(), peer.sent_open.begin(), peer.sent_open.end() );
+    msg->insert( msg->end(), peer.received_open.begin(), peer.received_open.end() );
+    return msg;
+}
+
+void bmp_exporter::peer_up( std::shared_ptr<bgp_fsm> peer ) {
+    if( !has_listeners() ) {
+        return;
+    }
+    broadcast( make_peer_up( *peer ) );
+}
+
+void bmp_exporter::peer_down( std::shared_ptr<bgp_fsm> peer, BMP_PEER_DOWN reason, const std::vector<uint8_t> &data ) {
+    if( !has_listeners() || peer->state != FSM_STATE::ESTABLISHED ) {
+        return;
+    }
+    auto msg = make_message( BMP_MSG_TYPE::PEER_DOWN, peer.get(), sizeof( reason ) + data.size() );
+    msg->push_back( static_cast<uint8_t>( reason ) );
+    msg->insert( msg->end(), data.begin(), data.end() );
+    broadcast( msg );
+}
+
+void bmp_exporter::route_monitoring( std::shared_ptr<bgp_fsm> peer, const uint8_t *update, std::size_t length ) {
+    if( !has_listeners() ) {
+        return;
+    }
+    // raw UPDATE as it was received, so no re-serialization is needed
+    auto msg = make_message( BMP_MSG_TYPE::ROUTE_MONITORING, peer.get(), length );
+    msg->insert( msg->end(), update, update + length );
+    broadcast( msg );
+}
+
+std::vector<std::shared_ptr<std::vector<uint8_t>>> bmp_exporter::make_session_start() {
+    std::vector<std::shared_ptr<std::vector<uint8_t>>> out;
+
+    std::vector<std::pair<BMP_INFO_TLV,std::string>> info {
+        { BMP_INFO_TLV::SYS_DESCR, "bgp++ 1.2.3" },
+        { BMP_INFO_TLV::SYS_NAME, conf.bgp_router_id.to_string() }
+    };
+    std::size_t len = 0;
+    for( auto const &[ type, val ]: info ) {
+        len += sizeof( bmp_tlv ) + val.size();
+    }
+    auto init = make_message( BMP_MSG_TYPE::INITIATION, nullptr, len );
+    for( auto const &[ type, val ]: info ) {
+        bmp_tlv tlv;
+        tlv.type = static_cast<uint16_t>( type );
+        tlv.len = val.size();
+        auto tlv_ptr = reinterpret_cast<uint8_t*>( &tlv );
+        init->insert( init->end(), tlv_ptr, tlv_ptr + sizeof( tlv ) );
+        init->insert( init->end(), val.begin(), val.end() );
+    }
+    out.push_back( init );
+
+    for( auto &[ address, nei ]: runtime->neighbours ) {
+        if( nei->state == FSM_STATE::ESTABLISHED ) {
+            out.push_back( make_peer_up( *nei ) );
+        }
+    }
+    return out;
+}
+
+std::shared_ptr<const rib_snapshot> bmp_exporter::make_dump_snapshot() {
+    return rib_snapshot::take( table, runtime->table_v6 );
+}
+
+std::vector<std::shared_ptr<std::vector<uint8_t>>> bmp_exporter::make_dump_chunk( const rib_snapshot &rib, std::optional<NLRI> &cursor, bool &finished ) {
+    std::vector<std::shared_ptr<std::vector<uint8_t>>> out;
+    std::map<std::pair<bgp_fsm*,std::vector<path_attr_t>*>,std::vector<path_nlri_t>> groups;
+
+    std::size_t count = 0;
+    finished = rib.for_each_v4_after( cursor, [ & ]( const NLRI &prefix, const std::vector<bgp_path> &paths ) {
+        if( count >= BMP_DUMP_CHUNK ) {
+            return false;
+        }
+        for( auto const &path: paths ) {
+            if( !path.source || path.source->state != FSM_STATE::ESTABLISHED ) {
+                continue;
+            }
+            groups[ { path.source.get(), path.attrs.get() } ].push_back( { path.path_id, prefix } );
+            count++;
+        }
+        cursor = prefix;
+        return true;
+    });
+
+    for( auto const &[ key, prefixes ]: groups ) {
+        auto [ peer, attrs ] = key;
+        // prefixes are split so every UPDATE fits into maximum BGP message size,
+        // path identifiers are encoded as peer sends them, so dump matches route monitoring stream.
+        // Table keeps attributes after import policy, so dump is post-policy Adj-RIB-In
+        for( auto const &update: build_updates( prefixes, *attrs, {}, peer->addpath_rx ) ) {
+            auto msg = make_message( BMP_MSG_TYPE::ROUTE_MONITORING, peer, update->size(), true );
+            msg->insert( msg->end(), update->begin(), update->end() );
+            out.push_back( msg );
+        }
+    }
+    return out;
+}
+
+void bmp_exporter::start_stats_timer() {
+    if( sessions.empty() ) {
+        return;
+    }
+    stats_timer.expires_after( std::chrono::seconds( conf.bmp_stats_interval.value_or( 60 ) ) );
+    stats_timer.async_wait( std::bind( &bmp_exporter::on_stats_timer, this, std::placeholders::_1 ) );
+}
+
+void bmp_exporter::on_stats_timer( const boost::system::error_code &ec ) {
+    if( ec ) {
+        return;
+    }
+    start_stats_timer();
+    if( !has_listeners() ) {
+        return;
+    }
+
+    for( auto &[ address, nei ]: runtime->neighbours ) {
+        if( nei->state != FSM_STATE::ESTABLISHED ) {
+            continue;
+        }
+        uint64_t count = table.peer_paths_count( nei );
+        auto msg = make_message( BMP_MSG_TYPE::STATS_REPORT, nei.get(), sizeof( BE32 ) + sizeof( bmp_tlv ) + sizeof( count ) );
+        BE32 stats_count { 1U };
+        auto ptr = reinterpret_cast<uint8_t*>( &stats_count );
+        msg->insert( msg->end(), ptr, ptr + sizeof( stats_count ) );
+        bmp_tlv tlv;
+        tlv.type = static_cast<uint16_t>( BMP_STAT_TLV::ADJ_RIB_IN_ROUTES );
+        tlv.len = sizeof( count );
+        ptr = reinterpret_cast<uint8_t*>( &tlv );
+        msg->insert( msg->end(), ptr, ptr + sizeof( tlv ) );
+        for( int shift = 56; shift >= 0; shift -= 8 ) {
+            msg->push_back( static_cast<uint8_t>( count >> shift ) );
+        }
+        broadcast( msg );
+    }
+}
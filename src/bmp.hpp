@@ -0,0 +1,153 @@
+#ifndef BMP_HPP_
+#define BMP_HPP_
+
+#include <deque>
+#include <list>
+#include <array>
+#include <optional>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "net_integer.hpp"
+#include "nlri.hpp"
+
+struct GlobalConf;
+struct bmp_collector_v4;
+struct bgp_fsm;
+class bgp_table_v4;
+class rib_snapshot;
+
+enum class BMP_MSG_TYPE : uint8_t {
+    ROUTE_MONITORING = 0,
+    STATS_REPORT = 1,
+    PEER_DOWN = 2,
+    PEER_UP = 3,
+    INITIATION = 4,
+    TERMINATION = 5,
+};
+
+enum class BMP_PEER_DOWN : uint8_t {
+    LOCAL_NOTIFICATION = 1,
+    LOCAL_NO_NOTIFICATION = 2,
+    REMOTE_NOTIFICATION = 3,
+    REMOTE_NO_NOTIFICATION = 4,
+};
+
+enum class BMP_INFO_TLV : uint16_t {
+    STRING = 0,
+    SYS_DESCR = 1,
+    SYS_NAME = 2,
+};
+
+enum class BMP_STAT_TLV : uint16_t {
+    REJECTED_PREFIXES = 0,
+    ADJ_RIB_IN_ROUTES = 7,
+};
+
+// per-peer header flags
+static constexpr uint8_t BMP_PEER_FLAG_POST_POLICY = 0x40;
+static constexpr uint8_t BMP_PEER_FLAG_LEGACY_AS_PATH = 0x20;
+
+struct bmp_common_header {
+    uint8_t version;
+    BE32 length;
+    BMP_MSG_TYPE type;
+}__attribute__((__packed__));
+
+static_assert( sizeof( bmp_common_header ) == 6, "size of bmp_common_header should be equal 6 bytes" );
+
+struct bmp_peer_header {
+    uint8_t peer_type;
+    uint8_t flags;
+    std::array<uint8_t,8> distinguisher;
+    std::array<uint8_t,16> address;
+    BE32 as;
+    BE32 bgp_id;
+    BE32 ts_sec;
+    BE32 ts_usec;
+}__attribute__((__packed__));
+
+static_assert( sizeof( bmp_peer_header ) == 42, "size of bmp_peer_header should be equal 42 bytes" );
+
+struct bmp_peer_up {
+    std::array<uint8_t,16> local_address;
+    BE16 local_port;
+    BE16 remote_port;
+}__attribute__((__packed__));
+
+struct bmp_tlv {
+    BE16 type;
+    BE16 len;
+    uint8_t data[0];
+}__attribute__((__packed__));
+
+class bmp_exporter;
+
+// Connection to one monitoring station. Messages are queued as shared buffers,
+// so the same message is encoded once for all collectors.
+class bmp_session : public std::enable_shared_from_this<bmp_session> {
+public:
+    bmp_session( boost::asio::io_context &i, bmp_exporter &e, const bmp_collector_v4 &c );
+    void start();
+    void enqueue( std::shared_ptr<std::vector<uint8_t>> msg );
+    bool is_connected() const;
+private:
+    void connect();
+    void on_connect( const boost::system::error_code &ec );
+    void on_reconnect_timer( const boost::system::error_code &ec );
+    void drop_to_resync();
+    void do_write();
+    void on_write( const boost::system::error_code &ec, std::size_t length );
+    void continue_dump();
+
+    boost::asio::io_context &io;
+    bmp_exporter &exporter;
+    boost::asio::ip::tcp::endpoint ep;
+    boost::asio::ip::tcp::socket sock;
+    boost::asio::steady_timer reconnect_timer;
+    bool connected;
+    bool writing;
+
+    std::deque<std::shared_ptr<std::vector<uint8_t>>> queue;
+    std::size_t queued_bytes;
+    std::vector<std::shared_ptr<std::vector<uint8_t>>> inflight;
+
+    // position of initial table dump, which is generated only when queue drains
+    bool dumping;
+    std::optional<NLRI> dump_cursor;
+    // dump is generated from table as it was on connect, later messages wait until it is finished
+    std::shared_ptr<const rib_snapshot> dump_snapshot;
+    std::deque<std::shared_ptr<std::vector<uint8_t>>> held;
+    std::size_t held_bytes;
+};
+
+class bmp_exporter {
+public:
+    bmp_exporter( boost::asio::io_context &i, GlobalConf &c, bgp_table_v4 &t );
+    void start();
+
+    void peer_up( std::shared_ptr<bgp_fsm> peer );
+    void peer_down( std::shared_ptr<bgp_fsm> peer, BMP_PEER_DOWN reason, const std::vector<uint8_t> &data );
+    void route_monitoring( std::shared_ptr<bgp_fsm> peer, const uint8_t *update, std::size_t length );
+
+    std::vector<std::shared_ptr<std::vector<uint8_t>>> make_session_start();
+    std::shared_ptr<const rib_snapshot> make_dump_snapshot();
+    std::vector<std::shared_ptr<std::vector<uint8_t>>> make_dump_chunk( const rib_snapshot &rib, std::optional<NLRI> &cursor, bool &finished );
+private:
+    bool has_listeners() const;
+    void broadcast( std::shared_ptr<std::vector<uint8_t>> msg );
+    void start_stats_timer();
+    void on_stats_timer( const boost::system::error_code &ec );
+
+    std::shared_ptr<std::vector<uint8_t>> make_peer_up( bgp_fsm &peer );
+    // post_policy marks routes taken from table, i.e. after import policy
+    std::shared_ptr<std::vector<uint8_t>> make_message( BMP_MSG_TYPE type, bgp_fsm *peer, std::size_t body_len, bool post_policy = false );
+
+    boost::asio::io_context &io;
+    GlobalConf &conf;
+    bgp_table_v4 &table;
+    boost::asio::steady_timer stats_timer;
+    std::list<std::shared_ptr<bmp_session>> sessions;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#include "buffer_pool.hpp"
+
+// sessions on one event loop parse one at a time, more buffers are needed only for incomplete packets
+static constexpr std::size_t MAX_SPARE_BUFFERS = 4;
+
+std::unique_ptr<rx_buffer> buffer_pool::acquire() {
+    if( spare.empty() ) {
+        // content is not initialized, only received bytes are read
+        return std::unique_ptr<rx_buffer>( new rx_buffer );
+    }
+    auto buf = std::move( spare.back() );
+    spare.pop_back();
+    return buf;
+}
+
+void buffer_pool::release( std::unique_ptr<rx_buffer> buf ) {
+    if( !buf ) {
+        return;
+    }
+    if( spare.size() < MAX_SPARE_BUFFERS ) {
+        spare.push_back( std::move( buf ) );
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef BUFFER_POOL_HPP_
+#define BUFFER_POOL_HPP_
+
+#include <array>
+#include <memory>
+#include <vector>
+
+// largest BGP message
+using rx_buffer = std::array<uint8_t,65535>;
+
+// Receive buffers shared by sessions. Session takes buffer when its socket is
+// readable and returns it after parsing, unless part of packet waits for the
+// rest, so idle sessions hold no buffer. Few returned buffers are kept for
+// reuse, others are freed, so pool follows number of sessions reading at once.
+class buffer_pool {
+public:
+    std::unique_ptr<rx_buffer> acquire();
+    void release( std::unique_ptr<rx_buffer> buf );
+private:
+    std::vector<std::unique_ptr<rx_buffer>> spare;
+};
+
+#endif
@@ -1,7 +1,9 @@
 #include <iostream>
 #include <memory>
-#include <iomanip>
 #include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
 #include <boost/asio.hpp>
 #include <boost/asio/local/stream_protocol.hpp>
 #include <boost/asio/ip/network_v4.hpp>
@@ -10,6 +12,8 @@ using address_v4 = boost::asio::ip::address_v4;
 
 #include "cli.hpp"
 #include "evloop.hpp"
+#include "rib_snapshot.hpp"
+#include "rib_feed.hpp"
 #include "fsm.hpp"
 #include "packet.hpp"
 #include "log.hpp"
@@ -20,107 +24,427 @@ using address_v4 = boost::asio::ip::address_v4;
 
 extern Logger logger;
 
-CLI_Session::CLI_Session( boost::asio::io_context &i, boost::asio::local::stream_protocol::socket s, std::shared_ptr<EVLoop> r ):
+// logger isn't thread safe, so CLI thread logs on event loop
+template<typename... Args>
+static void log_info( boost::asio::io_context &loop, Args... args ) {
+    boost::asio::post( loop, [ args... ]() {
+        ( ( logger.logInfo() << LOGS::CLI ) << ... << args ) << std::endl;
+    });
+}
+
+template<typename... Args>
+static void log_error( boost::asio::io_context &loop, Args... args ) {
+    boost::asio::post( loop, [ args... ]() {
+        ( ( logger.logError() << LOGS::CLI ) << ... << args ) << std::endl;
+    });
+}
+
+CLI_Session::CLI_Session( boost::asio::io_context &i, boost::asio::io_context &l, boost::asio::local::stream_protocol::socket s, std::shared_ptr<EVLoop> r ):
     io( i ),
+    loop( l ),
     sock( std::move( s ) ),
+    throttle( io ),
     runtime( r )
 {}
 
+CLI_Session::~CLI_Session() {
+    end_stream();
+    end_subscription();
+}
+
 void CLI_Session::start() {
-    sock.async_receive( boost::asio::buffer( buf ), std::bind( &CLI_Session::on_receive, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) );
+    auto now = std::chrono::steady_clock::now();
+    request_budget = std::max( request_budget, now ) + CLI_REQUEST_INTERVAL;
+    auto wait = request_budget - now - CLI_REQUEST_INTERVAL * CLI_REQUEST_BURST;
+    if( wait <= std::chrono::steady_clock::duration::zero() ) {
+        read_request();
+        return;
+    }
+    throttle.expires_after( wait );
+    throttle.async_wait( [ self = shared_from_this() ]( const boost::system::error_code &ec ) {
+        if( !ec ) {
+            self->read_request();
+        }
+    });
 }
 
-void CLI_Session::on_receive( const boost::system::error_code &ec, std::size_t len ) {
+void CLI_Session::read_request() {
+    boost::asio::async_read( sock, boost::asio::buffer( header ), std::bind( &CLI_Session::on_header, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) );
+}
+
+void CLI_Session::on_header( const boost::system::error_code &ec, std::size_t ) {
     if( ec ) {
-        logger.logError() << LOGS::CLI << ec.message() << std::endl;
-        start();
+        if( ec != boost::asio::error::eof ) {
+            log_error( loop, ec.message() );
+        }
         return;
     }
-    std::string inData { buf.data(), buf.data() + len };
-    auto inMsg = deserialize<Message>( inData );
-    if( inMsg.type != TYPE::REQ ) {
-        logger.logError() << LOGS::CLI << "This is not a request, so dropping it." << std::endl;
-        start();
+    auto body_len = frame_length( header.data() );
+    if( body_len > CLI_MAX_FRAME ) {
+        log_error( loop, "Too long request: ", body_len, ", closing session" );
         return;
     }
+    body.resize( body_len );
+    boost::asio::async_read( sock, boost::asio::buffer( body ), std::bind( &CLI_Session::on_receive, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) );
+}
+
+void CLI_Session::on_receive( const boost::system::error_code &ec, std::size_t ) {
+    if( ec ) {
+        log_error( loop, ec.message() );
+        return;
+    }
+    try {
+        cli_reader in( body );
+        if( in.type != TYPE::REQ ) {
+            log_error( loop, "This is not a request, so dropping it." );
+            start();
+            return;
+        }
+        log_info( loop, "Got new request from cli session: ", in.cont );
+        switch( in.cont ) {
+        case CONTENT::SHOW_NEI:
+            boost::asio::post( loop, [ self = shared_from_this(), req = in.read<Show_Neighbour_Req>() ]() {
+                self->send_neighbours( req );
+            });
+            return;
+        case CONTENT::SHOW_TABLE:
+            boost::asio::post( loop, [ self = shared_from_this(), req = in.read<Show_Table_Req>() ]() {
+                self->start_table_stream( req );
+            });
+            return;
+        case CONTENT::SUBSCRIBE:
+            boost::asio::post( loop, [ self = shared_from_this(), req = in.read<Subscribe_Req>() ]() {
+                self->start_subscription( req );
+            });
+            return;
+        case CONTENT::RELOAD:
+            boost::asio::post( loop, [ self = shared_from_this() ]() {
+                self->reload();
+            });
+            return;
+        case CONTENT::SHOW_VER:
+            break;
+        }
+        cli_writer out( TYPE::RESP, in.cont );
+        send( out.finish(), true );
+    } catch( std::exception &e ) {
+        log_error( loop, "Invalid request, closing session: ", std::string( e.what() ) );
+    }
+}
+
+void CLI_Session::send_neighbours( const Show_Neighbour_Req &req ) {
+    Show_Neighbour_Resp resp;
+    boost::system::error_code ec;
+    auto requested = req.address ? boost::asio::ip::make_address_v4( *req.address, ec ) : address_v4();
+    if( ec ) {
+        logger.logError() << LOGS::CLI << "Invalid neighbour address: " << *req.address << std::endl;
+    }
+    // index isn't ordered, neighbours are shown by address
+    std::vector<const neighbour_index::value_type*> sorted;
+    for( auto const &entry: runtime->neighbours ) {
+        if( !req.address || entry.first == requested ) {
+            sorted.push_back( &entry );
+        }
+    }
+    std::sort( sorted.begin(), sorted.end(), []( auto lhs, auto rhs ) { return lhs->first < rhs->first; } );
+    for( auto entry: sorted ) {
+        auto const &[ address, ptr ] = *entry;
+        BGP_Neighbour_Info info;
+        info.address = address.to_string();
+        if( !ptr ) {
+            continue;
+        }
+        info.hold_time = ptr->HoldTime;
+        info.remote_as = ptr->conf.remote_as;
+        if( ptr->sock ) {
+            info.socket = ptr->sock.value().native_handle();
+        }
+        for( auto const &cap: ptr->caps ) {
+            std::stringstream ss;
+            ss << cap.code;
+            info.caps.push_back( ss.str() );
+        }
+        resp.entries.push_back( info );
+    }
+    cli_writer out( TYPE::RESP, CONTENT::SHOW_NEI );
+    out & resp;
+    reply( out.finish(), true );
+}
 
-    logger.logInfo() << LOGS::CLI << "Got new request from cli session: " << inMsg.cont << std::endl;
+void CLI_Session::reload() {
+    Reload_Resp resp;
+    try {
+        resp.changes = runtime->reload();
+    } catch( std::exception &e ) {
+        logger.logError() << LOGS::CLI << "Cannot reload config: " << e.what() << std::endl;
+        resp.error = std::string( e.what() );
+    }
+    cli_writer out( TYPE::RESP, CONTENT::RELOAD );
+    out & resp;
+    reply( out.finish(), true );
+}
 
-    Message outMsg;
-    outMsg.type = TYPE::RESP;
-    outMsg.cont = inMsg.cont;
+void CLI_Session::send( std::string frame, bool last ) {
+    auto out = std::make_shared<std::string>( std::move( frame ) );
+    boost::asio::async_write( sock, boost::asio::buffer( *out ), [ self = shared_from_this(), out, last ]( const boost::system::error_code &ec, std::size_t ) {
+        if( ec ) {
+            log_error( self->loop, "Error on sending response: ", ec.message() );
+            self->end_stream();
+            return;
+        }
+        // next chunk is built after previous one is sent, so slow client gets table at its own pace
+        if( last ) {
+            self->start();
+        } else {
+            self->send_table_chunk();
+        }
+    });
+}
 
-    switch( inMsg.cont ) {
-    case CONTENT::SHOW_NEI: {
-        auto req = deserialize<Show_Neighbour_Req>( inMsg.data );
-        // TODO: handle req
-        Show_Neighbour_Resp resp;
-        for( auto const &[ address, ptr ]: runtime->neighbours ) {
-            BGP_Neighbour_Info info;
-            info.address = address.to_string();
-            if( !ptr ) {
-                continue;
-            }
-            info.hold_time = ptr->HoldTime;
-            info.remote_as = ptr->conf.remote_as;
-            if( ptr->sock ) {
-                info.socket = ptr->sock.value().native_handle();
-            }
-            for( auto const &cap: ptr->caps ) {
-                std::stringstream ss;
-                ss << cap.code;
-                info.caps.push_back( ss.str() );
+void CLI_Session::reply( std::string frame, bool last ) {
+    boost::asio::post( io, [ self = shared_from_this(), frame = std::move( frame ), last ]() mutable {
+        self->send( std::move( frame ), last );
+    });
+}
+
+// paths of one Show_Table_Resp in wire layout, attribute set is encoded once per chunk
+struct table_chunk {
+    std::string attr_sets;
+    std::string entries;
+    std::size_t count { 0 };
+    std::unordered_map<const std::vector<path_attr_t>*,uint32_t> attr_index;
+};
+
+static uint32_t add_attr_set( table_chunk &chunk, const std::vector<path_attr_t> &attrs ) {
+    auto [ it, inserted ] = chunk.attr_index.emplace( &attrs, chunk.attr_index.size() );
+    if( !inserted ) {
+        return it->second;
+    }
+    cli_attr_set set {};
+    set.local_pref = 100;
+    std::vector<uint32_t> as_path;
+    for( auto const &attr: attrs ) {
+        if( attr.type == PATH_ATTRIBUTE::NEXT_HOP ) {
+            auto bytes = address_v4( attr.get_u32() ).to_bytes();
+            std::copy( bytes.begin(), bytes.end(), set.nexthop.begin() );
+            set.nexthop_len = bytes.size();
+        } else if( attr.type == PATH_ATTRIBUTE::MP_REACH_NLRI ) {
+            auto nexthop = attr.get_mp_nexthop();
+            if( nexthop.size() >= 16 ) {
+                std::copy( nexthop.begin(), nexthop.begin() + 16, set.nexthop.begin() );
+                set.nexthop_len = 16;
             }
-            resp.entries.push_back( info );
+        } else if( attr.type == PATH_ATTRIBUTE::LOCAL_PREF ) {
+            set.local_pref = attr.get_u32();
+        } else if( attr.type == PATH_ATTRIBUTE::AS_PATH ) {
+            as_path = attr.parse_as_path();
         }
-        outMsg.data = serialize( resp );
-        break;
     }
-    case CONTENT::SHOW_TABLE: {
-        auto req = deserialize<Show_Table_Req>( inMsg.data );
-        // TODO: handle req
+    as_path.resize( std::min<std::size_t>( as_path.size(), UINT16_MAX ) );
+    set.as_path_len = as_path.size();
+    chunk.attr_sets.append( reinterpret_cast<const char*>( &set ), sizeof( set ) );
+    chunk.attr_sets.append( reinterpret_cast<const char*>( as_path.data() ), as_path.size() * sizeof( uint32_t ) );
+    return it->second;
+}
+
+static void add_entry( table_chunk &chunk, const NLRI &prefix, const bgp_path &path ) {
+    cli_table_entry entry {};
+    auto const &data = prefix.get_data();
+    std::copy( data.begin(), data.end(), entry.prefix.begin() );
+    entry.afi = static_cast<uint8_t>( prefix.get_afi() );
+    entry.prefix_len = prefix.get_len();
+    entry.flags = ( path.isBest ? CLI_ENTRY_BEST : 0 ) | ( path.isValid ? CLI_ENTRY_VALID : 0 );
+    entry.attr_index = add_attr_set( chunk, *path.attrs );
+    entry.source = path.source ? path.source->conf.address.to_uint() : 0;
+    entry.time = std::chrono::system_clock::to_time_t( path.time );
+    chunk.entries.append( reinterpret_cast<const char*>( &entry ), sizeof( entry ) );
+    chunk.count++;
+}
+
+void CLI_Session::start_table_stream( const Show_Table_Req &req ) {
+    table_stream st;
+    st.limit = req.limit;
+    st.skip = static_cast<uint64_t>( req.page ) * req.limit;
+    try {
+        st.query.emplace( req, runtime->neighbours );
+        if( req.cursor ) {
+            if( req.cursor->find( ':' ) != std::string::npos ) {
+                st.v6 = true;
+                st.v6_last = prefix_v6( NLRI( BGP_AFI::IPv6, *req.cursor ) );
+            } else {
+                st.v4_last = NLRI( BGP_AFI::IPv4, *req.cursor );
+            }
+        }
+    } catch( std::exception &e ) {
+        logger.logError() << LOGS::CLI << "Invalid table request: " << e.what() << std::endl;
         Show_Table_Resp resp;
-        for( auto const &[ prefix, path ]: runtime->table.table ) {
-            BGP_Entry entry;
-            auto in_time_t = std::chrono::system_clock::to_time_t( path.time );
-            std::stringstream stream;
-            stream << std::put_time( std::localtime( &in_time_t ), "%Y-%m-%d %X");
-            entry.time = stream.str();
-            entry.prefix = prefix.to_string();
-            for( auto const &attr: *path.attrs ) {
-                if( attr.type == PATH_ATTRIBUTE::NEXT_HOP ) {
-                    entry.nexthop = boost::asio::ip::make_address_v4( attr.get_u32() ).to_string();
-                } else if( attr.type == PATH_ATTRIBUTE::LOCAL_PREF ) {
-                    entry.local_pref = attr.get_u32();
-                } else if( attr.type == PATH_ATTRIBUTE::AS_PATH ) {
-                    std::stringstream ss;
-                    auto temp = attr.parse_as_path();
-                    for( auto const &as: temp ) {
-                        ss << as << " ";
-                    }
-                    entry.as_path = ss.str();
-                }
+        resp.error = e.what();
+        cli_writer out( TYPE::RESP, CONTENT::SHOW_TABLE );
+        out & resp;
+        reply( out.finish(), true );
+        return;
+    }
+    st.rib = rib_snapshot::take( runtime->table, runtime->table_v6 );
+    boost::asio::post( io, [ self = shared_from_this(), st = std::move( st ) ]() mutable {
+        self->stream.emplace( std::move( st ) );
+        self->send_table_chunk();
+    });
+}
+
+void CLI_Session::send_table_chunk() {
+    if( !stream ) {
+        return;
+    }
+    auto &st = *stream;
+    Show_Table_Resp resp;
+    table_chunk chunk;
+    // prefix is taken whole, so chunk may be a bit longer than CLI_TABLE_CHUNK entries
+    auto take = [ &st, &resp, &chunk ]( const NLRI &prefix, auto &&add_paths ) -> bool {
+        if( chunk.count >= CLI_TABLE_CHUNK ) {
+            return false;
+        }
+        if( st.limit > 0 && st.sent >= st.limit ) {
+            st.done = true;
+            resp.cursor = st.last_prefix;
+            return false;
+        }
+        if( st.skip > 0 ) {
+            st.skip--;
+            return true;
+        }
+        add_paths();
+        st.sent++;
+        st.last_prefix = prefix.to_string();
+        return true;
+    };
+    auto add_paths = [ &chunk ]( const NLRI &prefix, const std::vector<const bgp_path*> &paths ) {
+        for( auto path: paths ) {
+            add_entry( chunk, prefix, *path );
+        }
+    };
+    if( !st.done && !st.v6 ) {
+        auto visit = [ & ]( const NLRI &prefix, const std::vector<const bgp_path*> &paths ) {
+            if( !take( prefix, [ & ]() { add_paths( prefix, paths ); } ) ) {
+                return false;
             }
-            if( path.isBest ) {
-                entry.best = true;
+            st.v4_last = prefix;
+            return true;
+        };
+        if( st.query->walk_v4( *st.rib, st.v4_last, visit ) ) {
+            st.v6 = true;
+        }
+    }
+    if( !st.done && st.v6 ) {
+        auto visit = [ & ]( const NLRI &prefix, const std::vector<const bgp_path*> &paths ) {
+            if( !take( prefix, [ & ]() { add_paths( prefix, paths ); } ) ) {
+                return false;
             }
-            if( path.isValid ) {
-                entry.valid = true;
+            st.v6_last = prefix_v6( prefix );
+            return true;
+        };
+        if( st.query->walk_v6( *st.rib, st.v6_last, visit ) ) {
+            st.done = true;
+        }
+    }
+    resp.last = st.done;
+    resp.attr_sets = chunk.attr_sets;
+    resp.entries = chunk.entries;
+    cli_writer out( TYPE::RESP, CONTENT::SHOW_TABLE );
+    out & resp;
+    if( resp.last ) {
+        end_stream();
+    }
+    send( out.finish(), resp.last );
+}
+
+void CLI_Session::end_stream() {
+    if( !stream ) {
+        return;
+    }
+    boost::asio::post( loop, [ st = std::move( *stream ) ]() {} );
+    stream.reset();
+}
+
+void CLI_Session::start_subscription( const Subscribe_Req &req ) {
+    std::optional<NLRI> prefix;
+    std::shared_ptr<bgp_fsm> peer;
+    try {
+        if( req.prefix ) {
+            prefix.emplace( req.prefix->find( ':' ) != std::string::npos ? BGP_AFI::IPv6 : BGP_AFI::IPv4, *req.prefix );
+        }
+        if( req.neighbour ) {
+            auto it = runtime->neighbours.find( boost::asio::ip::make_address_v4( *req.neighbour ) );
+            if( it == runtime->neighbours.end() ) {
+                throw std::runtime_error( "Unknown neighbour: " + *req.neighbour );
             }
-            resp.entries.push_back( entry );
+            peer = it->second;
         }
-        outMsg.data = serialize( resp );
-        break;
+    } catch( std::exception &e ) {
+        logger.logError() << LOGS::CLI << "Invalid subscription: " << e.what() << std::endl;
+        Subscribe_Resp resp;
+        resp.error = e.what();
+        cli_writer out( TYPE::RESP, CONTENT::SUBSCRIBE );
+        out & resp;
+        reply( out.finish(), true );
+        return;
     }
-    case CONTENT::SHOW_VER: break;
+    // events of one event loop run are sent together
+    std::weak_ptr<CLI_Session> weak = shared_from_this();
+    auto sub = std::make_shared<rib_subscription>( std::move( prefix ), std::move( peer ), [ &io = io, weak ]() {
+        boost::asio::post( io, [ weak ]() {
+            if( auto self = weak.lock() ) {
+                self->send_events();
+            }
+        });
+    });
+    runtime->feed.subscribe( sub );
+    boost::asio::post( io, [ self = shared_from_this(), sub ]() {
+        self->subscription = sub;
+        self->send_events();
+        // client doesn't send anything while subscribed, so read only detects closed connection
+        boost::asio::async_read( self->sock, boost::asio::buffer( self->header ), std::bind( &CLI_Session::on_subscriber_read, self, std::placeholders::_1, std::placeholders::_2 ) );
+    });
+}
+
+void CLI_Session::send_events() {
+    if( !subscription || sending_events || subscription->empty() ) {
+        return;
     }
-    auto outData = serialize( outMsg );
-    sock.send( boost::asio::buffer( outData ) );
-    start();
+    Subscribe_Resp resp;
+    auto events = subscription->take( CLI_EVENT_CHUNK, resp.coalesced );
+    resp.events = events;
+    cli_writer writer( TYPE::RESP, CONTENT::SUBSCRIBE );
+    writer & resp;
+    auto out = std::make_shared<std::string>( writer.finish() );
+    sending_events = true;
+    // while this is written, new events are coalesced in subscription
+    boost::asio::async_write( sock, boost::asio::buffer( *out ), [ self = shared_from_this(), out ]( const boost::system::error_code &ec, std::size_t ) {
+        self->sending_events = false;
+        if( ec ) {
+            log_error( self->loop, "Error on sending events: ", ec.message() );
+            self->end_subscription();
+            return;
+        }
+        self->send_events();
+    });
 }
 
-CLI_Server::CLI_Server( boost::asio::io_context &i, const std::string &path, std::shared_ptr<EVLoop> r ):
-    io( i ),
+// any read result means that subscriber closed connection or broke protocol
+void CLI_Session::on_subscriber_read( const boost::system::error_code &, std::size_t ) {
+    log_info( loop, "Subscription is closed" );
+    end_subscription();
+    sock.close();
+}
+
+void CLI_Session::end_subscription() {
+    if( !subscription ) {
+        return;
+    }
+    boost::asio::post( loop, [ sub = std::move( subscription ) ]() {} );
+}
+
+CLI_Server::CLI_Server( boost::asio::io_context &l, const std::string &path, std::shared_ptr<EVLoop> r ):
+    loop( l ),
     ep( path ),
     acceptor( io, ep ),
     sock( io ),
@@ -128,17 +452,37 @@ CLI_Server::CLI_Server( boost::asio::io_context &i, const std::string &path, std
 {}
 
 void CLI_Server::start() {
+    accept();
+    worker = std::thread( [ this ]() {
+        while( !io.stopped() ) {
+            try {
+                io.run();
+            } catch( std::exception &e ) {
+                log_error( loop, "Error on run CLI thread: ", std::string( e.what() ) );
+            }
+        }
+    });
+}
+
+void CLI_Server::stop() {
+    io.stop();
+    if( worker.joinable() ) {
+        worker.join();
+    }
+}
+
+void CLI_Server::accept() {
     acceptor.async_accept( sock, std::bind( &CLI_Server::on_accept, shared_from_this(), std::placeholders::_1 ) );
 }
 
 void CLI_Server::on_accept( const boost::system::error_code &ec ) {
     if( ec ) {
-        logger.logError() << LOGS::CLI << ec.message() << std::endl;
-        start();
+        log_error( loop, ec.message() );
+        accept();
         return;
     }
-    logger.logInfo() << LOGS::CLI << "Accepted new CLI session" << std::endl;
-    auto session = std::make_shared<CLI_Session>( io, std::move( sock ), runtime );
+    log_info( loop, "Accepted new CLI session" );
+    auto session = std::make_shared<CLI_Session>( io, loop, std::move( sock ), runtime );
     session->start();
-    start();
-}
\ No newline at end of file
+    accept();
+}
@@ -1,32 +1,107 @@
 #ifndef CLI_HPP
 #define CLI_HPP
 
+#include <chrono>
+#include <thread>
+#include <optional>
+
+#include "nlri.hpp"
+#include "trie_v6.hpp"
+#include "table_query.hpp"
+
 class EVLoop;
+struct Show_Neighbour_Req;
+struct Show_Table_Req;
+struct Subscribe_Req;
+class rib_snapshot;
+class rib_subscription;
+
+// entries in one streamed chunk of table
+static constexpr std::size_t CLI_TABLE_CHUNK = 1000;
+// events in one response of subscription
+static constexpr std::size_t CLI_EVENT_CHUNK = 1000;
+// session can send CLI_REQUEST_BURST requests at once, then one per CLI_REQUEST_INTERVAL
+static constexpr std::chrono::milliseconds CLI_REQUEST_INTERVAL { 100 };
+static constexpr uint32_t CLI_REQUEST_BURST = 20;
 
+// Session runs on CLI thread. State of event loop is read by handlers posted to
+// loop, which post their result back, table is read only through rib_snapshot.
 class CLI_Session: public std::enable_shared_from_this<CLI_Session> {
 public:
-    CLI_Session( boost::asio::io_context &i, boost::asio::local::stream_protocol::socket s, std::shared_ptr<EVLoop> r );
+    CLI_Session( boost::asio::io_context &i, boost::asio::io_context &l, boost::asio::local::stream_protocol::socket s, std::shared_ptr<EVLoop> r );
+    ~CLI_Session();
+    // reads next request, it is delayed while session is over its request rate
     void start();
 private:
+    // table walk, which is continued after previous chunk is sent
+    struct table_stream {
+        uint32_t limit { 0U };
+        uint64_t skip { 0U };
+        uint32_t sent { 0U };
+        // IPv4 table is walked first, then IPv6
+        bool v6 { false };
+        bool done { false };
+        std::optional<NLRI> v4_last;
+        std::optional<prefix_v6> v6_last;
+        std::string last_prefix;
+        std::optional<table_query> query;
+        // unindexed queries walk copy of table, so pages don't change while client reads them
+        std::shared_ptr<const rib_snapshot> rib;
+    };
+
+    void read_request();
+    void on_header( const boost::system::error_code &ec, std::size_t len );
     void on_receive( const boost::system::error_code &ec, std::size_t len );
+    // frame is written by cli_writer, request is read after last response is sent
+    void send( std::string frame, bool last );
+    // send from event loop
+    void reply( std::string frame, bool last );
+    // called on event loop
+    void send_neighbours( const Show_Neighbour_Req &req );
+    void start_table_stream( const Show_Table_Req &req );
+    void start_subscription( const Subscribe_Req &req );
+    void reload();
+    void send_table_chunk();
+    // snapshot and query refer to neighbours, so they are released on event loop
+    void end_stream();
+    // subscription lasts until client closes connection
+    void send_events();
+    void on_subscriber_read( const boost::system::error_code &ec, std::size_t len );
+    void end_subscription();
 
-    std::array<char,2048> buf;
+    std::array<uint8_t,4> header;
+    std::string body;
+    std::optional<table_stream> stream;
+    std::shared_ptr<rib_subscription> subscription;
+    bool sending_events { false };
+    // time when session is back within its request rate, plus one interval
+    std::chrono::steady_clock::time_point request_budget;
     boost::asio::io_context &io;
+    boost::asio::io_context &loop;
     boost::asio::local::stream_protocol::socket sock;
+    boost::asio::steady_timer throttle;
     std::shared_ptr<EVLoop> runtime;
 };
 
+// Accepts CLI sessions and runs them on own thread, so slow clients don't delay
+// event loop.
 class CLI_Server : public std::enable_shared_from_this<CLI_Server> {
 public:
-    CLI_Server( boost::asio::io_context &io, const std::string &path, std::shared_ptr<EVLoop> r );
+    CLI_Server( boost::asio::io_context &l, const std::string &path, std::shared_ptr<EVLoop> r );
+    // starts CLI thread
     void start();
+    // stops CLI thread and waits for it, called on event loop
+    void stop();
 private:
+    void accept();
     void on_accept( const boost::system::error_code &ec );
-    boost::asio::io_context &io;
+    boost::asio::io_context &loop;
+    boost::asio::io_context io;
     boost::asio::local::stream_protocol::endpoint ep;
     boost::asio::local::stream_protocol::acceptor acceptor;
     boost::asio::local::stream_protocol::socket sock;
     std::shared_ptr<EVLoop> runtime;
+    std::thread worker;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,222 @@
+#include <cctype>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "community.hpp"
+#include "packet.hpp"
+
+// registry is swept when number of entries doubles since last sweep
+static constexpr std::size_t COMMUNITY_REGISTRY_MIN_SWEEP = 1024;
+
+static std::vector<std::string> split( const std::string &str, char sep ) {
+    std::vector<std::string> parts;
+    std::size_t start = 0;
+    while( true ) {
+        auto pos = str.find( sep, start );
+        parts.push_back( str.substr( start, pos == str.npos ? pos : pos - start ) );
+        if( pos == str.npos ) {
+            return parts;
+        }
+        start = pos + 1;
+    }
+}
+
+static uint32_t parse_number( const std::string &str, uint64_t max ) {
+    if( str.empty() || !std::all_of( str.begin(), str.end(), ::isdigit ) ) {
+        throw std::runtime_error( "not a number" );
+    }
+    auto val = std::stoull( str );
+    if( val > max ) {
+        throw std::runtime_error( "value is out of range" );
+    }
+    return val;
+}
+
+community_t community_t::parse( const std::string &str ) {
+    community_t c { PATH_ATTRIBUTE::COMMUNITIES, { 0, 0, 0 } };
+    try {
+        if( str == "no-export" ) {
+            c.words[ 0 ] = COMMUNITY_NO_EXPORT;
+            return c;
+        }
+        if( str == "no-advertise" ) {
+            c.words[ 0 ] = COMMUNITY_NO_ADVERTISE;
+            return c;
+        }
+        if( str == "no-export-subconfed" ) {
+            c.words[ 0 ] = COMMUNITY_NO_EXPORT_SUBCONFED;
+            return c;
+        }
+        auto parts = split( str, ':' );
+        if( parts.size() == 1 ) {
+            c.words[ 0 ] = parse_number( parts[ 0 ], 0xFFFFFFFF );
+            return c;
+        }
+        if( parts.size() == 2 ) {
+            c.words[ 0 ] = ( parse_number( parts[ 0 ], 0xFFFF ) << 16 ) | parse_number( parts[ 1 ], 0xFFFF );
+            return c;
+        }
+        if( parts.size() != 3 ) {
+            throw std::runtime_error( "too many fields" );
+        }
+        if( parts[ 0 ] != "rt" && parts[ 0 ] != "soo" ) {
+            c.type = PATH_ATTRIBUTE::LARGE_COMMUNITY;
+            for( int i = 0; i < 3; i++ ) {
+                c.words[ i ] = parse_number( parts[ i ], 0xFFFFFFFF );
+            }
+            return c;
+        }
+        // RFC 4360 and RFC 5668 transitive types with route target or route origin subtype
+        c.type = PATH_ATTRIBUTE::EXTENDED_COMMUNITIES;
+        uint32_t subtype = parts[ 0 ] == "rt" ? 0x02 : 0x03;
+        if( parts[ 1 ].find( '.' ) != std::string::npos ) {
+            auto admin = boost::asio::ip::make_address_v4( parts[ 1 ] ).to_uint();
+            c.words[ 0 ] = ( 0x01 << 24 ) | ( subtype << 16 ) | ( admin >> 16 );
+            c.words[ 1 ] = ( admin << 16 ) | parse_number( parts[ 2 ], 0xFFFF );
+        } else if( auto asn = parse_number( parts[ 1 ], 0xFFFFFFFF ); asn > 0xFFFF ) {
+            c.words[ 0 ] = ( 0x02 << 24 ) | ( subtype << 16 ) | ( asn >> 16 );
+            c.words[ 1 ] = ( asn << 16 ) | parse_number( parts[ 2 ], 0xFFFF );
+        } else {
+            c.words[ 0 ] = ( 0x00 << 24 ) | ( subtype << 16 ) | asn;
+            c.words[ 1 ] = parse_number( parts[ 2 ], 0xFFFFFFFF );
+        }
+        return c;
+    } catch( std::exception & ) {}
+    throw std::runtime_error( "Invalid community: " + str );
+}
+
+std::size_t community_list::width( PATH_ATTRIBUTE type ) {
+    switch( type ) {
+    case PATH_ATTRIBUTE::EXTENDED_COMMUNITIES:
+        return 2;
+    case PATH_ATTRIBUTE::LARGE_COMMUNITY:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+community_list::community_list( PATH_ATTRIBUTE t, std::vector<uint32_t> w ):
+    type( t )
+{
+    auto size = width( type );
+    std::vector<std::array<uint32_t,3>> values( w.size() / size, { 0, 0, 0 } );
+    for( std::size_t i = 0; i < values.size(); i++ ) {
+        std::copy( w.begin() + i * size, w.begin() + ( i + 1 ) * size, values[ i ].begin() );
+    }
+    std::sort( values.begin(), values.end() );
+    values.erase( std::unique( values.begin(), values.end() ), values.end() );
+    words.reserve( values.size() * size );
+    for( auto const &v: values ) {
+        words.insert( words.end(), v.begin(), v.begin() + size );
+    }
+    // FNV-1a over type and words
+    hash_value = 14695981039346656037ULL;
+    auto mix = [ this ]( uint32_t val ) {
+        hash_value = ( hash_value ^ val ) * 1099511628211ULL;
+    };
+    mix( static_cast<uint32_t>( type ) );
+    for( auto val: words ) {
+        mix( val );
+    }
+}
+
+std::shared_ptr<const community_list> community_list::intern( PATH_ATTRIBUTE type, const uint8_t *data, std::size_t len ) {
+    std::vector<uint32_t> w( len / 4 );
+    for( std::size_t i = 0; i < w.size(); i++ ) {
+        w[ i ] = ( data[ i * 4 ] << 24 ) | ( data[ i * 4 + 1 ] << 16 ) | ( data[ i * 4 + 2 ] << 8 ) | data[ i * 4 + 3 ];
+    }
+    return intern( type, std::move( w ) );
+}
+
+std::shared_ptr<const community_list> community_list::intern( PATH_ATTRIBUTE type, std::vector<uint32_t> words ) {
+    static std::unordered_multimap<std::size_t,std::weak_ptr<const community_list>> registry;
+    static std::size_t sweep_at = COMMUNITY_REGISTRY_MIN_SWEEP;
+
+    std::shared_ptr<const community_list> list( new community_list( type, std::move( words ) ) );
+    auto range = registry.equal_range( list->hash() );
+    for( auto it = range.first; it != range.second; ) {
+        auto existing = it->second.lock();
+        if( !existing ) {
+            it = registry.erase( it );
+            continue;
+        }
+        if( *existing == *list ) {
+            return existing;
+        }
+        it++;
+    }
+    registry.emplace( list->hash(), list );
+    if( registry.size() >= sweep_at ) {
+        for( auto it = registry.begin(); it != registry.end(); ) {
+            if( it->second.expired() ) {
+                it = registry.erase( it );
+            } else {
+                it++;
+            }
+        }
+        sweep_at = std::max( COMMUNITY_REGISTRY_MIN_SWEEP, registry.size() * 2 );
+    }
+    return list;
+}
+
+PATH_ATTRIBUTE community_list::get_type() const {
+    return type;
+}
+
+std::size_t community_list::size() const {
+    return words.size() / width( type );
+}
+
+std::size_t community_list::hash() const {
+    return hash_value;
+}
+
+const std::vector<uint32_t> &community_list::get_words() const {
+    return words;
+}
+
+bool community_list::contains( const uint32_t *value ) const {
+    auto size = width( type );
+    std::size_t low = 0;
+    std::size_t high = words.size() / size;
+    while( low < high ) {
+        auto mid = ( low + high ) / 2;
+        auto entry = words.data() + mid * size;
+        if( std::lexicographical_compare( entry, entry + size, value, value + size ) ) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low < words.size() / size && std::equal( value, value + size, words.data() + low * size );
+}
+
+bool community_list::contains( const community_t &c ) const {
+    return c.type == type && contains( c.words.data() );
+}
+
+bool community_list::contains( uint32_t standard ) const {
+    return type == PATH_ATTRIBUTE::COMMUNITIES && std::binary_search( words.begin(), words.end(), standard );
+}
+
+std::vector<uint8_t> community_list::to_bytes() const {
+    std::vector<uint8_t> out;
+    out.reserve( words.size() * 4 );
+    for( auto val: words ) {
+        out.push_back( val >> 24 );
+        out.push_back( val >> 16 );
+        out.push_back( val >> 8 );
+        out.push_back( val );
+    }
+    return out;
+}
+
+bool operator==( const community_list &lhs, const community_list &rhs ) {
+    return lhs.get_type() == rhs.get_type() && lhs.get_words() == rhs.get_words();
+}
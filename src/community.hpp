@@ -0,0 +1,60 @@
+#ifndef COMMUNITY_HPP_
+#define COMMUNITY_HPP_
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+enum class PATH_ATTRIBUTE : uint8_t;
+
+// well-known communities from RFC 1997
+static constexpr uint32_t COMMUNITY_NO_EXPORT = 0xFFFFFF01;
+static constexpr uint32_t COMMUNITY_NO_ADVERTISE = 0xFFFFFF02;
+static constexpr uint32_t COMMUNITY_NO_EXPORT_SUBCONFED = 0xFFFFFF03;
+
+// Value of standard (4 bytes), extended (8 bytes) or large (12 bytes)
+// community as 32 bit words, most significant first.
+struct community_t {
+    PATH_ATTRIBUTE type;
+    std::array<uint32_t,3> words;
+
+    // "asn:value" or number is standard, "rt:asn:value" and "soo:asn:value"
+    // are extended, "asn:value1:value2" is large community
+    // throws std::runtime_error on invalid string
+    static community_t parse( const std::string &str );
+};
+
+// Communities of path attribute. List is sorted and has no duplicates, values
+// are stored as contiguous 32 bit words, so membership test is binary search
+// over flat array. Lists are interned, all paths with the same communities
+// share one list.
+class community_list {
+public:
+    // list of attribute value in wire format
+    static std::shared_ptr<const community_list> intern( PATH_ATTRIBUTE type, const uint8_t *data, std::size_t len );
+    static std::shared_ptr<const community_list> intern( PATH_ATTRIBUTE type, std::vector<uint32_t> words );
+
+    PATH_ATTRIBUTE get_type() const;
+    // number of communities in list
+    std::size_t size() const;
+    bool contains( const community_t &c ) const;
+    bool contains( uint32_t standard ) const;
+    std::size_t hash() const;
+    const std::vector<uint32_t> &get_words() const;
+    std::vector<uint8_t> to_bytes() const;
+    // size of one community in 32 bit words
+    static std::size_t width( PATH_ATTRIBUTE type );
+private:
+    community_list( PATH_ATTRIBUTE type, std::vector<uint32_t> words );
+    bool contains( const uint32_t *value ) const;
+
+    PATH_ATTRIBUTE type;
+    std::vector<uint32_t> words;
+    std::size_t hash_value;
+};
+
+bool operator==( const community_list &lhs, const community_list &rhs );
+
+#endif
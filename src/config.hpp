@@ -2,12 +2,33 @@
 #define CONFIG_HPP_
 
 #include <list>
+#include <string>
+#include <optional>
 #include "nlri.hpp"
 
 struct bgp_neighbour_v4 {
     uint32_t remote_as;
     address_v4 address;
     std::optional<uint16_t> hold_time;
+    // ADD-PATH: accept multiple paths from neighbour, send best and this number of backup paths
+    bool add_path_receive;
+    std::optional<uint16_t> add_path_backups;
+    // exchange IPv6 unicast routes with MP-BGP
+    bool ipv6_unicast;
+    // iBGP neighbour is client of route reflector
+    bool route_reflector_client;
+    // names of route policies for received and advertised routes
+    std::optional<std::string> import_policy;
+    std::optional<std::string> export_policy;
+    // only accept connections from neighbour, don't connect to it
+    bool passive;
+    // TCP port of neighbour for outbound connections, 179 by default
+    std::optional<uint16_t> port;
+};
+
+struct bmp_collector_v4 {
+    address_v4 address;
+    uint16_t port;
 };
 
 enum RoutePolicyAction: uint8_t {
@@ -16,15 +37,35 @@ enum RoutePolicyAction: uint8_t {
     PASS
 };
 
+struct PrefixListEntry {
+    NLRI prefix;
+    // range of matched prefix lengths, exact match if both are not set
+    std::optional<uint8_t> ge;
+    std::optional<uint8_t> le;
+    RoutePolicyAction action;
+};
+
+struct PrefixList {
+    std::list<PrefixListEntry> entries;
+};
+
 struct RoutePolicyEntry {
     // match
     std::optional<NLRI> match_prefix_v4;
+    std::optional<std::string> match_prefix_list;
     std::optional<address_v4> match_nexthop;
     std::optional<uint32_t> match_localpref;
+    std::optional<std::string> match_as_path;
+    // matches if path has any of communities: "asn:value" is standard, "rt:asn:value"
+    // and "soo:asn:value" are extended, "asn:value1:value2" is large community
+    std::list<std::string> match_community;
 
     // action
     std::optional<address_v4> set_nexthop;
     std::optional<uint32_t> set_localpref;
+    // communities are deleted before new ones are added
+    std::list<std::string> add_community;
+    std::list<std::string> delete_community;
     RoutePolicyAction action;
 };
 
@@ -42,10 +83,30 @@ struct GlobalConf {
     uint32_t my_as;
     address_v4 bgp_router_id;
     uint16_t hold_time;
+    std::optional<uint16_t> graceful_restart_time;
+    std::optional<std::string> snapshot_path;
+    std::optional<uint32_t> snapshot_interval;
+    std::optional<uint32_t> bmp_stats_interval;
+    // maximum number of equal cost paths installed for prefix
+    std::optional<uint16_t> max_paths;
+    // data plane for best paths: "vpp", "netlink" or "recorder"
+    std::optional<std::string> fib_backend;
+    // routing table of data plane, main table by default
+    std::optional<uint32_t> fib_table;
+    // on start program only difference between data plane and table,
+    // VPP table must be dedicated to bgp++ for this
+    bool fib_reconcile;
+    // source of IGP routes for next hop resolution: "file" or "netlink"
+    std::optional<std::string> nexthop_resolution;
+    std::optional<std::string> igp_routes_file;
+    // route reflector cluster, router id is used if it is not set
+    std::optional<address_v4> cluster_id;
 
     std::list<bgp_neighbour_v4> neighbours;
     std::list<OrigEntry> originate_routes;
+    std::list<bmp_collector_v4> bmp_collectors;
     std::map<std::string,RoutePolicy> policies;
+    std::map<std::string,PrefixList> prefix_lists;
 };
 
 #endif
\ No newline at end of file
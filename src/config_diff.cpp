@@ -0,0 +1,151 @@
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "config_diff.hpp"
+#include "config.hpp"
+
+static bool same( const PrefixListEntry &a, const PrefixListEntry &b ) {
+    return std::tie( a.prefix, a.ge, a.le, a.action ) == std::tie( b.prefix, b.ge, b.le, b.action );
+}
+
+static bool same( const RoutePolicyEntry &a, const RoutePolicyEntry &b ) {
+    return
+        std::tie( a.match_prefix_v4, a.match_prefix_list, a.match_nexthop, a.match_localpref, a.match_as_path, a.match_community ) ==
+        std::tie( b.match_prefix_v4, b.match_prefix_list, b.match_nexthop, b.match_localpref, b.match_as_path, b.match_community ) &&
+        std::tie( a.set_nexthop, a.set_localpref, a.add_community, a.delete_community, a.action ) ==
+        std::tie( b.set_nexthop, b.set_localpref, b.add_community, b.delete_community, b.action );
+}
+
+static bool same( const bmp_collector_v4 &a, const bmp_collector_v4 &b ) {
+    return a.address == b.address && a.port == b.port;
+}
+
+template<typename T>
+static bool same( const std::list<T> &a, const std::list<T> &b ) {
+    return std::equal( a.begin(), a.end(), b.begin(), b.end(), []( const T &x, const T &y ) { return same( x, y ); } );
+}
+
+// names of entries which are only in one map or differ
+template<typename T>
+static std::set<std::string> changed_names( const std::map<std::string,T> &running, const std::map<std::string,T> &next ) {
+    std::set<std::string> names;
+    for( auto const &[ name, value ]: running ) {
+        auto it = next.find( name );
+        if( it == next.end() || !same( value.entries, it->second.entries ) ) {
+            names.insert( name );
+        }
+    }
+    for( auto const &[ name, value ]: next ) {
+        if( running.count( name ) == 0 ) {
+            names.insert( name );
+        }
+    }
+    return names;
+}
+
+static void diff_neighbours( const GlobalConf &running, const GlobalConf &next, config_diff &diff ) {
+    std::map<address_v4,const bgp_neighbour_v4*> current;
+    for( auto const &nei: running.neighbours ) {
+        current.emplace( nei.address, &nei );
+    }
+    std::set<address_v4> seen;
+    for( auto const &nei: next.neighbours ) {
+        if( !seen.insert( nei.address ).second ) {
+            throw std::runtime_error( "Duplicate neighbour: " + nei.address.to_string() );
+        }
+        auto it = current.find( nei.address );
+        if( it == current.end() ) {
+            diff.added_neighbours.push_back( nei.address );
+            continue;
+        }
+        auto const &old = *it->second;
+        if(
+            std::tie( old.remote_as, old.hold_time, old.add_path_receive, old.add_path_backups, old.ipv6_unicast, old.passive, old.port ) !=
+            std::tie( nei.remote_as, nei.hold_time, nei.add_path_receive, nei.add_path_backups, nei.ipv6_unicast, nei.passive, nei.port )
+        ) {
+            diff.reset_neighbours.push_back( nei.address );
+            continue;
+        }
+        if( old.import_policy != nei.import_policy ) {
+            diff.import_changed.push_back( nei.address );
+        }
+        if( old.export_policy != nei.export_policy || old.route_reflector_client != nei.route_reflector_client ) {
+            diff.export_changed.push_back( nei.address );
+        }
+    }
+    for( auto const &[ address, nei ]: current ) {
+        if( seen.count( address ) == 0 ) {
+            diff.removed_neighbours.push_back( address );
+        }
+    }
+}
+
+static void diff_routes( const GlobalConf &running, const GlobalConf &next, config_diff &diff ) {
+    std::map<NLRI,const OrigEntry*> current;
+    for( auto const &route: running.originate_routes ) {
+        current.emplace( route.prefix, &route );
+    }
+    std::set<NLRI> seen;
+    for( auto const &route: next.originate_routes ) {
+        if( !seen.insert( route.prefix ).second ) {
+            throw std::runtime_error( "Duplicate originated route: " + route.prefix.to_string() );
+        }
+        auto it = current.find( route.prefix );
+        if( it == current.end() || it->second->policy_name != route.policy_name ) {
+            diff.changed_routes.insert( route.prefix );
+        }
+    }
+    for( auto const &[ prefix, route ]: current ) {
+        if( seen.count( prefix ) == 0 ) {
+            diff.changed_routes.insert( prefix );
+        }
+    }
+}
+
+config_diff diff_config( const GlobalConf &running, const GlobalConf &next ) {
+    config_diff diff;
+    auto check = [ &diff ]( bool unchanged, const char *name ) {
+        if( !unchanged ) {
+            diff.restart_required.push_back( name );
+        }
+    };
+    check( running.listen_on_port == next.listen_on_port, "listen_on_port" );
+    check( running.my_as == next.my_as, "my_as" );
+    check( running.bgp_router_id == next.bgp_router_id, "bgp_router_id" );
+    check( running.hold_time == next.hold_time, "hold_time" );
+    check( running.graceful_restart_time == next.graceful_restart_time, "graceful_restart_time" );
+    check( running.snapshot_path == next.snapshot_path, "snapshot_path" );
+    check( running.snapshot_interval == next.snapshot_interval, "snapshot_interval" );
+    check( running.bmp_stats_interval == next.bmp_stats_interval, "bmp_stats_interval" );
+    check( running.max_paths == next.max_paths, "max_paths" );
+    check( running.fib_backend == next.fib_backend, "fib_backend" );
+    check( running.fib_table == next.fib_table, "fib_table" );
+    check( running.fib_reconcile == next.fib_reconcile, "fib_reconcile" );
+    check( running.nexthop_resolution == next.nexthop_resolution, "nexthop_resolution" );
+    check( running.igp_routes_file == next.igp_routes_file, "igp_routes_file" );
+    check( running.cluster_id == next.cluster_id, "cluster_id" );
+    check( same( running.bmp_collectors, next.bmp_collectors ), "bmp_collectors" );
+
+    diff_neighbours( running, next, diff );
+    diff_routes( running, next, diff );
+
+    // policies are compiled with prefix lists, so users of changed list are changed too
+    auto lists = changed_names( running.prefix_lists, next.prefix_lists );
+    diff.prefix_lists_changed = !lists.empty();
+    diff.changed_policies = changed_names( running.policies, next.policies );
+    for( auto const *policies: { &running.policies, &next.policies } ) {
+        for( auto const &[ name, pol ]: *policies ) {
+            for( auto const &entry: pol.entries ) {
+                if( entry.match_prefix_list && lists.count( *entry.match_prefix_list ) > 0 ) {
+                    diff.changed_policies.insert( name );
+                }
+            }
+        }
+    }
+    return diff;
+}
@@ -0,0 +1,34 @@
+#ifndef CONFIG_DIFF_HPP_
+#define CONFIG_DIFF_HPP_
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "nlri.hpp"
+
+struct GlobalConf;
+
+// Difference of new configuration from running one. Neighbours, policies, prefix
+// lists and originated routes are applied at runtime, other settings on restart.
+struct config_diff {
+    std::vector<address_v4> added_neighbours;
+    std::vector<address_v4> removed_neighbours;
+    // parameters of OPEN changed, session has to be established again
+    std::vector<address_v4> reset_neighbours;
+    std::vector<address_v4> import_changed;
+    // export policy or route reflector client flag changed
+    std::vector<address_v4> export_changed;
+    // policies which are added, removed or changed, also these which use changed prefix list
+    std::set<std::string> changed_policies;
+    bool prefix_lists_changed;
+    // originated prefixes which are added, removed or have other policy
+    std::set<NLRI> changed_routes;
+    // global settings which differ
+    std::vector<std::string> restart_required;
+};
+
+// throws std::runtime_error when new configuration is inconsistent
+config_diff diff_config( const GlobalConf &running, const GlobalConf &next );
+
+#endif
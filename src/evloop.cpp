@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <boost/asio/ip/address_v4.hpp>
+#include <yaml-cpp/yaml.h>
 
 using address_v4 = boost::asio::ip::address_v4;
 
@@ -9,22 +11,45 @@ using address_v4 = boost::asio::ip::address_v4;
 #include "config.hpp"
 #include "fsm.hpp"
 #include "packet.hpp"
+#include "yaml.hpp"
+#include "config_diff.hpp"
 
 extern Logger logger;
 
-EVLoop::EVLoop( boost::asio::io_context &i, GlobalConf &c ):
-    io( i ),
+EVLoop::EVLoop( boost::asio::io_context &i, GlobalConf &c, std::string path ):
+    timers( i ),
+    table( i, c ),
+    table_v6( i, c, table ),
+    snapshot( i, c, table, table_v6 ),
+    bmp( i, c, table ),
+    fib( i, c, table ),
+    feed( table, table_v6 ),
     conf( c ),
+    config_path( std::move( path ) ),
+    io( i ),
     accpt( i, endpoint( boost::asio::ip::tcp::v4(), c.listen_on_port ) ),
-    sock( i ),
-    table( i, c )
+    sock( i )
 {
+    neighbours.reserve( c.neighbours.size() );
     for( auto &nei: c.neighbours ) {
-        neighbours.emplace( nei.address, std::make_shared<bgp_fsm>( io, c, table, nei ) );
+        neighbours.emplace( nei.address, std::make_shared<bgp_fsm>( io, timers, buffers, c, table, nei ) );
     }
 }
 
 void EVLoop::start() {
+    // IGP routes are needed to resolve next hops of restored paths
+    table.nht.start();
+    if( snapshot.load( neighbours ) ) {
+        for( auto &[ address, nei ]: neighbours ) {
+            nei->warm_restart = true;
+        }
+    }
+    snapshot.start();
+    for( auto &[ address, nei ]: neighbours ) {
+        nei->start();
+    }
+    bmp.start();
+    fib.start();
     accpt.async_accept( sock, std::bind( &EVLoop::on_accept, shared_from_this(), std::placeholders::_1 ) );
 }
 
@@ -42,3 +67,92 @@ void EVLoop::on_accept( const boost::system::error_code &ec ) {
     }
     accpt.async_accept( sock, std::bind( &EVLoop::on_accept, shared_from_this(), std::placeholders::_1 ) );
 }
+
+std::vector<std::string> EVLoop::reload() {
+    GlobalConf next = YAML::LoadFile( config_path ).as<GlobalConf>();
+    auto diff = diff_config( conf, next );
+    std::vector<std::string> changes;
+    for( auto const &name: diff.restart_required ) {
+        changes.push_back( "Change of " + name + " is applied on restart" );
+    }
+    auto listed = []( const std::vector<address_v4> &addresses, const address_v4 &address ) {
+        return std::find( addresses.begin(), addresses.end(), address ) != addresses.end();
+    };
+
+    conf.policies = std::move( next.policies );
+    conf.prefix_lists = std::move( next.prefix_lists );
+    auto policies = table.reload_policies( diff.changed_policies, diff.prefix_lists_changed );
+    for( auto const &name: policies ) {
+        changes.push_back( "Policy " + name + " is changed" );
+    }
+    auto policy_changed = [ &policies ]( const std::optional<std::string> &name ) {
+        return name && policies.count( *name ) > 0;
+    };
+
+    for( auto const &address: diff.removed_neighbours ) {
+        auto it = neighbours.find( address );
+        it->second->stop();
+        it->second->shutdown( BGP_CEASE_ERR::PEER_DECONF );
+        neighbours.erase( it );
+        auto nei = std::find_if( conf.neighbours.begin(), conf.neighbours.end(), [ &address ]( const bgp_neighbour_v4 &n ) { return n.address == address; } );
+        retired_neighbours.splice( retired_neighbours.end(), conf.neighbours, nei );
+        changes.push_back( "Neighbour " + address.to_string() + " is removed" );
+    }
+    for( auto const &nei: next.neighbours ) {
+        auto it = neighbours.find( nei.address );
+        if( it == neighbours.end() ) {
+            auto &added = conf.neighbours.emplace_back( nei );
+            auto fsm = std::make_shared<bgp_fsm>( io, timers, buffers, conf, table, added );
+            neighbours.emplace( nei.address, fsm );
+            fsm->start();
+            changes.push_back( "Neighbour " + nei.address.to_string() + " is added" );
+            continue;
+        }
+        auto fsm = it->second;
+        bool had_import = fsm->conf.import_policy.has_value();
+        bool rr_client = fsm->conf.route_reflector_client;
+        bool import = listed( diff.import_changed, nei.address ) || policy_changed( nei.import_policy );
+        bool exports = listed( diff.export_changed, nei.address ) || policy_changed( nei.export_policy );
+        // fsm refers to this element of neighbour list
+        fsm->conf = nei;
+        if( listed( diff.reset_neighbours, nei.address ) ) {
+            fsm->shutdown( BGP_CEASE_ERR::OTH_CONF_CHANGE );
+            changes.push_back( "Session with neighbour " + nei.address.to_string() + " is reset" );
+            continue;
+        }
+        if( import ) {
+            fsm->reimport( had_import );
+            changes.push_back( "Import policy of neighbour " + nei.address.to_string() + " is applied again" );
+        }
+        if( exports ) {
+            fsm->readvertise();
+            changes.push_back( "Routes are advertised again to neighbour " + nei.address.to_string() );
+        }
+        if( rr_client != nei.route_reflector_client ) {
+            // reflection of paths received from this neighbour to other iBGP peers changes
+            table.schedule_peer_updates( fsm );
+            table_v6.schedule_peer_updates( fsm );
+        }
+    }
+
+    conf.originate_routes = std::move( next.originate_routes );
+    for( auto const &prefix: diff.changed_routes ) {
+        auto route = std::find_if( conf.originate_routes.begin(), conf.originate_routes.end(), [ &prefix ]( const OrigEntry &r ) { return r.prefix == prefix; } );
+        if( route == conf.originate_routes.end() ) {
+            table.del_path( prefix, nullptr );
+            changes.push_back( "Route " + prefix.to_string() + " is not originated anymore" );
+        }
+    }
+    for( auto const &route: conf.originate_routes ) {
+        if( diff.changed_routes.count( route.prefix ) > 0 || policy_changed( route.policy_name ) ) {
+            table.originate( route );
+            changes.push_back( "Route " + route.prefix.to_string() + " is originated" );
+        }
+    }
+
+    logger.logInfo() << LOGS::EVENT_LOOP << "Configuration is reloaded, " << changes.size() << " changes" << std::endl;
+    for( auto const &change: changes ) {
+        logger.logInfo() << LOGS::EVENT_LOOP << change << std::endl;
+    }
+    return changes;
+}
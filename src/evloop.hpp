@@ -2,26 +2,53 @@
 #define EVLOOP_HPP
 
 #include <set>
+#include <list>
+#include <string>
+#include <vector>
 #include <boost/asio.hpp>
 #include <boost/asio/steady_timer.hpp>
 
 #include "table.hpp"
+#include "table_v6.hpp"
 #include "fsm.hpp"
+#include "snapshot.hpp"
+#include "bmp.hpp"
+#include "fib.hpp"
+#include "rib_feed.hpp"
+#include "timer_wheel.hpp"
+#include "buffer_pool.hpp"
+#include "neighbour_index.hpp"
 
 struct GlobalConf;
 struct bgp_fsm;
+struct bgp_neighbour_v4;
 
 class EVLoop : public std::enable_shared_from_this<EVLoop> {
 public:
-    EVLoop( boost::asio::io_context &i, GlobalConf &c );
+    EVLoop( boost::asio::io_context &i, GlobalConf &c, std::string path );
     void start();
+    // loads configuration file again and applies its difference from running configuration,
+    // returns description of applied changes, throws when file can't be loaded
+    std::vector<std::string> reload();
     
-    std::map<address_v4,std::shared_ptr<bgp_fsm>> neighbours;
+    // session timers of all neighbours, it outlives them
+    timer_wheel timers;
+    // receive buffers of all neighbours
+    buffer_pool buffers;
+    neighbour_index neighbours;
     bgp_table_v4 table;
+    bgp_table_v6 table_v6;
+    bgp_snapshot snapshot;
+    bmp_exporter bmp;
+    fib_pipeline fib;
+    rib_feed feed;
 private:
     void on_accept( const boost::system::error_code &ec );
 
     GlobalConf &conf;
+    std::string config_path;
+    // configuration of removed neighbours, their sessions may still have pending handlers
+    std::list<bgp_neighbour_v4> retired_neighbours;
     // asio
     boost::asio::io_context &io;
     boost::asio::ip::tcp::acceptor accpt;
@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <linux/rtnetlink.h>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "fib.hpp"
+#include "table.hpp"
+#include "config.hpp"
+#include "log.hpp"
+#include "string_utils.hpp"
+#include "nlri.hpp"
+#include "netlink.hpp"
+#ifdef BUILD_VPP
+#include "vpp.hpp"
+#endif
+
+extern Logger logger;
+
+bool fib_recorder::connect() {
+    connects++;
+    if( fail_connects > 0 ) {
+        fail_connects--;
+        return false;
+    }
+    return true;
+}
+
+void fib_recorder::lose_connection() {
+    pending.clear();
+    if( on_lost ) {
+        on_lost();
+    }
+}
+
+void fib_recorder::restart() {
+    routes.clear();
+    lose_connection();
+}
+
+bool fib_recorder::submit( uint32_t context, const fib_route &route ) {
+    if( pending.size() >= queue_size ) {
+        return false;
+    }
+    call c { route.prefix, {}, route.group != nullptr };
+    if( route.group ) {
+        c.nexthops = route.group->nexthops;
+    }
+    if( fail_next > 0 ) {
+        fail_next--;
+        pending.push_back( { context, false } );
+    } else {
+        if( c.is_add ) {
+            routes[ c.prefix ] = c.nexthops;
+        } else {
+            routes.erase( c.prefix );
+        }
+        pending.push_back( { context, true } );
+    }
+    calls.push_back( std::move( c ) );
+    return true;
+}
+
+void fib_recorder::poll( std::vector<fib_reply> &replies ) {
+    replies.insert( replies.end(), pending.begin(), pending.end() );
+    pending.clear();
+}
+
+bool fib_recorder::dump( std::vector<fib_entry> &out ) {
+    for( auto const &[ prefix, nexthops ]: routes ) {
+        out.push_back( { prefix, nexthops } );
+    }
+    return true;
+}
+
+// interface is compared only when we choose it, otherwise data plane resolves it
+static bool same_nexthops( const std::vector<fib_nexthop> &fib, const std::vector<fib_nexthop> &rib ) {
+    return std::equal( fib.begin(), fib.end(), rib.begin(), rib.end(), []( const fib_nexthop &installed, const fib_nexthop &wanted ) {
+        return installed.gateway == wanted.gateway && ( wanted.ifindex == 0 || installed.ifindex == wanted.ifindex );
+    });
+}
+
+fib_pipeline::fib_pipeline( boost::asio::io_context &i, GlobalConf &c, bgp_table_v4 &t ):
+    io( i ),
+    conf( c ),
+    table( t ),
+    poll_timer( i ),
+    reconnect_timer( i ),
+    connected( false ),
+    reconnect_delay( FIB_RECONNECT_MIN_DELAY ),
+    next_context( 1 ),
+    flush_scheduled( false ),
+    polling( false ),
+    installed( 0 ),
+    failed( 0 )
+{}
+
+void fib_pipeline::start() {
+    if( !conf.fib_backend.has_value() ) {
+        return;
+    }
+    if( *conf.fib_backend == "recorder" ) {
+        start( std::make_unique<fib_recorder>() );
+    } else if( *conf.fib_backend == "netlink" ) {
+        start( std::make_unique<netlink_api>( conf.fib_table.value_or( RT_TABLE_MAIN ) ) );
+#ifdef BUILD_VPP
+    } else if( *conf.fib_backend == "vpp" ) {
+        start( std::make_unique<vpp_api>( conf.fib_table.value_or( 0 ) ) );
+#endif
+    } else {
+        logger.logError() << LOGS::FIB << "Unknown FIB backend: " << *conf.fib_backend << std::endl;
+    }
+}
+
+void fib_pipeline::start( std::unique_ptr<fib_transport> t ) {
+    transport = std::move( t );
+    transport->set_lost_handler( [ this ]() {
+        boost::asio::post( io, std::bind( &fib_pipeline::on_connection_lost, this ) );
+    });
+    table.add_fib_listener( [ this ]( const NLRI &prefix, const std::shared_ptr<bgp_nexthop_group> &group ) {
+        on_route_change( prefix, group );
+    });
+    connect();
+}
+
+void fib_pipeline::connect() {
+    if( !transport->connect() ) {
+        logger.logError() << LOGS::FIB << "Cannot connect to FIB backend, next attempt in " << reconnect_delay.count() << " s" << std::endl;
+        reconnect_timer.expires_after( reconnect_delay );
+        reconnect_timer.async_wait( std::bind( &fib_pipeline::on_reconnect_timer, this, std::placeholders::_1 ) );
+        reconnect_delay = std::min( reconnect_delay * 2, FIB_RECONNECT_MAX_DELAY );
+        return;
+    }
+    connected = true;
+    reconnect_delay = FIB_RECONNECT_MIN_DELAY;
+    // changes made while we were disconnected are covered by whole table
+    if( !conf.fib_reconcile || !reconcile() ) {
+        // routes selected before we were connected
+        for( auto const &[ prefix, group ]: table.get_nexthop_groups() ) {
+            pending.emplace_hint( pending.end(), prefix, group );
+        }
+    }
+    schedule_flush();
+}
+
+void fib_pipeline::on_reconnect_timer( const boost::system::error_code &ec ) {
+    if( ec ) {
+        return;
+    }
+    connect();
+}
+
+void fib_pipeline::on_connection_lost() {
+    if( !connected ) {
+        return;
+    }
+    logger.logError() << LOGS::FIB << "Lost connection to FIB backend with " << inflight.size() << " requests in flight, reconnecting" << std::endl;
+    connected = false;
+    // replies of lost connection never come, state of data plane is read again after reconnect
+    pending.clear();
+    retries.clear();
+    inflight.clear();
+    busy.clear();
+    connect();
+}
+
+bool fib_pipeline::reconcile() {
+    std::vector<fib_entry> dumped;
+    if( !transport->dump( dumped ) ) {
+        logger.logError() << LOGS::FIB << "Cannot read routes from FIB backend, programming full table" << std::endl;
+        return false;
+    }
+    std::sort( dumped.begin(), dumped.end(), []( const fib_entry &lhs, const fib_entry &rhs ) {
+        return lhs.prefix < rhs.prefix;
+    });
+
+    // both sides are sorted by prefix, so walk them in lockstep
+    auto const &groups = table.get_nexthop_groups();
+    auto fibIt = dumped.begin();
+    auto ribIt = groups.begin();
+    std::size_t added = 0;
+    std::size_t changed = 0;
+    std::size_t removed = 0;
+    while( fibIt != dumped.end() || ribIt != groups.end() ) {
+        if( ribIt == groups.end() || ( fibIt != dumped.end() && fibIt->prefix < ribIt->first ) ) {
+            pending.emplace_hint( pending.end(), fibIt->prefix, nullptr );
+            removed++;
+            fibIt++;
+        } else if( fibIt == dumped.end() || ribIt->first < fibIt->prefix ) {
+            pending.emplace_hint( pending.end(), ribIt->first, ribIt->second );
+            added++;
+            ribIt++;
+        } else {
+            if( !same_nexthops( fibIt->nexthops, ribIt->second->nexthops ) ) {
+                pending.emplace_hint( pending.end(), ribIt->first, ribIt->second );
+                changed++;
+            }
+            fibIt++;
+            ribIt++;
+        }
+    }
+    logger.logInfo() << LOGS::FIB << "FIB reconciliation: " << dumped.size() << " routes in data plane, "
+        << added << " to add, " << changed << " to change, " << removed << " to remove" << std::endl;
+    return true;
+}
+
+void fib_pipeline::on_route_change( const NLRI &prefix, const std::shared_ptr<bgp_nexthop_group> &group ) {
+    if( !connected ) {
+        return;
+    }
+    pending[ prefix ] = group;
+    retries.erase( prefix );
+    schedule_flush();
+}
+
+void fib_pipeline::schedule_flush() {
+    if( flush_scheduled ) {
+        return;
+    }
+    flush_scheduled = true;
+    boost::asio::post( io, [ this ]() {
+        flush_scheduled = false;
+        flush();
+    });
+}
+
+void fib_pipeline::flush() {
+    if( !connected ) {
+        return;
+    }
+    if( inflight.empty() ) {
+        batch_start = std::chrono::steady_clock::now();
+    }
+    std::size_t submitted = 0;
+    for( auto it = pending.begin(); it != pending.end() && submitted < FIB_BATCH_SIZE && inflight.size() < FIB_MAX_INFLIGHT; ) {
+        if( busy.count( it->first ) > 0 ) {
+            it++;
+            continue;
+        }
+        auto context = next_context++;
+        fib_route route { it->first, it->second };
+        if( !transport->submit( context, route ) ) {
+            break;
+        }
+        auto retryIt = retries.find( it->first );
+        uint32_t attempts = retryIt != retries.end() ? retryIt->second : 0;
+        busy.emplace( it->first, context );
+        inflight.emplace( context, inflight_entry { std::move( route ), attempts + 1 } );
+        it = pending.erase( it );
+        submitted++;
+    }
+    if( submitted == FIB_BATCH_SIZE ) {
+        // let other handlers run between batches
+        schedule_flush();
+    }
+    if( !inflight.empty() || !pending.empty() ) {
+        start_poll_timer();
+    }
+}
+
+void fib_pipeline::start_poll_timer() {
+    if( polling ) {
+        return;
+    }
+    polling = true;
+    poll_timer.expires_after( std::chrono::milliseconds( 1 ) );
+    poll_timer.async_wait( std::bind( &fib_pipeline::on_poll_timer, this, std::placeholders::_1 ) );
+}
+
+void fib_pipeline::on_poll_timer( const boost::system::error_code &ec ) {
+    polling = false;
+    if( ec || !connected ) {
+        return;
+    }
+    std::vector<fib_reply> replies;
+    transport->poll( replies );
+    for( auto const &reply: replies ) {
+        auto it = inflight.find( reply.context );
+        if( it == inflight.end() ) {
+            continue;
+        }
+        auto &entry = it->second;
+        busy.erase( entry.route.prefix );
+        if( reply.success ) {
+            installed++;
+            retries.erase( entry.route.prefix );
+        } else if( pending.count( entry.route.prefix ) == 0 ) {
+            // retry only if there is no newer state of prefix pending
+            if( entry.attempts < FIB_MAX_RETRIES ) {
+                retries[ entry.route.prefix ] = entry.attempts;
+                pending.emplace( entry.route.prefix, entry.route.group );
+            } else {
+                failed++;
+                retries.erase( entry.route.prefix );
+                logger.logError() << LOGS::FIB << "Cannot program route " << entry.route.prefix << " after " << entry.attempts << " attempts" << std::endl;
+            }
+        }
+        inflight.erase( it );
+    }
+
+    if( inflight.empty() && pending.empty() && !replies.empty() ) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - batch_start );
+        logger.logInfo() << LOGS::FIB << "FIB is in sync, programmed " << installed << " routes, failed " << failed
+            << ", last burst took " << elapsed.count() << " ms" << std::endl;
+    }
+    flush();
+}
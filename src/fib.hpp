@@ -0,0 +1,148 @@
+#ifndef FIB_HPP_
+#define FIB_HPP_
+
+#include <map>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "nlri.hpp"
+#include "nexthop.hpp"
+
+struct GlobalConf;
+struct bgp_nexthop_group;
+class bgp_table_v4;
+
+// number of route operations submitted in one event loop turn
+static constexpr std::size_t FIB_BATCH_SIZE = 4096;
+// maximum number of requests waiting for reply from data plane
+static constexpr std::size_t FIB_MAX_INFLIGHT = 16384;
+static constexpr uint32_t FIB_MAX_RETRIES = 5;
+// delay before reconnect to data plane, it is doubled after every failed attempt
+static constexpr std::chrono::seconds FIB_RECONNECT_MIN_DELAY { 1 };
+static constexpr std::chrono::seconds FIB_RECONNECT_MAX_DELAY { 60 };
+
+// route operation, route is removed when group is empty
+struct fib_route {
+    NLRI prefix;
+    std::shared_ptr<bgp_nexthop_group> group;
+};
+
+// route found in data plane, next hops are sorted
+struct fib_entry {
+    NLRI prefix;
+    std::vector<fib_nexthop> nexthops;
+};
+
+struct fib_reply {
+    uint32_t context;
+    bool success;
+};
+
+// Asynchronous request/reply channel to data plane API, implemented by
+// vpp_api, netlink_api and fib_recorder
+class fib_transport {
+public:
+    // called once when connection is lost, possibly from other thread
+    using lost_handler = std::function<void()>;
+
+    virtual ~fib_transport() = default;
+    // also connects again after loss, requests of previous connection are forgotten
+    virtual bool connect() = 0;
+    // false if request queue is full, request should be submitted again later
+    virtual bool submit( uint32_t context, const fib_route &route ) = 0;
+    virtual void poll( std::vector<fib_reply> &replies ) = 0;
+    // reads routes previously installed by bgp++, false if backend cannot do this
+    virtual bool dump( std::vector<fib_entry> & ) { return false; }
+    void set_lost_handler( lost_handler handler ) { on_lost = std::move( handler ); }
+protected:
+    lost_handler on_lost;
+};
+
+// In-memory data plane, records all requests and replies on next poll.
+// Used instead of real data plane for testing and benchmarks
+class fib_recorder : public fib_transport {
+public:
+    struct call {
+        NLRI prefix;
+        std::vector<fib_nexthop> nexthops;
+        bool is_add;
+    };
+
+    bool connect() override;
+    bool submit( uint32_t context, const fib_route &route ) override;
+    void poll( std::vector<fib_reply> &replies ) override;
+    bool dump( std::vector<fib_entry> &routes ) override;
+    // emulates lost connection, data plane keeps its routes
+    void lose_connection();
+    // emulates restart of data plane, which forgets all routes
+    void restart();
+
+    std::vector<call> calls;
+    // resulting forwarding table
+    std::map<NLRI,std::vector<fib_nexthop>> routes;
+    // emulates size of request queue
+    std::size_t queue_size = FIB_MAX_INFLIGHT;
+    // number of next requests, which will be answered with error
+    std::size_t fail_next = 0;
+    // number of next connect attempts, which fail
+    std::size_t fail_connects = 0;
+    std::size_t connects = 0;
+private:
+    std::vector<fib_reply> pending;
+};
+
+// Downloads forwarding state of bgp_table_v4 to data plane. Changes are coalesced
+// per prefix, so only the latest state is programmed, and submitted in batches
+// without waiting for replies. With fib_reconcile routes already present in
+// data plane are compared with the table and only the difference is programmed.
+// When connection to data plane is lost, e.g. VPP restarts, it is reestablished
+// with backoff and data plane is brought to state of the whole table again.
+class fib_pipeline {
+public:
+    fib_pipeline( boost::asio::io_context &i, GlobalConf &c, bgp_table_v4 &t );
+    void start();
+    void start( std::unique_ptr<fib_transport> t );
+    void on_route_change( const NLRI &prefix, const std::shared_ptr<bgp_nexthop_group> &group );
+private:
+    struct inflight_entry {
+        fib_route route;
+        uint32_t attempts;
+    };
+
+    void connect();
+    void on_reconnect_timer( const boost::system::error_code &ec );
+    void on_connection_lost();
+    bool reconcile();
+    void schedule_flush();
+    void flush();
+    void start_poll_timer();
+    void on_poll_timer( const boost::system::error_code &ec );
+
+    boost::asio::io_context &io;
+    GlobalConf &conf;
+    bgp_table_v4 &table;
+    boost::asio::steady_timer poll_timer;
+    boost::asio::steady_timer reconnect_timer;
+    std::unique_ptr<fib_transport> transport;
+    bool connected;
+    std::chrono::seconds reconnect_delay;
+
+    // latest not yet submitted state of prefix
+    std::map<NLRI,std::shared_ptr<bgp_nexthop_group>> pending;
+    std::map<NLRI,uint32_t> retries;
+    std::map<uint32_t,inflight_entry> inflight;
+    // prefixes with request in flight, next change of prefix waits for reply to keep order
+    std::map<NLRI,uint32_t> busy;
+    uint32_t next_context;
+    bool flush_scheduled;
+    bool polling;
+
+    uint64_t installed;
+    uint64_t failed;
+    std::chrono::steady_clock::time_point batch_start;
+};
+
+#endif
@@ -2,6 +2,8 @@
 #include <vector>
 #include <tuple>
 #include <set>
+#include <cstring>
+#include <random>
 #include <boost/asio/ip/address_v4.hpp>
 #include <boost/asio/posix/stream_descriptor.hpp>
 
@@ -18,14 +20,73 @@ using address_v4 = boost::asio::ip::address_v4;
 extern Logger logger;
 extern std::shared_ptr<EVLoop> runtime;
 
-bgp_fsm::bgp_fsm( io_context &io,  GlobalConf &g, bgp_table_v4 &t, bgp_neighbour_v4 &c ):
+// hold time until OPEN of peer is received
+static constexpr uint16_t OPEN_HOLD_TIME = 240;
+
+// spread of first connects after start
+static constexpr std::chrono::milliseconds CONNECT_START_SPREAD { 5000 };
+static constexpr std::chrono::milliseconds CONNECT_RETRY_MIN { 2000 };
+static constexpr uint16_t CONNECT_RETRY_TIME = 120;
+static constexpr uint16_t BGP_PORT = 179;
+
+static std::minstd_rand jitter( std::random_device{}() );
+
+// time for peer to close connection after NOTIFICATION
+static constexpr std::chrono::seconds NOTIFICATION_LINGER { 5 };
+
+static void drain( std::shared_ptr<socket_tcp> closing, std::shared_ptr<timer> deadline ) {
+    auto buf = std::make_shared<std::array<uint8_t,4096>>();
+    closing->async_receive( boost::asio::buffer( *buf ), [ closing, deadline, buf ]( error_code ec, std::size_t ) {
+        if( ec ) {
+            deadline->cancel();
+            return;
+        }
+        drain( closing, deadline );
+    });
+}
+
+// Closing socket with unread data resets connection and peer may lose NOTIFICATION,
+// so received data is discarded until peer closes connection or deadline expires.
+static void close_with_notification( socket_tcp s, std::shared_ptr<std::vector<uint8_t>> pkt_buf ) {
+    auto closing = std::make_shared<socket_tcp>( std::move( s ) );
+    auto deadline = std::make_shared<timer>( closing->get_executor(), NOTIFICATION_LINGER );
+    deadline->async_wait( [ closing ]( error_code ) {
+        error_code ignored;
+        closing->close( ignored );
+    });
+    boost::asio::async_write( *closing, boost::asio::buffer( *pkt_buf ), [ closing, deadline, pkt_buf ]( error_code ec, std::size_t ) {
+        if( ec ) {
+            deadline->cancel();
+            return;
+        }
+        closing->shutdown( boost::asio::socket_base::shutdown_send, ec );
+        drain( closing, deadline );
+    });
+}
+
+bgp_fsm::bgp_fsm( io_context &io, timer_wheel &w, buffer_pool &b, GlobalConf &g, bgp_table_v4 &t, bgp_neighbour_v4 &c ):
     state( FSM_STATE::IDLE ),
+    io( io ),
     gconf( g ),
     conf( c ),
     table( t ),
-    ConnectRetryTimer( io ),
-    HoldTimer( io ),
-    KeepaliveTimer( io )
+    buffers( b ),
+    buffer_fill( 0 ),
+    writing( false ),
+    outbound( false ),
+    colliding_outbound( false ),
+    active( false ),
+    warm_restart( false ),
+    addpath_rx( false ),
+    addpath_tx( false ),
+    remote_router_id( 0 ),
+    ipv6_unicast( false ),
+    ConnectRetryCounter( 0 ),
+    ConnectRetryTimer( w ),
+    HoldTimer( w ),
+    KeepaliveTimer( w ),
+    GracefulRestartTimer( io ),
+    ConnectRetryTime( CONNECT_RETRY_TIME )
 {
     HoldTime = gconf.hold_time;
     if( conf.hold_time.has_value() ) {
@@ -33,16 +94,41 @@ bgp_fsm::bgp_fsm( io_context &io,  GlobalConf &g, bgp_table_v4 &t, bgp_neighbour
     }
 }
 
-void bgp_fsm::place_connection( socket_tcp s ) {
+void bgp_fsm::place_connection( socket_tcp s, bool initiated ) {
+    if( sock.has_value() && ( state == FSM_STATE::OPENSENT || state == FSM_STATE::OPENCONFIRM ) ) {
+        // newer connection replaces previous colliding one
+        colliding.emplace( std::move( s ) );
+        colliding_outbound = initiated;
+        logger.logInfo() << LOGS::FSM << "Connection collision with peer " << conf.address.to_string() << std::endl;
+        if( state == FSM_STATE::OPENCONFIRM ) {
+            resolve_collision();
+        }
+        return;
+    }
+    if( sock.has_value() && initiated ) {
+        // session is already established over connection from peer
+        close_with_notification( std::move( s ), build_notification( BGP_ERR_CODE::CEASE, static_cast<uint8_t>( BGP_CEASE_ERR::CONN_COLLISION_RES ), {} ) );
+        return;
+    }
     if( sock.has_value() ) {
-        sock->close();
-        sock.reset();
-
-        KeepaliveTimer.cancel();
+        // new connection from peer, which had session, means that peer was restarted
+        runtime->bmp.peer_down( shared_from_this(), BMP_PEER_DOWN::LOCAL_NO_NOTIFICATION, { 0, 0 } );
+        session_down( true );
     }
+    ConnectRetryTimer.cancel();
+    // negotiation of previous session lowered it and configuration may be reloaded
+    HoldTime = conf.hold_time.value_or( gconf.hold_time );
     sock.emplace( std::move( s ) );
+    // socket is read only after it is readable, read of spurious wakeup must not block
+    sock->non_blocking( true );
+    outbound = initiated;
+    buffer_fill = 0;
+    buffers.release( std::move( buffer ) );
+    send_queue.clear();
+    last_received = std::chrono::steady_clock::now();
+    start_hold_timer( OPEN_HOLD_TIME );
     auto const &endpoint = sock->remote_endpoint();
-    logger.logInfo() << LOGS::FSM << "Incoming connection: " << endpoint.address().to_string() << ":" << endpoint.port() << std::endl;
+    logger.logInfo() << LOGS::FSM << ( outbound ? "Outbound" : "Incoming" ) << " connection: " << endpoint.address().to_string() << ":" << endpoint.port() << std::endl;
     do_read();
     std::set<bgp_cap_t> capabilites;
     bgp_cap_t rr;
@@ -52,20 +138,135 @@ void bgp_fsm::place_connection( socket_tcp s ) {
     capabilites.emplace( rr );
     rr.make_mp_bgp( BGP_AFI::IPv4, BGP_SAFI::UNICAST );
     capabilites.emplace( rr );
+    if( conf.ipv6_unicast ) {
+        rr.make_mp_bgp( BGP_AFI::IPv6, BGP_SAFI::UNICAST );
+        capabilites.emplace( rr );
+    }
     rr.make_fqdn( "myhost", "mydomain" );
     capabilites.emplace( rr );
+    if( gconf.graceful_restart_time.has_value() ) {
+        rr.make_graceful_restart( *gconf.graceful_restart_time, warm_restart );
+        capabilites.emplace( rr );
+    }
+    auto add_path = static_cast<uint8_t>( ADD_PATH_DIR::NONE );
+    if( conf.add_path_receive ) {
+        add_path |= static_cast<uint8_t>( ADD_PATH_DIR::RECEIVE );
+    }
+    if( conf.add_path_backups.has_value() ) {
+        add_path |= static_cast<uint8_t>( ADD_PATH_DIR::SEND );
+    }
+    if( add_path != static_cast<uint8_t>( ADD_PATH_DIR::NONE ) ) {
+        rr.make_add_path( BGP_AFI::IPv4, BGP_SAFI::UNICAST, static_cast<ADD_PATH_DIR>( add_path ) );
+        capabilites.emplace( rr );
+    }
     tx_open( capabilites );
 }
 
-void bgp_fsm::start_keepalive_timer() {
-    KeepaliveTimer.expires_from_now( std::chrono::seconds( KeepaliveTime ) );
-    KeepaliveTimer.async_wait( std::bind( &bgp_fsm::on_keepalive_timer, shared_from_this(), std::placeholders::_1 ) );
+void bgp_fsm::start() {
+    active = true;
+    if( conf.passive ) {
+        return;
+    }
+    std::uniform_int_distribution<int64_t> delay( 0, CONNECT_START_SPREAD.count() );
+    ConnectRetryTimer.arm( std::chrono::milliseconds( delay( jitter ) ), [ self = shared_from_this() ]() {
+        self->connect();
+    });
+}
+
+void bgp_fsm::stop() {
+    active = false;
+    ConnectRetryTimer.cancel();
+    connecting.reset();
+    colliding.reset();
+}
+
+void bgp_fsm::connect() {
+    if( !active || conf.passive || sock.has_value() || connecting.has_value() ) {
+        return;
+    }
+    logger.logInfo() << LOGS::FSM << "Connecting to peer " << conf.address.to_string() << std::endl;
+    state = FSM_STATE::CONNECT;
+    connecting.emplace( io );
+    connecting->async_connect( endpoint( conf.address, conf.port.value_or( BGP_PORT ) ), std::bind( &bgp_fsm::on_connect, shared_from_this(), std::placeholders::_1 ) );
+    // connect which takes too long is abandoned and retried later
+    ConnectRetryTimer.arm( std::chrono::seconds( ConnectRetryTime ), [ self = shared_from_this() ]() {
+        self->connecting.reset();
+        self->start_connect_retry_timer();
+    });
 }
 
-void bgp_fsm::on_keepalive_timer( error_code ec ) {
+void bgp_fsm::on_connect( error_code ec ) {
+    if( ec == boost::asio::error::operation_aborted || !connecting.has_value() ) {
+        return;
+    }
+    ConnectRetryTimer.cancel();
+    auto s = std::move( *connecting );
+    connecting.reset();
     if( ec ) {
-        logger.logInfo() << LOGS::FSM << "Keepaliva timer: " << ec.message() << std::endl;
-        // todo change state
+        logger.logError() << LOGS::FSM << "Cannot connect to peer " << conf.address.to_string() << ": " << ec.message() << std::endl;
+        if( !sock.has_value() ) {
+            state = FSM_STATE::ACTIVE;
+            start_connect_retry_timer();
+        }
+        return;
+    }
+    place_connection( std::move( s ), true );
+}
+
+void bgp_fsm::start_connect_retry_timer() {
+    if( !active || conf.passive ) {
+        return;
+    }
+    std::chrono::milliseconds limit = std::chrono::seconds( ConnectRetryTime );
+    std::chrono::milliseconds backoff = CONNECT_RETRY_MIN * ( int64_t( 1 ) << std::min<uint64_t>( ConnectRetryCounter, 16 ) );
+    backoff = std::min( backoff, limit );
+    ConnectRetryCounter++;
+    // random half of interval, so peers which failed together don't retry together
+    std::uniform_int_distribution<int64_t> delay( backoff.count() / 2, backoff.count() );
+    ConnectRetryTimer.arm( std::chrono::milliseconds( delay( jitter ) ), [ self = shared_from_this() ]() {
+        self->connect();
+    });
+}
+
+void bgp_fsm::resolve_collision() {
+    if( !colliding.has_value() ) {
+        return;
+    }
+    auto pkt_buf = build_notification( BGP_ERR_CODE::CEASE, static_cast<uint8_t>( BGP_CEASE_ERR::CONN_COLLISION_RES ), {} );
+    bool keep_outbound = gconf.bgp_router_id.to_uint() > remote_router_id;
+    // two connections of the same direction mean that peer started again, newer one is kept
+    if( outbound != colliding_outbound && outbound == keep_outbound ) {
+        logger.logInfo() << LOGS::FSM << "Collision with peer " << conf.address.to_string() << " is resolved, current connection is kept" << std::endl;
+        close_with_notification( std::move( *colliding ), pkt_buf );
+        colliding.reset();
+        return;
+    }
+    logger.logInfo() << LOGS::FSM << "Collision with peer " << conf.address.to_string() << " is resolved, other connection is kept" << std::endl;
+    auto winner = std::make_shared<socket_tcp>( std::move( *colliding ) );
+    bool initiated = colliding_outbound;
+    colliding.reset();
+    notify_and_close( BGP_ERR_CODE::CEASE, static_cast<uint8_t>( BGP_CEASE_ERR::CONN_COLLISION_RES ) );
+    session_down( false );
+    // packets of closed connection are still being processed, so new one is placed after them
+    boost::asio::post( io, [ self = shared_from_this(), winner, initiated ]() {
+        self->place_connection( std::move( *winner ), initiated );
+    });
+}
+
+void bgp_fsm::start_keepalive_timer() {
+    if( KeepaliveTime == 0 ) {
+        return;
+    }
+    // 75% to 100% of interval as RFC 4271 suggests
+    std::uniform_int_distribution<int> percent( 75, 100 );
+    std::chrono::milliseconds interval { KeepaliveTime * 10 * percent( jitter ) };
+    KeepaliveTimer.arm( interval, [ self = shared_from_this() ]() {
+        self->on_keepalive_timer();
+    });
+}
+
+void bgp_fsm::on_keepalive_timer() {
+    if( !sock.has_value() ) {
         return;
     }
     logger.logInfo() << LOGS::FSM << "Periodic KEEPALIVE" << std::endl;
@@ -73,12 +274,108 @@ void bgp_fsm::on_keepalive_timer( error_code ec ) {
     start_keepalive_timer();
 }
 
+void bgp_fsm::start_hold_timer( uint16_t hold_time ) {
+    if( hold_time == 0 ) {
+        HoldTimer.cancel();
+        return;
+    }
+    auto idle = std::chrono::steady_clock::now() - last_received;
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::seconds( hold_time ) - idle );
+    HoldTimer.arm( remaining, [ self = shared_from_this(), hold_time ]() {
+        self->on_hold_timer( hold_time );
+    });
+}
+
+void bgp_fsm::on_hold_timer( uint16_t hold_time ) {
+    if( !sock.has_value() ) {
+        return;
+    }
+    if( std::chrono::steady_clock::now() - last_received < std::chrono::seconds( hold_time ) ) {
+        // message was received since timer was armed
+        start_hold_timer( hold_time );
+        return;
+    }
+    logger.logError() << LOGS::FSM << "Hold timer expired for peer " << conf.address.to_string() << std::endl;
+    notify_and_close( BGP_ERR_CODE::HOLD_TIMER_EXPIRED, 0 );
+    session_down( false );
+}
+
+void bgp_fsm::start_graceful_restart_timer( uint16_t restart_time ) {
+    GracefulRestartTimer.expires_from_now( std::chrono::seconds( restart_time ) );
+    GracefulRestartTimer.async_wait( std::bind( &bgp_fsm::on_graceful_restart_timer, shared_from_this(), std::placeholders::_1 ) );
+}
+
+void bgp_fsm::on_graceful_restart_timer( error_code ec ) {
+    if( ec ) {
+        return;
+    }
+    logger.logInfo() << LOGS::FSM << "Graceful Restart timer expired for peer " << conf.address.to_string() << ", removing stale paths" << std::endl;
+    table.sweep_stale( shared_from_this() );
+}
+
+void bgp_fsm::session_down( bool graceful ) {
+    if( state == FSM_STATE::ESTABLISHED ) {
+        auto cap_it = std::find_if( caps.begin(), caps.end(), []( const bgp_cap_t &val ) -> bool { return val.code == BGP_CAP_CODE::GRACEFUL_RESTART; } );
+        if( graceful && gconf.graceful_restart_time.has_value() && cap_it != caps.end() && cap_it->get_restart_time() > 0 ) {
+            logger.logInfo() << LOGS::FSM << "Peer " << conf.address.to_string() << " is restarting, keeping its paths as stale" << std::endl;
+            table.mark_stale( shared_from_this() );
+            start_graceful_restart_timer( cap_it->get_restart_time() );
+        } else {
+            // clear all nlris from this peer
+            table.purge_peer( shared_from_this() );
+        }
+        // IPv6 paths are not kept for Graceful Restart
+        runtime->table_v6.purge_peer( shared_from_this() );
+    }
+    state = FSM_STATE::IDLE;
+    // memory of idle session is released, there may be thousands of them
+    caps = {};
+    sent_open = {};
+    received_open = {};
+    addpath_rx = false;
+    addpath_tx = false;
+    ipv6_unicast = false;
+    advertised_paths.clear();
+    adj_rib_in.clear();
+    buffer_fill = 0;
+    buffers.release( std::move( buffer ) );
+    KeepaliveTimer.cancel();
+    HoldTimer.cancel();
+    if( sock.has_value() ) {
+        sock->close();
+        sock.reset();
+    }
+    colliding.reset();
+    start_connect_retry_timer();
+}
+
+void bgp_fsm::shutdown( BGP_CEASE_ERR reason ) {
+    logger.logInfo() << LOGS::FSM << "Shutting down session with peer " << conf.address.to_string() << std::endl;
+    GracefulRestartTimer.cancel();
+    table.purge_peer( shared_from_this() );
+    runtime->table_v6.purge_peer( shared_from_this() );
+    if( sock.has_value() ) {
+        notify_and_close( BGP_ERR_CODE::CEASE, static_cast<uint8_t>( reason ) );
+    }
+    session_down( false );
+}
+
+void bgp_fsm::notify_and_close( BGP_ERR_CODE code, uint8_t subcode ) {
+    auto pkt_buf = build_notification( code, subcode, {} );
+    runtime->bmp.peer_down( shared_from_this(), BMP_PEER_DOWN::LOCAL_NOTIFICATION, *pkt_buf );
+    // pending reads and sends are aborted, socket is closed once NOTIFICATION is written
+    sock->cancel();
+    close_with_notification( std::move( *sock ), pkt_buf );
+    sock.reset();
+}
+
 void bgp_fsm::rx_open( bgp_packet &pkt ) {
     auto open = pkt.get_open();
 
     logger.logInfo() << LOGS::FSM << "Incoming OPEN packet from: " << sock->remote_endpoint().address().to_string() << std::endl;
     logger.logInfo() << LOGS::PACKET << open << std::endl;
 
+    received_open.assign( pkt.data, pkt.data + pkt.length );
     caps = open->parse_capabilites();
     for( auto const &cap: caps ) {
         logger.logInfo() << LOGS::PACKET << cap << std::endl;
@@ -89,10 +386,42 @@ void bgp_fsm::rx_open( bgp_packet &pkt ) {
         sock->close();
         return;
     }
+    remote_router_id = open->bgp_id.native();
+    if( colliding.has_value() ) {
+        resolve_collision();
+        if( !sock.has_value() ) {
+            return;
+        }
+    }
+
+    auto gr_it = std::find_if( caps.begin(), caps.end(), []( const bgp_cap_t &val ) -> bool { return val.code == BGP_CAP_CODE::GRACEFUL_RESTART; } );
+    if( gr_it == caps.end() || !gconf.graceful_restart_time.has_value() ) {
+        // peer doesn't support graceful restart anymore, so we cannot keep stale paths
+        GracefulRestartTimer.cancel();
+        table.sweep_stale( shared_from_this() );
+    }
+
+    auto peer_add_path = static_cast<uint8_t>( ADD_PATH_DIR::NONE );
+    for( auto const &cap: caps ) {
+        peer_add_path |= static_cast<uint8_t>( cap.get_add_path( BGP_AFI::IPv4, BGP_SAFI::UNICAST ) );
+    }
+    addpath_rx = conf.add_path_receive && ( peer_add_path & static_cast<uint8_t>( ADD_PATH_DIR::SEND ) );
+    addpath_tx = conf.add_path_backups.has_value() && ( peer_add_path & static_cast<uint8_t>( ADD_PATH_DIR::RECEIVE ) );
+    if( addpath_rx || addpath_tx ) {
+        logger.logInfo() << LOGS::FSM << "Negotiated ADD-PATH - receive: " << addpath_rx << " send: " << addpath_tx << std::endl;
+    }
+
+    ipv6_unicast = conf.ipv6_unicast && std::any_of( caps.begin(), caps.end(), []( const bgp_cap_t &cap ) {
+        return cap.is_mp_bgp( BGP_AFI::IPv6, BGP_SAFI::UNICAST );
+    });
+    if( ipv6_unicast ) {
+        logger.logInfo() << LOGS::FSM << "Negotiated IPv6 unicast" << std::endl;
+    }
 
     HoldTime = std::min( open->hold_time.native(), HoldTime );
     KeepaliveTime = HoldTime / 3;
     logger.logInfo() << LOGS::FSM << "Negotiated timers - hold_time: " << HoldTime << " keepalive_time: " << KeepaliveTime << std::endl;
+    start_hold_timer( HoldTime );
 
     tx_keepalive();
     state = FSM_STATE::OPENCONFIRM;
@@ -130,18 +459,52 @@ void bgp_fsm::tx_open( const std::set<bgp_cap_t> &caps ) {
     open->len = caps_bytes.size();
 
     pkt_buf->insert( pkt_buf->end(), caps_bytes.begin(), caps_bytes.end() );
+    sent_open = *pkt_buf;
 
     // send this msg
-    sock->async_send( boost::asio::buffer( *pkt_buf ), std::bind( &bgp_fsm::on_send, shared_from_this(), pkt_buf, std::placeholders::_1, std::placeholders::_2 ) );
+    send( pkt_buf );
     state = FSM_STATE::OPENSENT;
 }
 
-void bgp_fsm::on_send( std::shared_ptr<std::vector<uint8_t>> pkt, error_code ec, std::size_t length ) {
+void bgp_fsm::send( std::shared_ptr<std::vector<uint8_t>> pkt ) {
+    send_queue.push_back( std::move( pkt ) );
+    if( !writing ) {
+        start_write();
+    }
+}
+
+void bgp_fsm::start_write() {
+    if( !sock || send_queue.empty() ) {
+        return;
+    }
+    // batch is bound to handler only to keep messages alive until they are written
+    auto batch = std::make_shared<std::vector<std::shared_ptr<std::vector<uint8_t>>>>( send_queue.begin(), send_queue.end() );
+    send_queue.clear();
+    std::vector<boost::asio::const_buffer> bufs;
+    bufs.reserve( batch->size() );
+    for( auto const &pkt: *batch ) {
+        bufs.emplace_back( boost::asio::buffer( *pkt ) );
+    }
+    writing = true;
+    boost::asio::async_write( *sock, bufs, [ self = shared_from_this(), batch ]( error_code ec, std::size_t length ) {
+        self->on_send( ec, length );
+    });
+}
+
+void bgp_fsm::on_send( error_code ec, std::size_t length ) {
+    // write of closed connection is aborted, messages queued since then belong to new one
+    writing = false;
     if( ec ) {
-        logger.logError() << LOGS::FSM << "Error on sending packet: " << ec.message() << std::endl;
+        if( ec != boost::asio::error::operation_aborted ) {
+            logger.logError() << LOGS::FSM << "Error on sending packet: " << ec.message() << std::endl;
+            send_queue.clear();
+        } else {
+            start_write();
+        }
         return;
     }
-    logger.logInfo() << LOGS::FSM << "Successfully sent a message with size: " << length << std::endl;
+    logger.logInfo() << LOGS::FSM << "Successfully sent messages with size: " << length << std::endl;
+    start_write();
 }
 
 void bgp_fsm::tx_keepalive() {
@@ -158,14 +521,22 @@ void bgp_fsm::tx_keepalive() {
     std::fill( header->marker.begin(), header->marker.end(), 0xFF );
 
     // send this msg
-    sock->async_send( boost::asio::buffer( *pkt_buf ), std::bind( &bgp_fsm::on_send, shared_from_this(), pkt_buf, std::placeholders::_1, std::placeholders::_2 ) );
+    send( pkt_buf );
 }
 
-void bgp_fsm::rx_keepalive( bgp_packet &pkt ) {
+void bgp_fsm::rx_keepalive( bgp_packet & ) {
     if( state == FSM_STATE::OPENCONFIRM || state == FSM_STATE::OPENSENT ) {
         logger.logError() << LOGS::FSM << "BGP goes to ESTABLISHED state with peer: " << sock->remote_endpoint().address().to_string() << std::endl;
         state = FSM_STATE::ESTABLISHED;
+        ConnectRetryCounter = 0;
+        warm_restart = false;
         start_keepalive_timer();
+        auto gr_it = std::find_if( caps.begin(), caps.end(), []( const bgp_cap_t &val ) -> bool { return val.code == BGP_CAP_CODE::GRACEFUL_RESTART; } );
+        if( gr_it != caps.end() && gconf.graceful_restart_time.has_value() ) {
+            // stale paths will be removed after End-of-RIB or when this timer expires
+            start_graceful_restart_timer( gr_it->get_restart_time() );
+        }
+        runtime->bmp.peer_up( shared_from_this() );
         send_all_prefixes();
     } else if( state != FSM_STATE::ESTABLISHED ) {
         logger.logError() << LOGS::FSM << "Received a KEEPALIVE in incorrect state, closing connection" << std::endl;
@@ -175,12 +546,51 @@ void bgp_fsm::rx_keepalive( bgp_packet &pkt ) {
 }
 
 void bgp_fsm::rx_update( bgp_packet &pkt ) {
-    std::set<NLRI> schedule;
+    runtime->bmp.route_monitoring( shared_from_this(), pkt.data, pkt.length );
+
     auto cap_it = std::find_if( caps.begin(), caps.end(), []( const bgp_cap_t &val ) -> bool { return val.code == BGP_CAP_CODE::FOUR_OCT_AS; } );
     auto four_byte_asn = ( cap_it != caps.end() );
-    auto [ withdrawn_routes, path_attrs, routes ] = pkt.process_update( four_byte_asn );
+    auto [ withdrawn_routes, path_attrs, routes ] = pkt.process_update( four_byte_asn, addpath_rx );
+    auto mp = take_mp_nlri( path_attrs );
     logger.logInfo() << LOGS::FSM << "Received UPDATE message with withdrawn routes " << withdrawn_routes.size()
     << ", paths: " << path_attrs.size() << " and routes: " << routes.size() << std::endl;
+    if( mp.has_reach || mp.has_unreach ) {
+        logger.logInfo() << LOGS::FSM << "Received IPv6 withdrawn routes " << mp.withdrawn.size() << " and routes: " << mp.routes.size() << std::endl;
+        if( !ipv6_unicast ) {
+            logger.logError() << LOGS::FSM << "IPv6 unicast is not negotiated with peer " << conf.address.to_string() << ", ignoring IPv6 routes" << std::endl;
+            mp.routes.clear();
+            mp.withdrawn.clear();
+        }
+    }
+
+    if( mp.has_unreach && mp.withdrawn.empty() && !mp.has_reach && withdrawn_routes.empty() && path_attrs.empty() && routes.empty() ) {
+        logger.logInfo() << LOGS::FSM << "Received IPv6 End-of-RIB marker from peer " << conf.address.to_string() << std::endl;
+        return;
+    }
+
+    if( withdrawn_routes.empty() && path_attrs.empty() && routes.empty() && !mp.has_reach && !mp.has_unreach ) {
+        logger.logInfo() << LOGS::FSM << "Received End-of-RIB marker from peer " << conf.address.to_string() << std::endl;
+        GracefulRestartTimer.cancel();
+        table.sweep_stale( shared_from_this() );
+        return;
+    }
+
+    if( gconf.my_as == conf.remote_as ) {
+        // reflected path which we originated or which passed our cluster
+        for( auto const &a: path_attrs ) {
+            if( a.type == PATH_ATTRIBUTE::ORIGINATOR_ID && a.bytes.size() == sizeof( uint32_t ) && a.get_u32() == gconf.bgp_router_id.to_uint() ) {
+                logger.logInfo() << LOGS::FSM << "Do not process this update because ORIGINATOR_ID is our router id" << std::endl;
+                return;
+            }
+            if( a.type == PATH_ATTRIBUTE::CLUSTER_LIST ) {
+                auto clusters = a.parse_cluster_list();
+                if( std::find( clusters.begin(), clusters.end(), table.get_cluster_id() ) != clusters.end() ) {
+                    logger.logInfo() << LOGS::FSM << "Do not process this update because our cluster found in CLUSTER_LIST attribute" << std::endl;
+                    return;
+                }
+            }
+        }
+    }
 
     for( auto const &a: path_attrs ) {
         if( a.type != PATH_ATTRIBUTE::AS_PATH )
@@ -194,53 +604,148 @@ void bgp_fsm::rx_update( bgp_packet &pkt ) {
     }
 
     for( auto &wroute: withdrawn_routes ) {
-        schedule.emplace( wroute );
-        logger.logInfo() << LOGS::FSM << "Received withdrawn route: " << wroute << std::endl;
-        table.del_path( wroute, shared_from_this() );
+        logger.logInfo() << LOGS::FSM << "Received withdrawn route: " << wroute.prefix << " path id: " << wroute.path_id << std::endl;
+        table.del_path( wroute.prefix, shared_from_this(), wroute.path_id );
+        adj_rib_in.erase( { wroute.prefix, wroute.path_id } );
+    }
+    for( auto &wroute: mp.withdrawn ) {
+        logger.logInfo() << LOGS::FSM << "Received withdrawn route: " << wroute.prefix << std::endl;
+        runtime->table_v6.del_path( wroute.prefix, shared_from_this() );
+        adj_rib_in.erase( { wroute.prefix, 0 } );
     }
 
+    if( routes.empty() && mp.routes.empty() ) {
+        return;
+    }
+    std::shared_ptr<route_policy> import;
+    if( conf.import_policy ) {
+        import = table.get_policy( *conf.import_policy );
+    }
+    if( !mp.routes.empty() ) {
+        // next hop of IPv6 routes is in MP_REACH_NLRI
+        auto attrs_v6 = path_attrs;
+        attrs_v6.erase( std::remove_if( attrs_v6.begin(), attrs_v6.end(), []( const path_attr_t &a ) { return a.type == PATH_ATTRIBUTE::NEXT_HOP; } ), attrs_v6.end() );
+        auto attrs = table.intern_attrs( std::move( attrs_v6 ) );
+        for( auto &route: mp.routes ) {
+            logger.logInfo() << LOGS::FSM << "Received route: " << route.prefix << std::endl;
+            if( conf.import_policy ) {
+                adj_rib_in[ { route.prefix, 0 } ] = attrs;
+            }
+            if( auto accepted = import_attrs( route.prefix, attrs, import ); accepted ) {
+                runtime->table_v6.add_path( route.prefix, accepted, shared_from_this() );
+            } else {
+                runtime->table_v6.del_path( route.prefix, shared_from_this() );
+            }
+        }
+    }
+    if( routes.empty() ) {
+        return;
+    }
+    path_attrs.erase( std::remove_if( path_attrs.begin(), path_attrs.end(), []( const path_attr_t &a ) { return a.type == PATH_ATTRIBUTE::MP_REACH_NLRI; } ), path_attrs.end() );
+    // all routes of UPDATE share one attribute set
+    auto attrs = table.intern_attrs( std::move( path_attrs ) );
     for( auto &route: routes ) {
-        schedule.emplace( route );
-        logger.logInfo() << LOGS::FSM << "Received route: " << route << std::endl;
-        table.add_path( route, path_attrs, shared_from_this() );
+        logger.logInfo() << LOGS::FSM << "Received route: " << route.prefix << " path id: " << route.path_id << std::endl;
+        if( conf.import_policy ) {
+            adj_rib_in[ { route.prefix, route.path_id } ] = attrs;
+        }
+        if( auto accepted = import_attrs( route.prefix, attrs, import ); accepted ) {
+            table.add_path( route.prefix, accepted, shared_from_this(), route.path_id );
+        } else {
+            table.del_path( route.prefix, shared_from_this(), route.path_id );
+        }
     }
+}
 
-    logger.logInfo() << LOGS::FSM << "After update we have BGP table: " << std::endl;
-    for( auto const &[ k, v ]: table.table ) {
-        logger.logInfo() << LOGS::FSM << "Route: " << k.to_string() << std::endl;
-        for( auto path: *v.attrs ) {
-            logger.logInfo() << LOGS::FSM << "Path: " << path << std::endl;
-        }
+std::shared_ptr<std::vector<path_attr_t>> bgp_fsm::import_attrs( const NLRI &prefix, const std::shared_ptr<std::vector<path_attr_t>> &attrs, const std::shared_ptr<route_policy> &import ) {
+    if( !conf.import_policy ) {
+        return attrs;
     }
+    // policy which can't be loaded rejects everything
+    auto accepted = import ? table.apply_policy( *import, prefix, attrs ) : nullptr;
+    if( !accepted ) {
+        logger.logInfo() << LOGS::FSM << "Route " << prefix << " is rejected by import policy" << std::endl;
+    }
+    return accepted;
+}
 
-    table.best_path_selection();
+void bgp_fsm::reimport( bool had_policy ) {
+    auto self = shared_from_this();
+    if( !had_policy ) {
+        // without policy all received paths are in tables unchanged
+        table.collect_peer_paths( self, adj_rib_in );
+        runtime->table_v6.collect_peer_paths( self, adj_rib_in );
+    }
+    std::shared_ptr<route_policy> import;
+    if( conf.import_policy ) {
+        import = table.get_policy( *conf.import_policy );
+    }
+    for( auto const &[ key, attrs ]: adj_rib_in ) {
+        auto const &[ prefix, path_id ] = key;
+        bool v6 = prefix.get_afi() == BGP_AFI::IPv6;
+        auto accepted = import_attrs( prefix, attrs, import );
+        auto current = v6 ? runtime->table_v6.find_path( prefix, self ) : table.find_path( prefix, self, path_id );
+        if( ( current != nullptr ? current->attrs : nullptr ) == accepted ) {
+            continue;
+        }
+        if( !accepted ) {
+            v6 ? runtime->table_v6.del_path( prefix, self ) : table.del_path( prefix, self, path_id );
+        } else if( v6 ) {
+            runtime->table_v6.add_path( prefix, accepted, self );
+        } else {
+            table.add_path( prefix, accepted, self, path_id );
+        }
+    }
+    if( !conf.import_policy ) {
+        adj_rib_in.clear();
+    }
 }
 
 void bgp_fsm::on_receive( error_code ec, std::size_t length ) {
     if( ec ) {
+        if( ec == boost::asio::error::operation_aborted ) {
+            return;
+        }
         logger.logError() << LOGS::FSM << "Error on receiving data: " << ec.message() << std::endl;
+        runtime->bmp.peer_down( shared_from_this(), BMP_PEER_DOWN::REMOTE_NO_NOTIFICATION, {} );
+        session_down( true );
         return;
     }
 
     logger.logInfo() << LOGS::FSM << "Received message of size: " << length << std::endl;
 
+    // stream may end in the middle of packet, tail is kept in buffer until the rest arrives.
+    // Buffer is owned here while packets are processed, so session_down can't release it under them
+    auto data = std::move( buffer );
+    length += buffer_fill;
     std::list<bgp_packet> pkts;
-    auto pos = 0;
-    while( pos < length ) {
-        auto header = reinterpret_cast<bgp_header*>( buffer.data() + pos );
+    std::size_t pos = 0;
+    while( pos + sizeof( bgp_header ) <= length ) {
+        auto header = reinterpret_cast<bgp_header*>( data->data() + pos );
         auto len = header->length.native();
         logger.logInfo() << LOGS::FSM << "Next packet in stream with size: " << len << std::endl;
+        if( len < sizeof( bgp_header ) ) {
+            logger.logError() << LOGS::FSM << "Wrong BGP message length: " << len << std::endl;
+            session_down( false );
+            buffers.release( std::move( data ) );
+            return;
+        }
         if( ( pos + len ) > length ) {
             break;
         }
-        pkts.emplace_back( buffer.data() + pos, len );
+        pkts.emplace_back( data->data() + pos, len );
         pos += len;
     }
 
+    if( !pkts.empty() ) {
+        last_received = std::chrono::steady_clock::now();
+    }
     for( auto &pkt: pkts ) {
         auto bgp_header = pkt.get_header();
         if( std::any_of( bgp_header->marker.begin(), bgp_header->marker.end(), []( uint8_t el ) { return el != 0xFF; } ) ) {
             logger.logError() << LOGS::FSM << "Wrong BGP marker in header!" << std::endl;
+            session_down( false );
+            buffers.release( std::move( data ) );
             return;
         }
         switch( bgp_header->type ) {
@@ -261,32 +766,60 @@ void bgp_fsm::on_receive( error_code ec, std::size_t length ) {
             send_all_prefixes();
             break;
         }
+        if( !sock.has_value() ) {
+            // session was closed while processing this packet
+            buffers.release( std::move( data ) );
+            return;
+        }
+    }
+    buffer_fill = length - pos;
+    if( buffer_fill > 0 ) {
+        std::memmove( data->data(), data->data() + pos, buffer_fill );
+        buffer = std::move( data );
+    } else {
+        buffers.release( std::move( data ) );
     }
     do_read();
 }
 
 void bgp_fsm::do_read() {
-    sock->async_receive( boost::asio::buffer( buffer ), std::bind( &bgp_fsm::on_receive, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) );
+    sock->async_wait( socket_tcp::wait_read, std::bind( &bgp_fsm::on_readable, shared_from_this(), std::placeholders::_1 ) );
+}
+
+void bgp_fsm::on_readable( error_code ec ) {
+    if( ec ) {
+        on_receive( ec, 0 );
+        return;
+    }
+    if( !buffer ) {
+        buffer = buffers.acquire();
+    }
+    auto length = sock->receive( boost::asio::buffer( buffer->data() + buffer_fill, buffer->size() - buffer_fill ), 0, ec );
+    if( ec == boost::asio::error::would_block ) {
+        if( buffer_fill == 0 ) {
+            buffers.release( std::move( buffer ) );
+        }
+        do_read();
+        return;
+    }
+    on_receive( ec, length );
 }
 
-void bgp_fsm::tx_update( const std::vector<NLRI> &prefixes, std::shared_ptr<std::vector<path_attr_t>> path, const std::vector<NLRI> &withdrawn ) {
+void bgp_fsm::tx_update( const std::vector<path_nlri_t> &prefixes, std::shared_ptr<std::vector<path_attr_t>> path, const std::vector<path_nlri_t> &withdrawn ) {
     logger.logInfo() << LOGS::FSM << "Sending UPDATE to peer: " << sock->remote_endpoint().address().to_string() << std::endl;
 
-    auto new_path = *path;
-    auto cap_it = std::find_if( caps.begin(), caps.end(), []( const bgp_cap_t &val ) -> bool { return val.code == BGP_CAP_CODE::FOUR_OCT_AS; } );
-    auto four_byte_asn = ( cap_it != caps.end() );
+    if( !path ) {
+        // only withdrawn routes
+        for( auto const &pkt_buf: build_updates( {}, {}, withdrawn, addpath_tx ) ) {
+            send( pkt_buf );
+        }
+        return;
+    }
 
+    auto new_path = *path;
     // For eBGP peer
     if( gconf.my_as != conf.remote_as ) {
-        // remove local pref attribute
-        new_path.erase(
-            std::remove_if(
-                new_path.begin(),
-                new_path.end(),
-                []( const path_attr_t &a ) -> bool { return a.type == PATH_ATTRIBUTE::LOCAL_PREF; }
-            ),
-            new_path.end()
-        );
+        ebgp_rewrite( new_path );
 
         // set next hop to output interface
         auto nexthopIt = std::find_if(
@@ -299,119 +832,270 @@ void bgp_fsm::tx_update( const std::vector<NLRI> &prefixes, std::shared_ptr<std:
         if( nexthopIt != new_path.end() ) {
             nexthopIt->make_nexthop( sock->local_endpoint().address() );
         }
+    }
 
-        // put our as in as_path attribute
-        auto aspathIt = std::find_if(
+    logger.logInfo() << LOGS::FSM << "Sending " << prefixes.size() << " prefixes and " << withdrawn.size() << " withdrawn routes" << std::endl;
+    // prefixes sharing attributes may need several messages
+    for( auto const &pkt_buf: build_updates( prefixes, new_path, withdrawn, addpath_tx ) ) {
+        send( pkt_buf );
+    }
+}
+
+void bgp_fsm::ebgp_rewrite( std::vector<path_attr_t> &new_path ) {
+    auto cap_it = std::find_if( caps.begin(), caps.end(), []( const bgp_cap_t &val ) -> bool { return val.code == BGP_CAP_CODE::FOUR_OCT_AS; } );
+    auto four_byte_asn = ( cap_it != caps.end() );
+
+    // remove local pref and route reflection attributes
+    new_path.erase(
+        std::remove_if(
             new_path.begin(),
             new_path.end(),
-            []( const path_attr_t &attr ) -> bool {
-                return attr.type == PATH_ATTRIBUTE::AS_PATH;
+            []( const path_attr_t &a ) -> bool {
+                return a.type == PATH_ATTRIBUTE::LOCAL_PREF || a.type == PATH_ATTRIBUTE::ORIGINATOR_ID || a.type == PATH_ATTRIBUTE::CLUSTER_LIST;
             }
-        ); 
-        if( aspathIt != new_path.end() ) {
-            auto new_as_path = aspathIt->parse_as_path();
-            new_as_path.push_back( gconf.my_as );
-            aspathIt->make_as_path( new_as_path );
-        } else {
-            path_attr_t as_path;
-            as_path.four_byte_asn = four_byte_asn;
-            as_path.make_as_path( { gconf.my_as } );
-            new_path.push_back( as_path );
+        ),
+        new_path.end()
+    );
+
+    // put our as in as_path attribute
+    auto aspathIt = std::find_if(
+        new_path.begin(),
+        new_path.end(),
+        []( const path_attr_t &attr ) -> bool {
+            return attr.type == PATH_ATTRIBUTE::AS_PATH;
         }
+    ); 
+    if( aspathIt != new_path.end() ) {
+        auto new_as_path = aspathIt->parse_as_path();
+        new_as_path.push_back( gconf.my_as );
+        aspathIt->make_as_path( new_as_path );
+    } else {
+        path_attr_t as_path;
+        as_path.four_byte_asn = four_byte_asn;
+        as_path.make_as_path( { gconf.my_as } );
+        new_path.push_back( as_path );
     }
+}
 
-    // making withdrawn buf
-    std::vector<uint8_t> withdrawn_body;
-    withdrawn_body.reserve( 1000 );
-
-    for( auto const &w: withdrawn ) {
-        auto wdata = w.serialize();
-        withdrawn_body.insert( withdrawn_body.end(), wdata.begin(), wdata.end() );
+void bgp_fsm::tx_update_v6( const std::vector<path_nlri_t> &prefixes, std::shared_ptr<std::vector<path_attr_t>> path, const std::vector<path_nlri_t> &withdrawn ) {
+    logger.logInfo() << LOGS::FSM << "Sending IPv6 UPDATE to peer: " << sock->remote_endpoint().address().to_string() << std::endl;
+    std::vector<path_attr_t> new_path;
+    std::vector<uint8_t> nexthop;
+    if( path ) {
+        new_path = *path;
+        auto reachIt = std::find_if( new_path.begin(), new_path.end(), []( const path_attr_t &attr ) { return attr.type == PATH_ATTRIBUTE::MP_REACH_NLRI; } );
+        if( reachIt != new_path.end() ) {
+            nexthop = reachIt->get_mp_nexthop();
+        }
+        if( gconf.my_as != conf.remote_as ) {
+            ebgp_rewrite( new_path );
+        }
+        // For eBGP peer next hop is our address, IPv4 session address is sent as IPv4-mapped IPv6 address
+        if( gconf.my_as != conf.remote_as || nexthop.empty() ) {
+            auto local = sock->local_endpoint().address();
+            auto local_v6 = local.is_v6() ? local.to_v6() : boost::asio::ip::make_address_v6( boost::asio::ip::v4_mapped, local.to_v4() );
+            auto bytes = local_v6.to_bytes();
+            nexthop.assign( bytes.begin(), bytes.end() );
+        }
     }
 
-    {
-        uint16_t len = bswap( static_cast<uint16_t>( withdrawn_body.size() ) );
-        std::array<uint8_t,2> temp;
-        std::memcpy( temp.data(), &len, 2 );
-        withdrawn_body.insert( withdrawn_body.begin(), temp.begin(), temp.end() );
+    logger.logInfo() << LOGS::FSM << "Sending " << prefixes.size() << " IPv6 prefixes and " << withdrawn.size() << " withdrawn routes" << std::endl;
+    for( auto const &pkt_buf: build_updates_v6( prefixes, new_path, nexthop, withdrawn ) ) {
+        send( pkt_buf );
     }
+}
 
-    // making path buf
-    std::vector<uint8_t> path_body;
-    path_body.reserve( 1000 );
-
-    for( auto const &p: new_path ) {
-        logger.logInfo() << LOGS::FSM << "Sending path: " << p << std::endl;
-        auto bytes = p.to_bytes();
-        path_body.insert( path_body.end(), bytes.begin(), bytes.end() );
+void bgp_fsm::tx_group_updates_v6( const std::map<NLRI,std::vector<bgp_export_path>> &exported ) {
+    std::vector<path_nlri_t> withdrawn;
+    std::map<std::shared_ptr<std::vector<path_attr_t>>,std::vector<path_nlri_t>> pending_update;
+    for( auto const &[ prefix, paths ]: exported ) {
+        // path is not sent back to its source
+        if( paths.empty() || paths.front().path->source.get() == this ) {
+            withdrawn.push_back( { 0, prefix } );
+        } else {
+            pending_update[ paths.front().attrs ].push_back( { 0, prefix } );
+        }
     }
-
-    {
-        uint16_t len = bswap( static_cast<uint16_t>( path_body.size() ) );
-        std::array<uint8_t,2> temp;
-        std::memcpy( temp.data(), &len, 2 );
-        path_body.insert( path_body.begin(), temp.begin(), temp.end() );
+    if( !withdrawn.empty() ) {
+        tx_update_v6( {}, nullptr, withdrawn );
     }
-
-    // making nlri buf
-    std::vector<uint8_t> nlri_body;
-    nlri_body.reserve( 1000 );
-
-    for( auto const &p: prefixes ) {
-        logger.logInfo() << LOGS::FSM << "Sending prefix: " << p.to_string() << std::endl;
-        auto pdata = p.serialize();
-        nlri_body.insert( nlri_body.end(), pdata.begin(), pdata.end() );
+    for( auto const &[ path, n_vec ]: pending_update ) {
+        tx_update_v6( n_vec, path, {} );
     }
+}
 
-    std::vector<uint8_t> body { withdrawn_body.begin(), withdrawn_body.end() };
-    body.insert( body.end(), path_body.begin(), path_body.end() );
-    body.insert( body.end(), nlri_body.begin(), nlri_body.end() );
+void bgp_fsm::tx_packets( const std::vector<std::shared_ptr<std::vector<uint8_t>>> &pkts ) {
+    logger.logInfo() << LOGS::FSM << "Sending " << pkts.size() << " shared UPDATE messages to peer: " << sock->remote_endpoint().address().to_string() << std::endl;
+    for( auto const &pkt_buf: pkts ) {
+        send( pkt_buf );
+    }
+}
 
-    // making packet itself
+std::vector<std::shared_ptr<std::vector<uint8_t>>> build_group_updates( const std::map<NLRI,std::vector<bgp_export_path>> &exported ) {
+    std::vector<path_nlri_t> withdrawn;
+    std::map<std::shared_ptr<std::vector<path_attr_t>>,std::vector<path_nlri_t>> pending_update;
+    for( auto const &[ prefix, paths ]: exported ) {
+        if( paths.empty() ) {
+            withdrawn.push_back( { 0, prefix } );
+        } else {
+            pending_update[ paths.front().attrs ].push_back( { 0, prefix } );
+        }
+    }
+    std::vector<std::shared_ptr<std::vector<uint8_t>>> pkts;
+    if( pending_update.empty() && !withdrawn.empty() ) {
+        pkts = build_updates( {}, {}, withdrawn, false );
+    }
+    for( auto const &[ path, n_vec ]: pending_update ) {
+        auto part = build_updates( n_vec, *path, withdrawn, false );
+        pkts.insert( pkts.end(), part.begin(), part.end() );
+        withdrawn.clear();
+    }
+    return pkts;
+}
 
+void bgp_fsm::tx_end_of_rib() {
+    logger.logInfo() << LOGS::FSM << "Sending End-of-RIB to peer: " << sock->remote_endpoint().address().to_string() << std::endl;
+    auto len = sizeof( bgp_header ) + 2 * sizeof( uint16_t );
     auto pkt_buf = std::make_shared<std::vector<uint8_t>>();
-    auto len = sizeof( bgp_header ) + body.size();
     pkt_buf->resize( len );
     bgp_packet pkt { pkt_buf->data(), pkt_buf->size() };
 
-    // header
+    // header, withdrawn routes and path attributes length are zero
     auto header = pkt.get_header();
     header->type = bgp_type::UPDATE;
     header->length = len;
     std::fill( header->marker.begin(), header->marker.end(), 0xFF );
 
-    std::memcpy( pkt.get_body(), body.data(), body.size() );
-
     // send this msg
-    sock->async_send( boost::asio::buffer( *pkt_buf ), std::bind( &bgp_fsm::on_send, shared_from_this(), pkt_buf, std::placeholders::_1, std::placeholders::_2 ) );
+    send( pkt_buf );
 }
 
-void bgp_fsm::send_all_prefixes() {
-    std::set<NLRI> scheduled;
-    bool ibgp = ( gconf.my_as == conf.remote_as );
-    for( auto const &[ prefix, path ] : table.table ) {
-        if( path.source && path.source->conf.remote_as == gconf.my_as ) {
-            if( !ibgp ) {
-                scheduled.emplace( prefix );
+void bgp_fsm::tx_group_updates( const std::map<NLRI,std::vector<bgp_export_path>> &exported ) {
+    std::size_t max_paths = addpath_tx ? 1 + *conf.add_path_backups : 1;
+    std::vector<path_nlri_t> withdrawn;
+    std::map<std::shared_ptr<std::vector<path_attr_t>>,std::vector<path_nlri_t>> pending_update;
+    for( auto const &[ prefix, paths ]: exported ) {
+        if( !addpath_tx ) {
+            // path is not sent back to its source
+            if( paths.empty() || paths.front().path->source.get() == this ) {
+                withdrawn.push_back( { 0, prefix } );
+            } else {
+                pending_update[ paths.front().attrs ].push_back( { 0, prefix } );
+            }
+            continue;
+        }
+        std::set<uint32_t> current;
+        for( auto const &p: paths ) {
+            if( current.size() >= max_paths ) {
+                break;
+            }
+            if( p.path->source.get() == this ) {
+                continue;
+            }
+            current.insert( p.path->local_id );
+            pending_update[ p.attrs ].push_back( { p.path->local_id, prefix } );
+        }
+        // withdraw paths, which are not in best + backups set anymore
+        auto advIt = advertised_paths.find( prefix );
+        if( advIt != advertised_paths.end() ) {
+            for( auto id: advIt->second ) {
+                if( current.count( id ) == 0 ) {
+                    withdrawn.push_back( { id, prefix } );
+                }
+            }
+        }
+        if( current.empty() ) {
+            if( advIt != advertised_paths.end() ) {
+                advertised_paths.erase( advIt );
             }
         } else {
-            scheduled.emplace( prefix );
+            advertised_paths[ prefix ] = std::move( current );
         }
     }
+
+    if( pending_update.empty() && !withdrawn.empty() ) {
+        tx_update( {}, nullptr, withdrawn );
+        return;
+    }
+    for( auto const &[ path, n_vec ]: pending_update ) {
+        tx_update( n_vec, path, withdrawn );
+        withdrawn.clear();
+    }
+}
+
+bgp_update_group bgp_fsm::update_group() {
+    bool ibgp = gconf.my_as == conf.remote_as;
+    return { conf.export_policy, ibgp, ibgp && conf.route_reflector_client, addpath_tx, local_address(), { shared_from_this() } };
+}
+
+address_v4 bgp_fsm::local_address() const {
+    error_code ec;
+    auto local = sock.has_value() ? sock->local_endpoint( ec ).address() : boost::asio::ip::address {};
+    return !ec && local.is_v4() ? local.to_v4() : address_v4 {};
+}
+
+void bgp_fsm::readvertise() {
+    if( state != FSM_STATE::ESTABLISHED ) {
+        return;
+    }
+    std::set<NLRI> prefixes;
+    for( auto it = table.table.begin(); it != table.table.end(); it = table.table.upper_bound( it->first ) ) {
+        prefixes.emplace_hint( prefixes.end(), it->first );
+    }
+    auto group = update_group();
+    tx_group_updates( table.export_paths( group, prefixes ) );
+    if( ipv6_unicast ) {
+        tx_group_updates_v6( runtime->table_v6.export_paths( group, runtime->table_v6.prefixes() ) );
+    }
+}
+
+void bgp_fsm::send_all_prefixes() {
+    advertised_paths.clear();
+    std::set<NLRI> prefixes;
+    for( auto it = table.table.begin(); it != table.table.end(); it = table.table.upper_bound( it->first ) ) {
+        prefixes.emplace_hint( prefixes.end(), it->first );
+    }
+    auto group = update_group();
+    auto exported = table.export_paths( group, prefixes );
+    // nothing was advertised yet, so there is nothing to withdraw
+    for( auto it = exported.begin(); it != exported.end(); ) {
+        if( it->second.empty() || ( !addpath_tx && it->second.front().path->source.get() == this ) ) {
+            it = exported.erase( it );
+        } else {
+            it++;
+        }
+    }
+    tx_group_updates( exported );
+    tx_end_of_rib();
+
+    if( !ipv6_unicast ) {
+        return;
+    }
+    auto exported_v6 = runtime->table_v6.export_paths( group, runtime->table_v6.prefixes() );
+    for( auto it = exported_v6.begin(); it != exported_v6.end(); ) {
+        if( it->second.empty() || it->second.front().path->source.get() == this ) {
+            it = exported_v6.erase( it );
+        } else {
+            it++;
+        }
+    }
+    tx_group_updates_v6( exported_v6 );
+    logger.logInfo() << LOGS::FSM << "Sending IPv6 End-of-RIB to peer: " << sock->remote_endpoint().address().to_string() << std::endl;
+    for( auto const &pkt_buf: build_updates_v6( {}, {}, {}, {} ) ) {
+        send( pkt_buf );
+    }
 }
 
 void bgp_fsm::rx_notification( bgp_packet &pkt ) {
     logger.logInfo() << LOGS::FSM << "NOTIFICATION message" << std::endl;
 
-    // clear all nlris from this peer
-    table.purge_peer( shared_from_this() );
-
     auto notification = pkt.get_notification();
     logger.logInfo() << LOGS::FSM << notification << std::endl;
-    if( sock.has_value() ) {
-        sock->close();
-        sock.reset();
-    }
+
+    // paths are kept as stale, unless peer explicitly asks for hard reset
+    bool hard_reset = ( notification->code == BGP_ERR_CODE::CEASE && notification->subcode == static_cast<uint8_t>( BGP_CEASE_ERR::HARD_RESET ) );
+    runtime->bmp.peer_down( shared_from_this(), BMP_PEER_DOWN::REMOTE_NOTIFICATION, { pkt.data, pkt.data + pkt.length } );
+    session_down( !hard_reset );
 }
 
 void bgp_fsm::tx_notification( BGP_ERR_CODE code, BGP_MSG_HDR_ERR err, const std::vector<uint8_t> &data ) {
@@ -439,7 +1123,19 @@ void bgp_fsm::tx_notification( BGP_ERR_CODE code, uint8_t subcode, const std::ve
 
     // clear all nlris from this peer
     table.purge_peer( shared_from_this() );
+    runtime->table_v6.purge_peer( shared_from_this() );
+
+    auto pkt_buf = build_notification( code, subcode, data );
+    runtime->bmp.peer_down( shared_from_this(), BMP_PEER_DOWN::LOCAL_NOTIFICATION, *pkt_buf );
+
+    if( !sock.has_value() ) {
+        logger.logInfo() << LOGS::FSM << "Cannot send NOTIFICATION because there are no active socket" << std::endl;
+        return;
+    }
+    send( pkt_buf );
+}
 
+std::shared_ptr<std::vector<uint8_t>> build_notification( BGP_ERR_CODE code, uint8_t subcode, const std::vector<uint8_t> &data ) {
     auto pkt_buf = std::make_shared<std::vector<uint8_t>>();
     auto len = sizeof( bgp_header ) + sizeof( bgp_notification );
     pkt_buf->reserve( len + data.size() );
@@ -456,13 +1152,8 @@ void bgp_fsm::tx_notification( BGP_ERR_CODE code, uint8_t subcode, const std::ve
     auto notification = pkt.get_notification();
     notification->code = code;
     notification->subcode = subcode;
+    logger.logInfo() << LOGS::FSM << notification << std::endl;
 
     pkt_buf->insert( pkt_buf->end(), data.begin(), data.end() );
-
-    logger.logInfo() << LOGS::FSM << notification << std::endl;
-    if( !sock.has_value() ) {
-        logger.logInfo() << LOGS::FSM << "Cannot send NOTIFICATION because there are no active socket" << std::endl;
-        return;
-    }
-    sock->async_send( boost::asio::buffer( *pkt_buf ), std::bind( &bgp_fsm::on_send, shared_from_this(), pkt_buf, std::placeholders::_1, std::placeholders::_2 ) );
+    return pkt_buf;
 }
@@ -2,7 +2,10 @@
 #define FSM_HPP_
 
 #include <list>
+#include <deque>
 #include <set>
+#include <map>
+#include <optional>
 #include <boost/asio.hpp>
 #include <boost/asio/steady_timer.hpp>
 
@@ -19,6 +22,7 @@ struct GlobalConf;
 struct bgp_packet;
 struct bgp_cap_t;
 class NLRI;
+struct path_nlri_t;
 enum class BGP_CAP_CODE : uint8_t;
 enum class BGP_ERR_CODE : uint8_t;
 enum class BGP_MSG_HDR_ERR : uint8_t;
@@ -28,6 +32,8 @@ enum class BGP_FSM_ERR : uint8_t;
 enum class BGP_CEASE_ERR : uint8_t;
 
 #include "table.hpp"
+#include "timer_wheel.hpp"
+#include "buffer_pool.hpp"
 
 enum class FSM_STATE {
     IDLE,
@@ -40,35 +46,104 @@ enum class FSM_STATE {
 
 struct bgp_fsm : public std::enable_shared_from_this<bgp_fsm> {
     FSM_STATE state;
+    io_context &io;
     GlobalConf &gconf;
     bgp_neighbour_v4 &conf;
     bgp_table_v4 &table;
     std::vector<bgp_cap_t> caps;
 
-    std::array<uint8_t,65535> buffer;
+    buffer_pool &buffers;
+    // taken from pool for reading, between reads it is held only by incomplete packet
+    std::unique_ptr<rx_buffer> buffer;
+    // bytes of incomplete packet at the beginning of buffer
+    std::size_t buffer_fill;
     std::optional<socket_tcp> sock;
+    // messages wait until previous write is completed, so they are never interleaved on socket
+    std::deque<std::shared_ptr<std::vector<uint8_t>>> send_queue;
+    // write is in flight, it may still belong to previous connection of session
+    bool writing;
+    // current connection was initiated by us
+    bool outbound;
+    // outbound TCP connect in progress
+    std::optional<socket_tcp> connecting;
+    // other connection of colliding sessions, it waits until BGP identifier of peer is known
+    std::optional<socket_tcp> colliding;
+    bool colliding_outbound;
+    // connections are initiated after start and until stop
+    bool active;
+
+    // raw OPEN messages of current session for BMP
+    std::vector<uint8_t> sent_open;
+    std::vector<uint8_t> received_open;
+
+    // we were restarted with RIB restored from snapshot
+    bool warm_restart;
+
+    // negotiated ADD-PATH for IPv4 unicast
+    bool addpath_rx;
+    bool addpath_tx;
+    // BGP identifier from OPEN of peer
+    uint32_t remote_router_id;
+    // negotiated IPv6 unicast with MP-BGP
+    bool ipv6_unicast;
+    // path identifiers advertised to this peer with ADD-PATH
+    std::map<NLRI,std::set<uint32_t>> advertised_paths;
+    // received attributes before import policy, kept only while import policy is set,
+    // so changed policy is applied again without route refresh
+    bgp_table_v4::peer_paths adj_rib_in;
 
     // counters
     uint64_t ConnectRetryCounter;
 
     // timers
-    timer ConnectRetryTimer;
-    timer HoldTimer;
-    timer KeepaliveTimer;
+    wheel_timer ConnectRetryTimer;
+    wheel_timer HoldTimer;
+    wheel_timer KeepaliveTimer;
+    timer GracefulRestartTimer;
+    // any received message refreshes hold timer, it is checked when timer expires
+    std::chrono::steady_clock::time_point last_received;
 
     // config
     uint16_t ConnectRetryTime;
     uint16_t HoldTime;
     uint16_t KeepaliveTime;
 
-    bgp_fsm( io_context &io, GlobalConf &g, bgp_table_v4 &t, bgp_neighbour_v4 &c );
-    void place_connection( socket_tcp s );
-
+    bgp_fsm( io_context &io, timer_wheel &w, buffer_pool &b, GlobalConf &g, bgp_table_v4 &t, bgp_neighbour_v4 &c );
+    void place_connection( socket_tcp s, bool initiated = false );
+
+    // first connect of non passive neighbour is delayed randomly, so peers don't connect at once
+    void start();
+    // no connections are initiated anymore, e.g. when neighbour is removed
+    void stop();
+    void connect();
+    void on_connect( error_code ec );
+    // retry delay doubles with every failed attempt up to ConnectRetryTime, it is jittered
+    void start_connect_retry_timer();
+    // RFC 4271 6.8: connection initiated by side with higher BGP identifier is kept
+    void resolve_collision();
+
+    // interval is jittered, so keepalives of many peers are not sent in bursts
     void start_keepalive_timer();
-    void on_keepalive_timer( error_code ec );
-
+    void on_keepalive_timer();
+    void start_hold_timer( uint16_t hold_time );
+    void on_hold_timer( uint16_t hold_time );
+
+    void start_graceful_restart_timer( uint16_t restart_time );
+    void on_graceful_restart_timer( error_code ec );
+    void session_down( bool graceful );
+    // sends CEASE NOTIFICATION, closes connection and removes all paths of peer
+    void shutdown( BGP_CEASE_ERR reason );
+    // connection is closed after NOTIFICATION is sent, session_down is left to caller
+    void notify_and_close( BGP_ERR_CODE code, uint8_t subcode );
+
+    // socket is read when it becomes readable, so buffer is not held by pending read
+    void on_readable( error_code ec );
     void on_receive( error_code ec, std::size_t length );
-    void on_send( std::shared_ptr<std::vector<uint8_t>> pkt, error_code ec, std::size_t length );
+    // message is written after all previously queued ones
+    void send( std::shared_ptr<std::vector<uint8_t>> pkt );
+    // all queued messages are written by single gathered write
+    void start_write();
+    void on_send( error_code ec, std::size_t length );
     void do_read();
 
     void rx_open( bgp_packet &pkt );
@@ -78,7 +153,20 @@ struct bgp_fsm : public std::enable_shared_from_this<bgp_fsm> {
     void tx_keepalive();
 
     void rx_update( bgp_packet &pkt );
-    void tx_update( const std::vector<NLRI> &prefixes, std::shared_ptr<std::vector<path_attr_t>> path, const std::vector<NLRI> &withdrawn );
+    // attributes after import policy, nullptr if route is rejected
+    std::shared_ptr<std::vector<path_attr_t>> import_attrs( const NLRI &prefix, const std::shared_ptr<std::vector<path_attr_t>> &attrs, const std::shared_ptr<route_policy> &import );
+    // applies import policy again to received paths, table is changed only where result differs
+    void reimport( bool had_policy );
+    void tx_update( const std::vector<path_nlri_t> &prefixes, std::shared_ptr<std::vector<path_attr_t>> path, const std::vector<path_nlri_t> &withdrawn );
+    // sends changes of paths exported to update group of this peer
+    void tx_group_updates( const std::map<NLRI,std::vector<bgp_export_path>> &exported );
+    void tx_end_of_rib();
+    // sends prebuilt packets, which are shared by peers of update group
+    void tx_packets( const std::vector<std::shared_ptr<std::vector<uint8_t>>> &pkts );
+    void tx_update_v6( const std::vector<path_nlri_t> &prefixes, std::shared_ptr<std::vector<path_attr_t>> path, const std::vector<path_nlri_t> &withdrawn );
+    void tx_group_updates_v6( const std::map<NLRI,std::vector<bgp_export_path>> &exported );
+    // removes LOCAL_PREF and prepends our AS, next hop is left to caller
+    void ebgp_rewrite( std::vector<path_attr_t> &attrs );
 
     void rx_notification( bgp_packet &pkt );
     void tx_notification( BGP_ERR_CODE code, BGP_MSG_HDR_ERR err, const std::vector<uint8_t> &data );
@@ -88,7 +176,16 @@ struct bgp_fsm : public std::enable_shared_from_this<bgp_fsm> {
     void tx_notification( BGP_ERR_CODE code, BGP_CEASE_ERR err, const std::vector<uint8_t> &data );
     void tx_notification( BGP_ERR_CODE code, uint8_t err, const std::vector<uint8_t> &data );
 
+    bgp_update_group update_group();
+    // address of our end of connection, unspecified without connection
+    address_v4 local_address() const;
     void send_all_prefixes();
+    // sends current export of all prefixes, prefixes which aren't exported anymore are withdrawn
+    void readvertise();
 };
 
+// UPDATE packets with best paths of update group without split horizon and attribute changes
+std::vector<std::shared_ptr<std::vector<uint8_t>>> build_group_updates( const std::map<NLRI,std::vector<bgp_export_path>> &exported );
+std::shared_ptr<std::vector<uint8_t>> build_notification( BGP_ERR_CODE code, uint8_t subcode, const std::vector<uint8_t> &data );
+
 #endif
\ No newline at end of file
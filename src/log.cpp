@@ -20,7 +20,7 @@ Logger& Logger::printTime() {
     return *this;
 }
 
-Logger& Logger::operator<<( std::ostream& (*fun)( std::ostream& ) ) {
+Logger& Logger::operator<<( std::ostream& (*)( std::ostream& ) ) {
     if( !noop ) {
         os << std::endl;
     }
@@ -22,7 +22,10 @@ enum class LOGS: uint8_t {
     CONFIGURATION,
     VPP,
     CLI,
-    TABLE
+    TABLE,
+    BMP,
+    FIB,
+    NEXTHOP
 };
 
 class Logger {
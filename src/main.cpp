@@ -1,6 +1,7 @@
 #include <iostream>
 #include <fstream>
 #include <boost/asio/ip/address_v4.hpp>
+#include <boost/asio/signal_set.hpp>
 #include <yaml-cpp/yaml.h>
 #include <boost/program_options.hpp>
 
@@ -110,11 +111,40 @@ int main( int argc, char *argv[] ) {
     unlink( unix_socket_path.c_str() );
 
     boost::asio::io_context io;
-    runtime = std::make_shared<EVLoop>( io, conf );
+    runtime = std::make_shared<EVLoop>( io, conf, config_path );
     auto cli = std::make_shared<CLI_Server>( io, unix_socket_path, runtime );
     cli->start();
     runtime->start();
-    while( true ) {
+
+    boost::asio::signal_set signals { io, SIGINT, SIGTERM };
+    signals.async_wait( [ &io, &cli ]( const boost::system::error_code &ec, int signal ) {
+        if( ec ) {
+            return;
+        }
+        logger.logInfo() << LOGS::MAIN << "Received signal " << signal << ", shutting down" << std::endl;
+        cli->stop();
+        runtime->snapshot.save();
+        io.stop();
+    });
+
+    boost::asio::signal_set reload_signals { io, SIGHUP };
+    std::function<void()> wait_reload = [ &reload_signals, &wait_reload ]() {
+        reload_signals.async_wait( [ &wait_reload ]( const boost::system::error_code &ec, int ) {
+            if( ec ) {
+                return;
+            }
+            logger.logInfo() << LOGS::MAIN << "Received SIGHUP, reloading configuration" << std::endl;
+            try {
+                runtime->reload();
+            } catch( std::exception &e ) {
+                logger.logError() << LOGS::MAIN << "Cannot reload config: " << e.what() << std::endl;
+            }
+            wait_reload();
+        });
+    };
+    wait_reload();
+
+    while( !io.stopped() ) {
         try { 
             io.run();
         } catch( std::exception &e ) {
@@ -0,0 +1,96 @@
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "neighbour_index.hpp"
+
+// slots are kept at most half full, so probe sequences stay short
+static constexpr std::size_t MIN_SLOTS = 16;
+
+neighbour_index::neighbour_index():
+    slots( MIN_SLOTS, 0 )
+{}
+
+void neighbour_index::reserve( std::size_t count ) {
+    entries.reserve( count );
+    if( count * 2 > slots.size() ) {
+        rehash( count );
+    }
+}
+
+std::size_t neighbour_index::home( const address_v4 &address ) const {
+    // addresses of peers are often consecutive, so bits are mixed before masking
+    uint32_t h = address.to_uint();
+    h ^= h >> 16;
+    h *= 0x85EBCA6BU;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35U;
+    h ^= h >> 16;
+    return h & ( slots.size() - 1 );
+}
+
+std::size_t neighbour_index::probe( const address_v4 &address ) const {
+    auto mask = slots.size() - 1;
+    for( auto i = home( address ); ; i = ( i + 1 ) & mask ) {
+        if( slots[ i ] == 0 || entries[ slots[ i ] - 1 ].first == address ) {
+            return i;
+        }
+    }
+}
+
+void neighbour_index::rehash( std::size_t count ) {
+    std::size_t size = MIN_SLOTS;
+    while( size < count * 2 ) {
+        size *= 2;
+    }
+    slots.assign( size, 0 );
+    for( std::size_t pos = 0; pos < entries.size(); pos++ ) {
+        slots[ probe( entries[ pos ].first ) ] = pos + 1;
+    }
+}
+
+neighbour_index::iterator neighbour_index::find( const address_v4 &address ) {
+    auto slot = slots[ probe( address ) ];
+    return slot == 0 ? entries.end() : entries.begin() + ( slot - 1 );
+}
+
+neighbour_index::const_iterator neighbour_index::find( const address_v4 &address ) const {
+    auto slot = slots[ probe( address ) ];
+    return slot == 0 ? entries.end() : entries.begin() + ( slot - 1 );
+}
+
+std::pair<neighbour_index::iterator,bool> neighbour_index::emplace( const address_v4 &address, std::shared_ptr<bgp_fsm> fsm ) {
+    auto i = probe( address );
+    if( slots[ i ] != 0 ) {
+        return { entries.begin() + ( slots[ i ] - 1 ), false };
+    }
+    entries.emplace_back( address, std::move( fsm ) );
+    if( entries.size() * 2 > slots.size() ) {
+        rehash( entries.size() );
+    } else {
+        slots[ i ] = entries.size();
+    }
+    return { entries.end() - 1, true };
+}
+
+neighbour_index::iterator neighbour_index::erase( iterator it ) {
+    auto pos = it - entries.begin();
+    auto mask = slots.size() - 1;
+    // backward shift deletion, entries after removed one are moved closer to their home slot
+    auto i = probe( it->first );
+    for( auto j = ( i + 1 ) & mask; slots[ j ] != 0; j = ( j + 1 ) & mask ) {
+        auto k = home( entries[ slots[ j ] - 1 ].first );
+        bool stays = i <= j ? ( i < k && k <= j ) : ( i < k || k <= j );
+        if( !stays ) {
+            slots[ i ] = slots[ j ];
+            i = j;
+        }
+    }
+    slots[ i ] = 0;
+    if( static_cast<std::size_t>( pos ) + 1 != entries.size() ) {
+        slots[ probe( entries.back().first ) ] = pos + 1;
+        entries[ pos ] = std::move( entries.back() );
+    }
+    entries.pop_back();
+    return entries.begin() + pos;
+}
@@ -0,0 +1,47 @@
+#ifndef NEIGHBOUR_INDEX_HPP_
+#define NEIGHBOUR_INDEX_HPP_
+
+#include <memory>
+#include <vector>
+#include <utility>
+#include <boost/asio/ip/address_v4.hpp>
+
+struct bgp_fsm;
+
+// Neighbours by address. Entries are kept in dense vector, which is iterated,
+// and they are found through open addressing table of their positions with
+// linear probing. Erase moves last entry to place of erased one, so order of
+// iteration is not order of addresses.
+class neighbour_index {
+public:
+    using value_type = std::pair<boost::asio::ip::address_v4,std::shared_ptr<bgp_fsm>>;
+    using iterator = std::vector<value_type>::iterator;
+    using const_iterator = std::vector<value_type>::const_iterator;
+
+    neighbour_index();
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.end(); }
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+    std::size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    void reserve( std::size_t count );
+
+    iterator find( const boost::asio::ip::address_v4 &address );
+    const_iterator find( const boost::asio::ip::address_v4 &address ) const;
+    // existing entry is kept if address is already present
+    std::pair<iterator,bool> emplace( const boost::asio::ip::address_v4 &address, std::shared_ptr<bgp_fsm> fsm );
+    // returned iterator points to entry moved into place of erased one
+    iterator erase( iterator it );
+private:
+    std::size_t home( const boost::asio::ip::address_v4 &address ) const;
+    // slot with entry of address or empty slot where it would be placed
+    std::size_t probe( const boost::asio::ip::address_v4 &address ) const;
+    void rehash( std::size_t count );
+
+    std::vector<value_type> entries;
+    // position of entry plus one, zero marks empty slot, size is power of two
+    std::vector<uint32_t> slots;
+};
+
+#endif
@@ -0,0 +1,341 @@
+#include <array>
+#include <optional>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "netlink.hpp"
+#include "table.hpp"
+#include "log.hpp"
+#include "string_utils.hpp"
+#include "nlri.hpp"
+#include "packet.hpp"
+
+extern Logger logger;
+
+#ifndef RTPROT_BGP
+#define RTPROT_BGP 186
+#endif
+
+static void add_attr( std::vector<uint8_t> &buf, uint16_t type, const void *data, uint16_t len ) {
+    auto offset = buf.size();
+    buf.resize( offset + RTA_SPACE( len ) );
+    auto rta = reinterpret_cast<rtattr*>( buf.data() + offset );
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH( len );
+    std::memcpy( RTA_DATA( rta ), data, len );
+}
+
+// errors after which socket is useless, others concern single request or are transient
+static bool is_socket_failure( int error ) {
+    return error == EBADF || error == ENOTSOCK || error == ECONNREFUSED || error == ECONNRESET || error == EPIPE;
+}
+
+netlink_api::netlink_api( uint32_t table_id ):
+    fd( -1 ),
+    lost( false ),
+    table( table_id )
+{
+    rx_buffer.resize( 1024 * 1024 );
+}
+
+netlink_api::~netlink_api() {
+    if( fd >= 0 ) {
+        close( fd );
+    }
+}
+
+bool netlink_api::connect() {
+    if( fd >= 0 ) {
+        close( fd );
+    }
+    lost = false;
+    batch.clear();
+    batch_contexts.clear();
+    outstanding.clear();
+    send_errors.clear();
+    fd = socket( AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE );
+    if( fd < 0 ) {
+        logger.logError() << LOGS::FIB << "Netlink: cannot open socket: " << std::strerror( errno ) << std::endl;
+        return false;
+    }
+    int size = 16 * 1024 * 1024;
+    if( setsockopt( fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof( size ) ) != 0 ) {
+        setsockopt( fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof( size ) );
+    }
+    if( setsockopt( fd, SOL_SOCKET, SO_SNDBUFFORCE, &size, sizeof( size ) ) != 0 ) {
+        setsockopt( fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof( size ) );
+    }
+    // acks don't need to carry copy of our request
+    int one = 1;
+    setsockopt( fd, SOL_NETLINK, NETLINK_CAP_ACK, &one, sizeof( one ) );
+
+    sockaddr_nl local {};
+    local.nl_family = AF_NETLINK;
+    if( bind( fd, reinterpret_cast<sockaddr*>( &local ), sizeof( local ) ) != 0 ) {
+        logger.logError() << LOGS::FIB << "Netlink: cannot bind socket: " << std::strerror( errno ) << std::endl;
+        close( fd );
+        fd = -1;
+        return false;
+    }
+    logger.logInfo() << LOGS::FIB << "Netlink: connected, programming table " << table << std::endl;
+    return true;
+}
+
+bool netlink_api::submit( uint32_t context, const fib_route &route ) {
+    if( outstanding.size() + batch_contexts.size() >= NETLINK_MAX_OUTSTANDING ) {
+        return false;
+    }
+    bool is_add = route.group && !route.group->nexthops.empty();
+
+    auto offset = batch.size();
+    batch.resize( offset + NLMSG_SPACE( sizeof( rtmsg ) ) );
+    auto rtm = reinterpret_cast<rtmsg*>( NLMSG_DATA( reinterpret_cast<nlmsghdr*>( batch.data() + offset ) ) );
+    auto bytes = route.prefix.serialize();
+    rtm->rtm_family = AF_INET;
+    rtm->rtm_dst_len = bytes[ 0 ];
+    rtm->rtm_table = table < 256 ? table : RT_TABLE_UNSPEC;
+    rtm->rtm_protocol = RTPROT_BGP;
+    rtm->rtm_scope = RT_SCOPE_UNIVERSE;
+    rtm->rtm_type = RTN_UNICAST;
+
+    std::array<uint8_t,4> dst {};
+    std::copy( bytes.begin() + 1, bytes.end(), dst.begin() );
+    add_attr( batch, RTA_DST, dst.data(), dst.size() );
+    add_attr( batch, RTA_TABLE, &table, sizeof( table ) );
+
+    // BGP next hops are usually not directly connected, so IGP gateway resolved by next hop tracking is installed
+    if( is_add && route.group->nexthops.size() == 1 ) {
+        auto const &nh = route.group->nexthops.front();
+        auto gw = nh.gateway.to_bytes();
+        add_attr( batch, RTA_GATEWAY, gw.data(), gw.size() );
+        if( nh.ifindex != 0 ) {
+            add_attr( batch, RTA_OIF, &nh.ifindex, sizeof( nh.ifindex ) );
+        }
+    } else if( is_add ) {
+        std::vector<uint8_t> hops;
+        for( auto const &nh: route.group->nexthops ) {
+            auto hop_offset = hops.size();
+            hops.resize( hop_offset + RTNH_SPACE( 0 ) );
+            auto gw = nh.gateway.to_bytes();
+            add_attr( hops, RTA_GATEWAY, gw.data(), gw.size() );
+            auto rtnh = reinterpret_cast<rtnexthop*>( hops.data() + hop_offset );
+            rtnh->rtnh_len = hops.size() - hop_offset;
+            rtnh->rtnh_flags = 0;
+            rtnh->rtnh_hops = 0;
+            rtnh->rtnh_ifindex = nh.ifindex;
+        }
+        add_attr( batch, RTA_MULTIPATH, hops.data(), hops.size() );
+    }
+
+    auto hdr = reinterpret_cast<nlmsghdr*>( batch.data() + offset );
+    hdr->nlmsg_len = batch.size() - offset;
+    hdr->nlmsg_type = is_add ? RTM_NEWROUTE : RTM_DELROUTE;
+    hdr->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    if( is_add ) {
+        hdr->nlmsg_flags |= NLM_F_CREATE | NLM_F_REPLACE;
+    }
+    hdr->nlmsg_seq = context;
+    hdr->nlmsg_pid = 0;
+    batch_contexts.push_back( context );
+
+    if( batch.size() >= NETLINK_BATCH_BYTES ) {
+        send_batch();
+    }
+    return true;
+}
+
+void netlink_api::send_batch() {
+    if( batch.empty() ) {
+        return;
+    }
+    sockaddr_nl kernel {};
+    kernel.nl_family = AF_NETLINK;
+    iovec iov { batch.data(), batch.size() };
+    msghdr msg {};
+    msg.msg_name = &kernel;
+    msg.msg_namelen = sizeof( kernel );
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    auto ret = sendmsg( fd, &msg, 0 );
+    if( ret < 0 ) {
+        auto error = errno;
+        logger.logError() << LOGS::FIB << "Netlink: cannot send " << batch_contexts.size() << " requests: " << std::strerror( error ) << std::endl;
+        if( is_socket_failure( error ) ) {
+            connection_lost( error );
+        }
+        for( auto context: batch_contexts ) {
+            send_errors.push_back( { context, false } );
+        }
+    } else {
+        outstanding.insert( batch_contexts.begin(), batch_contexts.end() );
+    }
+    batch.clear();
+    batch_contexts.clear();
+}
+
+void netlink_api::fail_outstanding( std::vector<fib_reply> &replies ) {
+    for( auto context: outstanding ) {
+        replies.push_back( { context, false } );
+    }
+    outstanding.clear();
+}
+
+void netlink_api::connection_lost( int error ) {
+    if( lost ) {
+        return;
+    }
+    logger.logError() << LOGS::FIB << "Netlink: socket failed: " << std::strerror( error ) << std::endl;
+    lost = true;
+    if( on_lost ) {
+        on_lost();
+    }
+}
+
+void netlink_api::poll( std::vector<fib_reply> &replies ) {
+    send_batch();
+    replies.insert( replies.end(), send_errors.begin(), send_errors.end() );
+    send_errors.clear();
+    while( !outstanding.empty() ) {
+        auto len = recv( fd, rx_buffer.data(), rx_buffer.size(), MSG_DONTWAIT );
+        if( len < 0 ) {
+            if( errno == ENOBUFS ) {
+                // kernel dropped some acks, we cannot know which requests were applied
+                logger.logError() << LOGS::FIB << "Netlink: receive buffer overrun" << std::endl;
+                fail_outstanding( replies );
+            } else if( is_socket_failure( errno ) ) {
+                connection_lost( errno );
+            }
+            break;
+        }
+        for( auto hdr = reinterpret_cast<nlmsghdr*>( rx_buffer.data() ); NLMSG_OK( hdr, len ); hdr = NLMSG_NEXT( hdr, len ) ) {
+            if( hdr->nlmsg_type != NLMSG_ERROR ) {
+                continue;
+            }
+            auto err = reinterpret_cast<nlmsgerr*>( NLMSG_DATA( hdr ) );
+            if( outstanding.erase( hdr->nlmsg_seq ) == 0 ) {
+                continue;
+            }
+            // route which we remove may be already gone
+            bool success = err->error == 0 || err->error == -ESRCH;
+            if( !success ) {
+                logger.logError() << LOGS::FIB << "Netlink: request " << hdr->nlmsg_seq << " failed: " << std::strerror( -err->error ) << std::endl;
+            }
+            replies.push_back( { hdr->nlmsg_seq, success } );
+        }
+    }
+}
+
+bool netlink_api::parse_route( nlmsghdr *hdr, fib_entry &route ) {
+    auto rtm = reinterpret_cast<rtmsg*>( NLMSG_DATA( hdr ) );
+    if( rtm->rtm_family != AF_INET || rtm->rtm_protocol != RTPROT_BGP || rtm->rtm_type != RTN_UNICAST ) {
+        return false;
+    }
+    uint32_t route_table = rtm->rtm_table;
+    std::array<uint8_t,4> dst {};
+    // gateway and interface of single path route may come in any order
+    std::optional<address_v4> gateway;
+    uint32_t oif = 0;
+    int len = RTM_PAYLOAD( hdr );
+    for( auto rta = RTM_RTA( rtm ); RTA_OK( rta, len ); rta = RTA_NEXT( rta, len ) ) {
+        switch( rta->rta_type ) {
+        case RTA_TABLE:
+            route_table = *reinterpret_cast<uint32_t*>( RTA_DATA( rta ) );
+            break;
+        case RTA_DST:
+            std::memcpy( dst.data(), RTA_DATA( rta ), dst.size() );
+            break;
+        case RTA_GATEWAY:
+            gateway = address_v4( *reinterpret_cast<address_v4::bytes_type*>( RTA_DATA( rta ) ) );
+            break;
+        case RTA_OIF:
+            oif = *reinterpret_cast<uint32_t*>( RTA_DATA( rta ) );
+            break;
+        case RTA_MULTIPATH: {
+            auto rtnh = reinterpret_cast<rtnexthop*>( RTA_DATA( rta ) );
+            int hops_len = RTA_PAYLOAD( rta );
+            while( RTNH_OK( rtnh, hops_len ) ) {
+                int attrs_len = rtnh->rtnh_len - sizeof( *rtnh );
+                for( auto attr = RTNH_DATA( rtnh ); RTA_OK( attr, attrs_len ); attr = RTA_NEXT( attr, attrs_len ) ) {
+                    if( attr->rta_type == RTA_GATEWAY ) {
+                        route.nexthops.push_back( { address_v4( *reinterpret_cast<address_v4::bytes_type*>( RTA_DATA( attr ) ) ), static_cast<uint32_t>( rtnh->rtnh_ifindex ) } );
+                    }
+                }
+                hops_len -= RTNH_ALIGN( rtnh->rtnh_len );
+                rtnh = RTNH_NEXT( rtnh );
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    if( route_table != table ) {
+        return false;
+    }
+    if( gateway.has_value() ) {
+        route.nexthops.push_back( { *gateway, oif } );
+    }
+    route.prefix = NLRI( BGP_AFI::IPv4, dst.data(), rtm->rtm_dst_len );
+    std::sort( route.nexthops.begin(), route.nexthops.end() );
+    return true;
+}
+
+bool netlink_api::dump( std::vector<fib_entry> &routes ) {
+    struct {
+        nlmsghdr hdr;
+        rtmsg rtm;
+    } req {};
+    req.hdr.nlmsg_len = sizeof( req );
+    req.hdr.nlmsg_type = RTM_GETROUTE;
+    req.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.hdr.nlmsg_seq = 0;
+    req.rtm.rtm_family = AF_INET;
+    sockaddr_nl kernel {};
+    kernel.nl_family = AF_NETLINK;
+    if( sendto( fd, &req, sizeof( req ), 0, reinterpret_cast<sockaddr*>( &kernel ), sizeof( kernel ) ) < 0 ) {
+        logger.logError() << LOGS::FIB << "Netlink: cannot request routes: " << std::strerror( errno ) << std::endl;
+        return false;
+    }
+    // done once on start, so just wait for the whole dump
+    while( true ) {
+        pollfd pfd { fd, POLLIN, 0 };
+        if( ::poll( &pfd, 1, 1000 ) <= 0 ) {
+            logger.logError() << LOGS::FIB << "Netlink: timeout on reading routes" << std::endl;
+            return false;
+        }
+        auto len = recv( fd, rx_buffer.data(), rx_buffer.size(), MSG_DONTWAIT );
+        if( len < 0 ) {
+            if( errno == EAGAIN || errno == EINTR ) {
+                continue;
+            }
+            logger.logError() << LOGS::FIB << "Netlink: cannot read routes: " << std::strerror( errno ) << std::endl;
+            return false;
+        }
+        for( auto hdr = reinterpret_cast<nlmsghdr*>( rx_buffer.data() ); NLMSG_OK( hdr, len ); hdr = NLMSG_NEXT( hdr, len ) ) {
+            if( hdr->nlmsg_type == NLMSG_DONE ) {
+                return true;
+            }
+            if( hdr->nlmsg_type == NLMSG_ERROR ) {
+                auto err = reinterpret_cast<nlmsgerr*>( NLMSG_DATA( hdr ) );
+                logger.logError() << LOGS::FIB << "Netlink: cannot read routes: " << std::strerror( -err->error ) << std::endl;
+                return false;
+            }
+            if( hdr->nlmsg_type != RTM_NEWROUTE ) {
+                continue;
+            }
+            fib_entry route;
+            if( parse_route( hdr, route ) ) {
+                routes.push_back( std::move( route ) );
+            }
+        }
+    }
+}
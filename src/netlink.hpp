@@ -0,0 +1,44 @@
+#ifndef NETLINK_API_HPP_
+#define NETLINK_API_HPP_
+
+#include <set>
+#include <vector>
+
+#include "fib.hpp"
+
+struct nlmsghdr;
+
+// maximum size of messages sent with one sendmsg call
+static constexpr std::size_t NETLINK_BATCH_BYTES = 256 * 1024;
+// requests waiting for ack, bounded so acks fit into socket receive buffer
+static constexpr std::size_t NETLINK_MAX_OUTSTANDING = 8192;
+
+// FIB transport to Linux kernel routing table via rtnetlink
+struct netlink_api : public fib_transport {
+    netlink_api( uint32_t table_id );
+    ~netlink_api();
+
+    bool connect() override;
+    bool submit( uint32_t context, const fib_route &route ) override;
+    void poll( std::vector<fib_reply> &replies ) override;
+    bool dump( std::vector<fib_entry> &routes ) override;
+private:
+    bool parse_route( nlmsghdr *hdr, fib_entry &route );
+    void send_batch();
+    void fail_outstanding( std::vector<fib_reply> &replies );
+    // socket can't be used anymore, pipeline connects again
+    void connection_lost( int error );
+
+    int fd;
+    bool lost;
+    uint32_t table;
+    // many netlink messages, which are sent with single sendmsg
+    std::vector<uint8_t> batch;
+    std::vector<uint32_t> batch_contexts;
+    std::set<uint32_t> outstanding;
+    // requests which were not sent, reported on next poll
+    std::vector<fib_reply> send_errors;
+    std::vector<uint8_t> rx_buffer;
+};
+
+#endif
@@ -0,0 +1,375 @@
+#include <array>
+#include <algorithm>
+#include <tuple>
+#include <cstring>
+#include <stdexcept>
+#include <cerrno>
+#include <unistd.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <boost/asio/ip/address_v4.hpp>
+#include <yaml-cpp/yaml.h>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "nexthop.hpp"
+#include "config.hpp"
+#include "log.hpp"
+#include "string_utils.hpp"
+#include "nlri.hpp"
+#include "packet.hpp"
+
+extern Logger logger;
+
+#ifndef RTPROT_BGP
+#define RTPROT_BGP 186
+#endif
+
+bool fib_nexthop::operator==( const fib_nexthop &rhs ) const {
+    return gateway == rhs.gateway && ifindex == rhs.ifindex;
+}
+
+bool fib_nexthop::operator!=( const fib_nexthop &rhs ) const {
+    return !( *this == rhs );
+}
+
+bool fib_nexthop::operator<( const fib_nexthop &rhs ) const {
+    return std::tie( gateway, ifindex ) < std::tie( rhs.gateway, rhs.ifindex );
+}
+
+nexthop_tracker::nexthop_tracker( boost::asio::io_context &i, GlobalConf &c ):
+    io( i ),
+    conf( c ),
+    enabled( false ),
+    revalidate_scheduled( false ),
+    file_timer( i ),
+    file_mtime( 0 ),
+    netlink( i )
+{}
+
+nexthop_tracker::~nexthop_tracker() {
+    boost::system::error_code ec;
+    netlink.close( ec );
+}
+
+void nexthop_tracker::set_listener( change_listener l ) {
+    listener = std::move( l );
+}
+
+void nexthop_tracker::start() {
+    if( !conf.nexthop_resolution.has_value() ) {
+        return;
+    }
+    if( *conf.nexthop_resolution == "file" ) {
+        if( !conf.igp_routes_file.has_value() ) {
+            logger.logError() << LOGS::NEXTHOP << "IGP routes file is not configured, next hop tracking is disabled" << std::endl;
+            return;
+        }
+        enabled = true;
+        load_file();
+        file_timer.expires_after( std::chrono::seconds( NHT_FILE_CHECK_INTERVAL ) );
+        file_timer.async_wait( std::bind( &nexthop_tracker::on_file_timer, this, std::placeholders::_1 ) );
+    } else if( *conf.nexthop_resolution == "netlink" ) {
+        if( !netlink_open() ) {
+            return;
+        }
+        enabled = true;
+        netlink_read();
+    } else {
+        logger.logError() << LOGS::NEXTHOP << "Unknown next hop resolution source: " << *conf.nexthop_resolution << std::endl;
+        return;
+    }
+    // initial routes are known now, so resolve next hops which are already tracked
+    revalidate();
+}
+
+std::shared_ptr<bgp_nexthop> nexthop_tracker::track( address_v4 address, const NLRI &prefix ) {
+    auto &nh = nexthops[ address ];
+    if( !nh ) {
+        nh = std::make_shared<bgp_nexthop>( bgp_nexthop { address, true, 0, { address, 0 }, {} } );
+        resolve( *nh );
+    }
+    nh->dependents.insert( prefix );
+    return nh;
+}
+
+void nexthop_tracker::untrack( const std::shared_ptr<bgp_nexthop> &nh, const NLRI &prefix ) {
+    nh->dependents.erase( prefix );
+    if( nh->dependents.empty() ) {
+        nexthops.erase( nh->address );
+    }
+}
+
+const std::map<address_v4,std::shared_ptr<bgp_nexthop>> &nexthop_tracker::get_nexthops() const {
+    return nexthops;
+}
+
+const std::map<NLRI,igp_route> &nexthop_tracker::get_igp_routes() const {
+    return igp_routes;
+}
+
+void nexthop_tracker::resolve( bgp_nexthop &nh ) const {
+    nh.reachable = !enabled;
+    nh.metric = 0;
+    nh.forwarding = { nh.address, 0 };
+    if( !enabled ) {
+        return;
+    }
+    // longest prefix match, default route doesn't resolve next hops
+    auto address = nh.address.to_bytes();
+    for( int len = 32; len > 0; len-- ) {
+        std::array<uint8_t,4> masked {};
+        for( int i = 0; i < 4; i++ ) {
+            auto bits = std::clamp( len - i * 8, 0, 8 );
+            masked[ i ] = address[ i ] & static_cast<uint8_t>( 0xFF << ( 8 - bits ) );
+        }
+        auto it = igp_routes.find( NLRI( BGP_AFI::IPv4, masked.data(), len ) );
+        if( it != igp_routes.end() ) {
+            nh.reachable = true;
+            nh.metric = it->second.metric;
+            if( !it->second.gateway.is_unspecified() ) {
+                nh.forwarding.gateway = it->second.gateway;
+            }
+            nh.forwarding.ifindex = it->second.ifindex;
+            return;
+        }
+    }
+}
+
+void nexthop_tracker::schedule_revalidate() {
+    if( revalidate_scheduled ) {
+        return;
+    }
+    revalidate_scheduled = true;
+    // coalesce burst of IGP changes into one pass over next hops
+    boost::asio::post( io, [ this ]() {
+        revalidate_scheduled = false;
+        revalidate();
+    });
+}
+
+void nexthop_tracker::revalidate() {
+    for( auto &[ address, nh ]: nexthops ) {
+        auto reachable = nh->reachable;
+        auto metric = nh->metric;
+        auto forwarding = nh->forwarding;
+        resolve( *nh );
+        if( reachable == nh->reachable && metric == nh->metric && forwarding == nh->forwarding ) {
+            continue;
+        }
+        logger.logInfo() << LOGS::NEXTHOP << "Next hop " << address << " is " << ( nh->reachable ? "reachable" : "unreachable" )
+            << " with metric " << nh->metric << " via " << nh->forwarding.gateway << ", revalidating " << nh->dependents.size() << " prefixes" << std::endl;
+        if( listener ) {
+            listener( *nh );
+        }
+    }
+}
+
+void nexthop_tracker::load_file() {
+    struct stat st;
+    if( stat( conf.igp_routes_file->c_str(), &st ) != 0 ) {
+        logger.logError() << LOGS::NEXTHOP << "Cannot access IGP routes file " << *conf.igp_routes_file << std::endl;
+        return;
+    }
+    if( st.st_mtime == file_mtime ) {
+        return;
+    }
+    file_mtime = st.st_mtime;
+    std::map<NLRI,igp_route> routes;
+    try {
+        auto file = YAML::LoadFile( *conf.igp_routes_file );
+        for( auto const &node: file ) {
+            auto prefix = NLRI( BGP_AFI::IPv4, node[ "prefix" ].as<std::string>() );
+            igp_route route { 0, {}, 0 };
+            if( node[ "metric" ].IsDefined() ) {
+                route.metric = node[ "metric" ].as<uint32_t>();
+            }
+            if( node[ "gateway" ].IsDefined() ) {
+                route.gateway = address_v4::from_string( node[ "gateway" ].as<std::string>() );
+            }
+            if( node[ "interface" ].IsDefined() ) {
+                auto name = node[ "interface" ].as<std::string>();
+                route.ifindex = if_nametoindex( name.c_str() );
+                if( route.ifindex == 0 ) {
+                    throw std::runtime_error( "unknown interface " + name );
+                }
+            }
+            routes[ prefix ] = route;
+        }
+    } catch( std::exception &e ) {
+        logger.logError() << LOGS::NEXTHOP << "Cannot load IGP routes file " << *conf.igp_routes_file << ": " << e.what() << std::endl;
+        return;
+    }
+    logger.logInfo() << LOGS::NEXTHOP << "Loaded " << routes.size() << " IGP routes from " << *conf.igp_routes_file << std::endl;
+    igp_routes = std::move( routes );
+    schedule_revalidate();
+}
+
+void nexthop_tracker::on_file_timer( const boost::system::error_code &ec ) {
+    if( ec ) {
+        return;
+    }
+    load_file();
+    file_timer.expires_after( std::chrono::seconds( NHT_FILE_CHECK_INTERVAL ) );
+    file_timer.async_wait( std::bind( &nexthop_tracker::on_file_timer, this, std::placeholders::_1 ) );
+}
+
+bool nexthop_tracker::netlink_open() {
+    int fd = socket( AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE );
+    if( fd < 0 ) {
+        logger.logError() << LOGS::NEXTHOP << "Netlink: cannot open socket: " << std::strerror( errno ) << std::endl;
+        return false;
+    }
+    int size = 4 * 1024 * 1024;
+    if( setsockopt( fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof( size ) ) != 0 ) {
+        setsockopt( fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof( size ) );
+    }
+    // subscribe before dump, so no change is lost in between
+    sockaddr_nl local {};
+    local.nl_family = AF_NETLINK;
+    local.nl_groups = RTMGRP_IPV4_ROUTE;
+    if( bind( fd, reinterpret_cast<sockaddr*>( &local ), sizeof( local ) ) != 0 ) {
+        logger.logError() << LOGS::NEXTHOP << "Netlink: cannot bind socket: " << std::strerror( errno ) << std::endl;
+        close( fd );
+        return false;
+    }
+
+    struct {
+        nlmsghdr hdr;
+        rtmsg rtm;
+    } req {};
+    req.hdr.nlmsg_len = sizeof( req );
+    req.hdr.nlmsg_type = RTM_GETROUTE;
+    req.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.rtm.rtm_family = AF_INET;
+    sockaddr_nl kernel {};
+    kernel.nl_family = AF_NETLINK;
+    if( sendto( fd, &req, sizeof( req ), 0, reinterpret_cast<sockaddr*>( &kernel ), sizeof( kernel ) ) < 0 ) {
+        logger.logError() << LOGS::NEXTHOP << "Netlink: cannot request routes: " << std::strerror( errno ) << std::endl;
+        close( fd );
+        return false;
+    }
+
+    // initial dump is read synchronously, so next hops are resolved before any path is selected
+    netlink_buffer.resize( 256 * 1024 );
+    igp_routes.clear();
+    bool done = false;
+    while( !done ) {
+        pollfd pfd { fd, POLLIN, 0 };
+        if( ::poll( &pfd, 1, 1000 ) <= 0 ) {
+            logger.logError() << LOGS::NEXTHOP << "Netlink: timeout on reading routes" << std::endl;
+            close( fd );
+            return false;
+        }
+        auto len = recv( fd, netlink_buffer.data(), netlink_buffer.size(), 0 );
+        if( len < 0 ) {
+            logger.logError() << LOGS::NEXTHOP << "Netlink: cannot read routes: " << std::strerror( errno ) << std::endl;
+            close( fd );
+            return false;
+        }
+        int left = len;
+        for( auto hdr = reinterpret_cast<nlmsghdr*>( netlink_buffer.data() ); NLMSG_OK( hdr, left ); hdr = NLMSG_NEXT( hdr, left ) ) {
+            if( hdr->nlmsg_type == NLMSG_DONE ) {
+                done = true;
+            }
+        }
+        netlink_process( netlink_buffer.data(), len );
+    }
+    logger.logInfo() << LOGS::NEXTHOP << "Netlink: loaded " << igp_routes.size() << " IGP routes" << std::endl;
+    netlink.assign( fd );
+    netlink.non_blocking( true );
+    return true;
+}
+
+void nexthop_tracker::netlink_read() {
+    netlink.async_read_some( boost::asio::buffer( netlink_buffer ), [ this ]( const boost::system::error_code &ec, std::size_t len ) {
+        if( ec == boost::asio::error::operation_aborted ) {
+            return;
+        }
+        if( ec ) {
+            // kernel dropped notifications, so our copy of routes has to be read again
+            logger.logError() << LOGS::NEXTHOP << "Netlink: " << ec.message() << ", reloading IGP routes" << std::endl;
+            boost::system::error_code ignored;
+            netlink.close( ignored );
+            if( !netlink_open() ) {
+                return;
+            }
+            schedule_revalidate();
+        } else {
+            netlink_process( netlink_buffer.data(), len );
+        }
+        netlink_read();
+    });
+}
+
+void nexthop_tracker::netlink_process( const uint8_t *data, std::size_t size ) {
+    int len = size;
+    bool changed = false;
+    for( auto hdr = reinterpret_cast<const nlmsghdr*>( data ); NLMSG_OK( hdr, len ); hdr = NLMSG_NEXT( hdr, len ) ) {
+        if( hdr->nlmsg_type != RTM_NEWROUTE && hdr->nlmsg_type != RTM_DELROUTE ) {
+            continue;
+        }
+        auto rtm = reinterpret_cast<const rtmsg*>( NLMSG_DATA( hdr ) );
+        // our own routes must not resolve next hops
+        if( rtm->rtm_family != AF_INET || rtm->rtm_type != RTN_UNICAST || rtm->rtm_protocol == RTPROT_BGP || rtm->rtm_dst_len == 0 ) {
+            continue;
+        }
+        uint32_t table = rtm->rtm_table;
+        igp_route route { 0, {}, 0 };
+        std::array<uint8_t,4> dst {};
+        int attr_len = RTM_PAYLOAD( hdr );
+        for( auto rta = RTM_RTA( rtm ); RTA_OK( rta, attr_len ); rta = RTA_NEXT( rta, attr_len ) ) {
+            switch( rta->rta_type ) {
+            case RTA_TABLE:
+                table = *reinterpret_cast<const uint32_t*>( RTA_DATA( rta ) );
+                break;
+            case RTA_DST:
+                std::memcpy( dst.data(), RTA_DATA( rta ), dst.size() );
+                break;
+            case RTA_PRIORITY:
+                route.metric = *reinterpret_cast<const uint32_t*>( RTA_DATA( rta ) );
+                break;
+            case RTA_GATEWAY:
+                route.gateway = address_v4( *reinterpret_cast<const address_v4::bytes_type*>( RTA_DATA( rta ) ) );
+                break;
+            case RTA_OIF:
+                route.ifindex = *reinterpret_cast<const uint32_t*>( RTA_DATA( rta ) );
+                break;
+            case RTA_MULTIPATH: {
+                // BGP next hop is resolved via first path of IGP multipath route
+                auto rtnh = reinterpret_cast<const rtnexthop*>( RTA_DATA( rta ) );
+                if( !RTNH_OK( rtnh, static_cast<int>( RTA_PAYLOAD( rta ) ) ) ) {
+                    break;
+                }
+                route.ifindex = rtnh->rtnh_ifindex;
+                int hop_len = rtnh->rtnh_len - sizeof( *rtnh );
+                for( auto attr = RTNH_DATA( rtnh ); RTA_OK( attr, hop_len ); attr = RTA_NEXT( attr, hop_len ) ) {
+                    if( attr->rta_type == RTA_GATEWAY ) {
+                        route.gateway = address_v4( *reinterpret_cast<const address_v4::bytes_type*>( RTA_DATA( attr ) ) );
+                    }
+                }
+                break;
+            }
+            default:
+                break;
+            }
+        }
+        if( table != RT_TABLE_MAIN ) {
+            continue;
+        }
+        NLRI prefix( BGP_AFI::IPv4, dst.data(), rtm->rtm_dst_len );
+        if( hdr->nlmsg_type == RTM_NEWROUTE ) {
+            igp_routes[ prefix ] = route;
+        } else {
+            igp_routes.erase( prefix );
+        }
+        changed = true;
+    }
+    if( changed && enabled ) {
+        schedule_revalidate();
+    }
+}
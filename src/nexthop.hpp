@@ -0,0 +1,95 @@
+#ifndef NEXTHOP_HPP_
+#define NEXTHOP_HPP_
+
+#include <map>
+#include <set>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+#include "nlri.hpp"
+
+struct GlobalConf;
+
+// interval of checking IGP routes file for changes
+static constexpr uint32_t NHT_FILE_CHECK_INTERVAL = 2;
+
+// Next hop programmed to data plane. It is IGP gateway of BGP next hop or BGP next hop itself,
+// when it is directly connected or next hop tracking is disabled.
+struct fib_nexthop {
+    address_v4 gateway;
+    // outgoing interface, 0 if it is resolved by data plane
+    uint32_t ifindex;
+
+    bool operator==( const fib_nexthop &rhs ) const;
+    bool operator!=( const fib_nexthop &rhs ) const;
+    bool operator<( const fib_nexthop &rhs ) const;
+};
+
+// IGP route, which may resolve BGP next hops
+struct igp_route {
+    uint32_t metric;
+    // unspecified for connected routes
+    address_v4 gateway;
+    uint32_t ifindex;
+};
+
+// Resolution state of BGP next hop. It is shared by all paths via this next hop,
+// so change of reachability is applied to all of them by updating one object.
+struct bgp_nexthop {
+    address_v4 address;
+    bool reachable;
+    // metric of IGP route which resolves next hop
+    uint32_t metric;
+    // where packets via this next hop are forwarded
+    fib_nexthop forwarding;
+    // prefixes, which have paths via this next hop
+    std::set<NLRI> dependents;
+};
+
+// Resolves BGP next hops against IGP/connected routes, which are read from
+// YAML file or from kernel routing table. When tracking isn't configured
+// all next hops are reachable.
+class nexthop_tracker {
+public:
+    using change_listener = std::function<void( const bgp_nexthop& )>;
+
+    nexthop_tracker( boost::asio::io_context &i, GlobalConf &c );
+    ~nexthop_tracker();
+    void start();
+    void set_listener( change_listener l );
+    std::shared_ptr<bgp_nexthop> track( address_v4 address, const NLRI &prefix );
+    void untrack( const std::shared_ptr<bgp_nexthop> &nh, const NLRI &prefix );
+    const std::map<address_v4,std::shared_ptr<bgp_nexthop>> &get_nexthops() const;
+    const std::map<NLRI,igp_route> &get_igp_routes() const;
+private:
+    void resolve( bgp_nexthop &nh ) const;
+    void schedule_revalidate();
+    void revalidate();
+
+    void load_file();
+    void on_file_timer( const boost::system::error_code &ec );
+
+    bool netlink_open();
+    void netlink_read();
+    void netlink_process( const uint8_t *data, std::size_t len );
+
+    boost::asio::io_context &io;
+    GlobalConf &conf;
+    bool enabled;
+    bool revalidate_scheduled;
+    change_listener listener;
+    std::map<address_v4,std::shared_ptr<bgp_nexthop>> nexthops;
+    std::map<NLRI,igp_route> igp_routes;
+
+    boost::asio::steady_timer file_timer;
+    std::time_t file_mtime;
+
+    boost::asio::posix::stream_descriptor netlink;
+    std::vector<uint8_t> netlink_buffer;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "nlri.hpp"
 
 #include <stdexcept>
+#include <algorithm>
 #include <arpa/inet.h>
 #include <sstream>
 
@@ -77,6 +78,32 @@ bool operator!=( const NLRI &lhv,const NLRI &rhv ) {
     return !( lhv == rhv );
 }
 
+BGP_AFI NLRI::get_afi() const {
+    return afi;
+}
+
+uint8_t NLRI::get_len() const {
+    return nlri_len;
+}
+
+const std::vector<uint8_t> &NLRI::get_data() const {
+    return data;
+}
+
+bool NLRI::covers( const NLRI &other ) const {
+    if( afi != other.afi || nlri_len > other.nlri_len ) {
+        return false;
+    }
+    if( !std::equal( data.begin(), data.begin() + nlri_len / 8, other.data.begin() ) ) {
+        return false;
+    }
+    if( nlri_len % 8 == 0 ) {
+        return true;
+    }
+    uint8_t mask = 0xFF << ( 8 - nlri_len % 8 );
+    return ( data[ nlri_len / 8 ] & mask ) == ( other.data[ nlri_len / 8 ] & mask );
+}
+
 std::vector<uint8_t> NLRI::serialize() const {
     std::vector<uint8_t> ret;
 
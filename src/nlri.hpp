@@ -16,6 +16,12 @@ public:
 
     std::vector<uint8_t> serialize() const;
     std::string to_string() const;
+    uint8_t get_len() const;
+    BGP_AFI get_afi() const;
+    // significant bytes of prefix
+    const std::vector<uint8_t> &get_data() const;
+    // other prefix is equal to this one or is its more specific
+    bool covers( const NLRI &other ) const;
 
     friend std::ostream& operator<<( std::ostream &os, const NLRI &n );
     friend bool operator<( const NLRI &lhv,const NLRI &rhv );
@@ -27,6 +33,12 @@ private:
     uint8_t nlri_len;
 };
 
+// prefix with ADD-PATH identifier, path_id is zero when ADD-PATH is not negotiated
+struct path_nlri_t {
+    uint32_t path_id;
+    NLRI prefix;
+};
+
 std::ostream& operator<<( std::ostream &os, const NLRI &n );
 bool operator<( const NLRI &lhv,const NLRI &rhv );
 bool operator==( const NLRI &lhv,const NLRI &rhv );
@@ -1,4 +1,5 @@
 #include <vector>
+#include <optional>
 #include <boost/asio/ip/address.hpp>
 #include <boost/asio/ip/address_v4.hpp>
 
@@ -8,9 +9,24 @@ using address_v4 = boost::asio::ip::address_v4;
 #include "log.hpp"
 #include "nlri.hpp"
 #include "string_utils.hpp"
+#include "community.hpp"
 
 extern Logger logger;
 
+static bool is_community( PATH_ATTRIBUTE type ) {
+    return type == PATH_ATTRIBUTE::COMMUNITIES || type == PATH_ATTRIBUTE::EXTENDED_COMMUNITIES || type == PATH_ATTRIBUTE::LARGE_COMMUNITY;
+}
+
+path_attr_t::path_attr_t():
+    optional( 0 ),
+    transitive( 0 ),
+    partial( 0 ),
+    extended_length( 0 ),
+    unused( 0 ),
+    type( PATH_ATTRIBUTE::ORIGIN ),
+    four_byte_asn( false )
+{}
+
 path_attr_t::path_attr_t( path_attr_header *header, bool f ):
     optional( header->optional ),
     transitive( header->transitive ),
@@ -20,17 +36,26 @@ path_attr_t::path_attr_t( path_attr_header *header, bool f ):
     four_byte_asn( f )
 {
     auto len = header->len;
+    if( is_community( type ) ) {
+        communities = community_list::intern( type, header->data, len );
+        return;
+    }
     bytes = std::vector<uint8_t>( header->data, header->data + len );
 }
 
-path_attr_t::path_attr_t( path_attr_header_extlen *header ):
+path_attr_t::path_attr_t( path_attr_header_extlen *header, bool f ):
     optional( header->optional ),
     transitive( header->transitive ),
     partial( header->partial ),
     extended_length( header->extended_length ),
-    type( header->type )
+    type( header->type ),
+    four_byte_asn( f )
 {
     auto len = header->ext_len.native();
+    if( is_community( type ) ) {
+        communities = community_list::intern( type, header->data, len );
+        return;
+    }
     bytes = std::vector<uint8_t>( header->data, header->data + len );
 }
 
@@ -49,15 +74,21 @@ std::vector<uint8_t> path_attr_t::to_bytes() const {
     header->extended_length = extended_length;
     header->type = type;
 
-    if( extended_length == 1 ) {
+    std::vector<uint8_t> community_bytes;
+    if( communities ) {
+        community_bytes = communities->to_bytes();
+    }
+    auto const &value = communities ? community_bytes : bytes;
+    if( extended_length == 1 || value.size() > 0xFF ) {
+        header->extended_length = 1;
         out.resize( sizeof( path_attr_header_extlen ) );
         auto extlen_header = reinterpret_cast<path_attr_header_extlen*>( out.data() );
-        extlen_header->ext_len = bytes.size();
+        extlen_header->ext_len = value.size();
     } else {
-        header->len = bytes.size();
+        header->len = value.size();
     }
 
-    out.insert( out.end(), bytes.begin(), bytes.end() );
+    out.insert( out.end(), value.begin(), value.end() );
 
     return out;
 }
@@ -141,6 +172,60 @@ void bgp_cap_t::make_mp_bgp( BGP_AFI afi ,BGP_SAFI safi ) {
     data[ 3 ] = static_cast<uint8_t>( safi );
 }
 
+void bgp_cap_t::make_graceful_restart( uint16_t restart_time, bool restarting ) {
+    data.clear();
+    code = BGP_CAP_CODE::GRACEFUL_RESTART;
+    data.resize( 6 );
+    // restart flags (4 bits) and restart time in seconds (12 bits)
+    uint16_t flags = restart_time & 0x0FFF;
+    if( restarting ) {
+        flags |= 0x8000;
+    }
+    *reinterpret_cast<uint16_t*>( data.data() ) = bswap( flags );
+    // we preserve forwarding state only for IPv4 unicast
+    *reinterpret_cast<uint16_t*>( data.data() + 2 ) = bswap( static_cast<uint16_t>( BGP_AFI::IPv4 ) );
+    data[ 4 ] = static_cast<uint8_t>( BGP_SAFI::UNICAST );
+    data[ 5 ] = 0x80;
+}
+
+void bgp_cap_t::make_add_path( BGP_AFI afi, BGP_SAFI safi, ADD_PATH_DIR dir ) {
+    data.clear();
+    code = BGP_CAP_CODE::ADD_PATH;
+    data.resize( 4 );
+    *reinterpret_cast<uint16_t*>( data.data() ) = bswap( static_cast<uint16_t>( afi ) );
+    data[ 2 ] = static_cast<uint8_t>( safi );
+    data[ 3 ] = static_cast<uint8_t>( dir );
+}
+
+ADD_PATH_DIR bgp_cap_t::get_add_path( BGP_AFI afi, BGP_SAFI safi ) const {
+    if( code != BGP_CAP_CODE::ADD_PATH ) {
+        return ADD_PATH_DIR::NONE;
+    }
+    for( std::size_t pos = 0; pos + 4 <= data.size(); pos += 4 ) {
+        auto cap_afi = static_cast<BGP_AFI>( bswap( *reinterpret_cast<const uint16_t*>( data.data() + pos ) ) );
+        auto cap_safi = static_cast<BGP_SAFI>( data[ pos + 2 ] );
+        if( cap_afi == afi && cap_safi == safi ) {
+            return static_cast<ADD_PATH_DIR>( data[ pos + 3 ] );
+        }
+    }
+    return ADD_PATH_DIR::NONE;
+}
+
+bool bgp_cap_t::is_mp_bgp( BGP_AFI afi, BGP_SAFI safi ) const {
+    if( code != BGP_CAP_CODE::MPBGP || data.size() < 4 ) {
+        return false;
+    }
+    auto cap_afi = static_cast<BGP_AFI>( bswap( *reinterpret_cast<const uint16_t*>( data.data() ) ) );
+    return cap_afi == afi && static_cast<BGP_SAFI>( data[ 3 ] ) == safi;
+}
+
+uint16_t bgp_cap_t::get_restart_time() const {
+    if( code != BGP_CAP_CODE::GRACEFUL_RESTART || data.size() < 2 ) {
+        return 0;
+    }
+    return bswap( *reinterpret_cast<const uint16_t*>( data.data() ) ) & 0x0FFF;
+}
+
 bool bgp_cap_t::operator<( const bgp_cap_t &r ) const {
     return std::tie( code, data ) < std::tie( r.code, r.data );
 }
@@ -199,40 +284,58 @@ uint8_t* bgp_packet::get_body() {
     return reinterpret_cast<uint8_t*>( data + sizeof( bgp_header ) );
 }
 
-std::tuple<std::vector<NLRI>,std::vector<path_attr_t>,std::vector<NLRI>> bgp_packet::process_update( bool four_byte_asn ) {
-    std::vector<NLRI> withdrawn_routes;
-    auto header = get_header();
-    auto update_data = data + sizeof( bgp_header );
-    auto update_len = header->length.native() - sizeof( bgp_header );
-    logger.logInfo() << LOGS::PACKET << "Size of UPDATE payload: " << update_len << std::endl;
+static bool parse_nlri( uint8_t *data, uint16_t len, bool add_path, std::vector<path_nlri_t> &out, BGP_AFI afi = BGP_AFI::IPv4 ) {
+    uint16_t offset = 0;
+    while( offset < len ) {
+        uint32_t path_id = 0;
+        if( add_path ) {
+            if( offset + sizeof( path_id ) > len ) {
+                return false;
+            }
+            path_id = bswap( *reinterpret_cast<uint32_t*>( data + offset ) );
+            offset += sizeof( path_id );
+        }
+        if( offset >= len ) {
+            return false;
+        }
 
-    // parsing withdrawn routes
-    auto len = bswap( *reinterpret_cast<uint16_t*>( update_data ) );
-    logger.logInfo() << LOGS::PACKET << "Length of withdrawn routes: " << len << std::endl;
-    uint16_t offset = sizeof( len );
-    while( len > 0 ) {
-        if( offset >= update_len ) {
-            logger.logError() << LOGS::PACKET << "Error on parsing message" << std::endl;
-            return { {}, {}, {} };
+        uint8_t nlri_len = *reinterpret_cast<uint8_t*>( data + offset );
+        offset += sizeof( nlri_len );
+        if( nlri_len > ( afi == BGP_AFI::IPv6 ? 128 : 32 ) ) {
+            return false;
         }
 
-        uint8_t nlri_len = *reinterpret_cast<uint8_t*>( update_data + offset );
-        len -= sizeof( nlri_len );
-        
         auto bytes = nlri_len / 8;
         if( nlri_len % 8 != 0 ) {
             bytes++;
         }
 
-        if( bytes > len ) {
-            logger.logError() << LOGS::PACKET << "Error on parsing message" << std::endl;
-            return { {}, {}, {} };
+        if( offset + bytes > len ) {
+            return false;
         }
-        len -= bytes;
 
-        withdrawn_routes.emplace_back( BGP_AFI::IPv4, update_data + offset + 1, nlri_len );
-        offset += sizeof( nlri_len ) + bytes;
+        out.push_back( { path_id, NLRI( afi, data + offset, nlri_len ) } );
+        offset += bytes;
     }
+    return true;
+}
+
+std::tuple<std::vector<path_nlri_t>,std::vector<path_attr_t>,std::vector<path_nlri_t>> bgp_packet::process_update( bool four_byte_asn, bool add_path ) {
+    auto header = get_header();
+    auto update_data = data + sizeof( bgp_header );
+    auto update_len = header->length.native() - sizeof( bgp_header );
+    logger.logInfo() << LOGS::PACKET << "Size of UPDATE payload: " << update_len << std::endl;
+
+    // parsing withdrawn routes
+    std::vector<path_nlri_t> withdrawn_routes;
+    auto len = bswap( *reinterpret_cast<uint16_t*>( update_data ) );
+    logger.logInfo() << LOGS::PACKET << "Length of withdrawn routes: " << len << std::endl;
+    uint16_t offset = sizeof( len );
+    if( offset + len > update_len || !parse_nlri( update_data + offset, len, add_path, withdrawn_routes ) ) {
+        logger.logError() << LOGS::PACKET << "Error on parsing message" << std::endl;
+        return { {}, {}, {} };
+    }
+    offset += len;
 
     // parsing bgp path attributes
     std::vector<path_attr_t> paths;
@@ -244,7 +347,7 @@ std::tuple<std::vector<NLRI>,std::vector<path_attr_t>,std::vector<NLRI>> bgp_pac
         uint16_t attr_len = 0;
         if( path->extended_length == 1 ) {
             auto extlen_path = reinterpret_cast<path_attr_header_extlen*>( path );
-            paths.emplace_back( extlen_path );
+            paths.emplace_back( extlen_path, four_byte_asn );
             attr_len = sizeof( path_attr_header_extlen ) + extlen_path->ext_len.native();
         } else {
             paths.emplace_back( path, four_byte_asn );
@@ -257,32 +360,253 @@ std::tuple<std::vector<NLRI>,std::vector<path_attr_t>,std::vector<NLRI>> bgp_pac
     // parsing NLRI
     len = update_len - offset;
     logger.logInfo() << LOGS::PACKET << "Length of NLRI: " << len << std::endl;
-    std::vector<NLRI> routes;
-    while( len > 0 ) {
-        if( offset >= update_len ) {
-            logger.logError() << LOGS::PACKET << "Error on parsing message" << std::endl;
-            return { {}, {}, {} };
+    std::vector<path_nlri_t> routes;
+    if( !parse_nlri( update_data + offset, len, add_path, routes ) ) {
+        logger.logError() << LOGS::PACKET << "Error on parsing message" << std::endl;
+        return { {}, {}, {} };
+    }
+
+    return { withdrawn_routes, paths, routes };
+}
+
+static void serialize_nlri( std::vector<uint8_t> &out, const path_nlri_t &n, bool add_path ) {
+    if( add_path ) {
+        uint32_t path_id = bswap( n.path_id );
+        auto ptr = reinterpret_cast<uint8_t*>( &path_id );
+        out.insert( out.end(), ptr, ptr + sizeof( path_id ) );
+    }
+    auto data = n.prefix.serialize();
+    out.insert( out.end(), data.begin(), data.end() );
+}
+
+std::shared_ptr<std::vector<uint8_t>> build_update( const std::vector<path_nlri_t> &prefixes, const std::vector<path_attr_t> &attrs, const std::vector<path_nlri_t> &withdrawn, bool add_path ) {
+    auto pkt_buf = std::make_shared<std::vector<uint8_t>>();
+    pkt_buf->reserve( 1000 );
+    pkt_buf->resize( sizeof( bgp_header ) + sizeof( uint16_t ) );
+
+    // making withdrawn routes
+    for( auto const &w: withdrawn ) {
+        serialize_nlri( *pkt_buf, w, add_path );
+    }
+    uint16_t len = bswap( static_cast<uint16_t>( pkt_buf->size() - sizeof( bgp_header ) - sizeof( uint16_t ) ) );
+    std::memcpy( pkt_buf->data() + sizeof( bgp_header ), &len, sizeof( len ) );
+
+    // making path attributes
+    auto path_offset = pkt_buf->size();
+    pkt_buf->resize( path_offset + sizeof( uint16_t ) );
+    for( auto const &p: attrs ) {
+        auto bytes = p.to_bytes();
+        pkt_buf->insert( pkt_buf->end(), bytes.begin(), bytes.end() );
+    }
+    len = bswap( static_cast<uint16_t>( pkt_buf->size() - path_offset - sizeof( uint16_t ) ) );
+    std::memcpy( pkt_buf->data() + path_offset, &len, sizeof( len ) );
+
+    // making nlri
+    for( auto const &p: prefixes ) {
+        serialize_nlri( *pkt_buf, p, add_path );
+    }
+
+    // header
+    bgp_packet pkt { pkt_buf->data(), pkt_buf->size() };
+    auto header = pkt.get_header();
+    header->type = bgp_type::UPDATE;
+    header->length = pkt_buf->size();
+    std::fill( header->marker.begin(), header->marker.end(), 0xFF );
+
+    return pkt_buf;
+}
+
+static std::size_t nlri_size( const path_nlri_t &n, bool add_path ) {
+    return ( add_path ? sizeof( uint32_t ) : 0 ) + 1 + ( n.prefix.get_len() + 7 ) / 8;
+}
+
+std::vector<std::shared_ptr<std::vector<uint8_t>>> build_updates( const std::vector<path_nlri_t> &prefixes, const std::vector<path_attr_t> &attrs, const std::vector<path_nlri_t> &withdrawn, bool add_path ) {
+    std::size_t attrs_len = 0;
+    for( auto const &attr: attrs ) {
+        attrs_len += attr.to_bytes().size();
+    }
+    // header, withdrawn routes length and path attributes length
+    static constexpr std::size_t empty_len = sizeof( bgp_header ) + 2 * sizeof( uint16_t );
+    std::vector<std::shared_ptr<std::vector<uint8_t>>> pkts;
+    std::size_t w = 0;
+    std::size_t p = 0;
+    while( w < withdrawn.size() || p < prefixes.size() ) {
+        std::size_t len = empty_len;
+        std::vector<path_nlri_t> w_part;
+        std::vector<path_nlri_t> p_part;
+        while( w < withdrawn.size() && len + nlri_size( withdrawn[ w ], add_path ) <= BGP_MAX_MSG_SIZE ) {
+            len += nlri_size( withdrawn[ w ], add_path );
+            w_part.push_back( withdrawn[ w++ ] );
+        }
+        if( p < prefixes.size() && len + attrs_len + nlri_size( prefixes[ p ], add_path ) <= BGP_MAX_MSG_SIZE ) {
+            len += attrs_len;
+            while( p < prefixes.size() && len + nlri_size( prefixes[ p ], add_path ) <= BGP_MAX_MSG_SIZE ) {
+                len += nlri_size( prefixes[ p ], add_path );
+                p_part.push_back( prefixes[ p++ ] );
+            }
         }
+        if( w_part.empty() && p_part.empty() ) {
+            logger.logError() << LOGS::PACKET << "Path attributes of " << attrs_len << " bytes leave no room for prefixes, "
+            << prefixes.size() - p << " prefixes are not sent" << std::endl;
+            break;
+        }
+        pkts.push_back( build_update( p_part, p_part.empty() ? std::vector<path_attr_t>{} : attrs, w_part, add_path ) );
+    }
+    return pkts;
+}
 
-        uint8_t nlri_len = *reinterpret_cast<uint8_t*>( update_data + offset );
-        len -= sizeof( nlri_len );
-        
-        auto bytes = nlri_len / 8;
-        if( nlri_len % 8 != 0 ) {
-            bytes++;
+// one UPDATE of IPv6 routes, attrs don't contain NEXT_HOP and MP_REACH_NLRI
+static std::shared_ptr<std::vector<uint8_t>> build_update_v6( const std::vector<path_nlri_t> &prefixes, const std::vector<path_attr_t> &attrs, const std::vector<uint8_t> &nexthop, const std::vector<path_nlri_t> &withdrawn ) {
+    std::vector<path_attr_t> mp_attrs;
+    if( !prefixes.empty() ) {
+        mp_attrs = attrs;
+        path_attr_t reach;
+        reach.make_mp_reach( nexthop, prefixes );
+        mp_attrs.push_back( std::move( reach ) );
+    }
+    if( !withdrawn.empty() || prefixes.empty() ) {
+        // empty MP_UNREACH_NLRI is End-of-RIB
+        path_attr_t unreach;
+        unreach.make_mp_unreach( withdrawn );
+        mp_attrs.push_back( std::move( unreach ) );
+    }
+    return build_update( {}, mp_attrs, {}, false );
+}
+
+std::vector<std::shared_ptr<std::vector<uint8_t>>> build_updates_v6( const std::vector<path_nlri_t> &prefixes, const std::vector<path_attr_t> &attrs, const std::vector<uint8_t> &nexthop, const std::vector<path_nlri_t> &withdrawn ) {
+    if( prefixes.empty() && withdrawn.empty() ) {
+        return { build_update_v6( {}, {}, {}, {} ) };
+    }
+    std::vector<path_attr_t> other_attrs;
+    std::size_t attrs_len = 0;
+    for( auto const &attr: attrs ) {
+        if( attr.type != PATH_ATTRIBUTE::MP_REACH_NLRI && attr.type != PATH_ATTRIBUTE::NEXT_HOP ) {
+            attrs_len += attr.to_bytes().size();
+            other_attrs.push_back( attr );
+        }
+    }
+    // header, withdrawn routes length and path attributes length
+    static constexpr std::size_t empty_len = sizeof( bgp_header ) + 2 * sizeof( uint16_t );
+    // MP attribute header with extended length, AFI and SAFI
+    static constexpr std::size_t mp_header_len = 4 + 3;
+    // next hop length, next hop and reserved octet follow AFI and SAFI in MP_REACH_NLRI
+    auto reach_len = mp_header_len + 1 + nexthop.size() + 1;
+    std::vector<std::shared_ptr<std::vector<uint8_t>>> pkts;
+    std::size_t w = 0;
+    std::size_t p = 0;
+    while( w < withdrawn.size() || p < prefixes.size() ) {
+        std::size_t len = empty_len;
+        std::vector<path_nlri_t> w_part;
+        std::vector<path_nlri_t> p_part;
+        if( w < withdrawn.size() ) {
+            len += mp_header_len;
+            while( w < withdrawn.size() && len + nlri_size( withdrawn[ w ], false ) <= BGP_MAX_MSG_SIZE ) {
+                len += nlri_size( withdrawn[ w ], false );
+                w_part.push_back( withdrawn[ w++ ] );
+            }
+        }
+        if( p < prefixes.size() && len + attrs_len + reach_len + nlri_size( prefixes[ p ], false ) <= BGP_MAX_MSG_SIZE ) {
+            len += attrs_len + reach_len;
+            while( p < prefixes.size() && len + nlri_size( prefixes[ p ], false ) <= BGP_MAX_MSG_SIZE ) {
+                len += nlri_size( prefixes[ p ], false );
+                p_part.push_back( prefixes[ p++ ] );
+            }
+        }
+        if( w_part.empty() && p_part.empty() ) {
+            logger.logError() << LOGS::PACKET << "Path attributes of " << attrs_len << " bytes leave no room for IPv6 prefixes, "
+            << prefixes.size() - p << " prefixes are not sent" << std::endl;
+            break;
         }
+        pkts.push_back( build_update_v6( p_part, other_attrs, nexthop, w_part ) );
+    }
+    return pkts;
+}
 
-        if( bytes > len ) {
-            logger.logError() << LOGS::PACKET << "Error on parsing message" << std::endl;
-            return { {}, {}, {} };
+bgp_mp_nlri take_mp_nlri( std::vector<path_attr_t> &attrs ) {
+    bgp_mp_nlri mp { {}, {}, false, false };
+    std::optional<path_attr_t> nexthop_attr;
+    for( auto it = attrs.begin(); it != attrs.end(); ) {
+        if( it->type != PATH_ATTRIBUTE::MP_REACH_NLRI && it->type != PATH_ATTRIBUTE::MP_UNREACH_NLRI ) {
+            it++;
+            continue;
+        }
+        auto &bytes = it->bytes;
+        if( bytes.size() < 3 ) {
+            logger.logError() << LOGS::PACKET << "Too short " << it->type << " attribute" << std::endl;
+            it = attrs.erase( it );
+            continue;
+        }
+        auto afi = static_cast<BGP_AFI>( ( bytes[ 0 ] << 8 ) | bytes[ 1 ] );
+        auto safi = static_cast<BGP_SAFI>( bytes[ 2 ] );
+        if( afi != BGP_AFI::IPv6 || safi != BGP_SAFI::UNICAST ) {
+            logger.logError() << LOGS::PACKET << "Unsupported AFI " << static_cast<int>( afi ) << " SAFI " << static_cast<int>( safi )
+            << " in " << it->type << " attribute" << std::endl;
+            it = attrs.erase( it );
+            continue;
         }
-        len -= bytes;
+        if( it->type == PATH_ATTRIBUTE::MP_UNREACH_NLRI ) {
+            mp.has_unreach = true;
+            if( !parse_nlri( bytes.data() + 3, bytes.size() - 3, false, mp.withdrawn, BGP_AFI::IPv6 ) ) {
+                logger.logError() << LOGS::PACKET << "Error on parsing MP_UNREACH_NLRI" << std::endl;
+                mp.withdrawn.clear();
+            }
+            it = attrs.erase( it );
+            continue;
+        }
+        // next hop is global or global and link local address, then reserved octet
+        std::size_t nh_len = bytes.size() > 3 ? bytes[ 3 ] : 0;
+        if( ( nh_len != 16 && nh_len != 32 ) || bytes.size() < 4 + nh_len + 1 ) {
+            logger.logError() << LOGS::PACKET << "Invalid next hop in MP_REACH_NLRI" << std::endl;
+            it = attrs.erase( it );
+            continue;
+        }
+        mp.has_reach = true;
+        auto nlri_offset = 4 + nh_len + 1;
+        if( !parse_nlri( bytes.data() + nlri_offset, bytes.size() - nlri_offset, false, mp.routes, BGP_AFI::IPv6 ) ) {
+            logger.logError() << LOGS::PACKET << "Error on parsing MP_REACH_NLRI" << std::endl;
+            mp.routes.clear();
+        }
+        nexthop_attr.emplace();
+        nexthop_attr->make_mp_reach( { bytes.begin() + 4, bytes.begin() + 4 + nh_len }, {} );
+        it = attrs.erase( it );
+    }
+    if( nexthop_attr ) {
+        attrs.push_back( std::move( *nexthop_attr ) );
+    }
+    return mp;
+}
 
-        routes.emplace_back( BGP_AFI::IPv4, update_data + offset + 1, nlri_len );
-        offset += sizeof( nlri_len ) + bytes;
+void path_attr_t::make_mp_reach( const std::vector<uint8_t> &nexthop, const std::vector<path_nlri_t> &prefixes ) {
+    optional = 1;
+    transitive = 0;
+    extended_length = 1;
+    type = PATH_ATTRIBUTE::MP_REACH_NLRI;
+    communities.reset();
+    bytes = { 0, static_cast<uint8_t>( BGP_AFI::IPv6 ), static_cast<uint8_t>( BGP_SAFI::UNICAST ), static_cast<uint8_t>( nexthop.size() ) };
+    bytes.insert( bytes.end(), nexthop.begin(), nexthop.end() );
+    bytes.push_back( 0 );
+    for( auto const &p: prefixes ) {
+        serialize_nlri( bytes, p, false );
     }
+}
 
-    return { withdrawn_routes, paths, routes };
+void path_attr_t::make_mp_unreach( const std::vector<path_nlri_t> &prefixes ) {
+    optional = 1;
+    transitive = 0;
+    extended_length = 1;
+    type = PATH_ATTRIBUTE::MP_UNREACH_NLRI;
+    communities.reset();
+    bytes = { 0, static_cast<uint8_t>( BGP_AFI::IPv6 ), static_cast<uint8_t>( BGP_SAFI::UNICAST ) };
+    for( auto const &p: prefixes ) {
+        serialize_nlri( bytes, p, false );
+    }
+}
+
+std::vector<uint8_t> path_attr_t::get_mp_nexthop() const {
+    if( type != PATH_ATTRIBUTE::MP_REACH_NLRI || bytes.size() < 4 || bytes.size() < 4u + bytes[ 3 ] ) {
+        return {};
+    }
+    return { bytes.begin() + 4, bytes.begin() + 4 + bytes[ 3 ] };
 }
 
 bool operator==( const path_attr_t &lhs, const path_attr_t &rhs ) {
@@ -291,10 +615,55 @@ bool operator==( const path_attr_t &lhs, const path_attr_t &rhs ) {
             lhs.partial == rhs.partial &&
             lhs.extended_length == rhs.extended_length &&
             lhs.type == rhs.type &&
-            lhs.bytes == rhs.bytes;
+            lhs.bytes == rhs.bytes &&
+            // community lists are interned
+            lhs.communities == rhs.communities;
+}
+
+void path_attr_t::make_communities( std::shared_ptr<const community_list> list ) {
+    optional = 1;
+    transitive = 1;
+    bytes.clear();
+    type = list->get_type();
+    communities = std::move( list );
+}
+
+void path_attr_t::make_originator_id( uint32_t id ) {
+    optional = 1;
+    transitive = 0;
+    bytes.clear();
+    communities.reset();
+    type = PATH_ATTRIBUTE::ORIGINATOR_ID;
+    id = bswap( id );
+    bytes.resize( sizeof( id ) );
+    std::memcpy( bytes.data(), &id, sizeof( id ) );
+}
+
+void path_attr_t::make_cluster_list( const std::vector<uint32_t> &ids ) {
+    optional = 1;
+    transitive = 0;
+    bytes.clear();
+    communities.reset();
+    type = PATH_ATTRIBUTE::CLUSTER_LIST;
+    bytes.resize( ids.size() * sizeof( uint32_t ) );
+    for( std::size_t i = 0; i < ids.size(); i++ ) {
+        auto id = bswap( ids[ i ] );
+        std::memcpy( bytes.data() + i * sizeof( id ), &id, sizeof( id ) );
+    }
+}
+
+std::vector<uint32_t> path_attr_t::parse_cluster_list() const {
+    std::vector<uint32_t> ids;
+    for( std::size_t pos = 0; pos + sizeof( uint32_t ) <= bytes.size(); pos += sizeof( uint32_t ) ) {
+        uint32_t id;
+        std::memcpy( &id, bytes.data() + pos, sizeof( id ) );
+        ids.push_back( bswap( id ) );
+    }
+    return ids;
 }
 
 void path_attr_t::make_local_pref( uint32_t val ) {
+    transitive = 1;
     bytes.clear();
     val = bswap( val );
     type = PATH_ATTRIBUTE::LOCAL_PREF;
@@ -319,6 +688,7 @@ void path_attr_t::make_nexthop( const NLRI &a ) {
 }
 
 void path_attr_t::make_nexthop( const boost::asio::ip::address &a ) {
+    transitive = 1;
     bytes.clear();
     type = PATH_ATTRIBUTE::NEXT_HOP;
     if( a.is_v4() ) {
@@ -331,6 +701,7 @@ void path_attr_t::make_nexthop( const boost::asio::ip::address &a ) {
 }
 
 void path_attr_t::make_nexthop( const address_v4 &a ) {
+    transitive = 1;
     bytes.clear();
     type = PATH_ATTRIBUTE::NEXT_HOP;
     auto temp = a.to_bytes();
@@ -351,7 +722,7 @@ void path_attr_t::make_as_path( std::vector<uint32_t> aspath ) {
     header->type = AS_PATH_SEGMENT_TYPE::AS_SEQUENCE;
     header->len = aspath.size();
     
-    for( int i = 0; i < aspath.size(); i++ ) {
+    for( std::size_t i = 0; i < aspath.size(); i++ ) {
         if( four_byte_asn ) {
             header->val32[ i ] = aspath[ i ];
         } else {
@@ -1,9 +1,13 @@
 #ifndef PACKET_HPP_
 #define PACKET_HPP_
 
+#include <memory>
+
 #include "net_integer.hpp"
 
 class NLRI;
+struct path_nlri_t;
+class community_list;
 
 enum class PATH_ATTRIBUTE : uint8_t {
     ORIGIN = 1,
@@ -13,6 +17,13 @@ enum class PATH_ATTRIBUTE : uint8_t {
     LOCAL_PREF = 5,
     ATOMIC_AGGREGATE = 6,
     AGGREGATOR = 7,
+    COMMUNITIES = 8,
+    ORIGINATOR_ID = 9,
+    CLUSTER_LIST = 10,
+    MP_REACH_NLRI = 14,
+    MP_UNREACH_NLRI = 15,
+    EXTENDED_COMMUNITIES = 16,
+    LARGE_COMMUNITY = 32,
 };
 
 enum class ORIGIN : uint8_t {
@@ -57,6 +68,13 @@ enum class BGP_SAFI : uint8_t {
     MULTICAST = 2,
 };
 
+enum class ADD_PATH_DIR : uint8_t {
+    NONE = 0,
+    RECEIVE = 1,
+    SEND = 2,
+    BOTH = 3,
+};
+
 enum class BGP_ERR_CODE : uint8_t {
     MESSAGE_HEADER = 1,
     OPEN_MESSAGE = 2,
@@ -162,10 +180,12 @@ struct path_attr_t {
     PATH_ATTRIBUTE type;
     std::vector<uint8_t> bytes;
     bool four_byte_asn;
+    // value of community attributes, bytes are empty for them
+    std::shared_ptr<const community_list> communities;
 
-    path_attr_t() = default;
+    path_attr_t();
     path_attr_t( path_attr_header *header, bool four_byte_asn = false );
-    path_attr_t( path_attr_header_extlen *header );
+    path_attr_t( path_attr_header_extlen *header, bool four_byte_asn = false );
 
     void make_local_pref( uint32_t val );
     void make_origin( ORIGIN o );
@@ -173,6 +193,15 @@ struct path_attr_t {
     void make_nexthop( const boost::asio::ip::address &a );
     void make_nexthop( const address_v4 &a );
     void make_as_path( std::vector<uint32_t> aspath );
+    void make_communities( std::shared_ptr<const community_list> list );
+    // route reflection attributes
+    void make_originator_id( uint32_t id );
+    void make_cluster_list( const std::vector<uint32_t> &ids );
+    std::vector<uint32_t> parse_cluster_list() const;
+    // IPv6 unicast, MP_REACH_NLRI without prefixes keeps next hop of path in RIB
+    void make_mp_reach( const std::vector<uint8_t> &nexthop, const std::vector<path_nlri_t> &prefixes );
+    void make_mp_unreach( const std::vector<path_nlri_t> &prefixes );
+    std::vector<uint8_t> get_mp_nexthop() const;
 
     uint32_t get_u32() const;
     std::vector<uint32_t> parse_as_path() const;
@@ -220,6 +249,11 @@ struct bgp_cap_t {
     void make_fqdn( const std::string &host, const std::string &domain );
     void make_4byte_asn( uint32_t asn );
     void make_mp_bgp( BGP_AFI afi ,BGP_SAFI safi );
+    void make_graceful_restart( uint16_t restart_time, bool restarting );
+    void make_add_path( BGP_AFI afi, BGP_SAFI safi, ADD_PATH_DIR dir );
+    uint16_t get_restart_time() const;
+    ADD_PATH_DIR get_add_path( BGP_AFI afi, BGP_SAFI safi ) const;
+    bool is_mp_bgp( BGP_AFI afi, BGP_SAFI safi ) const;
     std::vector<uint8_t> toBytes() const;
 };
 
@@ -250,7 +284,28 @@ struct bgp_packet {
     bgp_open* get_open();
     bgp_notification* get_notification();
     uint8_t* get_body();
-    std::tuple<std::vector<NLRI>,std::vector<path_attr_t>,std::vector<NLRI>> process_update( bool four_byte_asn );
+    std::tuple<std::vector<path_nlri_t>,std::vector<path_attr_t>,std::vector<path_nlri_t>> process_update( bool four_byte_asn, bool add_path );
 };
 
+std::shared_ptr<std::vector<uint8_t>> build_update( const std::vector<path_nlri_t> &prefixes, const std::vector<path_attr_t> &attrs, const std::vector<path_nlri_t> &withdrawn, bool add_path );
+// maximum length of BGP message without Extended Messages
+static constexpr std::size_t BGP_MAX_MSG_SIZE = 4096;
+// IPv4 prefixes and withdrawn routes split into UPDATEs of at most BGP_MAX_MSG_SIZE bytes, withdrawn routes go first.
+// Prefixes are dropped with error if attributes leave no room for them
+std::vector<std::shared_ptr<std::vector<uint8_t>>> build_updates( const std::vector<path_nlri_t> &prefixes, const std::vector<path_attr_t> &attrs, const std::vector<path_nlri_t> &withdrawn, bool add_path );
+// prefixes and withdrawn routes are IPv6 and are sent in MP_REACH_NLRI and MP_UNREACH_NLRI,
+// split into UPDATEs of at most BGP_MAX_MSG_SIZE bytes like build_updates. Without routes it is End-of-RIB
+std::vector<std::shared_ptr<std::vector<uint8_t>>> build_updates_v6( const std::vector<path_nlri_t> &prefixes, const std::vector<path_attr_t> &attrs, const std::vector<uint8_t> &nexthop, const std::vector<path_nlri_t> &withdrawn );
+
+// IPv6 unicast routes of UPDATE, which are carried in MP attributes
+struct bgp_mp_nlri {
+    std::vector<path_nlri_t> routes;
+    std::vector<path_nlri_t> withdrawn;
+    bool has_reach;
+    bool has_unreach;
+};
+
+// takes IPv6 unicast NLRI out of MP attributes, MP_REACH_NLRI stays in attrs only with next hop
+bgp_mp_nlri take_mp_nlri( std::vector<path_attr_t> &attrs );
+
 #endif
\ No newline at end of file
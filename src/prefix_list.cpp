@@ -0,0 +1,57 @@
+#include <limits>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "prefix_list.hpp"
+#include "nlri.hpp"
+#include "packet.hpp"
+
+static int prefix_bit( const std::vector<uint8_t> &data, int bit ) {
+    return ( data[ bit / 8 ] >> ( 7 - bit % 8 ) ) & 1;
+}
+
+prefix_trie::prefix_trie() {
+    nodes.push_back( node { { -1, -1 }, {} } );
+    nodes.push_back( node { { -1, -1 }, {} } );
+}
+
+int32_t prefix_trie::root( const NLRI &prefix ) {
+    return prefix.get_afi() == BGP_AFI::IPv6 ? 1 : 0;
+}
+
+void prefix_trie::insert( const NLRI &prefix, uint8_t ge, uint8_t le, bool permit, uint32_t seq ) {
+    auto const &data = prefix.get_data();
+    int32_t current = root( prefix );
+    for( int bit = 0; bit < prefix.get_len(); bit++ ) {
+        auto b = prefix_bit( data, bit );
+        if( nodes[ current ].child[ b ] < 0 ) {
+            nodes[ current ].child[ b ] = nodes.size();
+            nodes.push_back( node { { -1, -1 }, {} } );
+        }
+        current = nodes[ current ].child[ b ];
+    }
+    nodes[ current ].rules.push_back( { ge, le, permit, seq } );
+}
+
+bool prefix_trie::match( const NLRI &prefix ) const {
+    auto const &data = prefix.get_data();
+    auto len = prefix.get_len();
+    uint32_t best_seq = std::numeric_limits<uint32_t>::max();
+    bool permit = false;
+    int32_t current = root( prefix );
+    for( int bit = 0; current >= 0; bit++ ) {
+        for( auto const &r: nodes[ current ].rules ) {
+            if( len >= r.ge && len <= r.le && r.seq < best_seq ) {
+                best_seq = r.seq;
+                permit = r.permit;
+            }
+        }
+        if( bit >= len ) {
+            break;
+        }
+        current = nodes[ current ].child[ prefix_bit( data, bit ) ];
+    }
+    return permit;
+}
@@ -0,0 +1,36 @@
+#ifndef PREFIX_LIST_HPP_
+#define PREFIX_LIST_HPP_
+
+#include <vector>
+#include <cstdint>
+
+class NLRI;
+
+// Prefix list stored as binary trie. Entries are attached to the node of their
+// prefix, so lookup only walks bits of the checked prefix and its cost doesn't
+// depend on the number of entries. IPv4 and IPv6 prefixes have separate roots.
+class prefix_trie {
+public:
+    prefix_trie();
+    // entry matches prefixes covered by prefix with length in [ge, le], lower seq wins
+    void insert( const NLRI &prefix, uint8_t ge, uint8_t le, bool permit, uint32_t seq );
+    // true if first matching entry permits prefix, false if it denies or nothing matches
+    bool match( const NLRI &prefix ) const;
+private:
+    struct rule {
+        uint8_t ge;
+        uint8_t le;
+        bool permit;
+        uint32_t seq;
+    };
+    struct node {
+        int32_t child[ 2 ];
+        std::vector<rule> rules;
+    };
+    static int32_t root( const NLRI &prefix );
+
+    // nodes are kept in one vector and linked by index, first two are roots
+    std::vector<node> nodes;
+};
+
+#endif
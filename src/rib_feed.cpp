@@ -0,0 +1,181 @@
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "rib_feed.hpp"
+#include "rib_snapshot.hpp"
+#include "table.hpp"
+#include "table_v6.hpp"
+#include "fsm.hpp"
+#include "packet.hpp"
+#include "message.hpp"
+#include "config.hpp"
+
+// network byte order
+template<typename T>
+static void put( std::string &out, T value ) {
+    for( int shift = ( sizeof( T ) - 1 ) * 8; shift >= 0; shift -= 8 ) {
+        out.push_back( static_cast<char>( value >> shift ) );
+    }
+}
+
+rib_subscription::rib_subscription( std::optional<NLRI> p, std::shared_ptr<bgp_fsm> nei, std::function<void()> r ):
+    prefix( std::move( p ) ),
+    peer( std::move( nei ) ),
+    ready( std::move( r ) ),
+    replaced( 0 )
+{}
+
+bool rib_subscription::matches( const NLRI &p ) const {
+    return !prefix || prefix->covers( p );
+}
+
+void rib_subscription::push( const NLRI &p, const bgp_fsm *source, const std::shared_ptr<const std::string> &event ) {
+    auto queued = event;
+    std::unique_lock<std::mutex> guard( lock );
+    if( peer ) {
+        if( source == peer.get() ) {
+            announced.insert( p );
+        } else if( announced.erase( p ) > 0 ) {
+            // best path moved away from peer
+            queued = source != nullptr ? rib_feed::encode( p, nullptr ) : event;
+        } else {
+            return;
+        }
+    }
+    bool was_empty = pending.empty();
+    auto [ it, inserted ] = pending.emplace( p, queued );
+    if( !inserted ) {
+        it->second = std::move( queued );
+        replaced++;
+    }
+    guard.unlock();
+    if( was_empty ) {
+        ready();
+    }
+}
+
+std::string rib_subscription::take( std::size_t max_events, uint64_t &coalesced ) {
+    std::string out;
+    std::size_t count = 0;
+    std::lock_guard<std::mutex> guard( lock );
+    for( auto it = pending.begin(); it != pending.end() && count < max_events; count++ ) {
+        out += *it->second;
+        it = pending.erase( it );
+    }
+    coalesced = replaced;
+    replaced = 0;
+    return out;
+}
+
+bool rib_subscription::empty() const {
+    std::lock_guard<std::mutex> guard( lock );
+    return pending.empty();
+}
+
+rib_feed::rib_feed( bgp_table_v4 &t, bgp_table_v6 &t6 ):
+    table( t ),
+    table_v6( t6 )
+{
+    table.add_best_path_listener( [ this ]( const NLRI &prefix, const bgp_path *path ) {
+        on_best_path( prefix, path );
+    });
+    table_v6.add_best_path_listener( [ this ]( const NLRI &prefix, const bgp_path *path ) {
+        on_best_path( prefix, path );
+    });
+}
+
+void rib_feed::subscribe( const std::shared_ptr<rib_subscription> &sub ) {
+    auto rib = rib_snapshot::take( table, table_v6 );
+    auto initial = [ &sub ]( const NLRI &prefix, const std::vector<bgp_path> &paths ) {
+        if( !sub->matches( prefix ) ) {
+            return true;
+        }
+        for( auto const &path: paths ) {
+            if( path.isBest ) {
+                sub->push( prefix, path.source.get(), encode( prefix, &path ) );
+            }
+        }
+        return true;
+    };
+    rib->for_each_v4_after( std::nullopt, initial );
+    rib->for_each_v6_after( std::nullopt, [ &initial ]( const prefix_v6 &prefix, const std::vector<bgp_path> &paths ) {
+        return initial( prefix.to_nlri(), paths );
+    });
+    subscriptions.push_back( sub );
+}
+
+void rib_feed::on_best_path( const NLRI &prefix, const bgp_path *path ) {
+    std::shared_ptr<const std::string> event;
+    for( auto it = subscriptions.begin(); it != subscriptions.end(); ) {
+        auto sub = it->lock();
+        if( !sub ) {
+            it = subscriptions.erase( it );
+            continue;
+        }
+        it++;
+        if( !sub->matches( prefix ) ) {
+            continue;
+        }
+        if( !event ) {
+            event = encode( prefix, path );
+        }
+        sub->push( prefix, path != nullptr ? path->source.get() : nullptr, event );
+    }
+}
+
+std::shared_ptr<const std::string> rib_feed::encode( const NLRI &prefix, const bgp_path *path ) {
+    auto event = std::make_shared<std::string>();
+    auto &out = *event;
+    put( out, static_cast<uint8_t>( path != nullptr ? RIB_EVENT::ANNOUNCE : RIB_EVENT::WITHDRAW ) );
+    put( out, static_cast<uint8_t>( prefix.get_afi() ) );
+    auto bytes = prefix.serialize();
+    out.append( bytes.begin(), bytes.end() );
+    if( path == nullptr ) {
+        return event;
+    }
+    put( out, path->source ? path->source->conf.address.to_uint() : 0U );
+    std::vector<uint8_t> nexthop;
+    uint32_t local_pref = 100;
+    uint32_t med = 0;
+    std::vector<uint32_t> as_path;
+    for( auto const &attr: *path->attrs ) {
+        switch( attr.type ) {
+        case PATH_ATTRIBUTE::NEXT_HOP:
+            if( prefix.get_afi() == BGP_AFI::IPv4 ) {
+                auto bytes = address_v4( attr.get_u32() ).to_bytes();
+                nexthop.assign( bytes.begin(), bytes.end() );
+            }
+            break;
+        case PATH_ATTRIBUTE::MP_REACH_NLRI:
+            if( prefix.get_afi() == BGP_AFI::IPv6 ) {
+                // link local address after global one is not sent
+                nexthop = attr.get_mp_nexthop();
+                nexthop.resize( std::min<std::size_t>( nexthop.size(), 16 ) );
+            }
+            break;
+        case PATH_ATTRIBUTE::LOCAL_PREF:
+            local_pref = attr.get_u32();
+            break;
+        case PATH_ATTRIBUTE::MULTI_EXIT_DISC:
+            med = attr.get_u32();
+            break;
+        case PATH_ATTRIBUTE::AS_PATH:
+            as_path = attr.parse_as_path();
+            break;
+        default:
+            break;
+        }
+    }
+    put( out, static_cast<uint8_t>( nexthop.size() ) );
+    out.append( nexthop.begin(), nexthop.end() );
+    put( out, local_pref );
+    put( out, med );
+    as_path.resize( std::min<std::size_t>( as_path.size(), UINT16_MAX ) );
+    put( out, static_cast<uint16_t>( as_path.size() ) );
+    for( auto as: as_path ) {
+        put( out, as );
+    }
+    return event;
+}
@@ -0,0 +1,60 @@
+#ifndef RIB_FEED_HPP_
+#define RIB_FEED_HPP_
+
+#include <map>
+#include <set>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <optional>
+#include <functional>
+
+#include "nlri.hpp"
+
+struct bgp_path;
+struct bgp_fsm;
+class bgp_table_v4;
+class bgp_table_v6;
+
+// Best path changes of one subscriber. Latest encoded event is kept per prefix,
+// so while subscriber is slow its queue is bounded by number of prefixes.
+// Events are pushed on event loop and taken on CLI thread.
+class rib_subscription {
+public:
+    // ready is called when first event is queued after queue was drained
+    rib_subscription( std::optional<NLRI> p, std::shared_ptr<bgp_fsm> nei, std::function<void()> r );
+    bool matches( const NLRI &prefix ) const;
+    void push( const NLRI &prefix, const bgp_fsm *source, const std::shared_ptr<const std::string> &event );
+    // concatenated events, at most max_events of them, coalesced is number of replaced events
+    std::string take( std::size_t max_events, uint64_t &coalesced );
+    bool empty() const;
+private:
+    std::optional<NLRI> prefix;
+    std::shared_ptr<bgp_fsm> peer;
+    std::function<void()> ready;
+    mutable std::mutex lock;
+    std::map<NLRI,std::shared_ptr<const std::string>> pending;
+    // prefixes announced with best path from peer, they are withdrawn when best path moves to other peer
+    std::set<NLRI> announced;
+    uint64_t replaced;
+};
+
+// Source of best path change events of both tables. Event is encoded once and
+// queued to every subscription which matches it.
+class rib_feed {
+public:
+    rib_feed( bgp_table_v4 &t, bgp_table_v6 &t6 );
+    // subscription gets current best paths first, they are taken from rib_snapshot
+    void subscribe( const std::shared_ptr<rib_subscription> &sub );
+    // encoding of RIB_EVENT, path is nullptr for withdraw
+    static std::shared_ptr<const std::string> encode( const NLRI &prefix, const bgp_path *path );
+private:
+    void on_best_path( const NLRI &prefix, const bgp_path *path );
+
+    bgp_table_v4 &table;
+    bgp_table_v6 &table_v6;
+    std::list<std::weak_ptr<rib_subscription>> subscriptions;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#include <array>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "rib_snapshot.hpp"
+#include "table.hpp"
+#include "table_v6.hpp"
+#include "packet.hpp"
+
+std::shared_ptr<const rib_snapshot> rib_snapshot::take( bgp_table_v4 &v4, bgp_table_v6 &v6 ) {
+    auto snapshot = std::make_shared<rib_snapshot>();
+    snapshot->v4 = v4.publish_segments();
+    snapshot->v6 = v6.publish_segments();
+    snapshot->path_count = v4.table.size() + v6.size();
+    return snapshot;
+}
+
+// leading bits of address, prefix is padded with zeros
+std::size_t rib_snapshot::segment( const NLRI &prefix ) {
+    auto const &data = prefix.get_data();
+    std::size_t first = data.size() > 0 ? data[ 0 ] : 0;
+    std::size_t second = data.size() > 1 ? data[ 1 ] : 0;
+    return ( ( first << 8 ) | second ) >> ( 16 - RIB_SEGMENT_BITS );
+}
+
+std::size_t rib_snapshot::segment( const prefix_v6 &prefix ) {
+    return prefix.hi >> ( 64 - RIB_SEGMENT_BITS );
+}
+
+// Prefixes are ordered by address bytes, then by length, and prefix of n bits
+// has n / 8 rounded up bytes. Segment whose bits end on byte boundary starts with
+// one byte prefixes, others start with two byte ones.
+NLRI rib_snapshot::segment_start( std::size_t index ) {
+    std::array<uint8_t,2> bytes {
+        static_cast<uint8_t>( index >> ( RIB_SEGMENT_BITS - 8 ) ),
+        static_cast<uint8_t>( index << ( 16 - RIB_SEGMENT_BITS ) )
+    };
+    if( index == 0 ) {
+        return NLRI( BGP_AFI::IPv4, bytes.data(), 0 );
+    }
+    return NLRI( BGP_AFI::IPv4, bytes.data(), bytes[ 1 ] == 0 ? 1 : 9 );
+}
+
+std::size_t rib_snapshot::size() const {
+    return path_count;
+}
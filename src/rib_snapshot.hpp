@@ -0,0 +1,126 @@
+#ifndef RIB_SNAPSHOT_HPP_
+#define RIB_SNAPSHOT_HPP_
+
+#include <memory>
+#include <vector>
+#include <optional>
+#include <algorithm>
+
+#include "nlri.hpp"
+#include "trie_v6.hpp"
+
+struct bgp_path;
+class bgp_table_v4;
+class bgp_table_v6;
+
+// tables are split into segments by leading bits of prefix
+static constexpr uint8_t RIB_SEGMENT_BITS = 12;
+static constexpr std::size_t RIB_SEGMENTS = std::size_t( 1 ) << RIB_SEGMENT_BITS;
+
+// copy of paths of prefixes in one segment, in table order
+template<typename Key>
+using rib_segment = std::vector<std::pair<Key,std::vector<bgp_path>>>;
+
+// Immutable copies of table segments. Table marks segments which it changes,
+// only these are copied again when snapshot is taken, others are shared with
+// previous snapshots.
+template<typename Segment>
+class rib_segments {
+public:
+    rib_segments():
+        published( RIB_SEGMENTS ),
+        dirty( RIB_SEGMENTS, true )
+    {}
+
+    void mark( std::size_t index ) {
+        dirty[ index ] = true;
+    }
+
+    // copy( index, segment ) fills segment with current content of table
+    template<typename F>
+    const std::vector<std::shared_ptr<const Segment>> &publish( F copy ) {
+        for( std::size_t i = 0; i < RIB_SEGMENTS; i++ ) {
+            if( !dirty[ i ] ) {
+                continue;
+            }
+            auto segment = std::make_shared<Segment>();
+            copy( i, *segment );
+            published[ i ] = std::move( segment );
+            dirty[ i ] = false;
+        }
+        return published;
+    }
+private:
+    std::vector<std::shared_ptr<const Segment>> published;
+    std::vector<bool> dirty;
+};
+
+// Consistent view of IPv4 and IPv6 RIB at one moment. Snapshot doesn't refer
+// to tables and its paths don't refer to next hop state, so it can be walked
+// on any thread while tables are changed by update processing.
+class rib_snapshot {
+public:
+    // called on event loop thread, costs copy of segments changed since previous snapshot
+    static std::shared_ptr<const rib_snapshot> take( bgp_table_v4 &v4, bgp_table_v6 &v6 );
+    static std::size_t segment( const NLRI &prefix );
+    static std::size_t segment( const prefix_v6 &prefix );
+    // key which isn't after any IPv4 prefix of segment
+    static NLRI segment_start( std::size_t index );
+
+    // number of paths
+    std::size_t size() const;
+    // visits prefixes after given one in table order, f( const Key&, const std::vector<bgp_path>& )
+    // returns false to stop, result is false if walk was stopped
+    template<typename F>
+    bool for_each_v4_after( const std::optional<NLRI> &after, F f ) const {
+        return walk( v4, after, f );
+    }
+    template<typename F>
+    bool for_each_v6_after( const std::optional<prefix_v6> &after, F f ) const {
+        return walk( v6, after, f );
+    }
+    // paths of prefix, nullptr if it isn't in snapshot
+    const std::vector<bgp_path> *find_v4( const NLRI &prefix ) const {
+        return find( v4, prefix );
+    }
+    const std::vector<bgp_path> *find_v6( const prefix_v6 &prefix ) const {
+        return find( v6, prefix );
+    }
+private:
+    template<typename Key>
+    static const std::vector<bgp_path> *find( const std::vector<std::shared_ptr<const rib_segment<Key>>> &segments, const Key &key ) {
+        auto const &seg = *segments[ segment( key ) ];
+        auto it = std::lower_bound( seg.begin(), seg.end(), key, []( const auto &entry, const Key &k ) {
+            return entry.first < k;
+        });
+        if( it == seg.end() || key < it->first ) {
+            return nullptr;
+        }
+        return &it->second;
+    }
+
+    template<typename Key, typename F>
+    static bool walk( const std::vector<std::shared_ptr<const rib_segment<Key>>> &segments, const std::optional<Key> &after, F &f ) {
+        for( std::size_t i = after ? segment( *after ) : 0; i < segments.size(); i++ ) {
+            auto const &seg = *segments[ i ];
+            auto it = seg.begin();
+            if( after ) {
+                it = std::upper_bound( seg.begin(), seg.end(), *after, []( const Key &key, const auto &entry ) {
+                    return key < entry.first;
+                });
+            }
+            for( ; it != seg.end(); it++ ) {
+                if( !f( it->first, it->second ) ) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    std::vector<std::shared_ptr<const rib_segment<NLRI>>> v4;
+    std::vector<std::shared_ptr<const rib_segment<prefix_v6>>> v6;
+    std::size_t path_count;
+};
+
+#endif
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <stdexcept>
 #include <boost/asio/ip/address.hpp>
 #include <boost/asio/ip/address_v4.hpp>
 
@@ -7,40 +9,306 @@ using address_v4 = boost::asio::ip::address_v4;
 #include "nlri.hpp"
 #include "packet.hpp"
 #include "config.hpp"
-#include "table.hpp"
+#include "attr_registry.hpp"
 
-bool routePolicyProcess( RoutePolicy &pol, NLRI &nlri, std::vector<path_attr_t> &attrs ) {
+route_policy::route_policy( const RoutePolicy &pol, const GlobalConf &conf ) {
+    static uint32_t next_id = 0;
+    id = next_id++;
+    // prefix lists which are used by several entries are compiled once
+    std::map<std::string,int32_t> named_lists;
+    bool sets_nexthop = false;
+    bool sets_localpref = false;
     for( auto const &entry: pol.entries ) {
+        term t { -1, -1, -1, std::nullopt, std::nullopt, std::nullopt, std::nullopt, {}, {}, entry.action, false, false };
         if( entry.match_prefix_v4 ) {
-            if( nlri != *entry.match_prefix_v4 ) {
+            prefix_trie trie;
+            auto len = entry.match_prefix_v4->get_len();
+            trie.insert( *entry.match_prefix_v4, len, len, true, 0 );
+            t.prefix_list = prefix_lists.size();
+            prefix_lists.push_back( std::move( trie ) );
+        }
+        if( entry.match_prefix_list ) {
+            if( entry.match_prefix_v4 ) {
+                throw std::runtime_error( "match_prefix_v4 and match_prefix_list can't be used together" );
+            }
+            auto named = named_lists.find( *entry.match_prefix_list );
+            if( named != named_lists.end() ) {
+                t.prefix_list = named->second;
+            } else {
+                auto list = conf.prefix_lists.find( *entry.match_prefix_list );
+                if( list == conf.prefix_lists.end() ) {
+                    throw std::runtime_error( "Unknown prefix list: " + *entry.match_prefix_list );
+                }
+                prefix_trie trie;
+                uint32_t seq = 0;
+                for( auto const &e: list->second.entries ) {
+                    auto len = e.prefix.get_len();
+                    uint8_t ge = e.ge.value_or( len );
+                    uint8_t max_len = e.prefix.get_afi() == BGP_AFI::IPv6 ? 128 : 32;
+                    uint8_t le = e.le.value_or( e.ge.has_value() ? max_len : len );
+                    trie.insert( e.prefix, ge, le, e.action == RoutePolicyAction::ACCEPT, seq++ );
+                }
+                t.prefix_list = prefix_lists.size();
+                named_lists.emplace( *entry.match_prefix_list, t.prefix_list );
+                prefix_lists.push_back( std::move( trie ) );
+            }
+        }
+        if( entry.match_as_path ) {
+            t.as_path = as_paths.size();
+            as_paths.emplace_back( *entry.match_as_path );
+        }
+        if( !entry.match_community.empty() ) {
+            std::vector<community_t> set;
+            for( auto const &c: entry.match_community ) {
+                set.push_back( community_t::parse( c ) );
+            }
+            t.community_set = community_sets.size();
+            community_sets.push_back( std::move( set ) );
+        }
+        if( entry.match_nexthop ) {
+            t.nexthop = entry.match_nexthop->to_uint();
+        }
+        t.localpref = entry.match_localpref;
+        if( entry.set_nexthop ) {
+            t.set_nexthop = entry.set_nexthop->to_uint();
+        }
+        t.set_localpref = entry.set_localpref;
+        for( auto const &c: entry.add_community ) {
+            t.add_communities.push_back( community_t::parse( c ) );
+        }
+        for( auto const &c: entry.delete_community ) {
+            t.delete_communities.push_back( community_t::parse( c ) );
+        }
+        // following terms see values set by previous ones
+        t.dynamic_nexthop = t.nexthop && sets_nexthop;
+        t.dynamic_localpref = t.localpref && sets_localpref;
+        sets_nexthop |= t.set_nexthop.has_value();
+        sets_localpref |= t.set_localpref.has_value();
+        terms.push_back( std::move( t ) );
+    }
+}
+
+uint32_t route_policy::get_id() const {
+    return id;
+}
+
+route_policy::attr_match route_policy::match_attrs( const std::vector<path_attr_t> &attrs ) const {
+    // single pass over attributes, terms only use values collected here
+    attr_match matched { {}, std::nullopt, 100 };
+    auto &nexthop = matched.nexthop;
+    auto &localpref = matched.localpref;
+    const path_attr_t *as_path_attr = nullptr;
+    // community lists of path by attribute type
+    std::array<const community_list*,3> communities { nullptr, nullptr, nullptr };
+    for( auto const &attr: attrs ) {
+        switch( attr.type ) {
+        case PATH_ATTRIBUTE::NEXT_HOP:
+            nexthop = attr.get_u32();
+            break;
+        case PATH_ATTRIBUTE::LOCAL_PREF:
+            localpref = attr.get_u32();
+            break;
+        case PATH_ATTRIBUTE::AS_PATH:
+            as_path_attr = &attr;
+            break;
+        case PATH_ATTRIBUTE::COMMUNITIES:
+            communities[ 0 ] = attr.communities.get();
+            break;
+        case PATH_ATTRIBUTE::EXTENDED_COMMUNITIES:
+            communities[ 1 ] = attr.communities.get();
+            break;
+        case PATH_ATTRIBUTE::LARGE_COMMUNITY:
+            communities[ 2 ] = attr.communities.get();
+            break;
+        default:
+            break;
+        }
+    }
+
+    for( std::size_t i = 0; i < terms.size(); i++ ) {
+        auto const &t = terms[ i ];
+        if( t.nexthop && !t.dynamic_nexthop && nexthop != t.nexthop ) {
+            continue;
+        }
+        if( t.localpref && !t.dynamic_localpref && localpref != *t.localpref ) {
+            continue;
+        }
+        if( t.as_path >= 0 && !as_paths[ t.as_path ].match( as_path_attr ) ) {
+            continue;
+        }
+        if( t.community_set >= 0 ) {
+            auto const &set = community_sets[ t.community_set ];
+            auto found = std::any_of( set.begin(), set.end(), [ &communities ]( const community_t &c ) {
+                return std::any_of( communities.begin(), communities.end(), [ &c ]( const community_list *list ) {
+                    return list != nullptr && list->contains( c );
+                });
+            });
+            if( !found ) {
                 continue;
             }
         }
-        for( auto &attr: attrs ) {
-            if( attr.type == PATH_ATTRIBUTE::NEXT_HOP && entry.match_nexthop ) {
-                if( attr.get_u32() != entry.match_nexthop->to_uint() ) {
+        matched.terms.push_back( i );
+        // terms after unconditional accept or drop are never reached
+        if( t.prefix_list < 0 && !t.dynamic_nexthop && !t.dynamic_localpref && t.action != RoutePolicyAction::PASS ) {
+            break;
+        }
+    }
+    return matched;
+}
+
+route_policy::result route_policy::evaluate( const attr_match &matched, const NLRI &prefix ) const {
+    result res { false, std::nullopt, std::nullopt, {} };
+    auto nexthop = matched.nexthop;
+    auto localpref = matched.localpref;
+    for( auto i: matched.terms ) {
+        auto const &t = terms[ i ];
+        if( t.dynamic_nexthop && nexthop != t.nexthop ) {
+            continue;
+        }
+        if( t.dynamic_localpref && localpref != *t.localpref ) {
+            continue;
+        }
+        if( t.prefix_list >= 0 && !prefix_lists[ t.prefix_list ].match( prefix ) ) {
+            continue;
+        }
+        if( t.set_nexthop ) {
+            res.set_nexthop = nexthop = t.set_nexthop;
+        }
+        if( t.set_localpref ) {
+            res.set_localpref = localpref = *t.set_localpref;
+        }
+        if( !t.add_communities.empty() || !t.delete_communities.empty() ) {
+            res.community_terms.push_back( i );
+        }
+        if( t.action == RoutePolicyAction::PASS ) {
+            continue;
+        }
+        res.accept = t.action == RoutePolicyAction::ACCEPT;
+        return res;
+    }
+    return res;
+}
+
+bool route_policy::apply( const NLRI &prefix, std::vector<path_attr_t> &attrs ) const {
+    auto res = evaluate( match_attrs( attrs ), prefix );
+    if( res.accept ) {
+        transform( res, attrs );
+    }
+    return res.accept;
+}
+
+void route_policy::transform( const result &res, std::vector<path_attr_t> &attrs ) const {
+    bool nexthop_found = false;
+    bool localpref_found = false;
+    for( auto &attr: attrs ) {
+        if( attr.type == PATH_ATTRIBUTE::NEXT_HOP && res.set_nexthop ) {
+            attr.make_nexthop( address_v4 { *res.set_nexthop } );
+            nexthop_found = true;
+        }
+        if( attr.type == PATH_ATTRIBUTE::LOCAL_PREF && res.set_localpref ) {
+            attr.make_local_pref( *res.set_localpref );
+            localpref_found = true;
+        }
+    }
+    if( res.set_nexthop && !nexthop_found ) {
+        path_attr_t nnh;
+        nnh.make_nexthop( address_v4 { *res.set_nexthop } );
+        attrs.push_back( std::move( nnh ) );
+    }
+    if( res.set_localpref && !localpref_found ) {
+        path_attr_t nlp;
+        nlp.make_local_pref( *res.set_localpref );
+        attrs.push_back( std::move( nlp ) );
+    }
+    if( res.community_terms.empty() ) {
+        return;
+    }
+    for( auto type: { PATH_ATTRIBUTE::COMMUNITIES, PATH_ATTRIBUTE::EXTENDED_COMMUNITIES, PATH_ATTRIBUTE::LARGE_COMMUNITY } ) {
+        auto of_type = [ type ]( const community_t &c ) { return c.type == type; };
+        bool changed = std::any_of( res.community_terms.begin(), res.community_terms.end(), [ & ]( uint16_t i ) {
+            return std::any_of( terms[ i ].add_communities.begin(), terms[ i ].add_communities.end(), of_type ) ||
+                std::any_of( terms[ i ].delete_communities.begin(), terms[ i ].delete_communities.end(), of_type );
+        });
+        if( !changed ) {
+            continue;
+        }
+        auto width = community_list::width( type );
+        auto attr = std::find_if( attrs.begin(), attrs.end(), [ type ]( const path_attr_t &a ) { return a.type == type; } );
+        std::vector<uint32_t> words;
+        if( attr != attrs.end() ) {
+            words = attr->communities->get_words();
+        }
+        for( auto i: res.community_terms ) {
+            for( auto const &c: terms[ i ].delete_communities ) {
+                if( c.type != type ) {
                     continue;
                 }
-            }
-            if( attr.type == PATH_ATTRIBUTE::LOCAL_PREF && entry.match_localpref ) {
-                if( attr.get_u32() != *entry.match_localpref ) {
-                    continue;
+                for( std::size_t pos = 0; pos < words.size(); ) {
+                    if( std::equal( c.words.begin(), c.words.begin() + width, words.begin() + pos ) ) {
+                        words.erase( words.begin() + pos, words.begin() + pos + width );
+                    } else {
+                        pos += width;
+                    }
                 }
             }
-            if( attr.type == PATH_ATTRIBUTE::LOCAL_PREF && entry.set_localpref ) {
-                attr.make_local_pref( *entry.set_localpref );
-            }
-            if( attr.type == PATH_ATTRIBUTE::NEXT_HOP && entry.set_nexthop ) {
-                attr.make_nexthop( *entry.set_nexthop );
+            for( auto const &c: terms[ i ].add_communities ) {
+                if( c.type == type ) {
+                    words.insert( words.end(), c.words.begin(), c.words.begin() + width );
+                }
             }
-            if( entry.action == RoutePolicyAction::ACCEPT ) {
-                return true;
-            } else if( entry.action == RoutePolicyAction::PASS ) {
-                continue;
-            } else if( entry.action == RoutePolicyAction::DROP ) {
-                return false;
+        }
+        if( words.empty() ) {
+            if( attr != attrs.end() ) {
+                attrs.erase( attr );
             }
+        } else if( attr != attrs.end() ) {
+            attr->make_communities( community_list::intern( type, std::move( words ) ) );
+        } else {
+            path_attr_t nc;
+            nc.make_communities( community_list::intern( type, std::move( words ) ) );
+            attrs.push_back( std::move( nc ) );
         }
     }
-    return false;
-}
\ No newline at end of file
+}
+
+policy_cache::policy_cache( attr_registry &r ):
+    registry( r )
+{}
+
+std::size_t policy_cache::key_hash::operator()( const key &k ) const {
+    return std::hash<const void*>()( k.second ) ^ ( static_cast<std::size_t>( k.first ) * 0x9E3779B97F4A7C15ULL );
+}
+
+std::shared_ptr<std::vector<path_attr_t>> policy_cache::apply( const route_policy &pol, const NLRI &prefix, const std::shared_ptr<std::vector<path_attr_t>> &attrs ) {
+    key k { pol.get_id(), attrs.get() };
+    auto it = entries.find( k );
+    if( it != entries.end() && it->second.attrs.lock() != attrs ) {
+        entries.erase( it );
+        it = entries.end();
+    }
+    if( it == entries.end() ) {
+        if( entries.size() >= POLICY_CACHE_MAX_ENTRIES ) {
+            entries.clear();
+        }
+        it = entries.emplace( k, entry { attrs, pol.match_attrs( *attrs ), {} } ).first;
+    }
+    auto &e = it->second;
+    auto res = pol.evaluate( e.matched, prefix );
+    if( !res.accept ) {
+        return nullptr;
+    }
+    if( !res.set_nexthop && !res.set_localpref && res.community_terms.empty() ) {
+        return attrs;
+    }
+    auto &transformed = e.transformed[ { res.set_nexthop, res.set_localpref, res.community_terms } ];
+    if( !transformed ) {
+        auto modified = *attrs;
+        pol.transform( res, modified );
+        transformed = registry.intern( std::move( modified ) );
+    }
+    return transformed;
+}
+
+void policy_cache::clear() {
+    entries.clear();
+}
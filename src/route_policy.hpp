@@ -1,12 +1,111 @@
 #ifndef ROUTE_POLICY_HPP
 #define ROUTE_POLICY_HPP
 
+#include <map>
+#include <tuple>
+#include <memory>
 #include <vector>
+#include <optional>
+#include <unordered_map>
+
+#include "prefix_list.hpp"
+#include "as_path_regex.hpp"
+#include "community.hpp"
+
 struct RoutePolicy;
+struct GlobalConf;
 struct path_attr_t;
 struct bgp_path;
 class NLRI;
+class attr_registry;
+enum RoutePolicyAction: uint8_t;
+
+// limit of cached attribute sets, cache is cleared when it is reached
+static constexpr std::size_t POLICY_CACHE_MAX_ENTRIES = 65536;
+
+// Route policy compiled from configuration. Entries become flat list of terms,
+// prefix matches are tries, AS path patterns are DFAs and communities are parsed
+// values, so evaluation doesn't parse or compare configuration objects.
+class route_policy {
+public:
+    // changes of attributes made by policy
+    struct result {
+        bool accept;
+        std::optional<uint32_t> set_nexthop;
+        std::optional<uint32_t> set_localpref;
+        // matched terms which add or delete communities
+        std::vector<uint16_t> community_terms;
+    };
+
+    // attribute part of policy evaluated for one attribute set
+    struct attr_match {
+        // terms which match attributes, prefix lists are left to check
+        std::vector<uint16_t> terms;
+        // values for conditions which depend on sets of previous terms
+        std::optional<uint32_t> nexthop;
+        uint32_t localpref;
+    };
+
+    // throws std::runtime_error when policy references unknown or invalid objects
+    route_policy( const RoutePolicy &pol, const GlobalConf &conf );
+    // unique for every compiled policy, so it can be used as cache key
+    uint32_t get_id() const;
+    attr_match match_attrs( const std::vector<path_attr_t> &attrs ) const;
+    result evaluate( const attr_match &matched, const NLRI &prefix ) const;
+    // modifies attributes according to policy, false if route is rejected
+    bool apply( const NLRI &prefix, std::vector<path_attr_t> &attrs ) const;
+    void transform( const result &res, std::vector<path_attr_t> &attrs ) const;
+private:
+    struct term {
+        // indexes of compiled match objects, -1 if term doesn't match on it
+        int32_t prefix_list;
+        int32_t as_path;
+        int32_t community_set;
+        std::optional<uint32_t> nexthop;
+        std::optional<uint32_t> localpref;
+
+        std::optional<uint32_t> set_nexthop;
+        std::optional<uint32_t> set_localpref;
+        std::vector<community_t> add_communities;
+        std::vector<community_t> delete_communities;
+        RoutePolicyAction action;
+        // previous terms may set value, so condition is checked per prefix
+        bool dynamic_nexthop;
+        bool dynamic_localpref;
+    };
+
+    uint32_t id;
+    std::vector<term> terms;
+    std::vector<prefix_trie> prefix_lists;
+    std::vector<as_path_regex> as_paths;
+    // path matches if it has any community of set
+    std::vector<std::vector<community_t>> community_sets;
+};
+
+// Results of policies for interned attribute sets. Prefixes received in one
+// UPDATE share attributes, so attribute matches run once per set and policy,
+// only prefix lists are evaluated per prefix. Modified sets are interned and
+// reused for all prefixes with the same result.
+class policy_cache {
+public:
+    explicit policy_cache( attr_registry &r );
+    // attrs must be interned, returns interned attributes after policy or nullptr if route is rejected
+    std::shared_ptr<std::vector<path_attr_t>> apply( const route_policy &pol, const NLRI &prefix, const std::shared_ptr<std::vector<path_attr_t>> &attrs );
+    void clear();
+private:
+    using key = std::pair<uint32_t,const std::vector<path_attr_t>*>;
+    struct key_hash {
+        std::size_t operator()( const key &k ) const;
+    };
+    struct entry {
+        // set address may be reused after it is freed, so entry checks it is still the same set
+        std::weak_ptr<std::vector<path_attr_t>> attrs;
+        route_policy::attr_match matched;
+        std::map<std::tuple<std::optional<uint32_t>,std::optional<uint32_t>,std::vector<uint16_t>>,std::shared_ptr<std::vector<path_attr_t>>> transformed;
+    };
 
-bool routePolicyProcess( RoutePolicy &pol, NLRI &nlri, std::vector<path_attr_t> &attrs );
+    attr_registry &registry;
+    std::unordered_map<key,entry,key_hash> entries;
+};
 
-#endif
\ No newline at end of file
+#endif
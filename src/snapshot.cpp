@@ -0,0 +1,316 @@
+#include <boost/asio/ip/address_v4.hpp>
+#include <unordered_map>
+#include <optional>
+#include <fstream>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "snapshot.hpp"
+#include "table.hpp"
+#include "table_v6.hpp"
+#include "rib_snapshot.hpp"
+#include "fsm.hpp"
+#include "neighbour_index.hpp"
+#include "packet.hpp"
+#include "config.hpp"
+#include "log.hpp"
+#include "string_utils.hpp"
+#include "nlri.hpp"
+
+extern Logger logger;
+
+// nullopt if attribute doesn't fit into the set, file is corrupted then
+static std::optional<std::vector<path_attr_t>> parse_attr_set( uint8_t *data, uint32_t len, bool four_byte_asn ) {
+    std::vector<path_attr_t> attrs;
+    std::size_t offset = 0;
+    while( offset < len ) {
+        if( offset + sizeof( path_attr_header ) > len ) {
+            return std::nullopt;
+        }
+        auto header = reinterpret_cast<path_attr_header*>( data + offset );
+        if( header->extended_length == 1 ) {
+            auto extlen_header = reinterpret_cast<path_attr_header_extlen*>( header );
+            if( offset + sizeof( path_attr_header_extlen ) > len || offset + sizeof( path_attr_header_extlen ) + extlen_header->ext_len.native() > len ) {
+                return std::nullopt;
+            }
+            attrs.emplace_back( extlen_header, four_byte_asn );
+            offset += sizeof( path_attr_header_extlen ) + extlen_header->ext_len.native();
+        } else {
+            if( offset + sizeof( path_attr_header ) + header->len > len ) {
+                return std::nullopt;
+            }
+            attrs.emplace_back( header, four_byte_asn );
+            offset += sizeof( path_attr_header ) + header->len;
+        }
+    }
+    return attrs;
+}
+
+// result of write, it is logged on event loop thread
+struct snapshot_result {
+    std::string error;
+    std::size_t paths;
+    std::size_t attr_sets;
+    std::chrono::milliseconds elapsed;
+};
+
+// only reads snapshot and immutable attribute sets, so it can run on any thread
+static snapshot_result write_snapshot( const std::string &path, const rib_snapshot &rib, std::chrono::steady_clock::time_point start_time ) {
+    std::unordered_map<const std::vector<path_attr_t>*,uint32_t> attr_index;
+    std::vector<const std::vector<path_attr_t>*> attr_sets;
+    std::map<bgp_fsm*,uint16_t> peer_index;
+    std::vector<uint32_t> peers;
+    std::vector<snapshot_path> paths;
+    paths.reserve( rib.size() );
+
+    rib.for_each_v4_after( std::nullopt, [ & ]( const NLRI &prefix, const std::vector<bgp_path> &prefix_paths ) {
+        auto bytes = prefix.serialize();
+        for( auto const &path: prefix_paths ) {
+            snapshot_path entry {};
+            auto [ it, inserted ] = attr_index.emplace( path.attrs.get(), attr_sets.size() );
+            if( inserted ) {
+                attr_sets.push_back( path.attrs.get() );
+            }
+            entry.attr_index = it->second;
+            if( path.source ) {
+                auto [ pit, pinserted ] = peer_index.emplace( path.source.get(), peers.size() );
+                if( pinserted ) {
+                    peers.push_back( path.source->conf.address.to_uint() );
+                }
+                entry.peer_index = pit->second;
+            } else {
+                entry.peer_index = SNAPSHOT_LOCAL_PEER;
+            }
+            entry.prefix_len = bytes[ 0 ];
+            std::copy( bytes.begin() + 1, bytes.end(), entry.prefix.begin() );
+            entry.time = path.time.time_since_epoch().count();
+            entry.path_id = path.path_id;
+            paths.push_back( entry );
+        }
+        return true;
+    });
+
+    snapshot_result result { {}, paths.size(), attr_sets.size(), {} };
+    auto tmp_path = path + ".tmp";
+    std::ofstream out( tmp_path, std::ios::binary | std::ios::trunc );
+    if( !out ) {
+        result.error = "Cannot open snapshot file: " + tmp_path;
+        return result;
+    }
+
+    snapshot_header header {};
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.peers = peers.size();
+    header.attr_sets = attr_sets.size();
+    header.paths = paths.size();
+    out.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+
+    std::vector<uint8_t> set_bytes;
+    for( auto const set: attr_sets ) {
+        set_bytes.resize( sizeof( snapshot_attr_set ) );
+        bool four_byte_asn = false;
+        for( auto const &attr: *set ) {
+            auto bytes = attr.to_bytes();
+            set_bytes.insert( set_bytes.end(), bytes.begin(), bytes.end() );
+            four_byte_asn |= attr.four_byte_asn;
+        }
+        auto set_header = reinterpret_cast<snapshot_attr_set*>( set_bytes.data() );
+        set_header->length = set_bytes.size() - sizeof( snapshot_attr_set );
+        set_header->four_byte_asn = four_byte_asn;
+        out.write( reinterpret_cast<const char*>( set_bytes.data() ), set_bytes.size() );
+    }
+
+    for( auto const &p: peers ) {
+        BE32 address { p };
+        out.write( reinterpret_cast<const char*>( &address ), sizeof( address ) );
+    }
+    out.write( reinterpret_cast<const char*>( paths.data() ), paths.size() * sizeof( snapshot_path ) );
+    out.close();
+    if( !out || std::rename( tmp_path.c_str(), path.c_str() ) != 0 ) {
+        result.error = "Cannot write snapshot file: " + path;
+        return result;
+    }
+    result.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start_time );
+    return result;
+}
+
+static bool log_result( const snapshot_result &result ) {
+    if( !result.error.empty() ) {
+        logger.logError() << LOGS::TABLE << result.error << std::endl;
+        return false;
+    }
+    logger.logInfo() << LOGS::TABLE << "Saved RIB snapshot with " << result.paths << " paths and "
+        << result.attr_sets << " attribute sets in " << result.elapsed.count() << " ms" << std::endl;
+    return true;
+}
+
+bgp_snapshot::bgp_snapshot( boost::asio::io_context &i, GlobalConf &c, bgp_table_v4 &t, bgp_table_v6 &t6 ):
+    io( i ),
+    conf( c ),
+    table( t ),
+    table_v6( t6 ),
+    save_timer( i )
+{}
+
+bgp_snapshot::~bgp_snapshot() {
+    if( writer.joinable() ) {
+        writer.join();
+    }
+}
+
+void bgp_snapshot::start() {
+    if( !conf.snapshot_path.has_value() || !conf.snapshot_interval.has_value() || *conf.snapshot_interval == 0 ) {
+        return;
+    }
+    save_timer.expires_after( std::chrono::seconds( *conf.snapshot_interval ) );
+    save_timer.async_wait( std::bind( &bgp_snapshot::on_timer, this, std::placeholders::_1 ) );
+}
+
+void bgp_snapshot::on_timer( const boost::system::error_code &ec ) {
+    if( ec ) {
+        return;
+    }
+    save_async();
+    start();
+}
+
+void bgp_snapshot::save_async() {
+    if( !conf.snapshot_path.has_value() ) {
+        return;
+    }
+    if( writer.joinable() ) {
+        logger.logInfo() << LOGS::TABLE << "Previous RIB snapshot is still being written, skipping" << std::endl;
+        return;
+    }
+    auto start_time = std::chrono::steady_clock::now();
+    // update processing goes on while file is written
+    auto rib = rib_snapshot::take( table, table_v6 );
+    writer = std::thread( [ this, path = *conf.snapshot_path, rib, start_time ]() mutable {
+        auto result = write_snapshot( path, *rib, start_time );
+        // snapshot holds peers, so it is released on event loop too
+        boost::asio::post( io, [ this, result, rib = std::move( rib ) ]() {
+            if( writer.joinable() ) {
+                writer.join();
+            }
+            log_result( result );
+        });
+    });
+}
+
+bool bgp_snapshot::save() {
+    if( !conf.snapshot_path.has_value() ) {
+        return false;
+    }
+    if( writer.joinable() ) {
+        writer.join();
+    }
+    auto start_time = std::chrono::steady_clock::now();
+    return log_result( write_snapshot( *conf.snapshot_path, *rib_snapshot::take( table, table_v6 ), start_time ) );
+}
+
+bool bgp_snapshot::load( const neighbour_index &neighbours ) {
+    if( !conf.snapshot_path.has_value() ) {
+        return false;
+    }
+    auto start_time = std::chrono::steady_clock::now();
+
+    auto fd = open( conf.snapshot_path->c_str(), O_RDONLY );
+    if( fd < 0 ) {
+        logger.logInfo() << LOGS::TABLE << "No RIB snapshot found at " << *conf.snapshot_path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if( fstat( fd, &st ) != 0 || static_cast<std::size_t>( st.st_size ) < sizeof( snapshot_header ) ) {
+        close( fd );
+        logger.logError() << LOGS::TABLE << "RIB snapshot is too short" << std::endl;
+        return false;
+    }
+    std::size_t size = st.st_size;
+    auto map = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if( map == MAP_FAILED ) {
+        logger.logError() << LOGS::TABLE << "Cannot mmap RIB snapshot" << std::endl;
+        return false;
+    }
+    madvise( map, size, MADV_SEQUENTIAL );
+
+    auto data = static_cast<uint8_t*>( map );
+    auto header = reinterpret_cast<snapshot_header*>( data );
+    if( header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION ) {
+        munmap( map, size );
+        logger.logError() << LOGS::TABLE << "RIB snapshot has unknown format" << std::endl;
+        return false;
+    }
+
+    std::size_t offset = sizeof( snapshot_header );
+    std::vector<std::shared_ptr<std::vector<path_attr_t>>> attr_sets;
+    attr_sets.reserve( header->attr_sets );
+    for( uint32_t i = 0; i < header->attr_sets; i++ ) {
+        if( offset + sizeof( snapshot_attr_set ) > size ) {
+            break;
+        }
+        auto set = reinterpret_cast<snapshot_attr_set*>( data + offset );
+        offset += sizeof( snapshot_attr_set ) + set->length;
+        if( offset > size ) {
+            break;
+        }
+        auto attrs = parse_attr_set( set->data, set->length, set->four_byte_asn );
+        if( !attrs.has_value() ) {
+            break;
+        }
+        attr_sets.push_back( table.intern_attrs( std::move( *attrs ) ) );
+    }
+
+    std::vector<std::shared_ptr<bgp_fsm>> peers;
+    for( uint16_t i = 0; i < header->peers && offset + sizeof( BE32 ) <= size; i++ ) {
+        auto address = reinterpret_cast<BE32*>( data + offset );
+        offset += sizeof( BE32 );
+        auto it = neighbours.find( address_v4( address->native() ) );
+        peers.push_back( it != neighbours.end() ? it->second : nullptr );
+    }
+
+    if( attr_sets.size() != header->attr_sets || peers.size() != header->peers || header->paths > ( size - offset ) / sizeof( snapshot_path ) ) {
+        munmap( map, size );
+        logger.logError() << LOGS::TABLE << "RIB snapshot is truncated or corrupted" << std::endl;
+        return false;
+    }
+
+    std::vector<std::pair<NLRI,bgp_path>> paths;
+    paths.reserve( header->paths );
+    auto entries = reinterpret_cast<snapshot_path*>( data + offset );
+    for( uint64_t i = 0; i < header->paths; i++ ) {
+        auto const &entry = entries[ i ];
+        // locally originated routes are installed from configuration
+        if( entry.peer_index == SNAPSHOT_LOCAL_PEER || entry.peer_index >= peers.size() || !peers[ entry.peer_index ] ) {
+            continue;
+        }
+        if( entry.attr_index >= attr_sets.size() || entry.prefix_len > 32 ) {
+            continue;
+        }
+        auto prefix = entry.prefix;
+        paths.emplace_back( std::piecewise_construct,
+            std::forward_as_tuple( BGP_AFI::IPv4, prefix.data(), entry.prefix_len ),
+            std::forward_as_tuple( attr_sets[ entry.attr_index ], peers[ entry.peer_index ], entry.path_id )
+        );
+        paths.back().second.time = std::chrono::system_clock::time_point( std::chrono::system_clock::duration( entry.time ) );
+    }
+    munmap( map, size );
+
+    auto restored = paths.size();
+    auto restored_peers = table.restore_paths( std::move( paths ) );
+    auto restart_time = conf.graceful_restart_time.value_or( 120 );
+    for( auto &peer: restored_peers ) {
+        peer->start_graceful_restart_timer( restart_time );
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start_time );
+    logger.logInfo() << LOGS::TABLE << "Loaded RIB snapshot with " << restored << " paths from "
+        << restored_peers.size() << " peers in " << elapsed.count() << " ms" << std::endl;
+    return true;
+}
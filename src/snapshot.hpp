@@ -0,0 +1,73 @@
+#ifndef SNAPSHOT_HPP_
+#define SNAPSHOT_HPP_
+
+#include <map>
+#include <array>
+#include <thread>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+struct GlobalConf;
+struct bgp_fsm;
+class neighbour_index;
+class bgp_table_v4;
+class bgp_table_v6;
+class rib_snapshot;
+
+// On-disk layout:
+// snapshot_header
+// attribute table: for each set - snapshot_attr_set followed by raw path attributes
+// peer table: BE32 address for each peer
+// path array: snapshot_path for each path in table order
+static constexpr uint32_t SNAPSHOT_MAGIC = 0x42475053; // "BGPS"
+static constexpr uint16_t SNAPSHOT_VERSION = 2;
+static constexpr uint16_t SNAPSHOT_LOCAL_PEER = 0xFFFF;
+
+struct snapshot_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t peers;
+    uint32_t attr_sets;
+    uint64_t paths;
+}__attribute__((__packed__));
+
+struct snapshot_attr_set {
+    uint32_t length;
+    uint8_t four_byte_asn;
+    uint8_t data[0];
+}__attribute__((__packed__));
+
+struct snapshot_path {
+    uint32_t attr_index;
+    uint16_t peer_index;
+    uint8_t prefix_len;
+    uint8_t reserved;
+    std::array<uint8_t,4> prefix;
+    int64_t time;
+    uint32_t path_id;
+}__attribute__((__packed__));
+
+static_assert( sizeof( snapshot_path ) == 24, "size of snapshot_path should be equal 24 bytes" );
+
+class bgp_snapshot {
+public:
+    bgp_snapshot( boost::asio::io_context &i, GlobalConf &c, bgp_table_v4 &t, bgp_table_v6 &t6 );
+    ~bgp_snapshot();
+    void start();
+    // writes file on calling thread, waits for periodic save in progress
+    bool save();
+    bool load( const neighbour_index &neighbours );
+private:
+    void on_timer( const boost::system::error_code &ec );
+    // writes RIB snapshot to file on writer thread, result is logged on event loop
+    void save_async();
+
+    boost::asio::io_context &io;
+    GlobalConf &conf;
+    bgp_table_v4 &table;
+    bgp_table_v6 &table_v6;
+    boost::asio::steady_timer save_timer;
+    std::thread writer;
+};
+
+#endif
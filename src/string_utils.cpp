@@ -11,6 +11,7 @@ using address_v4 = boost::asio::ip::address_v4;
 #include "config.hpp"
 #include "packet.hpp"
 #include "message.hpp"
+#include "community.hpp"
 
 std::ostream& operator<<( std::ostream &os, const LOGL &l ) {
     switch( l ) {
@@ -35,6 +36,10 @@ std::ostream& operator<<( std::ostream &os, const LOGS &l ) {
     case LOGS::CONFIGURATION: return os << "[CONFIG] ";
     case LOGS::CLI: return os << "[CLI] ";
     case LOGS::TABLE: return os << "[TABLE] ";
+    case LOGS::VPP: return os << "[VPP] ";
+    case LOGS::BMP: return os << "[BMP] ";
+    case LOGS::FIB: return os << "[FIB] ";
+    case LOGS::NEXTHOP: return os << "[NHT] ";
     }
     return os;
 }
@@ -56,6 +61,30 @@ std::ostream& operator<<( std::ostream &os, const bgp_neighbour_v4 &nei ) {
     if( nei.hold_time.has_value() ) {
         os << " Hold Time: " << nei.hold_time.value();
     }
+    if( nei.add_path_receive ) {
+        os << " ADD-PATH receive";
+    }
+    if( nei.add_path_backups.has_value() ) {
+        os << " ADD-PATH backups: " << nei.add_path_backups.value();
+    }
+    if( nei.ipv6_unicast ) {
+        os << " IPv6 unicast";
+    }
+    if( nei.route_reflector_client ) {
+        os << " Route reflector client";
+    }
+    if( nei.import_policy.has_value() ) {
+        os << " Import policy: " << nei.import_policy.value();
+    }
+    if( nei.export_policy.has_value() ) {
+        os << " Export policy: " << nei.export_policy.value();
+    }
+    if( nei.passive ) {
+        os << " Passive";
+    }
+    if( nei.port.has_value() ) {
+        os << " Port: " << nei.port.value();
+    }
     return os;
 }
 
@@ -63,6 +92,30 @@ std::ostream& operator<<( std::ostream &os, const GlobalConf &conf ) {
     os << "My AS: " << conf.my_as << std::endl;
     os << "Listen on port: " << conf.listen_on_port << std::endl;
     os << "BGP Router ID: " << conf.bgp_router_id.to_string() << std::endl;
+    if( conf.graceful_restart_time.has_value() ) {
+        os << "Graceful Restart time: " << conf.graceful_restart_time.value() << std::endl;
+    }
+    if( conf.max_paths.has_value() ) {
+        os << "Maximum paths: " << conf.max_paths.value() << std::endl;
+    }
+    if( conf.fib_backend.has_value() ) {
+        os << "FIB backend: " << conf.fib_backend.value() << std::endl;
+    }
+    if( conf.fib_table.has_value() ) {
+        os << "FIB table: " << conf.fib_table.value() << std::endl;
+    }
+    if( conf.fib_reconcile ) {
+        os << "FIB reconciliation enabled" << std::endl;
+    }
+    if( conf.nexthop_resolution.has_value() ) {
+        os << "Next hop resolution: " << conf.nexthop_resolution.value() << std::endl;
+    }
+    if( conf.igp_routes_file.has_value() ) {
+        os << "IGP routes file: " << conf.igp_routes_file.value() << std::endl;
+    }
+    if( conf.cluster_id.has_value() ) {
+        os << "Cluster ID: " << conf.cluster_id->to_string() << std::endl;
+    }
     for( auto const &n: conf.neighbours ) {
         os << n << std::endl;
     }
@@ -113,15 +166,21 @@ std::ostream& operator<<( std::ostream &os, const bgp_notification *notification
 
 std::ostream& operator<<( std::ostream &os, const path_attr_t &attr ) {
     os << "Type: " << attr.type;
-    os << " Length: " << attr.bytes.size();
+    os << " Length: " << ( attr.communities ? attr.communities->get_words().size() * 4 : attr.bytes.size() );
     os << " Value: ";
     switch( attr.type ) {
     case PATH_ATTRIBUTE::ORIGIN:
         os << static_cast<ORIGIN>( attr.bytes[0] );
         break;
     case PATH_ATTRIBUTE::NEXT_HOP: 
+    case PATH_ATTRIBUTE::ORIGINATOR_ID:
         os << address_v4( attr.get_u32() ).to_string();
         break;
+    case PATH_ATTRIBUTE::CLUSTER_LIST:
+        for( auto id: attr.parse_cluster_list() ) {
+            os << address_v4( id ).to_string() << " ";
+        }
+        break;
     case PATH_ATTRIBUTE::LOCAL_PREF:
         os << attr.get_u32();
         break;
@@ -133,6 +192,22 @@ std::ostream& operator<<( std::ostream &os, const path_attr_t &attr ) {
             os << l << " ";
         }
         break;
+    case PATH_ATTRIBUTE::COMMUNITIES:
+    case PATH_ATTRIBUTE::EXTENDED_COMMUNITIES:
+    case PATH_ATTRIBUTE::LARGE_COMMUNITY:
+        if( attr.communities ) {
+            os << *attr.communities;
+        }
+        break;
+    case PATH_ATTRIBUTE::MP_REACH_NLRI: {
+        auto nexthop = attr.get_mp_nexthop();
+        if( nexthop.size() >= 16 ) {
+            boost::asio::ip::address_v6::bytes_type bytes;
+            std::copy( nexthop.begin(), nexthop.begin() + 16, bytes.begin() );
+            os << boost::asio::ip::address_v6( bytes ).to_string();
+        }
+        break;
+    }
     default:
         os << "NA";
         break;
@@ -140,6 +215,44 @@ std::ostream& operator<<( std::ostream &os, const path_attr_t &attr ) {
     return os;
 }
 
+std::ostream& operator<<( std::ostream &os, const community_list &list ) {
+    auto const &words = list.get_words();
+    auto width = community_list::width( list.get_type() );
+    for( std::size_t i = 0; i < words.size(); i += width ) {
+        if( i > 0 ) {
+            os << " ";
+        }
+        switch( list.get_type() ) {
+        case PATH_ATTRIBUTE::COMMUNITIES:
+            os << ( words[ i ] >> 16 ) << ":" << ( words[ i ] & 0xFFFF );
+            break;
+        case PATH_ATTRIBUTE::LARGE_COMMUNITY:
+            os << words[ i ] << ":" << words[ i + 1 ] << ":" << words[ i + 2 ];
+            break;
+        default: {
+            // route target and route origin of two and four octet AS types, others in hex
+            auto type = words[ i ] >> 24;
+            auto subtype = ( words[ i ] >> 16 ) & 0xFF;
+            auto name = subtype == 0x02 ? "rt:" : "soo:";
+            if( type == 0x00 && ( subtype == 0x02 || subtype == 0x03 ) ) {
+                os << name << ( words[ i ] & 0xFFFF ) << ":" << words[ i + 1 ];
+            } else if( type == 0x02 && ( subtype == 0x02 || subtype == 0x03 ) ) {
+                os << name << ( ( words[ i ] << 16 ) | ( words[ i + 1 ] >> 16 ) ) << ":" << ( words[ i + 1 ] & 0xFFFF );
+            } else if( type == 0x01 && ( subtype == 0x02 || subtype == 0x03 ) ) {
+                os << name << address_v4( ( words[ i ] << 16 ) | ( words[ i + 1 ] >> 16 ) ).to_string() << ":" << ( words[ i + 1 ] & 0xFFFF );
+            } else {
+                auto flags = os.flags();
+                os << "0x" << std::hex << std::setfill( '0' ) << std::setw( 8 ) << words[ i ] << std::setw( 8 ) << words[ i + 1 ];
+                os.flags( flags );
+                os << std::setfill( ' ' );
+            }
+            break;
+        }
+        }
+    }
+    return os;
+}
+
 std::ostream& operator<<( std::ostream &os, const PATH_ATTRIBUTE &attr ) {
     switch( attr ) {
     case PATH_ATTRIBUTE::ORIGIN:
@@ -156,6 +269,20 @@ std::ostream& operator<<( std::ostream &os, const PATH_ATTRIBUTE &attr ) {
         os << "ATOMIC_AGGREGATE"; break;
     case PATH_ATTRIBUTE::AGGREGATOR:
         os << "AGGREGATOR"; break;
+    case PATH_ATTRIBUTE::COMMUNITIES:
+        os << "COMMUNITIES"; break;
+    case PATH_ATTRIBUTE::ORIGINATOR_ID:
+        os << "ORIGINATOR_ID"; break;
+    case PATH_ATTRIBUTE::CLUSTER_LIST:
+        os << "CLUSTER_LIST"; break;
+    case PATH_ATTRIBUTE::MP_REACH_NLRI:
+        os << "MP_REACH_NLRI"; break;
+    case PATH_ATTRIBUTE::MP_UNREACH_NLRI:
+        os << "MP_UNREACH_NLRI"; break;
+    case PATH_ATTRIBUTE::EXTENDED_COMMUNITIES:
+        os << "EXTENDED_COMMUNITIES"; break;
+    case PATH_ATTRIBUTE::LARGE_COMMUNITY:
+        os << "LARGE_COMMUNITY"; break;
     default:
         os << "NA"; break;
     }
@@ -181,6 +308,8 @@ std::ostream& operator<<( std::ostream &os, const CONTENT &cont ) {
     case CONTENT::SHOW_VER: os << "SHOW_VER"; break;
     case CONTENT::SHOW_TABLE: os << "SHOW_TABLE"; break;
     case CONTENT::SHOW_NEI: os << "SHOW_NEI"; break;
+    case CONTENT::SUBSCRIBE: os << "SUBSCRIBE"; break;
+    case CONTENT::RELOAD: os << "RELOAD"; break;
     default: os << "UNKNOWN"; break;
     }
     return os;
@@ -217,6 +346,12 @@ std::ostream& operator<<( std::ostream &os, const bgp_cap_t &cap ) {
         os << "Host: " << host << " Domain: " << domain;
         break;
     }
+    case BGP_CAP_CODE::GRACEFUL_RESTART:
+        os << "Restart time: " << cap.get_restart_time();
+        break;
+    case BGP_CAP_CODE::ADD_PATH:
+        os << "IPv4 unicast mode: " << static_cast<int>( cap.get_add_path( BGP_AFI::IPv4, BGP_SAFI::UNICAST ) );
+        break;
     default:
         os << cap.data;
     }
@@ -20,6 +20,7 @@ struct path_attr_t;
 struct bgp_cap_t;
 struct GlobalConf;
 struct bgp_neighbour_v4;
+class community_list;
 enum class CONTENT: uint8_t;
 
 std::ostream& operator<<( std::ostream &os, const LOGL &l );
@@ -30,6 +31,7 @@ std::ostream& operator<<( std::ostream &os, const bgp_neighbour_v4 &nei );
 std::ostream& operator<<( std::ostream &os, const bgp_open *open );
 std::ostream& operator<<( std::ostream &os, const bgp_notification *notification );
 std::ostream& operator<<( std::ostream &os, const path_attr_t &attr );
+std::ostream& operator<<( std::ostream &os, const community_list &list );
 std::ostream& operator<<( std::ostream &os, const bgp_cap_t &cont );
 std::ostream& operator<<( std::ostream &os, const PATH_ATTRIBUTE &attr );
 std::ostream& operator<<( std::ostream &os, const ORIGIN &orig );
@@ -1,6 +1,8 @@
 #include <boost/asio/ip/address_v4.hpp>
 #include <map>
 #include <chrono>
+#include <fstream>
+#include <sstream>
 #include <yaml-cpp/yaml.h>
 
 using address_v4 = boost::asio::ip::address_v4;
@@ -14,19 +16,123 @@ using address_v4 = boost::asio::ip::address_v4;
 #include "evloop.hpp"
 #include "nlri.hpp"
 #include "route_policy.hpp"
+#include "community.hpp"
 #include "yaml.hpp"
 
 extern Logger logger;
 extern std::shared_ptr<EVLoop> runtime;
 
-bgp_path::bgp_path( std::shared_ptr<std::vector<path_attr_t>> a, std::shared_ptr<bgp_fsm> s ):
+bgp_path::bgp_path( std::shared_ptr<std::vector<path_attr_t>> a, std::shared_ptr<bgp_fsm> s, uint32_t id ):
     attrs( std::move( a ) ),
-    source( std::move( s ) ),
     time( std::chrono::system_clock::now() ),
+    source( std::move( s ) ),
     isValid( true ),
-    isBest( false )
+    isBest( false ),
+    isStale( false ),
+    isMultipath( false ),
+    path_id( id ),
+    local_id( 0 )
 {}
 
+static const path_attr_t *find_attr( const bgp_path &path, PATH_ATTRIBUTE type ) {
+    for( auto const &el: *path.attrs ) {
+        if( el.type == type ) {
+            return &el;
+        }
+    }
+    return nullptr;
+}
+
+static uint32_t path_local_pref( const bgp_path &path ) {
+    auto attr = find_attr( path, PATH_ATTRIBUTE::LOCAL_PREF );
+    return attr ? attr->get_u32() : 100;
+}
+
+static std::size_t path_as_path_len( const bgp_path &path ) {
+    auto attr = find_attr( path, PATH_ATTRIBUTE::AS_PATH );
+    return attr ? attr->parse_as_path().size() : 0;
+}
+
+static uint32_t path_origin( const bgp_path &path ) {
+    // origin is single octet attribute
+    auto attr = find_attr( path, PATH_ATTRIBUTE::ORIGIN );
+    return attr && !attr->bytes.empty() ? attr->bytes[ 0 ] : static_cast<uint32_t>( ORIGIN::INCOMPLETE );
+}
+
+static uint32_t path_med( const bgp_path &path ) {
+    auto attr = find_attr( path, PATH_ATTRIBUTE::MULTI_EXIT_DISC );
+    return attr ? attr->get_u32() : 0;
+}
+
+// locally originated, then eBGP, then iBGP
+static int path_kind( const bgp_path &path ) {
+    if( !path.source ) {
+        return 0;
+    }
+    return path.source->conf.remote_as != path.source->gconf.my_as ? 1 : 2;
+}
+
+static uint32_t path_igp_metric( const bgp_path &path ) {
+    return path.nexthop ? path.nexthop->metric : 0;
+}
+
+// data plane forwards to IGP gateway of tracked next hop
+static fib_nexthop path_forwarding( const bgp_path &path ) {
+    if( path.nexthop ) {
+        return path.nexthop->forwarding;
+    }
+    return { path.get_nexthop_v4(), 0 };
+}
+
+static std::size_t path_cluster_list_len( const bgp_path &path ) {
+    auto attr = find_attr( path, PATH_ATTRIBUTE::CLUSTER_LIST );
+    return attr ? attr->bytes.size() / sizeof( uint32_t ) : 0;
+}
+
+bool better_path( const bgp_path &lhv, const bgp_path &rhv ) {
+    if( path_local_pref( lhv ) != path_local_pref( rhv ) ) {
+        return path_local_pref( lhv ) > path_local_pref( rhv );
+    }
+    if( path_as_path_len( lhv ) != path_as_path_len( rhv ) ) {
+        return path_as_path_len( lhv ) < path_as_path_len( rhv );
+    }
+    if( path_origin( lhv ) != path_origin( rhv ) ) {
+        return path_origin( lhv ) < path_origin( rhv );
+    }
+    if( path_med( lhv ) != path_med( rhv ) ) {
+        return path_med( lhv ) < path_med( rhv );
+    }
+    if( path_kind( lhv ) != path_kind( rhv ) ) {
+        return path_kind( lhv ) < path_kind( rhv );
+    }
+    if( path_igp_metric( lhv ) != path_igp_metric( rhv ) ) {
+        return path_igp_metric( lhv ) < path_igp_metric( rhv );
+    }
+    if( path_cluster_list_len( lhv ) != path_cluster_list_len( rhv ) ) {
+        return path_cluster_list_len( lhv ) < path_cluster_list_len( rhv );
+    }
+
+    // deterministic tie break, so all paths of prefix have strict order
+    if( lhv.source && rhv.source && lhv.source != rhv.source ) {
+        return lhv.source->conf.address < rhv.source->conf.address;
+    }
+    return lhv.path_id < rhv.path_id;
+}
+
+// paths are equal up to tie breakers, so both could be used for forwarding
+static bool multipath_equal( const bgp_path &lhv, const bgp_path &rhv ) {
+    if( !lhv.source || !rhv.source ) {
+        return false;
+    }
+    return path_local_pref( lhv ) == path_local_pref( rhv ) &&
+        path_as_path_len( lhv ) == path_as_path_len( rhv ) &&
+        path_origin( lhv ) == path_origin( rhv ) &&
+        path_med( lhv ) == path_med( rhv ) &&
+        path_kind( lhv ) == path_kind( rhv ) &&
+        path_igp_metric( lhv ) == path_igp_metric( rhv ) &&
+        lhv.source->conf.remote_as == rhv.source->conf.remote_as;
+}
+
 uint32_t bgp_path::get_local_pref() const {
     for( auto const &el: *attrs ) {
         if( el.type == PATH_ATTRIBUTE::LOCAL_PREF ) {
@@ -47,8 +153,8 @@ uint32_t bgp_path::get_med() const {
 
 ORIGIN bgp_path::get_origin() const {
     for( auto const &el: *attrs ) {
-        if( el.type == PATH_ATTRIBUTE::ORIGIN ) {
-            return static_cast<ORIGIN>( el.get_u32() );
+        if( el.type == PATH_ATTRIBUTE::ORIGIN && !el.bytes.empty() ) {
+            return static_cast<ORIGIN>( el.bytes[ 0 ] );
         }
     }
     throw std::runtime_error( "No such attribute (ORIGIN)" );
@@ -56,7 +162,7 @@ ORIGIN bgp_path::get_origin() const {
 
 std::vector<uint32_t> bgp_path::get_as_path() const {
     for( auto const &el: *attrs ) {
-        if( el.type == PATH_ATTRIBUTE::LOCAL_PREF ) {
+        if( el.type == PATH_ATTRIBUTE::AS_PATH ) {
             return el.parse_as_path();
         }
     }
@@ -98,98 +204,182 @@ void bgp_path::set_nexthop_v4( address_v4 nh ) {
 }
 
 bgp_table_v4::bgp_table_v4( boost::asio::io_context &i, GlobalConf &c ):
-    io( i ),
     conf( c ),
-    send_updates( i )
+    nht( i, c ),
+    io( i ),
+    send_updates( i ),
+    next_local_id( 1 ),
+    next_group_id( 1 ),
+    policy_results( attr_sets )
 {
-    for( auto &r: conf.originate_routes ) {
-        std::vector<path_attr_t> attrs;
+    nht.set_listener( [ this ]( const bgp_nexthop &nh ) {
+        on_nexthop_change( nh );
+    });
+    // policies are compiled once, evaluation only uses compiled form
+    for( auto const &[ name, pol ]: conf.policies ) {
+        try {
+            policies.emplace( name, std::make_shared<route_policy>( pol, conf ) );
+        } catch( std::exception &e ) {
+            logger.logError() << LOGS::TABLE << "Cannot compile route policy " << name << ": " << e.what() << std::endl;
+        }
+    }
+    for( auto const &r: conf.originate_routes ) {
+        originate( r );
+    }
+}
+
+void bgp_table_v4::originate( const OrigEntry &r ) {
+    std::vector<path_attr_t> attrs;
 
-        path_attr_t attr;
-        attr.make_local_pref( 100 );
-        attrs.push_back( attr );
+    path_attr_t attr;
+    attr.make_local_pref( 100 );
+    attrs.push_back( attr );
 
-        attr.make_origin( ORIGIN::IGP );
-        attrs.push_back( attr );
+    attr.make_origin( ORIGIN::IGP );
+    attrs.push_back( attr );
 
-        attr.make_nexthop( boost::asio::ip::make_address_v4( "0.0.0.0" ) );
-        attrs.push_back( attr );
+    attr.make_nexthop( boost::asio::ip::make_address_v4( "0.0.0.0" ) );
+    attrs.push_back( attr );
 
-        if( r.policy_name ) {
-            RoutePolicy pol;
+    auto interned = intern_attrs( std::move( attrs ) );
+    if( r.policy_name ) {
+        auto pol = get_policy( *r.policy_name );
+        interned = pol ? apply_policy( *pol, r.prefix, interned ) : nullptr;
+    }
+    if( interned ) {
+        add_path( r.prefix, interned, nullptr );
+    } else {
+        del_path( r.prefix, nullptr );
+    }
+}
+
+std::shared_ptr<route_policy> bgp_table_v4::get_policy( const std::string &name ) {
+    if( auto it = policies.find( name ); it != policies.end() ) {
+        return it->second;
+    }
+    if( conf.policies.count( name ) > 0 ) {
+        // it is in configuration, but failed to compile
+        return nullptr;
+    }
+    std::shared_ptr<route_policy> pol;
+    try {
+        std::ifstream file( name );
+        if( !file ) {
+            throw std::runtime_error( "cannot open file" );
+        }
+        std::stringstream text;
+        text << file.rdbuf();
+        policy_files[ name ] = text.str();
+        pol = std::make_shared<route_policy>( YAML::Load( text.str() ).as<RoutePolicy>(), conf );
+    } catch( std::exception &e ) {
+        logger.logError() << LOGS::TABLE << "Cannot load route policy " << name << ": " << e.what() << std::endl;
+    }
+    policies.emplace( name, pol );
+    return pol;
+}
+
+std::set<std::string> bgp_table_v4::reload_policies( const std::set<std::string> &changed, bool prefix_lists_changed ) {
+    auto result = changed;
+    for( auto const &name: changed ) {
+        policies.erase( name );
+        if( auto it = conf.policies.find( name ); it != conf.policies.end() ) {
             try {
-                YAML::Node file = YAML::LoadFile( *r.policy_name );
-                pol = file.as<RoutePolicy>();
+                policies.emplace( name, std::make_shared<route_policy>( it->second, conf ) );
             } catch( std::exception &e ) {
-                logger.logError() << LOGS::TABLE << "Cannot load route policy " << r.policy_name.value() << ": " << e.what() << std::endl;
+                logger.logError() << LOGS::TABLE << "Cannot compile route policy " << name << ": " << e.what() << std::endl;
             }
-            if( routePolicyProcess( pol, r.prefix, attrs ) ) {
-                add_path( r.prefix, attrs, nullptr );
-            }
-        } else {
-            add_path( r.prefix, attrs, nullptr );
         }
     }
+    // loaded files are read again, policy of changed file is recompiled on next use
+    for( auto it = policy_files.begin(); it != policy_files.end(); ) {
+        auto const &name = it->first;
+        std::ifstream file( name );
+        std::stringstream text;
+        text << file.rdbuf();
+        if( !prefix_lists_changed && file && text.str() == it->second && changed.count( name ) == 0 ) {
+            it++;
+            continue;
+        }
+        result.insert( name );
+        if( changed.count( name ) == 0 ) {
+            policies.erase( name );
+        }
+        it = policy_files.erase( it );
+    }
+    if( !result.empty() ) {
+        policy_results.clear();
+    }
+    return result;
 }
 
-void bgp_table_v4::add_path( const NLRI &prefix, std::vector<path_attr_t> attr, std::shared_ptr<bgp_fsm> nei ) {
-    scheduled_updates.emplace( prefix );
-    schedule_updates();
+std::shared_ptr<std::vector<path_attr_t>> bgp_table_v4::apply_policy( const route_policy &pol, const NLRI &prefix, const std::shared_ptr<std::vector<path_attr_t>> &attrs ) {
+    return policy_results.apply( pol, prefix, attrs );
+}
+
+std::shared_ptr<std::vector<path_attr_t>> bgp_table_v4::intern_attrs( std::vector<path_attr_t> attrs ) {
     // Add local preference attribute, if it doesn't exist
     if(
         auto it = std::find_if(
-            attr.begin(),
-            attr.end(),
+            attrs.begin(),
+            attrs.end(),
             []( const path_attr_t &v ) {
                 return v.type == PATH_ATTRIBUTE::LOCAL_PREF;
             }
-        ); it == attr.end() )
+        ); it == attrs.end() )
     {
         path_attr_t lp;
         lp.make_local_pref( 100 );
-        attr.push_back( std::move( lp ) );
+        attrs.push_back( std::move( lp ) );
     }
-    // If we already have path from this neighbour
+    return attr_sets.intern( std::move( attrs ) );
+}
+
+void bgp_table_v4::add_path( const NLRI &prefix, std::vector<path_attr_t> attr, std::shared_ptr<bgp_fsm> nei, uint32_t path_id ) {
+    add_path( prefix, intern_attrs( std::move( attr ) ), std::move( nei ), path_id );
+}
+
+void bgp_table_v4::add_path( const NLRI &prefix, std::shared_ptr<std::vector<path_attr_t>> attrs, std::shared_ptr<bgp_fsm> nei, uint32_t path_id ) {
+    scheduled_updates.emplace( prefix );
+    schedule_updates();
+    // If we already have path from this neighbour with the same path identifier
     auto range = table.equal_range( prefix );
     for( auto prefixIt = range.first; prefixIt != range.second; prefixIt++ ) {
-        if( prefixIt->second.source != nei ) {
+        if( prefixIt->second.source != nei || prefixIt->second.path_id != path_id ) {
             continue;
         }
         prefixIt->second.time = std::chrono::system_clock::now();
-        prefixIt->second.attrs.reset();
-        prefixIt->second.attrs = std::make_shared<std::vector<path_attr_t>>( std::move( attr ) );
+        prefixIt->second.isStale = false;
+        if( prefixIt->second.attrs != attrs ) {
+            prefixIt->second.attrs = std::move( attrs );
+            // replaced best path is reported as changed
+            prefixIt->second.isBest = false;
+            release_nexthop( prefixIt );
+            track_nexthop( prefixIt );
+        }
         best_path_selection( prefix );
         return;
     }
-    // If not, we will look if path already exists
-    auto pathIt = std::find_if( 
-        table.begin(), 
-        table.end(), 
-        [ &attr ]( const std::pair<NLRI,bgp_path> &pair ) -> bool {
-            return *pair.second.attrs == attr;
-        }
+    auto it = table.emplace( std::piecewise_construct,
+        std::forward_as_tuple( prefix ),
+        std::forward_as_tuple( std::move( attrs ), nei, path_id )
     );
-    if( pathIt == table.end() ) {
-        table.emplace( std::piecewise_construct,
-            std::forward_as_tuple( prefix ), 
-            std::forward_as_tuple( std::make_shared<std::vector<path_attr_t>>( std::move( attr ) ), nei )
-        );
-    } else {
-        table.emplace( std::piecewise_construct, 
-            std::forward_as_tuple( prefix ), 
-            std::forward_as_tuple( pathIt->second )
-        );
-    }
+    it->second.local_id = next_local_id++;
+    index_path( prefix, nei );
+    track_nexthop( it );
     best_path_selection( prefix );
 }
 
-void bgp_table_v4::del_path( const NLRI &prefix, std::shared_ptr<bgp_fsm> nei ) {
-    scheduled_updates.emplace( prefix );
-    schedule_updates();
-    for( auto prefixIt = table.find( prefix ); prefixIt != table.end(); prefixIt++ ) {
-        if( prefixIt->second.source != nei ) {
+void bgp_table_v4::del_path( const NLRI &prefix, std::shared_ptr<bgp_fsm> nei, uint32_t path_id ) {
+    auto range = table.equal_range( prefix );
+    for( auto prefixIt = range.first; prefixIt != range.second; prefixIt++ ) {
+        if( prefixIt->second.source != nei || prefixIt->second.path_id != path_id ) {
             continue;
         }
+        // import policy deletes every rejected route, so only existing paths schedule updates
+        scheduled_updates.emplace( prefix );
+        schedule_updates();
+        release_nexthop( prefixIt );
+        unindex_path( prefix, nei );
         table.erase( prefixIt );
         best_path_selection( prefix );
         return;
@@ -197,128 +387,502 @@ void bgp_table_v4::del_path( const NLRI &prefix, std::shared_ptr<bgp_fsm> nei )
 }
 
 void bgp_table_v4::best_path_selection() {
-    NLRI current_prefix;
-    std::multimap<NLRI,bgp_path>::iterator best = table.end();
-
-    for( auto currentIt = table.begin(); currentIt != table.end(); currentIt++ ) {
-        auto const &prefix = currentIt->first;
-        auto &path = currentIt->second;
-
-        path.isValid = true;
+    for( auto it = table.begin(); it != table.end(); it = table.upper_bound( it->first ) ) {
+        best_path_selection( it->first );
+    }
+}
 
-        if( current_prefix != prefix ) {
-            current_prefix = prefix;
-            best->second.isBest = true;
-            best = table.end();
+void bgp_table_v4::best_path_selection( const NLRI &prefix ) {
+    // every change of prefix paths ends here
+    segments.mark( rib_snapshot::segment( prefix ) );
+    auto range = table.equal_range( prefix );
+    if( range.first == range.second ) {
+        update_nexthop_group( prefix, {} );
+        // last path is removed, it could be the best one
+        notify_best_path( prefix, nullptr );
+        return;
+    }
+    auto best = range.second;
+    // previous best path, it is gone if it was removed or replaced
+    const bgp_path *previous = nullptr;
+    for( auto it = range.first; it != range.second; it++ ) {
+        if( it->second.isBest ) {
+            previous = &it->second;
         }
-
-        if( best == table.end() ) {
-            best = currentIt;
-            path.isBest = true;
+        it->second.isBest = false;
+        it->second.isMultipath = false;
+        it->second.isValid = !it->second.nexthop || it->second.nexthop->reachable;
+        if( it->second.isValid && ( best == range.second || better_path( it->second, best->second ) ) ) {
+            best = it;
+        }
+    }
+    if( best == range.second ) {
+        // all next hops are unreachable
+        update_nexthop_group( prefix, {} );
+        if( previous != nullptr ) {
+            notify_best_path( prefix, nullptr );
         }
+        return;
+    }
+    best->second.isBest = true;
+    best->second.isMultipath = true;
+    if( previous != &best->second ) {
+        notify_best_path( prefix, &best->second );
+    }
 
-        if( best != currentIt ) {
-            path.isBest = false;
+    // locally originated prefixes are not forwarded via BGP next hops
+    std::vector<fib_nexthop> nexthops;
+    if( best->second.source ) {
+        try {
+            nexthops.push_back( path_forwarding( best->second ) );
+        } catch( std::exception &e ) {
+            logger.logError() << LOGS::TABLE << e.what() << std::endl;
         }
+    }
 
-        if( best != currentIt ) {
-            try {
-                if( currentIt->second.get_local_pref() > best->second.get_local_pref() ) {
-                    best = currentIt; continue;
-                }
-            } catch( std::exception &e ) {
-                logger.logError() << LOGS::TABLE << e.what() << std::endl;
+    std::size_t max_paths = conf.max_paths.value_or( 1 );
+    if( max_paths > 1 && !nexthops.empty() ) {
+        std::vector<bgp_path*> candidates;
+        for( auto it = range.first; it != range.second; it++ ) {
+            if( it != best && it->second.isValid && multipath_equal( it->second, best->second ) ) {
+                candidates.push_back( &it->second );
             }
-
-            try {
-                if( currentIt->second.get_as_path().size() < best->second.get_as_path().size() ) {
-                    best = currentIt; continue;
-                }
-            } catch( std::exception &e ) {
-                logger.logError() << LOGS::TABLE << e.what() << std::endl;
+        }
+        std::sort( candidates.begin(), candidates.end(), []( const bgp_path *lhv, const bgp_path *rhv ) { return better_path( *lhv, *rhv ); } );
+        for( auto path: candidates ) {
+            if( nexthops.size() >= max_paths ) {
+                break;
             }
-
             try {
-                if( currentIt->second.get_origin() < best->second.get_origin() ) {
-                    best = currentIt; continue;
+                auto nh = path_forwarding( *path );
+                // paths via the same next hop don't add forwarding capacity
+                if( std::find( nexthops.begin(), nexthops.end(), nh ) == nexthops.end() ) {
+                    nexthops.push_back( nh );
+                    path->isMultipath = true;
                 }
             } catch( std::exception &e ) {
                 logger.logError() << LOGS::TABLE << e.what() << std::endl;
             }
+        }
+    }
+    std::sort( nexthops.begin(), nexthops.end() );
+    update_nexthop_group( prefix, std::move( nexthops ) );
+}
 
-            try {
-                if( currentIt->second.get_med() > best->second.get_med() ) {
-                    best = currentIt; continue;
-                }
-            } catch( std::exception &e ) {
-                logger.logError() << LOGS::TABLE << e.what() << std::endl;
+void bgp_table_v4::track_nexthop( std::multimap<NLRI,bgp_path>::iterator it ) {
+    if( !it->second.source ) {
+        return;
+    }
+    auto attr = find_attr( it->second, PATH_ATTRIBUTE::NEXT_HOP );
+    if( attr != nullptr ) {
+        it->second.nexthop = nht.track( address_v4 { attr->get_u32() }, it->first );
+    }
+}
+
+void bgp_table_v4::index_path( const NLRI &prefix, const std::shared_ptr<bgp_fsm> &peer ) {
+    peer_prefixes[ peer ][ prefix ]++;
+}
+
+void bgp_table_v4::unindex_path( const NLRI &prefix, const std::shared_ptr<bgp_fsm> &peer ) {
+    auto indexed = peer_prefixes.find( peer );
+    if( indexed == peer_prefixes.end() ) {
+        return;
+    }
+    auto it = indexed->second.find( prefix );
+    if( it == indexed->second.end() || --it->second > 0 ) {
+        return;
+    }
+    indexed->second.erase( it );
+    if( indexed->second.empty() ) {
+        peer_prefixes.erase( indexed );
+    }
+}
+
+const std::vector<std::shared_ptr<const rib_segment<NLRI>>> &bgp_table_v4::publish_segments() {
+    return segments.publish( [ this ]( std::size_t index, rib_segment<NLRI> &segment ) {
+        for( auto it = table.lower_bound( rib_snapshot::segment_start( index ) ); it != table.end() && rib_snapshot::segment( it->first ) == index; it++ ) {
+            if( segment.empty() || segment.back().first != it->first ) {
+                segment.emplace_back( it->first, std::vector<bgp_path>{} );
             }
-            // TODO: other BPS conditionds
+            auto &path = segment.back().second.emplace_back( it->second );
+            // next hop state is changed by event loop
+            path.nexthop.reset();
         }
+    });
+}
+
+uint64_t bgp_table_v4::peer_paths_count( const std::shared_ptr<bgp_fsm> &peer ) const {
+    auto indexed = peer_prefixes.find( peer );
+    if( indexed == peer_prefixes.end() ) {
+        return 0;
     }
+    uint64_t total = 0;
+    for( auto const &[ prefix, count ]: indexed->second ) {
+        total += count;
+    }
+    return total;
+}
 
-    if( best == table.end() ) {
-        best->second.isBest = true;
+void bgp_table_v4::release_nexthop( std::multimap<NLRI,bgp_path>::iterator it ) {
+    auto nh = std::move( it->second.nexthop );
+    if( !nh ) {
+        return;
     }
+    // prefix stays dependent while any other of its paths uses the same next hop
+    auto range = table.equal_range( it->first );
+    for( auto other = range.first; other != range.second; other++ ) {
+        if( other != it && other->second.nexthop == nh ) {
+            return;
+        }
+    }
+    nht.untrack( nh, it->first );
 }
 
-void bgp_table_v4::best_path_selection( const NLRI &prefix ) {
-    auto range = table.equal_range( prefix );
-    std::multimap<NLRI,bgp_path>::iterator best = range.first;
+void bgp_table_v4::on_nexthop_change( const bgp_nexthop &nh ) {
+    for( auto const &prefix: nh.dependents ) {
+        scheduled_updates.emplace( prefix );
+        best_path_selection( prefix );
+    }
+    if( !nh.dependents.empty() ) {
+        schedule_updates();
+    }
+}
+
+void bgp_table_v4::update_nexthop_group( const NLRI &prefix, std::vector<fib_nexthop> nexthops ) {
+    auto current = prefix_groups.find( prefix );
+    if( current == prefix_groups.end() ? nexthops.empty() : current->second->nexthops == nexthops ) {
+        return;
+    }
+
+    std::shared_ptr<bgp_nexthop_group> group;
+    if( !nexthops.empty() ) {
+        auto &weak = nexthop_groups[ nexthops ];
+        group = weak.lock();
+        if( !group ) {
+            group = std::make_shared<bgp_nexthop_group>( bgp_nexthop_group { next_group_id++, nexthops } );
+            weak = group;
+            logger.logInfo() << LOGS::TABLE << "Created next hop group " << group->id << " with " << nexthops.size() << " next hops" << std::endl;
+        }
+    }
+
+    if( current != prefix_groups.end() ) {
+        // registry only keeps groups which are referenced by some prefix
+        auto old = std::move( current->second );
+        if( old.use_count() == 1 ) {
+            logger.logInfo() << LOGS::TABLE << "Released next hop group " << old->id << std::endl;
+            nexthop_groups.erase( old->nexthops );
+        }
+        if( group ) {
+            current->second = group;
+        } else {
+            prefix_groups.erase( current );
+        }
+    } else {
+        prefix_groups.emplace( prefix, group );
+    }
+
+    for( auto const &listener: fib_listeners ) {
+        listener( prefix, group );
+    }
+}
+
+std::shared_ptr<bgp_nexthop_group> bgp_table_v4::get_nexthop_group( const NLRI &prefix ) const {
+    auto it = prefix_groups.find( prefix );
+    return it != prefix_groups.end() ? it->second : nullptr;
+}
+
+const std::map<NLRI,std::shared_ptr<bgp_nexthop_group>> &bgp_table_v4::get_nexthop_groups() const {
+    return prefix_groups;
+}
+
+void bgp_table_v4::add_fib_listener( fib_listener listener ) {
+    fib_listeners.push_back( std::move( listener ) );
+}
+
+void bgp_table_v4::add_best_path_listener( best_path_listener listener ) {
+    best_path_listeners.push_back( std::move( listener ) );
+}
+
+void bgp_table_v4::notify_best_path( const NLRI &prefix, const bgp_path *best ) {
+    for( auto const &listener: best_path_listeners ) {
+        listener( prefix, best );
+    }
+}
+
+std::size_t bgp_table_v4::nexthop_groups_count() const {
+    return nexthop_groups.size();
+}
 
+const bgp_path *bgp_table_v4::find_path( const NLRI &prefix, const std::shared_ptr<bgp_fsm> &peer, uint32_t path_id ) const {
+    auto range = table.equal_range( prefix );
     for( auto it = range.first; it != range.second; it++ ) {
-        auto &path = it->second;
-        path.isBest = false;
+        if( it->second.source == peer && it->second.path_id == path_id ) {
+            return &it->second;
+        }
+    }
+    return nullptr;
+}
 
-        try {
-            if( it->second.get_local_pref() > best->second.get_local_pref() ) {
-                best = it; continue;
+void bgp_table_v4::collect_peer_paths( const std::shared_ptr<bgp_fsm> &peer, peer_paths &paths ) const {
+    auto indexed = peer_prefixes.find( peer );
+    if( indexed == peer_prefixes.end() ) {
+        return;
+    }
+    for( auto const &[ prefix, count ]: indexed->second ) {
+        auto range = table.equal_range( prefix );
+        for( auto it = range.first; it != range.second; it++ ) {
+            if( it->second.source == peer ) {
+                paths.emplace( std::make_pair( prefix, it->second.path_id ), it->second.attrs );
             }
-        } catch( std::exception &e ) {
-            logger.logError() << LOGS::TABLE << e.what() << std::endl;
         }
+    }
+}
 
-        try {
-            if( it->second.get_as_path().size() < best->second.get_as_path().size() ) {
-                best = it; continue;
-            }
-        } catch( std::exception &e ) {
-            logger.logError() << LOGS::TABLE << e.what() << std::endl;
+void bgp_table_v4::schedule_peer_updates( const std::shared_ptr<bgp_fsm> &peer ) {
+    auto indexed = peer_prefixes.find( peer );
+    if( indexed == peer_prefixes.end() ) {
+        return;
+    }
+    for( auto const &[ prefix, count ]: indexed->second ) {
+        scheduled_updates.emplace( prefix );
+    }
+    schedule_updates();
+}
+
+const bgp_path *bgp_table_v4::get_best_path( const NLRI &prefix ) const {
+    auto range = table.equal_range( prefix );
+    for( auto it = range.first; it != range.second; it++ ) {
+        if( it->second.isBest ) {
+            return &it->second;
         }
+    }
+    return nullptr;
+}
 
-        try {
-            if( it->second.get_origin() < best->second.get_origin() ) {
-                best = it; continue;
+std::vector<const bgp_path*> bgp_table_v4::ranked_paths( const NLRI &prefix ) const {
+    std::vector<const bgp_path*> paths;
+    auto range = table.equal_range( prefix );
+    for( auto it = range.first; it != range.second; it++ ) {
+        paths.push_back( &it->second );
+    }
+    std::sort( paths.begin(), paths.end(), []( const bgp_path *lhv, const bgp_path *rhv ) { return better_path( *lhv, *rhv ); } );
+    return paths;
+}
+
+bool bgp_table_v4::is_exportable( const bgp_path &path, bool ibgp_peer, bool rr_client_peer ) const {
+    if( !path.isValid ) {
+        return false;
+    }
+    // iBGP learned paths are only reflected: paths of clients to all iBGP peers, other paths to clients
+    if( ibgp_peer && path.source && path.source->conf.remote_as == conf.my_as &&
+        !path.source->conf.route_reflector_client && !rr_client_peer ) {
+        return false;
+    }
+    // well-known communities, there are no confederations, so NO_EXPORT_SUBCONFED is the same as NO_EXPORT
+    if( auto attr = find_attr( path, PATH_ATTRIBUTE::COMMUNITIES ); attr != nullptr && attr->communities ) {
+        if( attr->communities->contains( COMMUNITY_NO_ADVERTISE ) ) {
+            return false;
+        }
+        if( !ibgp_peer && ( attr->communities->contains( COMMUNITY_NO_EXPORT ) || attr->communities->contains( COMMUNITY_NO_EXPORT_SUBCONFED ) ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t bgp_table_v4::get_cluster_id() const {
+    return conf.cluster_id.value_or( conf.bgp_router_id ).to_uint();
+}
+
+std::shared_ptr<std::vector<path_attr_t>> bgp_table_v4::reflect_attrs( const bgp_path &path, const std::shared_ptr<std::vector<path_attr_t>> &attrs, reflect_cache &cache ) {
+    auto originator_attr = find_attr( path, PATH_ATTRIBUTE::ORIGINATOR_ID );
+    auto originator = originator_attr != nullptr ? originator_attr->get_u32() : path.source->remote_router_id;
+    auto &reflected = cache[ { attrs.get(), originator } ];
+    if( reflected ) {
+        return reflected;
+    }
+    auto modified = *attrs;
+    std::vector<uint32_t> clusters { get_cluster_id() };
+    auto it = std::find_if( modified.begin(), modified.end(), []( const path_attr_t &a ) { return a.type == PATH_ATTRIBUTE::CLUSTER_LIST; } );
+    if( it != modified.end() ) {
+        auto list = it->parse_cluster_list();
+        clusters.insert( clusters.end(), list.begin(), list.end() );
+        it->make_cluster_list( clusters );
+    } else {
+        path_attr_t cl;
+        cl.make_cluster_list( clusters );
+        modified.push_back( std::move( cl ) );
+    }
+    if( originator_attr == nullptr ) {
+        path_attr_t id;
+        id.make_originator_id( originator );
+        modified.push_back( std::move( id ) );
+    }
+    reflected = attr_sets.intern( std::move( modified ) );
+    return reflected;
+}
+
+std::shared_ptr<std::vector<path_attr_t>> bgp_table_v4::nexthop_self_attrs( const std::shared_ptr<std::vector<path_attr_t>> &attrs, const address_v4 &local, nexthop_self_cache &cache ) {
+    auto &rewritten = cache[ attrs.get() ];
+    if( rewritten ) {
+        return rewritten;
+    }
+    auto modified = *attrs;
+    auto it = std::find_if( modified.begin(), modified.end(), []( const path_attr_t &a ) { return a.type == PATH_ATTRIBUTE::NEXT_HOP; } );
+    if( it == modified.end() ) {
+        path_attr_t nh;
+        nh.make_nexthop( local );
+        modified.push_back( std::move( nh ) );
+    } else if( it->get_u32() == 0 ) {
+        it->make_nexthop( local );
+    } else {
+        rewritten = attrs;
+        return rewritten;
+    }
+    rewritten = attr_sets.intern( std::move( modified ) );
+    return rewritten;
+}
+
+std::map<NLRI,std::vector<bgp_export_path>> bgp_table_v4::export_paths( const bgp_update_group &group, const std::set<NLRI> &prefixes ) {
+    std::shared_ptr<route_policy> pol;
+    if( group.export_policy ) {
+        pol = get_policy( *group.export_policy );
+    }
+    reflect_cache reflected;
+    nexthop_self_cache nexthop_self;
+    std::map<NLRI,std::vector<bgp_export_path>> exported;
+    for( auto const &prefix: prefixes ) {
+        auto &paths = exported.emplace_hint( exported.end(), prefix, std::vector<bgp_export_path>{} )->second;
+        // policy which can't be loaded rejects everything
+        if( group.export_policy && !pol ) {
+            continue;
+        }
+        std::vector<const bgp_path*> candidates;
+        if( group.add_path ) {
+            candidates = ranked_paths( prefix );
+        } else if( auto best = get_best_path( prefix ); best != nullptr ) {
+            candidates.push_back( best );
+        }
+        for( auto path: candidates ) {
+            if( !is_exportable( *path, group.ibgp, group.rr_client ) ) {
+                continue;
+            }
+            auto attrs = pol ? apply_policy( *pol, prefix, path->attrs ) : path->attrs;
+            if( attrs && group.ibgp && path->source && path->source->conf.remote_as == conf.my_as ) {
+                attrs = reflect_attrs( *path, attrs, reflected );
+            }
+            // 0.0.0.0 of originated path must not reach any peer, iBGP ones included
+            if( attrs && !path->source ) {
+                attrs = nexthop_self_attrs( attrs, group.local_address, nexthop_self );
+            }
+            if( attrs ) {
+                paths.push_back( { path, std::move( attrs ) } );
             }
-        } catch( std::exception &e ) {
-            logger.logError() << LOGS::TABLE << e.what() << std::endl;
         }
+    }
+    return exported;
+}
 
-        try {
-            if( it->second.get_med() > best->second.get_med() ) {
-                best = it; continue;
+void bgp_table_v4::purge_peer( std::shared_ptr<bgp_fsm> peer ) {
+    stale_prefixes.erase( peer );
+    auto indexed = peer_prefixes.find( peer );
+    if( indexed == peer_prefixes.end() ) {
+        return;
+    }
+    auto prefixes = std::move( indexed->second );
+    peer_prefixes.erase( indexed );
+    for( auto const &[ prefix, count ]: prefixes ) {
+        auto range = table.equal_range( prefix );
+        for( auto it = range.first; it != range.second; ) {
+            if( it->second.source == peer ) {
+                release_nexthop( it );
+                it = table.erase( it );
+            } else {
+                it++;
             }
-        } catch( std::exception &e ) {
-            logger.logError() << LOGS::TABLE << e.what() << std::endl;
         }
-        // TODO: other BPS conditionds
+        scheduled_updates.emplace( prefix );
+        best_path_selection( prefix );
     }
+    schedule_updates();
+}
 
-    if( best != table.end() ) {
-        best->second.isBest = true;
+void bgp_table_v4::mark_stale( std::shared_ptr<bgp_fsm> peer ) {
+    auto &stale = stale_prefixes[ peer ];
+    stale.clear();
+    for( auto &[ prefix, path ]: table ) {
+        if( path.source != peer ) {
+            continue;
+        }
+        path.isStale = true;
+        // with ADD-PATH peer may have several paths of prefix, they are adjacent in table
+        if( stale.empty() || stale.back() != prefix ) {
+            stale.push_back( prefix );
+        }
+        segments.mark( rib_snapshot::segment( prefix ) );
+    }
+    logger.logInfo() << LOGS::TABLE << "Marked " << stale.size() << " paths as stale" << std::endl;
+    if( stale.empty() ) {
+        stale_prefixes.erase( peer );
     }
 }
 
-void bgp_table_v4::purge_peer( std::shared_ptr<bgp_fsm> peer ) {
-    for( auto it = table.begin(); it != table.end(); ) {
-        if( it->second.source == peer ) {
-            scheduled_updates.emplace( it->first );
+void bgp_table_v4::sweep_stale( std::shared_ptr<bgp_fsm> peer ) {
+    auto staleIt = stale_prefixes.find( peer );
+    if( staleIt == stale_prefixes.end() ) {
+        return;
+    }
+    std::size_t count = 0;
+    for( auto const &prefix: staleIt->second ) {
+        auto range = table.equal_range( prefix );
+        bool removed = false;
+        // every path identifier of peer is swept
+        for( auto it = range.first; it != range.second; ) {
+            if( it->second.source != peer || !it->second.isStale ) {
+                it++;
+                continue;
+            }
+            release_nexthop( it );
+            unindex_path( prefix, peer );
             it = table.erase( it );
-        } else {
-            it++;
+            count++;
+            removed = true;
+        }
+        if( removed ) {
+            scheduled_updates.emplace( prefix );
+            best_path_selection( prefix );
         }
     }
-    schedule_updates();
+    stale_prefixes.erase( staleIt );
+    logger.logInfo() << LOGS::TABLE << "Swept " << count << " stale paths" << std::endl;
+    if( count > 0 ) {
+        schedule_updates();
+    }
+}
+
+std::vector<std::shared_ptr<bgp_fsm>> bgp_table_v4::restore_paths( std::vector<std::pair<NLRI,bgp_path>> paths ) {
+    std::set<std::shared_ptr<bgp_fsm>> peers;
+    std::optional<NLRI> last;
+    // paths are expected in table order, so hinted insert is amortized O(1)
+    for( auto &[ prefix, path ]: paths ) {
+        if( last.has_value() && *last != prefix ) {
+            best_path_selection( *last );
+        }
+        path.isStale = true;
+        path.local_id = next_local_id++;
+        auto &stale = stale_prefixes[ path.source ];
+        if( stale.empty() || stale.back() != prefix ) {
+            stale.push_back( prefix );
+        }
+        peers.insert( path.source );
+        index_path( prefix, path.source );
+        last = prefix;
+        track_nexthop( table.emplace_hint( table.end(), std::move( prefix ), std::move( path ) ) );
+    }
+    if( last.has_value() ) {
+        best_path_selection( *last );
+    }
+    return { peers.begin(), peers.end() };
 }
 
 void bgp_table_v4::schedule_updates() {
@@ -333,36 +897,45 @@ void bgp_table_v4::on_send_updates( const boost::system::error_code &ec ) {
             return;
         logger.logError() << LOGS::EVENT_LOOP << "On timer for sending updates: " << ec.message() << std::endl;
     }
-    std::vector<NLRI> withdrawn_update;
-    std::map<std::shared_ptr<std::vector<path_attr_t>>,std::vector<NLRI>> pending_update;
-    for( auto const &n: scheduled_updates ) {
-        auto it = table.end();
-        if( it = table.find( n ); it == table.end() ) {
-            withdrawn_update.push_back( n );
-            continue;
-        }
-        if( auto updIt = pending_update.find( it->second.attrs ); updIt != pending_update.end() ) {
-            updIt->second.push_back( n );
-        } else {
-            std::vector<NLRI> new_vec { n };
-            pending_update.emplace( it->second.attrs, new_vec );
-        }
-    }
-
+    std::map<std::tuple<std::optional<std::string>,bool,bool,bool,address_v4>,bgp_update_group> groups;
     for( auto const &[ add, nei ]: runtime->neighbours ) {
-        // send updates only for eBGP neighbours
-        if( nei->conf.remote_as == conf.my_as ) {
-            continue;
-        }
-
         if( nei->state != FSM_STATE::ESTABLISHED ) {
             continue;
         }
-
-        auto cur_withdrawn = withdrawn_update;
-        for( auto const &[ path, n_vec ]: pending_update ) {
-            nei->tx_update( n_vec, path, cur_withdrawn );
-            cur_withdrawn.clear();
+        bool ibgp = nei->conf.remote_as == conf.my_as;
+        bool rr_client = ibgp && nei->conf.route_reflector_client;
+        // packets are shared, so peers of group must see the same next hop of our routes
+        auto local = nei->local_address();
+        auto &group = groups[ { nei->conf.export_policy, ibgp, rr_client, nei->addpath_tx, local } ];
+        group.export_policy = nei->conf.export_policy;
+        group.ibgp = ibgp;
+        group.rr_client = rr_client;
+        group.add_path = nei->addpath_tx;
+        group.local_address = local;
+        group.peers.push_back( nei );
+    }
+    for( auto const &[ key, group ]: groups ) {
+        logger.logInfo() << LOGS::TABLE << "Sending updates for " << scheduled_updates.size() << " prefixes to update group with "
+        << group.peers.size() << " peers" << std::endl;
+        auto exported = export_paths( group, scheduled_updates );
+        // attributes are not changed per iBGP peer, so packets are built once for peers which aren't source of any path
+        std::set<const bgp_fsm*> sources;
+        std::vector<std::shared_ptr<std::vector<uint8_t>>> shared;
+        if( group.ibgp && !group.add_path ) {
+            for( auto const &[ prefix, paths ]: exported ) {
+                if( !paths.empty() ) {
+                    sources.insert( paths.front().path->source.get() );
+                }
+            }
+            shared = build_group_updates( exported );
+        }
+        for( auto const &nei: group.peers ) {
+            if( group.ibgp && !group.add_path && sources.count( nei.get() ) == 0 ) {
+                nei->tx_packets( shared );
+            } else {
+                nei->tx_group_updates( exported );
+            }
         }
     }
+    scheduled_updates.clear();
 }
\ No newline at end of file
@@ -2,15 +2,25 @@
 #define TABLE_HPP_
 
 #include <tuple>
+#include <string>
+#include <optional>
 #include <vector>
 #include <set>
+#include <map>
+#include <functional>
 #include <boost/asio.hpp>
 #include <boost/asio/steady_timer.hpp>
 
+#include "nexthop.hpp"
+#include "attr_registry.hpp"
+#include "route_policy.hpp"
+#include "rib_snapshot.hpp"
+
 struct path_attr_t;
 struct bgp_fsm;
 enum class ORIGIN : uint8_t;
 struct GlobalConf;
+struct OrigEntry;
 class NLRI;
 
 struct bgp_path {
@@ -19,8 +29,17 @@ struct bgp_path {
     std::shared_ptr<bgp_fsm> source;
     bool isValid;
     bool isBest;
+    bool isStale;
+    // path is part of equal cost set together with best path
+    bool isMultipath;
+    // ADD-PATH identifier received from source, zero when ADD-PATH isn't negotiated
+    uint32_t path_id;
+    // identifier used when we advertise this path with ADD-PATH
+    uint32_t local_id;
+    // resolution of next hop, empty for locally originated paths
+    std::shared_ptr<bgp_nexthop> nexthop;
 
-    bgp_path( std::shared_ptr<std::vector<path_attr_t>> a, std::shared_ptr<bgp_fsm> s );
+    bgp_path( std::shared_ptr<std::vector<path_attr_t>> a, std::shared_ptr<bgp_fsm> s, uint32_t id = 0 );
 
     uint32_t get_local_pref() const;
     uint32_t get_med() const;
@@ -32,23 +51,132 @@ struct bgp_path {
     void set_nexthop_v4( address_v4 lp );
 };
 
+// returns true if lhv is preferred over rhv, missing attributes take their default values
+bool better_path( const bgp_path &lhv, const bgp_path &rhv );
+
+// Equal cost next hops of prefix. Groups are interned, so all prefixes
+// resolved to the same set of next hops share one group object.
+struct bgp_nexthop_group {
+    uint32_t id;
+    // BGP next hops resolved by next hop tracking, sorted
+    std::vector<fib_nexthop> nexthops;
+};
+
+// Peers which are advertised the same paths. Export policy and iBGP rules are
+// evaluated once per group, only split horizon is checked per peer.
+struct bgp_update_group {
+    std::optional<std::string> export_policy;
+    bool ibgp;
+    // peers are route reflector clients
+    bool rr_client;
+    // all exportable paths are needed, not only best one
+    bool add_path;
+    // our address of sessions, it is next hop of locally originated paths
+    address_v4 local_address;
+    std::vector<std::shared_ptr<bgp_fsm>> peers;
+};
+
+// path with attributes after export policy
+struct bgp_export_path {
+    const bgp_path *path;
+    std::shared_ptr<std::vector<path_attr_t>> attrs;
+};
+
 class bgp_table_v4 {
 public:
     bgp_table_v4( boost::asio::io_context &i, GlobalConf &c );
     GlobalConf &conf;
     std::multimap<NLRI,bgp_path> table;
-    void add_path( const NLRI &prefix, std::vector<path_attr_t> attr, std::shared_ptr<bgp_fsm> peer );
-    void del_path( const NLRI &prefix, std::shared_ptr<bgp_fsm> peer );
+    nexthop_tracker nht;
+    void add_path( const NLRI &prefix, std::vector<path_attr_t> attr, std::shared_ptr<bgp_fsm> peer, uint32_t path_id = 0 );
+    // attrs must be interned with intern_attrs
+    void add_path( const NLRI &prefix, std::shared_ptr<std::vector<path_attr_t>> attrs, std::shared_ptr<bgp_fsm> peer, uint32_t path_id = 0 );
+    // adds default local preference and returns shared set with these attributes
+    std::shared_ptr<std::vector<path_attr_t>> intern_attrs( std::vector<path_attr_t> attrs );
+    void del_path( const NLRI &prefix, std::shared_ptr<bgp_fsm> peer, uint32_t path_id = 0 );
+    // adds locally originated path after its policy, or removes it when policy rejects it
+    void originate( const OrigEntry &route );
     void purge_peer( std::shared_ptr<bgp_fsm> peer );
+    void mark_stale( std::shared_ptr<bgp_fsm> peer );
+    void sweep_stale( std::shared_ptr<bgp_fsm> peer );
+    std::vector<std::shared_ptr<bgp_fsm>> restore_paths( std::vector<std::pair<NLRI,bgp_path>> paths );
     void best_path_selection();
     void best_path_selection( const NLRI &prefix );
+    const bgp_path *get_best_path( const NLRI &prefix ) const;
+    const bgp_path *find_path( const NLRI &prefix, const std::shared_ptr<bgp_fsm> &peer, uint32_t path_id ) const;
+    // paths received from peer by prefix and path identifier
+    using peer_paths = std::map<std::pair<NLRI,uint32_t>,std::shared_ptr<std::vector<path_attr_t>>>;
+    void collect_peer_paths( const std::shared_ptr<bgp_fsm> &peer, peer_paths &paths ) const;
+    // exports of paths from peer are evaluated again, e.g. when it becomes route reflector client
+    void schedule_peer_updates( const std::shared_ptr<bgp_fsm> &peer );
+    // all paths of prefix ordered by best path selection rules, best first
+    std::vector<const bgp_path*> ranked_paths( const NLRI &prefix ) const;
+    // checks path validity, iBGP and route reflection rules, split horizon is left to caller
+    bool is_exportable( const bgp_path &path, bool ibgp_peer, bool rr_client_peer ) const;
+    // reflected attribute sets by original set and originator
+    using reflect_cache = std::map<std::pair<const std::vector<path_attr_t>*,uint32_t>,std::shared_ptr<std::vector<path_attr_t>>>;
+    // adds ORIGINATOR_ID and our cluster to attributes of iBGP path, which is reflected to iBGP peer
+    std::shared_ptr<std::vector<path_attr_t>> reflect_attrs( const bgp_path &path, const std::shared_ptr<std::vector<path_attr_t>> &attrs, reflect_cache &cache );
+    uint32_t get_cluster_id() const;
+    // locally originated attribute sets with our address as next hop by original set
+    using nexthop_self_cache = std::map<const std::vector<path_attr_t>*,std::shared_ptr<std::vector<path_attr_t>>>;
+    // next hop of locally originated path is our address, unless its policy set one
+    std::shared_ptr<std::vector<path_attr_t>> nexthop_self_attrs( const std::shared_ptr<std::vector<path_attr_t>> &attrs, const address_v4 &local, nexthop_self_cache &cache );
+    // exportable paths of prefixes for update group, best first
+    std::map<NLRI,std::vector<bgp_export_path>> export_paths( const bgp_update_group &group, const std::set<NLRI> &prefixes );
+    // number of paths from peer in table, counted from its index
+    uint64_t peer_paths_count( const std::shared_ptr<bgp_fsm> &peer ) const;
+    std::shared_ptr<bgp_nexthop_group> get_nexthop_group( const NLRI &prefix ) const;
+    const std::map<NLRI,std::shared_ptr<bgp_nexthop_group>> &get_nexthop_groups() const;
+    std::size_t nexthop_groups_count() const;
+    // policy from configuration or from YAML file with this name, nullptr if it can't be compiled
+    std::shared_ptr<route_policy> get_policy( const std::string &name );
+    // compiles changed policies of configuration again and reloads policy files, which
+    // are also recompiled when prefix lists changed, returns names of changed policies
+    std::set<std::string> reload_policies( const std::set<std::string> &changed, bool prefix_lists_changed );
+    // interned attributes after policy, nullptr if route is rejected
+    std::shared_ptr<std::vector<path_attr_t>> apply_policy( const route_policy &pol, const NLRI &prefix, const std::shared_ptr<std::vector<path_attr_t>> &attrs );
+    // called when forwarding state of prefix changes, group is nullptr when prefix is removed
+    using fib_listener = std::function<void( const NLRI&, const std::shared_ptr<bgp_nexthop_group>& )>;
+    void add_fib_listener( fib_listener listener );
+    // called when best path of prefix changes, path is nullptr when prefix has no best path anymore
+    using best_path_listener = std::function<void( const NLRI&, const bgp_path* )>;
+    void add_best_path_listener( best_path_listener listener );
+    // copies of table segments for rib_snapshot, segments changed since previous call are copied again
+    const std::vector<std::shared_ptr<const rib_segment<NLRI>>> &publish_segments();
 private:
+    void track_nexthop( std::multimap<NLRI,bgp_path>::iterator it );
+    void release_nexthop( std::multimap<NLRI,bgp_path>::iterator it );
+    void index_path( const NLRI &prefix, const std::shared_ptr<bgp_fsm> &peer );
+    void unindex_path( const NLRI &prefix, const std::shared_ptr<bgp_fsm> &peer );
+    void on_nexthop_change( const bgp_nexthop &nh );
+    void update_nexthop_group( const NLRI &prefix, std::vector<fib_nexthop> nexthops );
+    void notify_best_path( const NLRI &prefix, const bgp_path *best );
+
     void schedule_updates();
     void on_send_updates( const boost::system::error_code &ec );
 
     boost::asio::io_context &io;
     boost::asio::steady_timer send_updates;
     std::set<NLRI> scheduled_updates;
+    uint32_t next_local_id;
+    // selected next hop group for each prefix and registry of alive groups
+    std::map<NLRI,std::shared_ptr<bgp_nexthop_group>> prefix_groups;
+    std::map<std::vector<fib_nexthop>,std::weak_ptr<bgp_nexthop_group>> nexthop_groups;
+    uint32_t next_group_id;
+    std::vector<fib_listener> fib_listeners;
+    std::vector<best_path_listener> best_path_listeners;
+    attr_registry attr_sets;
+    policy_cache policy_results;
+    // compiled policies by name
+    std::map<std::string,std::shared_ptr<route_policy>> policies;
+    // content of loaded policy files, so reload knows which of them changed
+    std::map<std::string,std::string> policy_files;
+    // prefixes which had stale paths from peer in table order, so sweep doesn't need full table walk
+    std::map<std::shared_ptr<bgp_fsm>,std::vector<NLRI>> stale_prefixes;
+    // prefixes by source of their paths, so peer queries and purge don't walk whole table
+    std::map<std::shared_ptr<bgp_fsm>,std::map<NLRI,uint32_t>> peer_prefixes;
+    rib_segments<rib_segment<NLRI>> segments;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <stdexcept>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "table_query.hpp"
+#include "table.hpp"
+#include "neighbour_index.hpp"
+#include "rib_snapshot.hpp"
+#include "packet.hpp"
+#include "message.hpp"
+
+// prefix shortened to len bits
+static NLRI truncate( const NLRI &prefix, uint8_t len ) {
+    auto data = prefix.get_data();
+    data.resize( ( len + 7 ) / 8 );
+    if( len % 8 != 0 ) {
+        data.back() &= 0xFF << ( 8 - len % 8 );
+    }
+    return NLRI( prefix.get_afi(), data.data(), len );
+}
+
+static const NLRI &to_nlri( const NLRI &key ) {
+    return key;
+}
+
+static NLRI to_nlri( const prefix_v6 &key ) {
+    return key.to_nlri();
+}
+
+table_query::table_query( const Show_Table_Req &req, const neighbour_index &neighbours ):
+    prefix_match( req.match )
+{
+    if( req.prefix ) {
+        auto str = *req.prefix;
+        auto afi = str.find( ':' ) != std::string::npos ? BGP_AFI::IPv6 : BGP_AFI::IPv4;
+        if( str.find( '/' ) == std::string::npos ) {
+            if( prefix_match != PREFIX_MATCH::LONGEST ) {
+                throw std::runtime_error( "Prefix length is missing: " + str );
+            }
+            str += afi == BGP_AFI::IPv6 ? "/128" : "/32";
+        }
+        NLRI parsed( afi, str );
+        prefix = truncate( parsed, parsed.get_len() );
+    }
+    if( req.neighbour ) {
+        auto it = neighbours.find( boost::asio::ip::make_address_v4( *req.neighbour ) );
+        if( it == neighbours.end() ) {
+            throw std::runtime_error( "Unknown neighbour: " + *req.neighbour );
+        }
+        peer = it->second;
+    }
+    if( req.nexthop ) {
+        auto address = boost::asio::ip::make_address( *req.nexthop );
+        if( address.is_v4() ) {
+            nexthop_v4 = address.to_v4();
+        } else {
+            nexthop_v6 = address.to_v6();
+        }
+    }
+    if( req.as ) {
+        asn = *req.as;
+    }
+    if( req.community ) {
+        community = community_t::parse( *req.community );
+    }
+}
+
+bool table_query::match( const bgp_path &path ) {
+    if( peer && path.source != peer ) {
+        return false;
+    }
+    if( !nexthop_v4 && !nexthop_v6 && !asn && !community ) {
+        return true;
+    }
+    auto [ it, inserted ] = attr_matches.emplace( path.attrs.get(), false );
+    if( inserted ) {
+        it->second = match_attrs( *path.attrs );
+    }
+    return it->second;
+}
+
+bool table_query::collect( const std::vector<bgp_path> &all, std::vector<const bgp_path*> &paths ) {
+    paths.clear();
+    for( auto const &path: all ) {
+        if( match( path ) ) {
+            paths.push_back( &path );
+        }
+    }
+    return !paths.empty();
+}
+
+bool table_query::match_attrs( const std::vector<path_attr_t> &attrs ) const {
+    bool nexthop_found = !nexthop_v4 && !nexthop_v6;
+    bool asn_found = !asn;
+    bool community_found = !community;
+    for( auto const &attr: attrs ) {
+        switch( attr.type ) {
+        case PATH_ATTRIBUTE::NEXT_HOP:
+            if( nexthop_v4 && attr.get_u32() == nexthop_v4->to_uint() ) {
+                nexthop_found = true;
+            }
+            break;
+        case PATH_ATTRIBUTE::MP_REACH_NLRI:
+            if( nexthop_v6 ) {
+                auto nexthop = attr.get_mp_nexthop();
+                auto bytes = nexthop_v6->to_bytes();
+                nexthop_found = nexthop.size() >= bytes.size() && std::equal( bytes.begin(), bytes.end(), nexthop.begin() );
+            }
+            break;
+        case PATH_ATTRIBUTE::AS_PATH:
+            if( asn ) {
+                auto path = attr.parse_as_path();
+                asn_found = std::find( path.begin(), path.end(), *asn ) != path.end();
+            }
+            break;
+        case PATH_ATTRIBUTE::COMMUNITIES:
+        case PATH_ATTRIBUTE::EXTENDED_COMMUNITIES:
+        case PATH_ATTRIBUTE::LARGE_COMMUNITY:
+            if( community && community->type == attr.type && attr.communities->contains( *community ) ) {
+                community_found = true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return nexthop_found && asn_found && community_found;
+}
+
+template<typename Key, typename Find, typename Walk>
+bool table_query::walk( const std::optional<Key> &after, Find find, Walk walk_after, const visitor &f ) {
+    attr_matches.clear();
+    std::vector<const bgp_path*> paths;
+    auto visit = [ & ]( const Key &key, const std::vector<bgp_path> &all ) -> bool {
+        return !collect( all, paths ) || f( to_nlri( key ), paths );
+    };
+    auto visited = [ &after ]( const Key &key ) {
+        return after && !( *after < key );
+    };
+    if( !prefix ) {
+        return walk_after( after, visit );
+    }
+    Key key( *prefix );
+    switch( prefix_match ) {
+    case PREFIX_MATCH::EXACT: {
+        auto all = find( key );
+        return all == nullptr || visited( key ) || visit( key, *all );
+    }
+    case PREFIX_MATCH::LONGEST:
+        for( int len = prefix->get_len(); len >= 0; len-- ) {
+            Key covering( truncate( *prefix, len ) );
+            auto all = find( covering );
+            if( all != nullptr && collect( *all, paths ) ) {
+                return visited( covering ) || f( to_nlri( covering ), paths );
+            }
+        }
+        return true;
+    case PREFIX_MATCH::MORE_SPECIFIC: {
+        // more specifics are contiguous range after prefix in table order
+        if( !visited( key ) ) {
+            auto all = find( key );
+            if( all != nullptr && !visit( key, *all ) ) {
+                return false;
+            }
+        }
+        bool within = true;
+        auto completed = walk_after( visited( key ) ? after : std::optional<Key>( key ), [ & ]( const Key &k, const std::vector<bgp_path> &all ) {
+            within = prefix->covers( to_nlri( k ) );
+            return within && visit( k, all );
+        });
+        return completed || !within;
+    }
+    }
+    return true;
+}
+
+bool table_query::walk_v4( const rib_snapshot &rib, const std::optional<NLRI> &after, const visitor &f ) {
+    if( ( prefix && prefix->get_afi() != BGP_AFI::IPv4 ) || nexthop_v6 ) {
+        return true;
+    }
+    auto find = [ &rib ]( const NLRI &key ) {
+        return rib.find_v4( key );
+    };
+    auto walk_after = [ &rib ]( const std::optional<NLRI> &from, auto visit ) {
+        return rib.for_each_v4_after( from, visit );
+    };
+    return walk( after, find, walk_after, f );
+}
+
+bool table_query::walk_v6( const rib_snapshot &rib, const std::optional<prefix_v6> &after, const visitor &f ) {
+    if( ( prefix && prefix->get_afi() != BGP_AFI::IPv6 ) || nexthop_v4 ) {
+        return true;
+    }
+    auto find = [ &rib ]( const prefix_v6 &key ) {
+        return rib.find_v6( key );
+    };
+    auto walk_after = [ &rib ]( const std::optional<prefix_v6> &from, auto visit ) {
+        return rib.for_each_v6_after( from, visit );
+    };
+    return walk( after, find, walk_after, f );
+}
@@ -0,0 +1,58 @@
+#ifndef TABLE_QUERY_HPP_
+#define TABLE_QUERY_HPP_
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <boost/asio/ip/address_v4.hpp>
+#include <boost/asio/ip/address_v6.hpp>
+
+#include "nlri.hpp"
+#include "trie_v6.hpp"
+#include "community.hpp"
+
+struct bgp_path;
+struct bgp_fsm;
+class neighbour_index;
+struct path_attr_t;
+struct Show_Table_Req;
+class rib_snapshot;
+enum class PREFIX_MATCH: uint8_t;
+
+// Filter of CLI table request. It is evaluated over rib_snapshot, so it can run
+// off the event loop and pages of one request are consistent. Prefix filters
+// are lookups in sorted segments, other filters are checked on paths, AS path
+// and community conditions once per interned attribute set.
+class table_query {
+public:
+    // matching paths of one prefix, returns false to stop walk
+    using visitor = std::function<bool( const NLRI&, const std::vector<const bgp_path*>& )>;
+
+    // throws std::runtime_error on invalid filter
+    table_query( const Show_Table_Req &req, const neighbour_index &neighbours );
+    // visit prefixes after given one in table order, false if visitor stopped walk
+    bool walk_v4( const rib_snapshot &rib, const std::optional<NLRI> &after, const visitor &f );
+    bool walk_v6( const rib_snapshot &rib, const std::optional<prefix_v6> &after, const visitor &f );
+private:
+    // Key is NLRI or prefix_v6, find( key ) returns paths of prefix or nullptr,
+    // walk_after( after, f ) visits prefixes after given one
+    template<typename Key, typename Find, typename Walk>
+    bool walk( const std::optional<Key> &after, Find find, Walk walk_after, const visitor &f );
+    bool match( const bgp_path &path );
+    bool match_attrs( const std::vector<path_attr_t> &attrs ) const;
+    bool collect( const std::vector<bgp_path> &all, std::vector<const bgp_path*> &paths );
+
+    std::optional<NLRI> prefix;
+    PREFIX_MATCH prefix_match;
+    std::shared_ptr<bgp_fsm> peer;
+    std::optional<boost::asio::ip::address_v4> nexthop_v4;
+    std::optional<boost::asio::ip::address_v6> nexthop_v6;
+    std::optional<uint32_t> asn;
+    std::optional<community_t> community;
+    // results of attribute conditions, snapshot keeps sets alive while one walk runs
+    std::map<const std::vector<path_attr_t>*,bool> attr_matches;
+};
+
+#endif
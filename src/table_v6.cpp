@@ -0,0 +1,287 @@
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "table_v6.hpp"
+#include "fsm.hpp"
+#include "packet.hpp"
+#include "config.hpp"
+#include "log.hpp"
+#include "string_utils.hpp"
+#include "evloop.hpp"
+#include "nlri.hpp"
+#include "route_policy.hpp"
+
+extern Logger logger;
+extern std::shared_ptr<EVLoop> runtime;
+
+bgp_table_v6::bgp_table_v6( boost::asio::io_context &i, GlobalConf &c, bgp_table_v4 &t ):
+    conf( c ),
+    table_v4( t ),
+    path_count( 0 ),
+    io( i ),
+    send_updates( i )
+{}
+
+void bgp_table_v6::add_path( const NLRI &prefix, std::shared_ptr<std::vector<path_attr_t>> attrs, std::shared_ptr<bgp_fsm> nei ) {
+    scheduled_updates.emplace( prefix );
+    schedule_updates();
+    prefix_v6 key( prefix );
+    segments.mark( rib_snapshot::segment( key ) );
+    auto &paths = rib.get( key );
+    auto it = std::find_if( paths.begin(), paths.end(), [ &nei ]( const bgp_path &p ) { return p.source == nei; } );
+    if( it != paths.end() ) {
+        it->time = std::chrono::system_clock::now();
+        it->attrs = std::move( attrs );
+        // replaced best path is reported as changed
+        it->isBest = false;
+    } else {
+        paths.emplace_back( std::move( attrs ), nei );
+        peer_prefixes[ nei ].insert( key );
+        path_count++;
+    }
+    best_path_selection( key, paths );
+}
+
+void bgp_table_v6::del_path( const NLRI &prefix, std::shared_ptr<bgp_fsm> nei ) {
+    prefix_v6 key( prefix );
+    auto paths = rib.find( key );
+    if( paths == nullptr ) {
+        return;
+    }
+    auto it = std::find_if( paths->begin(), paths->end(), [ &nei ]( const bgp_path &p ) { return p.source == nei; } );
+    if( it == paths->end() ) {
+        return;
+    }
+    scheduled_updates.emplace( prefix );
+    schedule_updates();
+    segments.mark( rib_snapshot::segment( key ) );
+    paths->erase( it );
+    path_count--;
+    auto indexed = peer_prefixes.find( nei );
+    if( indexed != peer_prefixes.end() ) {
+        indexed->second.erase( key );
+        if( indexed->second.empty() ) {
+            peer_prefixes.erase( indexed );
+        }
+    }
+    if( paths->empty() ) {
+        rib.erase( key );
+        notify_best_path( key, nullptr );
+    } else {
+        best_path_selection( key, *paths );
+    }
+}
+
+void bgp_table_v6::purge_peer( std::shared_ptr<bgp_fsm> peer ) {
+    auto indexed = peer_prefixes.find( peer );
+    if( indexed == peer_prefixes.end() ) {
+        return;
+    }
+    for( auto const &prefix: indexed->second ) {
+        auto paths = rib.find( prefix );
+        if( paths == nullptr ) {
+            continue;
+        }
+        auto it = std::remove_if( paths->begin(), paths->end(), [ &peer ]( const bgp_path &p ) { return p.source == peer; } );
+        path_count -= std::distance( it, paths->end() );
+        paths->erase( it, paths->end() );
+        scheduled_updates.emplace( prefix.to_nlri() );
+        segments.mark( rib_snapshot::segment( prefix ) );
+        if( paths->empty() ) {
+            rib.erase( prefix );
+            notify_best_path( prefix, nullptr );
+        } else {
+            best_path_selection( prefix, *paths );
+        }
+    }
+    peer_prefixes.erase( indexed );
+    schedule_updates();
+}
+
+void bgp_table_v6::best_path_selection( const prefix_v6 &prefix, std::vector<bgp_path> &paths ) {
+    bgp_path *best = nullptr;
+    const bgp_path *previous = nullptr;
+    for( auto &path: paths ) {
+        if( path.isBest ) {
+            previous = &path;
+        }
+        path.isBest = false;
+        if( best == nullptr || better_path( path, *best ) ) {
+            best = &path;
+        }
+    }
+    if( best != nullptr ) {
+        best->isBest = true;
+    }
+    if( best != previous ) {
+        notify_best_path( prefix, best );
+    }
+}
+
+void bgp_table_v6::add_best_path_listener( bgp_table_v4::best_path_listener listener ) {
+    best_path_listeners.push_back( std::move( listener ) );
+}
+
+void bgp_table_v6::notify_best_path( const prefix_v6 &prefix, const bgp_path *best ) {
+    if( best_path_listeners.empty() ) {
+        return;
+    }
+    auto nlri = prefix.to_nlri();
+    for( auto const &listener: best_path_listeners ) {
+        listener( nlri, best );
+    }
+}
+
+const bgp_path *bgp_table_v6::get_best_path( const NLRI &prefix ) const {
+    auto paths = rib.find( prefix_v6( prefix ) );
+    if( paths == nullptr ) {
+        return nullptr;
+    }
+    for( auto const &path: *paths ) {
+        if( path.isBest ) {
+            return &path;
+        }
+    }
+    return nullptr;
+}
+
+const bgp_path *bgp_table_v6::find_path( const NLRI &prefix, const std::shared_ptr<bgp_fsm> &peer ) const {
+    auto paths = rib.find( prefix_v6( prefix ) );
+    if( paths == nullptr ) {
+        return nullptr;
+    }
+    for( auto const &path: *paths ) {
+        if( path.source == peer ) {
+            return &path;
+        }
+    }
+    return nullptr;
+}
+
+void bgp_table_v6::collect_peer_paths( const std::shared_ptr<bgp_fsm> &peer, bgp_table_v4::peer_paths &paths ) const {
+    auto indexed = peer_prefixes.find( peer );
+    if( indexed == peer_prefixes.end() ) {
+        return;
+    }
+    for( auto const &prefix: indexed->second ) {
+        auto nlri = prefix.to_nlri();
+        if( auto path = find_path( nlri, peer ); path != nullptr ) {
+            paths.emplace( std::make_pair( nlri, 0U ), path->attrs );
+        }
+    }
+}
+
+void bgp_table_v6::schedule_peer_updates( const std::shared_ptr<bgp_fsm> &peer ) {
+    auto indexed = peer_prefixes.find( peer );
+    if( indexed == peer_prefixes.end() ) {
+        return;
+    }
+    for( auto const &prefix: indexed->second ) {
+        scheduled_updates.emplace( prefix.to_nlri() );
+    }
+    schedule_updates();
+}
+
+const std::vector<std::shared_ptr<const rib_segment<prefix_v6>>> &bgp_table_v6::publish_segments() {
+    return segments.publish( [ this ]( std::size_t index, rib_segment<prefix_v6> &segment ) {
+        auto copy = [ &segment ]( const prefix_v6 &prefix, const std::vector<bgp_path> &paths ) {
+            auto &entry = segment.emplace_back( prefix, paths );
+            for( auto &path: entry.second ) {
+                path.nexthop.reset();
+            }
+        };
+        // prefixes shorter than segment cover it, but they belong to segment of their leading bits
+        prefix_v6 start( uint64_t( index ) << ( 64 - RIB_SEGMENT_BITS ), 0, RIB_SEGMENT_BITS );
+        rib.for_each_covering( start, [ & ]( const prefix_v6 &prefix, const std::vector<bgp_path> &paths ) {
+            if( prefix.len < RIB_SEGMENT_BITS && rib_snapshot::segment( prefix ) == index ) {
+                copy( prefix, paths );
+            }
+        });
+        rib.for_each_within( start, std::nullopt, [ & ]( const prefix_v6 &prefix, const std::vector<bgp_path> &paths ) {
+            copy( prefix, paths );
+            return true;
+        });
+    });
+}
+
+std::size_t bgp_table_v6::size() const {
+    return path_count;
+}
+
+std::set<NLRI> bgp_table_v6::prefixes() {
+    std::set<NLRI> all;
+    rib.for_each( [ &all ]( const prefix_v6 &prefix, const std::vector<bgp_path>& ) {
+        all.emplace( prefix.to_nlri() );
+    });
+    return all;
+}
+
+std::map<NLRI,std::vector<bgp_export_path>> bgp_table_v6::export_paths( const bgp_update_group &group, const std::set<NLRI> &prefixes ) {
+    std::shared_ptr<route_policy> pol;
+    if( group.export_policy ) {
+        pol = table_v4.get_policy( *group.export_policy );
+    }
+    bgp_table_v4::reflect_cache reflected;
+    std::map<NLRI,std::vector<bgp_export_path>> exported;
+    for( auto const &prefix: prefixes ) {
+        auto &paths = exported.emplace_hint( exported.end(), prefix, std::vector<bgp_export_path>{} )->second;
+        // policy which can't be loaded rejects everything
+        if( group.export_policy && !pol ) {
+            continue;
+        }
+        auto best = get_best_path( prefix );
+        if( best == nullptr || !table_v4.is_exportable( *best, group.ibgp, group.rr_client ) ) {
+            continue;
+        }
+        auto attrs = pol ? table_v4.apply_policy( *pol, prefix, best->attrs ) : best->attrs;
+        if( attrs && group.ibgp && best->source && best->source->conf.remote_as == conf.my_as ) {
+            attrs = table_v4.reflect_attrs( *best, attrs, reflected );
+        }
+        if( attrs ) {
+            paths.push_back( { best, std::move( attrs ) } );
+        }
+    }
+    return exported;
+}
+
+void bgp_table_v6::schedule_updates() {
+    send_updates.expires_after( std::chrono::seconds( 1 ) );
+    send_updates.async_wait( std::bind( &bgp_table_v6::on_send_updates, this, std::placeholders::_1 ) );
+}
+
+void bgp_table_v6::on_send_updates( const boost::system::error_code &ec ) {
+    if( ec ) {
+        // supress operation canceled, because we could have multiple timer schedules
+        if( ec == boost::system::errc::operation_canceled )
+            return;
+        logger.logError() << LOGS::EVENT_LOOP << "On timer for sending IPv6 updates: " << ec.message() << std::endl;
+    }
+    std::map<std::tuple<std::optional<std::string>,bool,bool>,bgp_update_group> groups;
+    for( auto const &[ add, nei ]: runtime->neighbours ) {
+        if( nei->state != FSM_STATE::ESTABLISHED || !nei->ipv6_unicast ) {
+            continue;
+        }
+        bool ibgp = nei->conf.remote_as == conf.my_as;
+        bool rr_client = ibgp && nei->conf.route_reflector_client;
+        auto &group = groups[ { nei->conf.export_policy, ibgp, rr_client } ];
+        group.export_policy = nei->conf.export_policy;
+        group.ibgp = ibgp;
+        group.rr_client = rr_client;
+        group.add_path = false;
+        group.peers.push_back( nei );
+    }
+    for( auto const &[ key, group ]: groups ) {
+        logger.logInfo() << LOGS::TABLE << "Sending updates for " << scheduled_updates.size() << " IPv6 prefixes to update group with "
+        << group.peers.size() << " peers" << std::endl;
+        auto exported = export_paths( group, scheduled_updates );
+        for( auto const &nei: group.peers ) {
+            nei->tx_group_updates_v6( exported );
+        }
+    }
+    scheduled_updates.clear();
+}
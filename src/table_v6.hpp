@@ -0,0 +1,83 @@
+#ifndef TABLE_V6_HPP_
+#define TABLE_V6_HPP_
+
+#include <set>
+#include <map>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "table.hpp"
+#include "trie_v6.hpp"
+
+struct path_attr_t;
+struct bgp_fsm;
+struct GlobalConf;
+class NLRI;
+
+// IPv6 unicast RIB. Attribute sets are interned and policies are evaluated by
+// IPv4 table, so both address families share one attribute store and policy
+// cache. Paths are kept in 128 bit trie, there is no ADD-PATH and multipath.
+class bgp_table_v6 {
+public:
+    bgp_table_v6( boost::asio::io_context &i, GlobalConf &c, bgp_table_v4 &t );
+    // attrs must be interned with bgp_table_v4::intern_attrs
+    void add_path( const NLRI &prefix, std::shared_ptr<std::vector<path_attr_t>> attrs, std::shared_ptr<bgp_fsm> peer );
+    void del_path( const NLRI &prefix, std::shared_ptr<bgp_fsm> peer );
+    void purge_peer( std::shared_ptr<bgp_fsm> peer );
+    const bgp_path *get_best_path( const NLRI &prefix ) const;
+    const bgp_path *find_path( const NLRI &prefix, const std::shared_ptr<bgp_fsm> &peer ) const;
+    // paths received from peer, path identifier is zero
+    void collect_peer_paths( const std::shared_ptr<bgp_fsm> &peer, bgp_table_v4::peer_paths &paths ) const;
+    void schedule_peer_updates( const std::shared_ptr<bgp_fsm> &peer );
+    std::size_t size() const;
+    std::set<NLRI> prefixes();
+    // copies of trie segments for rib_snapshot, segments changed since previous call are copied again
+    const std::vector<std::shared_ptr<const rib_segment<prefix_v6>>> &publish_segments();
+    void add_best_path_listener( bgp_table_v4::best_path_listener listener );
+    // best exportable path of prefixes for update group, empty vector withdraws prefix
+    std::map<NLRI,std::vector<bgp_export_path>> export_paths( const bgp_update_group &group, const std::set<NLRI> &prefixes );
+    // visits paths in prefix order, f( const NLRI&, const bgp_path& )
+    template<typename F>
+    void for_each( F f ) {
+        rib.for_each( [ &f ]( const prefix_v6 &prefix, const std::vector<bgp_path> &paths ) {
+            auto nlri = prefix.to_nlri();
+            for( auto const &path: paths ) {
+                f( nlri, path );
+            }
+        });
+    }
+    // walk of paths of more specifics of within after prefix, f( const prefix_v6&, const std::vector<bgp_path>& ) returns false to stop
+    template<typename F>
+    void for_each_within( const prefix_v6 &within, const std::optional<prefix_v6> &after, F f ) const {
+        rib.for_each_within( within, after, [ &f ]( const prefix_v6 &prefix, const std::vector<bgp_path> &paths ) {
+            return f( prefix, paths );
+        });
+    }
+    // paths of prefixes which cover given one, shortest first, f( const prefix_v6&, const std::vector<bgp_path>& )
+    template<typename F>
+    void for_each_covering( const prefix_v6 &prefix, F f ) const {
+        rib.for_each_covering( prefix, f );
+    }
+private:
+    void best_path_selection( const prefix_v6 &prefix, std::vector<bgp_path> &paths );
+    void notify_best_path( const prefix_v6 &prefix, const bgp_path *best );
+    void schedule_updates();
+    void on_send_updates( const boost::system::error_code &ec );
+
+    GlobalConf &conf;
+    bgp_table_v4 &table_v4;
+    trie_v6<std::vector<bgp_path>> rib;
+    std::size_t path_count;
+    // prefixes by source of their paths
+    std::map<std::shared_ptr<bgp_fsm>,std::set<prefix_v6>> peer_prefixes;
+    rib_segments<rib_segment<prefix_v6>> segments;
+    std::vector<bgp_table_v4::best_path_listener> best_path_listeners;
+
+    boost::asio::io_context &io;
+    boost::asio::steady_timer send_updates;
+    std::set<NLRI> scheduled_updates;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include <algorithm>
+
+#include "timer_wheel.hpp"
+
+wheel_timer::wheel_timer( timer_wheel &w ):
+    wheel( w ),
+    expiry( 0 ),
+    list( nullptr ),
+    prev( nullptr ),
+    next( nullptr )
+{}
+
+wheel_timer::~wheel_timer() {
+    cancel();
+}
+
+void wheel_timer::arm( std::chrono::milliseconds delay, std::function<void()> cb ) {
+    cancel();
+    callback = std::move( cb );
+    wheel.insert( *this, delay );
+}
+
+void wheel_timer::cancel() {
+    if( armed() ) {
+        wheel.remove( *this );
+        callback = nullptr;
+    }
+}
+
+bool wheel_timer::armed() const {
+    return list != nullptr;
+}
+
+timer_wheel::timer_wheel( boost::asio::io_context &io ):
+    timer( io ),
+    start( std::chrono::steady_clock::now() ),
+    slots( TIMER_WHEEL_SLOTS, nullptr ),
+    pending( nullptr ),
+    processed( 0 ),
+    count( 0 ),
+    running( false )
+{}
+
+timer_wheel::~timer_wheel() {
+    // callbacks may own timers, so they are destroyed after all timers are unlinked
+    std::vector<std::function<void()>> callbacks;
+    for( auto &head: slots ) {
+        while( head != nullptr ) {
+            callbacks.emplace_back().swap( head->callback );
+            unlink( *head );
+        }
+    }
+    while( pending != nullptr ) {
+        callbacks.emplace_back().swap( pending->callback );
+        unlink( *pending );
+    }
+    count = 0;
+}
+
+std::size_t timer_wheel::size() const {
+    return count;
+}
+
+uint64_t timer_wheel::current_tick() const {
+    return ( std::chrono::steady_clock::now() - start ) / TIMER_WHEEL_TICK;
+}
+
+void timer_wheel::link( wheel_timer &t, wheel_timer *&head ) {
+    t.list = &head;
+    t.prev = nullptr;
+    t.next = head;
+    if( head != nullptr ) {
+        head->prev = &t;
+    }
+    head = &t;
+}
+
+void timer_wheel::unlink( wheel_timer &t ) {
+    if( t.prev != nullptr ) {
+        t.prev->next = t.next;
+    } else {
+        *t.list = t.next;
+    }
+    if( t.next != nullptr ) {
+        t.next->prev = t.prev;
+    }
+    t.list = nullptr;
+    t.prev = nullptr;
+    t.next = nullptr;
+}
+
+void timer_wheel::insert( wheel_timer &t, std::chrono::milliseconds delay ) {
+    auto since_start = std::chrono::steady_clock::now() - start;
+    if( !running ) {
+        // slots of ticks while wheel was stopped are empty
+        processed = since_start / TIMER_WHEEL_TICK;
+    }
+    // first tick at or after due time, current tick is already partly elapsed
+    auto due = since_start + delay;
+    uint64_t due_tick = ( due + TIMER_WHEEL_TICK - std::chrono::steady_clock::duration( 1 ) ) / TIMER_WHEEL_TICK;
+    t.expiry = std::max( due_tick, processed + 1 );
+    link( t, slots[ t.expiry % slots.size() ] );
+    count++;
+    if( !running ) {
+        schedule();
+    }
+}
+
+void timer_wheel::remove( wheel_timer &t ) {
+    unlink( t );
+    count--;
+}
+
+void timer_wheel::schedule() {
+    if( count == 0 ) {
+        running = false;
+        return;
+    }
+    running = true;
+    timer.expires_at( start + ( processed + 1 ) * TIMER_WHEEL_TICK );
+    timer.async_wait( std::bind( &timer_wheel::on_tick, this, std::placeholders::_1 ) );
+}
+
+void timer_wheel::on_tick( const boost::system::error_code &ec ) {
+    if( ec ) {
+        running = false;
+        return;
+    }
+    auto now = current_tick();
+    while( processed < now ) {
+        processed++;
+        for( auto t = slots[ processed % slots.size() ]; t != nullptr; ) {
+            auto next = t->next;
+            if( t->expiry <= processed ) {
+                unlink( *t );
+                link( *t, pending );
+            }
+            t = next;
+        }
+    }
+    // callback may arm or cancel any timer, including expired ones
+    while( pending != nullptr ) {
+        auto &t = *pending;
+        remove( t );
+        std::function<void()> callback;
+        callback.swap( t.callback );
+        callback();
+    }
+    schedule();
+}
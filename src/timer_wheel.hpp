@@ -0,0 +1,70 @@
+#ifndef TIMER_WHEEL_HPP_
+#define TIMER_WHEEL_HPP_
+
+#include <chrono>
+#include <vector>
+#include <functional>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+static constexpr std::chrono::milliseconds TIMER_WHEEL_TICK { 100 };
+// one revolution is about 100 seconds, longer timers stay in slot for more rounds
+static constexpr std::size_t TIMER_WHEEL_SLOTS = 1024;
+
+class timer_wheel;
+
+// Timer served by timer_wheel. It is owned by its user and can be armed again
+// without allocation, destruction cancels it.
+class wheel_timer {
+public:
+    explicit wheel_timer( timer_wheel &w );
+    ~wheel_timer();
+    wheel_timer( const wheel_timer& ) = delete;
+    wheel_timer &operator=( const wheel_timer& ) = delete;
+
+    // callback is called on event loop after delay rounded up to tick, previous arm is cancelled
+    void arm( std::chrono::milliseconds delay, std::function<void()> cb );
+    void cancel();
+    bool armed() const;
+private:
+    friend class timer_wheel;
+    timer_wheel &wheel;
+    std::function<void()> callback;
+    uint64_t expiry;
+    // intrusive list of slot, list is nullptr when timer isn't armed
+    wheel_timer **list;
+    wheel_timer *prev;
+    wheel_timer *next;
+};
+
+// Hashed timer wheel. Timer is linked into slot of its expiry tick, so arm and
+// cancel are constant time, and one asio timer, which runs only while some
+// timer is armed, serves all of them.
+class timer_wheel {
+public:
+    explicit timer_wheel( boost::asio::io_context &io );
+    ~timer_wheel();
+    // number of armed timers
+    std::size_t size() const;
+private:
+    friend class wheel_timer;
+    void insert( wheel_timer &t, std::chrono::milliseconds delay );
+    void remove( wheel_timer &t );
+    static void link( wheel_timer &t, wheel_timer *&head );
+    static void unlink( wheel_timer &t );
+    uint64_t current_tick() const;
+    void schedule();
+    void on_tick( const boost::system::error_code &ec );
+
+    boost::asio::steady_timer timer;
+    std::chrono::steady_clock::time_point start;
+    std::vector<wheel_timer*> slots;
+    // expired timers, which are not called yet
+    wheel_timer *pending;
+    // last tick whose slot was processed
+    uint64_t processed;
+    std::size_t count;
+    bool running;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include <array>
+#include <tuple>
+#include <algorithm>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "trie_v6.hpp"
+#include "nlri.hpp"
+#include "packet.hpp"
+
+static uint64_t mask( uint8_t bits ) {
+    return bits == 0 ? 0 : ~uint64_t( 0 ) << ( 64 - bits );
+}
+
+prefix_v6::prefix_v6( const NLRI &prefix ):
+    hi( 0 ),
+    lo( 0 ),
+    len( std::min<uint8_t>( prefix.get_len(), 128 ) )
+{
+    auto const &data = prefix.get_data();
+    for( std::size_t i = 0; i < data.size() && i < 16; i++ ) {
+        if( i < 8 ) {
+            hi |= uint64_t( data[ i ] ) << ( 56 - i * 8 );
+        } else {
+            lo |= uint64_t( data[ i ] ) << ( 56 - ( i - 8 ) * 8 );
+        }
+    }
+    *this = truncate( len );
+}
+
+prefix_v6::prefix_v6( uint64_t h, uint64_t l, uint8_t n ):
+    hi( h ),
+    lo( l ),
+    len( n )
+{}
+
+NLRI prefix_v6::to_nlri() const {
+    std::array<uint8_t,16> bytes;
+    for( int i = 0; i < 8; i++ ) {
+        bytes[ i ] = hi >> ( 56 - i * 8 );
+        bytes[ i + 8 ] = lo >> ( 56 - i * 8 );
+    }
+    return NLRI( BGP_AFI::IPv6, bytes.data(), len );
+}
+
+int prefix_v6::bit( uint8_t pos ) const {
+    return pos < 64 ? ( hi >> ( 63 - pos ) ) & 1 : ( lo >> ( 127 - pos ) ) & 1;
+}
+
+prefix_v6 prefix_v6::truncate( uint8_t n ) const {
+    if( n <= 64 ) {
+        return { hi & mask( n ), 0, n };
+    }
+    return { hi, lo & mask( n - 64 ), n };
+}
+
+uint8_t prefix_v6::common_len( const prefix_v6 &a, const prefix_v6 &b ) {
+    uint8_t max = std::min( a.len, b.len );
+    uint8_t common;
+    if( auto diff = a.hi ^ b.hi; diff != 0 ) {
+        common = __builtin_clzll( diff );
+    } else if( auto diff_lo = a.lo ^ b.lo; diff_lo != 0 ) {
+        common = 64 + __builtin_clzll( diff_lo );
+    } else {
+        common = 128;
+    }
+    return std::min( common, max );
+}
+
+bool operator==( const prefix_v6 &lhs, const prefix_v6 &rhs ) {
+    return lhs.hi == rhs.hi && lhs.lo == rhs.lo && lhs.len == rhs.len;
+}
+
+bool operator<( const prefix_v6 &lhs, const prefix_v6 &rhs ) {
+    return std::tie( lhs.hi, lhs.lo, lhs.len ) < std::tie( rhs.hi, rhs.lo, rhs.len );
+}
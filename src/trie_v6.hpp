@@ -0,0 +1,305 @@
+#ifndef TRIE_V6_HPP_
+#define TRIE_V6_HPP_
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+
+class NLRI;
+
+// IPv6 prefix as two 64 bit words in host order, bits after length are zero
+struct prefix_v6 {
+    uint64_t hi;
+    uint64_t lo;
+    uint8_t len;
+
+    explicit prefix_v6( const NLRI &prefix );
+    prefix_v6( uint64_t h, uint64_t l, uint8_t n );
+
+    NLRI to_nlri() const;
+    int bit( uint8_t pos ) const;
+    // prefix shortened to n bits
+    prefix_v6 truncate( uint8_t n ) const;
+    // number of leading bits which are equal in both prefixes, not more than shorter length
+    static uint8_t common_len( const prefix_v6 &a, const prefix_v6 &b );
+};
+
+bool operator==( const prefix_v6 &lhs, const prefix_v6 &rhs );
+// order of trie walk: address bits, then length, so covering prefix is before more specifics
+bool operator<( const prefix_v6 &lhs, const prefix_v6 &rhs );
+
+// Path compressed binary trie over 128 bit prefixes. Nodes are kept in one
+// vector and linked by indexes, comparison of node prefixes works on two
+// machine words, so lookup is at most one word compare per branching node.
+template<typename T>
+class trie_v6 {
+public:
+    T *find( const prefix_v6 &prefix );
+    const T *find( const prefix_v6 &prefix ) const;
+    // inserts default value if prefix doesn't exist
+    T &get( const prefix_v6 &prefix );
+    bool erase( const prefix_v6 &prefix );
+    std::size_t size() const {
+        return count;
+    }
+    // visits values in prefix order, parents before more specifics
+    template<typename F>
+    void for_each( F f );
+    // visits values of prefixes after given one in the same order, until f returns false,
+    // subtrees before prefix are skipped, so walk can be resumed without visiting them again
+    template<typename F>
+    void for_each_after( const std::optional<prefix_v6> &after, F f ) const;
+    // the same walk limited to prefixes covered by within, subtrees outside of it are skipped
+    template<typename F>
+    void for_each_within( const prefix_v6 &within, const std::optional<prefix_v6> &after, F f ) const;
+    // visits values of prefixes which cover given one, shortest first
+    template<typename F>
+    void for_each_covering( const prefix_v6 &prefix, F f ) const;
+private:
+    struct node {
+        prefix_v6 prefix;
+        int32_t child[ 2 ];
+        std::optional<T> value;
+    };
+
+    int32_t alloc( const prefix_v6 &prefix );
+    void release( int32_t index );
+    int32_t &link( int32_t parent, int which );
+    template<typename F>
+    void walk( const std::optional<prefix_v6> &within, const std::optional<prefix_v6> &after, F f ) const;
+
+    std::vector<node> nodes;
+    std::vector<int32_t> free_nodes;
+    int32_t root = -1;
+    std::size_t count = 0;
+};
+
+template<typename T>
+int32_t trie_v6<T>::alloc( const prefix_v6 &prefix ) {
+    if( !free_nodes.empty() ) {
+        auto index = free_nodes.back();
+        free_nodes.pop_back();
+        nodes[ index ] = node { prefix, { -1, -1 }, std::nullopt };
+        return index;
+    }
+    nodes.push_back( node { prefix, { -1, -1 }, std::nullopt } );
+    return nodes.size() - 1;
+}
+
+template<typename T>
+void trie_v6<T>::release( int32_t index ) {
+    nodes[ index ].value.reset();
+    free_nodes.push_back( index );
+}
+
+template<typename T>
+int32_t &trie_v6<T>::link( int32_t parent, int which ) {
+    return parent < 0 ? root : nodes[ parent ].child[ which ];
+}
+
+template<typename T>
+T *trie_v6<T>::find( const prefix_v6 &prefix ) {
+    return const_cast<T*>( static_cast<const trie_v6<T>*>( this )->find( prefix ) );
+}
+
+template<typename T>
+const T *trie_v6<T>::find( const prefix_v6 &prefix ) const {
+    auto current = root;
+    while( current >= 0 ) {
+        auto const &n = nodes[ current ];
+        if( n.prefix.len > prefix.len || prefix_v6::common_len( n.prefix, prefix ) < n.prefix.len ) {
+            return nullptr;
+        }
+        if( n.prefix.len == prefix.len ) {
+            return n.value ? &*n.value : nullptr;
+        }
+        current = n.child[ prefix.bit( n.prefix.len ) ];
+    }
+    return nullptr;
+}
+
+template<typename T>
+T &trie_v6<T>::get( const prefix_v6 &prefix ) {
+    int32_t parent = -1;
+    int which = 0;
+    while( true ) {
+        auto current = link( parent, which );
+        if( current < 0 ) {
+            auto leaf = alloc( prefix );
+            link( parent, which ) = leaf;
+            count++;
+            return nodes[ leaf ].value.emplace();
+        }
+        auto common = prefix_v6::common_len( nodes[ current ].prefix, prefix );
+        auto node_len = nodes[ current ].prefix.len;
+        if( common == node_len ) {
+            if( prefix.len == node_len ) {
+                if( !nodes[ current ].value ) {
+                    count++;
+                    nodes[ current ].value.emplace();
+                }
+                return *nodes[ current ].value;
+            }
+            parent = current;
+            which = prefix.bit( node_len );
+            continue;
+        }
+        // prefixes diverge before end of node, node is moved under new one
+        auto old_bit = nodes[ current ].prefix.bit( common );
+        int32_t inserted;
+        int32_t leaf;
+        if( common == prefix.len ) {
+            inserted = leaf = alloc( prefix );
+            nodes[ inserted ].child[ old_bit ] = current;
+        } else {
+            inserted = alloc( prefix.truncate( common ) );
+            leaf = alloc( prefix );
+            nodes[ inserted ].child[ old_bit ] = current;
+            nodes[ inserted ].child[ 1 - old_bit ] = leaf;
+        }
+        link( parent, which ) = inserted;
+        count++;
+        return nodes[ leaf ].value.emplace();
+    }
+}
+
+template<typename T>
+bool trie_v6<T>::erase( const prefix_v6 &prefix ) {
+    int32_t grandparent = -1;
+    int grandparent_which = 0;
+    int32_t parent = -1;
+    int which = 0;
+    auto current = root;
+    while( current >= 0 ) {
+        auto const &n = nodes[ current ];
+        if( n.prefix.len > prefix.len || prefix_v6::common_len( n.prefix, prefix ) < n.prefix.len ) {
+            return false;
+        }
+        if( n.prefix.len == prefix.len ) {
+            break;
+        }
+        grandparent = parent;
+        grandparent_which = which;
+        parent = current;
+        which = prefix.bit( n.prefix.len );
+        current = n.child[ which ];
+    }
+    if( current < 0 || !nodes[ current ].value ) {
+        return false;
+    }
+    nodes[ current ].value.reset();
+    count--;
+    // node without value is only kept while it branches
+    auto &n = nodes[ current ];
+    if( n.child[ 0 ] >= 0 && n.child[ 1 ] >= 0 ) {
+        return true;
+    }
+    auto only = n.child[ 0 ] >= 0 ? n.child[ 0 ] : n.child[ 1 ];
+    link( parent, which ) = only;
+    release( current );
+    if( only < 0 && parent >= 0 && !nodes[ parent ].value ) {
+        // parent has single child now
+        auto sibling = nodes[ parent ].child[ 1 - which ];
+        link( grandparent, grandparent_which ) = sibling;
+        release( parent );
+    }
+    return true;
+}
+
+template<typename T>
+template<typename F>
+void trie_v6<T>::for_each( F f ) {
+    std::vector<int32_t> stack;
+    if( root >= 0 ) {
+        stack.push_back( root );
+    }
+    while( !stack.empty() ) {
+        auto current = stack.back();
+        stack.pop_back();
+        auto &n = nodes[ current ];
+        if( n.child[ 1 ] >= 0 ) {
+            stack.push_back( n.child[ 1 ] );
+        }
+        if( n.child[ 0 ] >= 0 ) {
+            stack.push_back( n.child[ 0 ] );
+        }
+        if( n.value ) {
+            f( n.prefix, *n.value );
+        }
+    }
+}
+
+template<typename T>
+template<typename F>
+void trie_v6<T>::for_each_after( const std::optional<prefix_v6> &after, F f ) const {
+    walk( std::nullopt, after, f );
+}
+
+template<typename T>
+template<typename F>
+void trie_v6<T>::for_each_within( const prefix_v6 &within, const std::optional<prefix_v6> &after, F f ) const {
+    walk( within, after, f );
+}
+
+template<typename T>
+template<typename F>
+void trie_v6<T>::for_each_covering( const prefix_v6 &prefix, F f ) const {
+    auto current = root;
+    while( current >= 0 ) {
+        auto const &n = nodes[ current ];
+        if( n.prefix.len > prefix.len || prefix_v6::common_len( n.prefix, prefix ) < n.prefix.len ) {
+            return;
+        }
+        if( n.value ) {
+            f( n.prefix, *n.value );
+        }
+        if( n.prefix.len == prefix.len ) {
+            return;
+        }
+        current = n.child[ prefix.bit( n.prefix.len ) ];
+    }
+}
+
+template<typename T>
+template<typename F>
+void trie_v6<T>::walk( const std::optional<prefix_v6> &within, const std::optional<prefix_v6> &after, F f ) const {
+    std::vector<int32_t> stack;
+    if( root >= 0 ) {
+        stack.push_back( root );
+    }
+    while( !stack.empty() ) {
+        auto current = stack.back();
+        stack.pop_back();
+        auto const &n = nodes[ current ];
+        if( within && prefix_v6::common_len( n.prefix, *within ) < std::min( n.prefix.len, within->len ) ) {
+            continue;
+        }
+        if( after ) {
+            // last prefix of subtree has all remaining bits set
+            auto len = n.prefix.len;
+            prefix_v6 last {
+                len >= 64 ? n.prefix.hi : n.prefix.hi | ( len == 0 ? ~uint64_t( 0 ) : ~uint64_t( 0 ) >> len ),
+                len >= 128 ? n.prefix.lo : n.prefix.lo | ( len <= 64 ? ~uint64_t( 0 ) : ~uint64_t( 0 ) >> ( len - 64 ) ),
+                128
+            };
+            if( !( *after < last ) ) {
+                continue;
+            }
+        }
+        if( n.child[ 1 ] >= 0 ) {
+            stack.push_back( n.child[ 1 ] );
+        }
+        if( n.child[ 0 ] >= 0 ) {
+            stack.push_back( n.child[ 0 ] );
+        }
+        if( within && n.prefix.len < within->len ) {
+            continue;
+        }
+        if( n.value && ( !after || *after < n.prefix ) && !f( n.prefix, *n.value ) ) {
+            return;
+        }
+    }
+}
+
+#endif
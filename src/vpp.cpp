@@ -1,26 +1,234 @@
+#include <algorithm>
+#include <cstring>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
 #include "vpp.hpp"
+#include "table.hpp"
 #include "log.hpp"
 #include "string_utils.hpp"
+#include "nlri.hpp"
+#include "packet.hpp"
 
 extern Logger logger;
 
 DEFINE_VAPI_MSG_IDS_VPE_API_JSON
+DEFINE_VAPI_MSG_IDS_IP_API_JSON
 DEFINE_VAPI_MSG_IDS_SESSION_API_JSON
 
-vpp_api::vpp_api() {
-    auto ret = con.connect( "bgp++", nullptr, 32, 32 );
+vpp_api::vpp_api( uint32_t table_id ):
+    connected( false ),
+    table( table_id ),
+    stopping( false ),
+    outstanding( 0 )
+{}
+
+vpp_api::~vpp_api() {
+    stop();
+}
+
+void vpp_api::stop() {
+    if( worker.joinable() ) {
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            stopping = true;
+        }
+        wakeup.notify_one();
+        worker.join();
+    }
+    if( connected ) {
+        connected = false;
+        auto ret = con.disconnect();
+        if( ret == VAPI_OK ) {
+            logger.logInfo() << LOGS::VPP << "VPP API: disconnected" << std::endl;
+        } else {
+            logger.logError() << LOGS::VPP << "VPP API: something went wrong, cannot disconnect" << std::endl;
+        }
+    }
+    // requests of previous connection are forgotten
+    stopping = false;
+    submitted.clear();
+    completed.clear();
+    outstanding = 0;
+    requests.clear();
+    dispatched.clear();
+}
+
+bool vpp_api::connect() {
+    stop();
+    // request queue is large enough to keep whole FIB batch in flight
+    auto ret = con.connect( "bgp++", nullptr, FIB_MAX_INFLIGHT, FIB_MAX_INFLIGHT );
     if( ret == VAPI_OK ) {
         logger.logInfo() << LOGS::VPP << "VPP API: connected" << std::endl;
+        connected = true;
     } else {
         logger.logError() << LOGS::VPP << "VPP API: Cannot connect to vpp" << std::endl;
     }
+    return connected;
 }
 
-vpp_api::~vpp_api() {
-    auto ret = con.disconnect();
-    if( ret == VAPI_OK ) {
-        logger.logInfo() << LOGS::VPP << "VPP API: disconnected" << std::endl;
-    } else {
-        logger.logError() << LOGS::VPP << "VPP API: something went wrong, cannot disconnect" << std::endl;
+bool vpp_api::submit( uint32_t context, const fib_route &route ) {
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        if( outstanding >= FIB_MAX_INFLIGHT ) {
+            return false;
+        }
+        submitted.emplace_back( context, route );
+        outstanding++;
     }
-}
\ No newline at end of file
+    // worker is started after routes are dumped on connect, both use connection
+    if( !worker.joinable() ) {
+        worker = std::thread( &vpp_api::run, this );
+    }
+    wakeup.notify_one();
+    return true;
+}
+
+void vpp_api::poll( std::vector<fib_reply> &replies ) {
+    std::lock_guard<std::mutex> lock( mutex );
+    outstanding -= completed.size();
+    replies.insert( replies.end(), completed.begin(), completed.end() );
+    completed.clear();
+}
+
+void vpp_api::complete( uint32_t context, bool success ) {
+    std::lock_guard<std::mutex> lock( mutex );
+    completed.push_back( { context, success } );
+}
+
+void vpp_api::run() {
+    std::unique_lock<std::mutex> lock( mutex );
+    while( true ) {
+        if( !wakeup.wait_for( lock, VPP_KEEPALIVE_INTERVAL, [ this ]() { return stopping || !submitted.empty(); } ) ) {
+            lock.unlock();
+            if( !ping() ) {
+                connection_lost();
+                return;
+            }
+            lock.lock();
+            continue;
+        }
+        if( stopping ) {
+            return;
+        }
+        auto batch = std::move( submitted );
+        submitted.clear();
+        lock.unlock();
+
+        for( auto const &[ context, route ]: batch ) {
+            execute( context, route );
+        }
+        // blocks until replies to all executed requests are received
+        bool lost = !requests.empty() && con.dispatch() != VAPI_OK;
+        if( lost ) {
+            logger.logError() << LOGS::VPP << "VPP API: cannot receive replies of " << requests.size() << " requests" << std::endl;
+        }
+        for( auto context: dispatched ) {
+            requests.erase( context );
+        }
+        dispatched.clear();
+        // replies which didn't come are reported as failed, so pipeline retries them
+        for( auto const &entry: requests ) {
+            complete( entry.first, false );
+        }
+        requests.clear();
+        if( lost ) {
+            connection_lost();
+            return;
+        }
+        lock.lock();
+    }
+}
+
+bool vpp_api::ping() {
+    vapi::Control_ping req( con );
+    return req.execute() == VAPI_OK && con.wait_for_response( req ) == VAPI_OK;
+}
+
+void vpp_api::connection_lost() {
+    logger.logError() << LOGS::VPP << "VPP API: VPP doesn't respond, connection is lost" << std::endl;
+    if( on_lost ) {
+        on_lost();
+    }
+}
+
+void vpp_api::execute( uint32_t context, const fib_route &route ) {
+    std::size_t n_paths = route.group ? route.group->nexthops.size() : 0;
+    auto req = std::make_unique<vapi::Ip_route_add_del>( con, n_paths,
+        [ this, context ]( vapi::Ip_route_add_del &r ) -> vapi_error_e {
+            complete( context, r.get_response().get_payload().retval == 0 );
+            dispatched.push_back( context );
+            return VAPI_OK;
+        }
+    );
+
+    auto &mp = req->get_request().get_payload();
+    mp.is_add = n_paths > 0;
+    mp.is_multipath = false;
+    mp.route.table_id = table;
+    mp.route.prefix.address.af = ADDRESS_IP4;
+    auto bytes = route.prefix.serialize();
+    mp.route.prefix.len = bytes[ 0 ];
+    std::memset( mp.route.prefix.address.un.ip4, 0, sizeof( mp.route.prefix.address.un.ip4 ) );
+    std::memcpy( mp.route.prefix.address.un.ip4, bytes.data() + 1, bytes.size() - 1 );
+    mp.route.n_paths = n_paths;
+    for( std::size_t i = 0; i < n_paths; i++ ) {
+        auto &path = mp.route.paths[ i ];
+        std::memset( &path, 0, sizeof( path ) );
+        path.sw_if_index = ~0;
+        path.weight = 1;
+        path.type = FIB_API_PATH_TYPE_NORMAL;
+        path.proto = FIB_API_PATH_NH_PROTO_IP4;
+        // interface index of kernel means nothing to VPP, it resolves gateway itself
+        auto nh = route.group->nexthops[ i ].gateway.to_bytes();
+        std::memcpy( path.nh.address.ip4, nh.data(), nh.size() );
+    }
+
+    // blocking connection waits here while request queue of VPP is full
+    if( req->execute() != VAPI_OK ) {
+        logger.logError() << LOGS::VPP << "VPP API: cannot send ip_route_add_del for " << route.prefix << std::endl;
+        complete( context, false );
+        return;
+    }
+    requests.emplace( context, std::move( req ) );
+}
+
+bool vpp_api::dump( std::vector<fib_entry> &routes ) {
+    // VPP routes carry no owner, so only routes of table dedicated to bgp++ are known to be ours
+    if( table == 0 ) {
+        logger.logError() << LOGS::VPP << "VPP API: default table is shared with other routes, it cannot be reconciled" << std::endl;
+        return false;
+    }
+    vapi::Ip_route_dump req( con );
+    auto &mp = req.get_request().get_payload();
+    mp.table.table_id = table;
+    mp.table.is_ip6 = false;
+    if( req.execute() != VAPI_OK || con.wait_for_response( req ) != VAPI_OK ) {
+        logger.logError() << LOGS::VPP << "VPP API: cannot dump routes of table " << table << std::endl;
+        return false;
+    }
+    for( auto &details: req.get_result_set() ) {
+        auto &r = details.get_payload().route;
+        if( r.prefix.address.af != ADDRESS_IP4 || r.n_paths == 0 ) {
+            continue;
+        }
+        // special routes, which VPP adds to every table, have no recursive next hops
+        fib_entry route;
+        bool ours = true;
+        for( std::size_t i = 0; i < r.n_paths && ours; i++ ) {
+            auto &path = r.paths[ i ];
+            ours = path.sw_if_index == ~0u && path.type == FIB_API_PATH_TYPE_NORMAL && path.proto == FIB_API_PATH_NH_PROTO_IP4;
+            address_v4::bytes_type nh;
+            std::memcpy( nh.data(), path.nh.address.ip4, nh.size() );
+            route.nexthops.push_back( { address_v4( nh ), 0 } );
+        }
+        if( !ours ) {
+            continue;
+        }
+        route.prefix = NLRI( BGP_AFI::IPv4, r.prefix.address.un.ip4, r.prefix.len );
+        std::sort( route.nexthops.begin(), route.nexthops.end() );
+        routes.push_back( std::move( route ) );
+    }
+    return true;
+}
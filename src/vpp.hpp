@@ -1,16 +1,62 @@
 #ifndef VPP_API_HPP_
 #define VPP_API_HPP_
 
+#include <map>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
 #include "vapi/vapi.hpp"
 #include "vapi/vpe.api.vapi.hpp"
+#include "vapi/ip.api.vapi.hpp"
 
 #include "vapi/session.api.vapi.hpp"
 
-struct vpp_api {
+#include "fib.hpp"
+
+// interval of pinging idle VPP, so its restart is noticed without route changes
+static constexpr std::chrono::seconds VPP_KEEPALIVE_INTERVAL { 5 };
+
+// FIB transport to VPP. Connection of VAPI C++ API is blocking, so requests are
+// executed and replies dispatched by worker thread, poll only collects its replies.
+// Worker reports connection as lost when VPP doesn't answer.
+struct vpp_api : public fib_transport {
     vapi::Connection con;
-    vpp_api();
+    vpp_api( uint32_t table_id );
     ~vpp_api();
 
+    bool connect() override;
+    bool submit( uint32_t context, const fib_route &route ) override;
+    void poll( std::vector<fib_reply> &replies ) override;
+    // called after connect before any route is submitted, so worker doesn't use connection yet
+    bool dump( std::vector<fib_entry> &routes ) override;
+private:
+    // stops worker and closes connection
+    void stop();
+    void run();
+    bool ping();
+    void connection_lost();
+    void execute( uint32_t context, const fib_route &route );
+    void complete( uint32_t context, bool success );
+
+    bool connected;
+    uint32_t table;
+    std::thread worker;
+
+    // guards members shared with worker
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping;
+    std::deque<std::pair<uint32_t,fib_route>> submitted;
+    std::vector<fib_reply> completed;
+    // submitted requests without collected reply
+    std::size_t outstanding;
+
+    // used only by worker, requests must be alive until reply is dispatched
+    std::map<uint32_t,std::unique_ptr<vapi::Ip_route_add_del>> requests;
+    std::vector<uint32_t> dispatched;
 };
 
-#endif
\ No newline at end of file
+#endif
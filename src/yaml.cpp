@@ -15,8 +15,50 @@ YAML::Node YAML::convert<GlobalConf>::encode(const GlobalConf& rhs) {
     node[ "my_as" ]            = rhs.my_as;
     node[ "hold_time" ]        = rhs.hold_time;
     node[ "bgp_router_id" ]    = rhs.bgp_router_id.to_string();
+    if( rhs.graceful_restart_time.has_value() ) {
+        node[ "graceful_restart_time" ] = *rhs.graceful_restart_time;
+    }
+    if( rhs.snapshot_path.has_value() ) {
+        node[ "snapshot_path" ] = *rhs.snapshot_path;
+    }
+    if( rhs.snapshot_interval.has_value() ) {
+        node[ "snapshot_interval" ] = *rhs.snapshot_interval;
+    }
     node[ "neighbours" ]       = rhs.neighbours;
     node[ "originate_routes" ] = rhs.originate_routes;
+    if( !rhs.bmp_collectors.empty() ) {
+        node[ "bmp_collectors" ] = rhs.bmp_collectors;
+    }
+    if( rhs.bmp_stats_interval.has_value() ) {
+        node[ "bmp_stats_interval" ] = *rhs.bmp_stats_interval;
+    }
+    if( rhs.max_paths.has_value() ) {
+        node[ "max_paths" ] = *rhs.max_paths;
+    }
+    if( rhs.fib_backend.has_value() ) {
+        node[ "fib_backend" ] = *rhs.fib_backend;
+    }
+    if( rhs.fib_table.has_value() ) {
+        node[ "fib_table" ] = *rhs.fib_table;
+    }
+    if( rhs.fib_reconcile ) {
+        node[ "fib_reconcile" ] = rhs.fib_reconcile;
+    }
+    if( rhs.nexthop_resolution.has_value() ) {
+        node[ "nexthop_resolution" ] = *rhs.nexthop_resolution;
+    }
+    if( rhs.igp_routes_file.has_value() ) {
+        node[ "igp_routes_file" ] = *rhs.igp_routes_file;
+    }
+    if( rhs.cluster_id.has_value() ) {
+        node[ "cluster_id" ] = rhs.cluster_id->to_string();
+    }
+    if( !rhs.policies.empty() ) {
+        node[ "policies" ] = rhs.policies;
+    }
+    if( !rhs.prefix_lists.empty() ) {
+        node[ "prefix_lists" ] = rhs.prefix_lists;
+    }
     return node;
 }
 
@@ -27,6 +69,46 @@ bool YAML::convert<GlobalConf>::decode(const YAML::Node& node, GlobalConf& rhs)
     rhs.bgp_router_id    = address_v4::from_string( node["bgp_router_id"].as<std::string>() );
     rhs.neighbours       = node[ "neighbours" ].as<std::list<bgp_neighbour_v4>>();
     rhs.originate_routes = node[ "originate_routes" ].as<std::list<OrigEntry>>();
+    if( node[ "graceful_restart_time" ].IsDefined() ) {
+        rhs.graceful_restart_time = node[ "graceful_restart_time" ].as<uint16_t>();
+    }
+    if( node[ "snapshot_path" ].IsDefined() ) {
+        rhs.snapshot_path = node[ "snapshot_path" ].as<std::string>();
+    }
+    if( node[ "snapshot_interval" ].IsDefined() ) {
+        rhs.snapshot_interval = node[ "snapshot_interval" ].as<uint32_t>();
+    }
+    if( node[ "bmp_collectors" ].IsDefined() ) {
+        rhs.bmp_collectors = node[ "bmp_collectors" ].as<std::list<bmp_collector_v4>>();
+    }
+    if( node[ "bmp_stats_interval" ].IsDefined() ) {
+        rhs.bmp_stats_interval = node[ "bmp_stats_interval" ].as<uint32_t>();
+    }
+    if( node[ "max_paths" ].IsDefined() ) {
+        rhs.max_paths = node[ "max_paths" ].as<uint16_t>();
+    }
+    if( node[ "fib_backend" ].IsDefined() ) {
+        rhs.fib_backend = node[ "fib_backend" ].as<std::string>();
+    }
+    if( node[ "fib_table" ].IsDefined() ) {
+        rhs.fib_table = node[ "fib_table" ].as<uint32_t>();
+    }
+    rhs.fib_reconcile = node[ "fib_reconcile" ].IsDefined() && node[ "fib_reconcile" ].as<bool>();
+    if( node[ "nexthop_resolution" ].IsDefined() ) {
+        rhs.nexthop_resolution = node[ "nexthop_resolution" ].as<std::string>();
+    }
+    if( node[ "igp_routes_file" ].IsDefined() ) {
+        rhs.igp_routes_file = node[ "igp_routes_file" ].as<std::string>();
+    }
+    if( node[ "cluster_id" ].IsDefined() ) {
+        rhs.cluster_id = address_v4::from_string( node[ "cluster_id" ].as<std::string>() );
+    }
+    if( node[ "policies" ].IsDefined() ) {
+        rhs.policies = node[ "policies" ].as<std::map<std::string,RoutePolicy>>();
+    }
+    if( node[ "prefix_lists" ].IsDefined() ) {
+        rhs.prefix_lists = node[ "prefix_lists" ].as<std::map<std::string,PrefixList>>();
+    }
     return true;
 } 
 
@@ -37,6 +119,30 @@ YAML::Node YAML::convert<bgp_neighbour_v4>::encode(const bgp_neighbour_v4& rhs)
     if( rhs.hold_time.has_value() ) {
         node[ "hold_time" ] = *rhs.hold_time;
     }
+    if( rhs.add_path_receive ) {
+        node[ "add_path_receive" ] = rhs.add_path_receive;
+    }
+    if( rhs.add_path_backups.has_value() ) {
+        node[ "add_path_backups" ] = *rhs.add_path_backups;
+    }
+    if( rhs.ipv6_unicast ) {
+        node[ "ipv6_unicast" ] = rhs.ipv6_unicast;
+    }
+    if( rhs.route_reflector_client ) {
+        node[ "route_reflector_client" ] = rhs.route_reflector_client;
+    }
+    if( rhs.import_policy.has_value() ) {
+        node[ "import_policy" ] = *rhs.import_policy;
+    }
+    if( rhs.export_policy.has_value() ) {
+        node[ "export_policy" ] = *rhs.export_policy;
+    }
+    if( rhs.passive ) {
+        node[ "passive" ] = rhs.passive;
+    }
+    if( rhs.port.has_value() ) {
+        node[ "port" ] = *rhs.port;
+    }
     return node;
 }
 
@@ -46,6 +152,35 @@ bool YAML::convert<bgp_neighbour_v4>::decode(const YAML::Node& node, bgp_neighbo
     if( node[ "hold_time"].IsDefined() ) {
         rhs.hold_time       = node[ "hold_time" ].as<uint16_t>();
     }
+    rhs.add_path_receive = node[ "add_path_receive" ].IsDefined() && node[ "add_path_receive" ].as<bool>();
+    if( node[ "add_path_backups" ].IsDefined() ) {
+        rhs.add_path_backups = node[ "add_path_backups" ].as<uint16_t>();
+    }
+    rhs.ipv6_unicast = node[ "ipv6_unicast" ].IsDefined() && node[ "ipv6_unicast" ].as<bool>();
+    rhs.route_reflector_client = node[ "route_reflector_client" ].IsDefined() && node[ "route_reflector_client" ].as<bool>();
+    if( node[ "import_policy" ].IsDefined() ) {
+        rhs.import_policy = node[ "import_policy" ].as<std::string>();
+    }
+    if( node[ "export_policy" ].IsDefined() ) {
+        rhs.export_policy = node[ "export_policy" ].as<std::string>();
+    }
+    rhs.passive = node[ "passive" ].IsDefined() && node[ "passive" ].as<bool>();
+    if( node[ "port" ].IsDefined() ) {
+        rhs.port = node[ "port" ].as<uint16_t>();
+    }
+    return true;
+}
+
+YAML::Node YAML::convert<bmp_collector_v4>::encode(const bmp_collector_v4& rhs) {
+    Node node;
+    node[ "address" ] = rhs.address.to_string();
+    node[ "port" ]    = rhs.port;
+    return node;
+}
+
+bool YAML::convert<bmp_collector_v4>::decode(const YAML::Node& node, bmp_collector_v4& rhs) {
+    rhs.address = address_v4::from_string( node["address"].as<std::string>() );
+    rhs.port    = node[ "port" ].as<uint16_t>();
     return true;
 }
 
@@ -57,7 +192,7 @@ YAML::Node YAML::convert<RoutePolicy>::encode(const RoutePolicy& rhs) {
 
 bool YAML::convert<RoutePolicy>::decode(const YAML::Node& node, RoutePolicy& rhs) {
     rhs.entries = node[ "entries" ].as<std::list<RoutePolicyEntry>>();
-    return node;
+    return true;
 }
 
 YAML::Node YAML::convert<RoutePolicyEntry>::encode(const RoutePolicyEntry& rhs) {
@@ -65,18 +200,33 @@ YAML::Node YAML::convert<RoutePolicyEntry>::encode(const RoutePolicyEntry& rhs)
     if( rhs.match_prefix_v4.has_value() ) {
         node[ "match_prefix_v4" ] = rhs.match_prefix_v4.value().to_string();
     }
+    if( rhs.match_prefix_list.has_value() ) {
+        node[ "match_prefix_list" ] = rhs.match_prefix_list.value();
+    }
     if( rhs.match_nexthop.has_value() ) {
         node[ "match_nexthop" ] = rhs.match_nexthop.value().to_string();
     }
     if( rhs.match_localpref.has_value() ) {
         node[ "match_localpref" ] = rhs.match_localpref.value();
     }
+    if( rhs.match_as_path.has_value() ) {
+        node[ "match_as_path" ] = rhs.match_as_path.value();
+    }
+    if( !rhs.match_community.empty() ) {
+        node[ "match_community" ] = rhs.match_community;
+    }
     if( rhs.set_nexthop.has_value() ) {
         node[ "set_nexthop" ] = rhs.set_nexthop.value().to_string();
     }
     if( rhs.set_localpref.has_value() ) {
         node[ "set_localpref" ] = rhs.set_localpref.value();
     }
+    if( !rhs.add_community.empty() ) {
+        node[ "add_community" ] = rhs.add_community;
+    }
+    if( !rhs.delete_community.empty() ) {
+        node[ "delete_community" ] = rhs.delete_community;
+    }
     node[ "action" ] = rhs.action;
     return node;
 }
@@ -86,21 +236,73 @@ bool YAML::convert<RoutePolicyEntry>::decode(const YAML::Node& node, RoutePolicy
     if( node[ "match_prefix_v4"].IsDefined() ) {
         rhs.match_prefix_v4.emplace( BGP_AFI::IPv4, node[ "match_prefix_v4" ].as<std::string>() );
     }
+    if( node[ "match_prefix_list"].IsDefined() ) {
+        rhs.match_prefix_list.emplace( node[ "match_prefix_list" ].as<std::string>() );
+    }
     if( node[ "match_nexthop"].IsDefined() ) {
         rhs.match_nexthop.emplace( boost::asio::ip::make_address_v4( node[ "match_nexthop" ].as<std::string>() ) );
     }
     if( node[ "match_localpref"].IsDefined() ) {
         rhs.match_localpref.emplace( node[ "match_localpref" ].as<uint32_t>() );
     }
+    if( node[ "match_as_path"].IsDefined() ) {
+        rhs.match_as_path.emplace( node[ "match_as_path" ].as<std::string>() );
+    }
+    if( node[ "match_community"].IsDefined() ) {
+        rhs.match_community = node[ "match_community" ].as<std::list<std::string>>();
+    }
     if( node[ "set_nexthop"].IsDefined() ) {
         rhs.set_nexthop.emplace( boost::asio::ip::make_address_v4( node[ "set_nexthop" ].as<std::string>() ) );
     }
     if( node[ "set_localpref"].IsDefined() ) {
         rhs.set_localpref.emplace( node[ "set_localpref" ].as<uint32_t>() );
     }
+    if( node[ "add_community"].IsDefined() ) {
+        rhs.add_community = node[ "add_community" ].as<std::list<std::string>>();
+    }
+    if( node[ "delete_community"].IsDefined() ) {
+        rhs.delete_community = node[ "delete_community" ].as<std::list<std::string>>();
+    }
     return true;
 } 
 
+YAML::Node YAML::convert<PrefixList>::encode(const PrefixList& rhs) {
+    Node node;
+    node[ "entries" ] = rhs.entries;
+    return node;
+}
+
+bool YAML::convert<PrefixList>::decode(const YAML::Node& node, PrefixList& rhs) {
+    rhs.entries = node[ "entries" ].as<std::list<PrefixListEntry>>();
+    return true;
+}
+
+YAML::Node YAML::convert<PrefixListEntry>::encode(const PrefixListEntry& rhs) {
+    Node node;
+    node[ "prefix" ] = rhs.prefix.to_string();
+    if( rhs.ge.has_value() ) {
+        node[ "ge" ] = static_cast<uint32_t>( rhs.ge.value() );
+    }
+    if( rhs.le.has_value() ) {
+        node[ "le" ] = static_cast<uint32_t>( rhs.le.value() );
+    }
+    node[ "action" ] = rhs.action;
+    return node;
+}
+
+bool YAML::convert<PrefixListEntry>::decode(const YAML::Node& node, PrefixListEntry& rhs) {
+    auto prefix = node[ "prefix" ].as<std::string>();
+    rhs.prefix = NLRI( prefix.find( ':' ) != prefix.npos ? BGP_AFI::IPv6 : BGP_AFI::IPv4, prefix );
+    rhs.action = node[ "action" ].as<RoutePolicyAction>();
+    if( node[ "ge" ].IsDefined() ) {
+        rhs.ge = node[ "ge" ].as<uint32_t>();
+    }
+    if( node[ "le" ].IsDefined() ) {
+        rhs.le = node[ "le" ].as<uint32_t>();
+    }
+    return true;
+}
+
 YAML::Node YAML::convert<OrigEntry>::encode(const OrigEntry& rhs) {
     Node node;
     node[ "prefix" ] = rhs.prefix.to_string();
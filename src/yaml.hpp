@@ -3,8 +3,11 @@
 
 struct GlobalConf;
 struct bgp_neighbour_v4;
+struct bmp_collector_v4;
 struct RoutePolicy;
 struct RoutePolicyEntry;
+struct PrefixList;
+struct PrefixListEntry;
 enum RoutePolicyAction: uint8_t;
 struct OrigEntry;
 
@@ -15,6 +18,12 @@ namespace YAML {
         static bool decode( const Node& node, bgp_neighbour_v4 &rhs );
     };
 
+    template<>
+    struct convert<bmp_collector_v4> {
+        static Node encode( const bmp_collector_v4 &rhs );
+        static bool decode( const Node& node, bmp_collector_v4 &rhs );
+    };
+
     template<>
     struct convert<GlobalConf> {
         static Node encode( const GlobalConf &rhs );
@@ -33,6 +42,18 @@ namespace YAML {
         static bool decode( const Node &node, RoutePolicyEntry &rhs );
     };
 
+    template<>
+    struct convert<PrefixList> {
+        static Node encode( const PrefixList &rhs );
+        static bool decode( const Node &node, PrefixList &rhs );
+    };
+
+    template<>
+    struct convert<PrefixListEntry> {
+        static Node encode( const PrefixListEntry &rhs );
+        static bool decode( const Node &node, PrefixListEntry &rhs );
+    };
+
     template<>
     struct convert<RoutePolicyAction> {
         static Node encode( const RoutePolicyAction &rhs );
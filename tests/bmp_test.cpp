@@ -0,0 +1,87 @@
+#include <list>
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "bmp.hpp"
+#include "table.hpp"
+#include "table_v6.hpp"
+#include "rib_snapshot.hpp"
+#include "fsm.hpp"
+#include "config.hpp"
+#include "packet.hpp"
+#include "nlri.hpp"
+
+// established peer with paths in table, session is never started
+struct bmp_fixture {
+    bmp_fixture():
+        conf {},
+        wheel( io ),
+        table( io, conf ),
+        table_v6( io, conf, table ),
+        exporter( io, conf, table )
+    {
+        conf.my_as = 65000;
+        conf.hold_time = 90;
+        auto &nei = neighbours.emplace_back();
+        nei.address = address_v4::from_string( "192.0.2.1" );
+        nei.remote_as = 65001;
+        peer = std::make_shared<bgp_fsm>( io, wheel, buffers, conf, table, nei );
+        peer->state = FSM_STATE::ESTABLISHED;
+    }
+
+    std::vector<path_attr_t> attrs() {
+        std::vector<path_attr_t> out( 3 );
+        out[ 0 ].make_origin( ORIGIN::IGP );
+        out[ 1 ].make_as_path( { 65001 } );
+        out[ 2 ].make_nexthop( address_v4::from_string( "10.0.0.1" ) );
+        return out;
+    }
+
+    boost::asio::io_context io;
+    GlobalConf conf;
+    timer_wheel wheel;
+    buffer_pool buffers;
+    std::list<bgp_neighbour_v4> neighbours;
+    bgp_table_v4 table;
+    bgp_table_v6 table_v6;
+    bmp_exporter exporter;
+    std::shared_ptr<bgp_fsm> peer;
+};
+
+BOOST_AUTO_TEST_SUITE( bmp_export )
+
+BOOST_FIXTURE_TEST_CASE( table_dump_is_post_policy, bmp_fixture ) {
+    table.add_path( NLRI( BGP_AFI::IPv4, "198.51.100.0/24" ), attrs(), peer );
+    table.add_path( NLRI( BGP_AFI::IPv4, "203.0.113.0/24" ), attrs(), peer );
+    std::optional<NLRI> cursor;
+    bool finished = false;
+    auto msgs = exporter.make_dump_chunk( *rib_snapshot::take( table, table_v6 ), cursor, finished );
+    BOOST_CHECK( finished );
+    BOOST_REQUIRE_EQUAL( msgs.size(), 1U );
+    auto &msg = *msgs.front();
+    BOOST_REQUIRE_GT( msg.size(), sizeof( bmp_common_header ) + sizeof( bmp_peer_header ) );
+    auto common = reinterpret_cast<bmp_common_header*>( msg.data() );
+    BOOST_CHECK( common->type == BMP_MSG_TYPE::ROUTE_MONITORING );
+    BOOST_CHECK_EQUAL( common->length.native(), msg.size() );
+    // attributes in table include LOCAL_PREF added on import
+    auto header = reinterpret_cast<bmp_peer_header*>( msg.data() + sizeof( bmp_common_header ) );
+    BOOST_CHECK( header->flags & BMP_PEER_FLAG_POST_POLICY );
+}
+
+BOOST_FIXTURE_TEST_CASE( paths_of_peer_are_counted_from_index, bmp_fixture ) {
+    BOOST_CHECK_EQUAL( table.peer_paths_count( peer ), 0U );
+    NLRI prefix( BGP_AFI::IPv4, "198.51.100.0/24" );
+    table.add_path( prefix, attrs(), peer, 1 );
+    table.add_path( prefix, attrs(), peer, 2 );
+    table.add_path( NLRI( BGP_AFI::IPv4, "203.0.113.0/24" ), attrs(), peer, 1 );
+    BOOST_CHECK_EQUAL( table.peer_paths_count( peer ), 3U );
+    table.del_path( prefix, peer, 1 );
+    BOOST_CHECK_EQUAL( table.peer_paths_count( peer ), 2U );
+    table.purge_peer( peer );
+    BOOST_CHECK_EQUAL( table.peer_paths_count( peer ), 0U );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,321 @@
+#include <unistd.h>
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "cli.hpp"
+#include "evloop.hpp"
+#include "community.hpp"
+#include "fsm.hpp"
+#include "config.hpp"
+#include "packet.hpp"
+#include "message.hpp"
+#include "nlri.hpp"
+
+extern std::shared_ptr<EVLoop> runtime;
+
+// one Show_Table_Resp as seen by client
+struct table_response {
+    std::vector<std::string> prefixes;
+    bool last;
+    boost::optional<std::string> cursor;
+    boost::optional<std::string> error;
+};
+
+// CLI server with two neighbours, their sessions are never started. Client runs
+// on event loop, so requests which CLI thread posts to loop are handled meanwhile.
+struct cli_fixture {
+    cli_fixture():
+        conf {},
+        path( "/tmp/bgp_tests_cli_" + std::to_string( getpid() ) )
+    {
+        conf.listen_on_port = 0;
+        conf.my_as = 65000;
+        conf.hold_time = 90;
+        for( auto const &[ address, as ]: { std::make_pair( "192.0.2.1", 65001 ), std::make_pair( "192.0.2.2", 65002 ) } ) {
+            auto &nei = conf.neighbours.emplace_back();
+            nei.address = address_v4::from_string( address );
+            nei.remote_as = as;
+        }
+        runtime = std::make_shared<EVLoop>( io, conf, "" );
+        unlink( path.c_str() );
+        server = std::make_shared<CLI_Server>( io, path, runtime );
+        server->start();
+    }
+
+    ~cli_fixture() {
+        server->stop();
+        server.reset();
+        unlink( path.c_str() );
+        runtime.reset();
+    }
+
+    std::shared_ptr<bgp_fsm> peer( const std::string &address ) {
+        return runtime->neighbours.find( address_v4::from_string( address ) )->second;
+    }
+
+    void add_path( const std::string &prefix, const std::string &neighbour = "192.0.2.1", std::vector<path_attr_t> extra = {} ) {
+        auto source = peer( neighbour );
+        std::vector<path_attr_t> attrs( 3 );
+        attrs[ 0 ].make_origin( ORIGIN::IGP );
+        attrs[ 1 ].make_as_path( { source->conf.remote_as } );
+        attrs[ 2 ].make_nexthop( source->conf.address );
+        attrs.insert( attrs.end(), extra.begin(), extra.end() );
+        runtime->table.add_path( NLRI( BGP_AFI::IPv4, prefix ), attrs, source );
+    }
+
+    // /24 prefixes 10.x.y.0 in table order
+    void add_paths( std::size_t count ) {
+        for( std::size_t i = 0; i < count; i++ ) {
+            add_path( "10." + std::to_string( i / 256 ) + "." + std::to_string( i % 256 ) + ".0/24" );
+        }
+    }
+
+    static std::string prefix_of( const cli_table_entry &entry ) {
+        address_v4::bytes_type bytes;
+        std::copy( entry.prefix.begin(), entry.prefix.begin() + bytes.size(), bytes.begin() );
+        return address_v4( bytes ).to_string() + "/" + std::to_string( entry.prefix_len );
+    }
+
+    // next response without its length
+    std::string receive( boost::asio::local::stream_protocol::socket &client ) {
+        std::array<uint8_t,CLI_FRAME_HEADER> header;
+        std::string body;
+        bool done = false;
+        boost::asio::async_read( client, boost::asio::buffer( header ), [ & ]( const boost::system::error_code &ec, std::size_t ) {
+            BOOST_REQUIRE( !ec );
+            body.resize( frame_length( header.data() ) );
+            boost::asio::async_read( client, boost::asio::buffer( body ), [ & ]( const boost::system::error_code &ec, std::size_t ) {
+                BOOST_REQUIRE( !ec );
+                done = true;
+            });
+        });
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( 5 );
+        while( !done && std::chrono::steady_clock::now() < deadline ) {
+            io.restart();
+            io.run_for( std::chrono::milliseconds( 10 ) );
+        }
+        BOOST_REQUIRE( done );
+        return body;
+    }
+
+    // writes frame and reads table responses until last one
+    std::vector<std::string> exchange( boost::asio::local::stream_protocol::socket &client, const std::string &frame ) {
+        std::vector<std::string> responses;
+        boost::asio::write( client, boost::asio::buffer( frame ) );
+        do {
+            responses.push_back( receive( client ) );
+        } while( !cli_reader( responses.back() ).read<bool>() );
+        return responses;
+    }
+
+    std::vector<table_response> show_table( const Show_Table_Req &req ) {
+        boost::asio::local::stream_protocol::socket client( io );
+        client.connect( path );
+        cli_writer out( TYPE::REQ, CONTENT::SHOW_TABLE );
+        out & req;
+        std::vector<table_response> chunks;
+        for( auto const &frame: exchange( client, out.finish() ) ) {
+            cli_reader in( frame );
+            auto resp = in.read<Show_Table_Resp>();
+            auto &chunk = chunks.emplace_back( table_response { {}, resp.last, resp.cursor, resp.error } );
+            auto entries = reinterpret_cast<const cli_table_entry*>( resp.entries.data() );
+            for( std::size_t i = 0; i < resp.entries.size() / sizeof( cli_table_entry ); i++ ) {
+                chunk.prefixes.push_back( prefix_of( entries[ i ] ) );
+            }
+        }
+        return chunks;
+    }
+
+    // prefixes of all chunks, cursor of last one
+    std::vector<std::string> show_page( const Show_Table_Req &req, boost::optional<std::string> *cursor = nullptr ) {
+        auto chunks = show_table( req );
+        std::vector<std::string> prefixes;
+        for( auto const &chunk: chunks ) {
+            BOOST_CHECK( !chunk.error.has_value() );
+            prefixes.insert( prefixes.end(), chunk.prefixes.begin(), chunk.prefixes.end() );
+        }
+        if( cursor ) {
+            *cursor = chunks.back().cursor;
+        }
+        return prefixes;
+    }
+
+    boost::asio::io_context io;
+    GlobalConf conf;
+    std::string path;
+    std::shared_ptr<CLI_Server> server;
+};
+
+static Show_Table_Req page_req( uint32_t limit, uint32_t page, boost::optional<std::string> cursor = boost::none ) {
+    Show_Table_Req req;
+    req.limit = limit;
+    req.page = page;
+    req.cursor = cursor;
+    return req;
+}
+
+BOOST_AUTO_TEST_SUITE( cli_table_pages )
+
+BOOST_FIXTURE_TEST_CASE( pages_cover_table_without_gaps, cli_fixture ) {
+    add_paths( 10 );
+    auto all = show_page( page_req( 0, 0 ) );
+    BOOST_REQUIRE_EQUAL( all.size(), 10U );
+    BOOST_CHECK_EQUAL( all.front(), "10.0.0.0/24" );
+
+    boost::optional<std::string> cursor;
+    BOOST_CHECK( show_page( page_req( 4, 0 ), &cursor ) == std::vector<std::string>( all.begin(), all.begin() + 4 ) );
+    BOOST_CHECK( cursor == all[ 3 ] );
+    BOOST_CHECK( show_page( page_req( 4, 1 ), &cursor ) == std::vector<std::string>( all.begin() + 4, all.begin() + 8 ) );
+    BOOST_CHECK( cursor == all[ 7 ] );
+    // last page is short and has no cursor
+    BOOST_CHECK( show_page( page_req( 4, 2 ), &cursor ) == std::vector<std::string>( all.begin() + 8, all.end() ) );
+    BOOST_CHECK( !cursor.has_value() );
+    BOOST_CHECK( show_page( page_req( 4, 3 ), &cursor ).empty() );
+    BOOST_CHECK( !cursor.has_value() );
+}
+
+BOOST_FIXTURE_TEST_CASE( page_ending_at_end_of_table_has_no_cursor, cli_fixture ) {
+    add_paths( 10 );
+    boost::optional<std::string> cursor;
+    BOOST_CHECK_EQUAL( show_page( page_req( 5, 1 ), &cursor ).size(), 5U );
+    BOOST_CHECK( !cursor.has_value() );
+    BOOST_CHECK_EQUAL( show_page( page_req( 10, 0 ), &cursor ).size(), 10U );
+    BOOST_CHECK( !cursor.has_value() );
+}
+
+BOOST_FIXTURE_TEST_CASE( cursor_continues_after_its_prefix, cli_fixture ) {
+    add_paths( 10 );
+    auto all = show_page( page_req( 0, 0 ) );
+    boost::optional<std::string> cursor;
+    std::vector<std::string> walked;
+    do {
+        auto page = show_page( page_req( 3, 0, cursor ), &cursor );
+        walked.insert( walked.end(), page.begin(), page.end() );
+    } while( cursor );
+    BOOST_CHECK( walked == all );
+    // cursor needn't be in table
+    BOOST_CHECK( show_page( page_req( 2, 0, std::string( "10.0.4.128/25" ) ) ) == std::vector<std::string>( all.begin() + 5, all.begin() + 7 ) );
+}
+
+BOOST_FIXTURE_TEST_CASE( table_longer_than_chunk_is_streamed, cli_fixture ) {
+    add_paths( CLI_TABLE_CHUNK + 1 );
+    auto chunks = show_table( page_req( 0, 0 ) );
+    BOOST_REQUIRE_EQUAL( chunks.size(), 2U );
+    BOOST_CHECK( !chunks[ 0 ].last );
+    BOOST_CHECK_EQUAL( chunks[ 0 ].prefixes.size(), CLI_TABLE_CHUNK );
+    BOOST_CHECK( chunks[ 1 ].last );
+    BOOST_REQUIRE_EQUAL( chunks[ 1 ].prefixes.size(), 1U );
+    BOOST_CHECK_EQUAL( chunks[ 1 ].prefixes[ 0 ], "10.3.232.0/24" );
+    // limit is reached within chunk
+    auto limited = show_table( page_req( CLI_TABLE_CHUNK, 0 ) );
+    BOOST_REQUIRE_EQUAL( limited.size(), 2U );
+    BOOST_CHECK( limited[ 1 ].prefixes.empty() );
+    BOOST_CHECK( limited[ 1 ].cursor == chunks[ 0 ].prefixes.back() );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE( cli_table_filters )
+
+BOOST_FIXTURE_TEST_CASE( prefix_match_modes, cli_fixture ) {
+    for( auto prefix: { "10.0.0.0/8", "10.1.0.0/16", "10.1.2.0/24", "10.2.0.0/16", "11.0.0.0/8" } ) {
+        add_path( prefix );
+    }
+    Show_Table_Req req;
+    req.prefix = "10.1.0.0/16";
+    BOOST_CHECK( show_page( req ) == std::vector<std::string>( { "10.1.0.0/16" } ) );
+    req.match = PREFIX_MATCH::MORE_SPECIFIC;
+    BOOST_CHECK( show_page( req ) == std::vector<std::string>( { "10.1.0.0/16", "10.1.2.0/24" } ) );
+    req.prefix = "10.1.3.1";
+    req.match = PREFIX_MATCH::LONGEST;
+    BOOST_CHECK( show_page( req ) == std::vector<std::string>( { "10.1.0.0/16" } ) );
+    req.prefix = "12.0.0.1";
+    BOOST_CHECK( show_page( req ).empty() );
+}
+
+BOOST_FIXTURE_TEST_CASE( path_filters_are_combined, cli_fixture ) {
+    path_attr_t tagged;
+    tagged.make_communities( community_list::intern( PATH_ATTRIBUTE::COMMUNITIES, { community_t::parse( "65000:1" ).words[ 0 ] } ) );
+    add_path( "10.0.1.0/24", "192.0.2.1", { tagged } );
+    add_path( "10.0.2.0/24", "192.0.2.1" );
+    add_path( "10.0.2.0/24", "192.0.2.2", { tagged } );
+    add_path( "10.0.3.0/24", "192.0.2.2" );
+
+    Show_Table_Req req;
+    req.neighbour = "192.0.2.2";
+    BOOST_CHECK( show_page( req ) == std::vector<std::string>( { "10.0.2.0/24", "10.0.3.0/24" } ) );
+    req.community = "65000:1";
+    BOOST_CHECK( show_page( req ) == std::vector<std::string>( { "10.0.2.0/24" } ) );
+    req.neighbour.reset();
+    BOOST_CHECK( show_page( req ) == std::vector<std::string>( { "10.0.1.0/24", "10.0.2.0/24" } ) );
+    req.community.reset();
+    req.as = 65001;
+    req.nexthop = "192.0.2.1";
+    BOOST_CHECK( show_page( req ) == std::vector<std::string>( { "10.0.1.0/24", "10.0.2.0/24" } ) );
+    req.as = 65002;
+    BOOST_CHECK( show_page( req ).empty() );
+}
+
+BOOST_FIXTURE_TEST_CASE( invalid_filter_is_rejected, cli_fixture ) {
+    add_paths( 1 );
+    for( auto field: { &Show_Table_Req::neighbour, &Show_Table_Req::community, &Show_Table_Req::prefix } ) {
+        Show_Table_Req req;
+        req.*field = "192.0.2.9";
+        auto chunks = show_table( req );
+        BOOST_REQUIRE_EQUAL( chunks.size(), 1U );
+        BOOST_CHECK( chunks[ 0 ].last );
+        BOOST_CHECK( chunks[ 0 ].error.has_value() );
+        BOOST_CHECK( chunks[ 0 ].prefixes.empty() );
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE( cli_thread )
+
+BOOST_FIXTURE_TEST_CASE( table_is_served_while_subscription_is_open, cli_fixture ) {
+    add_paths( 2 );
+    boost::asio::local::stream_protocol::socket subscriber( io );
+    subscriber.connect( path );
+    cli_writer out( TYPE::REQ, CONTENT::SUBSCRIBE );
+    out & Subscribe_Req {};
+    boost::asio::write( subscriber, boost::asio::buffer( out.finish() ) );
+    // current best paths
+    auto first = receive( subscriber );
+    auto resp = cli_reader( first ).read<Subscribe_Resp>();
+    BOOST_CHECK( !resp.error.has_value() );
+    BOOST_CHECK( !resp.events.empty() );
+
+    // subscription doesn't hold CLI thread, so other session is served
+    BOOST_CHECK_EQUAL( show_page( page_req( 0, 0 ) ).size(), 2U );
+    add_path( "10.9.0.0/24" );
+    auto next = receive( subscriber );
+    resp = cli_reader( next ).read<Subscribe_Resp>();
+    BOOST_CHECK( !resp.events.empty() );
+    BOOST_CHECK_EQUAL( resp.coalesced, 0U );
+    // server is stopped with subscription still open
+}
+
+BOOST_FIXTURE_TEST_CASE( table_pages_are_consistent_while_table_changes, cli_fixture ) {
+    add_paths( CLI_TABLE_CHUNK + 1 );
+    boost::asio::local::stream_protocol::socket client( io );
+    client.connect( path );
+    cli_writer out( TYPE::REQ, CONTENT::SHOW_TABLE );
+    out & page_req( 0, 0 );
+    boost::asio::write( client, boost::asio::buffer( out.finish() ) );
+    auto first = receive( client );
+    BOOST_CHECK( !cli_reader( first ).read<bool>() );
+    // stream walks snapshot taken when request arrived
+    runtime->table.purge_peer( peer( "192.0.2.1" ) );
+    BOOST_REQUIRE( runtime->table.table.empty() );
+    auto second = receive( client );
+    auto last = cli_reader( second ).read<Show_Table_Resp>();
+    BOOST_CHECK( last.last );
+    BOOST_CHECK_EQUAL( last.entries.size(), sizeof( cli_table_entry ) );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,217 @@
+#include <sys/socket.h>
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "evloop.hpp"
+#include "fsm.hpp"
+#include "config.hpp"
+#include "packet.hpp"
+
+extern std::shared_ptr<EVLoop> runtime;
+
+static constexpr uint16_t PEER_AS = 65001;
+
+struct message {
+    bgp_type type;
+    std::vector<uint8_t> body;
+};
+
+// Session with peer simulated by test. Connections are socket pairs on loopback,
+// our ends are given to session as if they were accepted or connected by it.
+struct collision_fixture {
+    collision_fixture():
+        conf {},
+        listener( io, endpoint( address_v4::loopback(), 0 ) )
+    {
+        conf.listen_on_port = 0;
+        conf.my_as = 65000;
+        conf.hold_time = 90;
+        auto &nei = conf.neighbours.emplace_back();
+        nei.address = address_v4::loopback();
+        nei.remote_as = PEER_AS;
+        nei.passive = true;
+        runtime = std::make_shared<EVLoop>( io, conf, "" );
+        fsm = runtime->neighbours.find( nei.address )->second;
+    }
+
+    ~collision_fixture() {
+        fsm.reset();
+        runtime.reset();
+    }
+
+    // our end of connection goes to session, peer end is returned
+    socket_tcp connect( bool initiated ) {
+        socket_tcp ours( io );
+        socket_tcp peer( io );
+        peer.connect( listener.local_endpoint() );
+        listener.accept( ours );
+        // peer end is read synchronously, missing message must fail test instead of blocking it
+        timeval timeout { 2, 0 };
+        setsockopt( peer.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+        fsm->place_connection( std::move( ours ), initiated );
+        return peer;
+    }
+
+    // peer announces Graceful Restart capability with restart_time
+    void send_open( socket_tcp &peer, const std::string &router_id, uint16_t restart_time = 0 ) {
+        auto id = address_v4::from_string( router_id ).to_bytes();
+        std::vector<uint8_t> params;
+        if( restart_time > 0 ) {
+            params = { 2, 4, static_cast<uint8_t>( BGP_CAP_CODE::GRACEFUL_RESTART ), 2, static_cast<uint8_t>( restart_time >> 8 ), static_cast<uint8_t>( restart_time & 0xFF ) };
+        }
+        std::vector<uint8_t> open( 16, 0xFF );
+        open.insert( open.end(), { 0, static_cast<uint8_t>( 29 + params.size() ), static_cast<uint8_t>( bgp_type::OPEN ), 4, PEER_AS >> 8, PEER_AS & 0xFF, 0, 90 } );
+        open.insert( open.end(), id.begin(), id.end() );
+        open.push_back( params.size() );
+        open.insert( open.end(), params.begin(), params.end() );
+        boost::asio::write( peer, boost::asio::buffer( open ) );
+        settle();
+    }
+
+    void send_keepalive( socket_tcp &peer ) {
+        std::vector<uint8_t> keepalive( 16, 0xFF );
+        keepalive.insert( keepalive.end(), { 0, 19, static_cast<uint8_t>( bgp_type::KEEPALIVE ) } );
+        boost::asio::write( peer, boost::asio::buffer( keepalive ) );
+        settle();
+    }
+
+    // handlers of session run until it has nothing more to do for now
+    void settle() {
+        io.restart();
+        io.run_for( std::chrono::milliseconds( 200 ) );
+    }
+
+    // next message sent to peer, nullopt when connection is closed
+    std::optional<message> receive( socket_tcp &peer ) {
+        std::array<uint8_t,19> header;
+        error_code ec;
+        boost::asio::read( peer, boost::asio::buffer( header ), ec );
+        if( ec ) {
+            return std::nullopt;
+        }
+        message msg { static_cast<bgp_type>( header[ 18 ] ), std::vector<uint8_t>( ( header[ 16 ] << 8 | header[ 17 ] ) - header.size() ) };
+        boost::asio::read( peer, boost::asio::buffer( msg.body ), ec );
+        BOOST_REQUIRE( !ec );
+        return msg;
+    }
+
+    void expect( socket_tcp &peer, bgp_type type ) {
+        auto msg = receive( peer );
+        BOOST_REQUIRE( msg.has_value() );
+        BOOST_CHECK( msg->type == type );
+    }
+
+    void expect_collision_notification( socket_tcp &peer ) {
+        auto msg = receive( peer );
+        BOOST_REQUIRE( msg.has_value() );
+        BOOST_REQUIRE( msg->type == bgp_type::NOTIFICATION );
+        BOOST_REQUIRE_GE( msg->body.size(), 2 );
+        BOOST_CHECK_EQUAL( msg->body[ 0 ], static_cast<uint8_t>( BGP_ERR_CODE::CEASE ) );
+        BOOST_CHECK_EQUAL( msg->body[ 1 ], static_cast<uint8_t>( BGP_CEASE_ERR::CONN_COLLISION_RES ) );
+        // connection is closed after NOTIFICATION
+        BOOST_CHECK( !receive( peer ).has_value() );
+    }
+
+    boost::asio::io_context io;
+    GlobalConf conf;
+    acceptor listener;
+    std::shared_ptr<bgp_fsm> fsm;
+};
+
+BOOST_AUTO_TEST_SUITE( connection_collision )
+
+BOOST_FIXTURE_TEST_CASE( connection_of_higher_identifier_is_kept, collision_fixture ) {
+    conf.bgp_router_id = address_v4::from_string( "10.0.0.2" );
+    auto incoming = connect( false );
+    settle();
+    BOOST_CHECK( fsm->state == FSM_STATE::OPENSENT );
+    // our connect completes while session over connection from peer waits for OPEN
+    auto outgoing = connect( true );
+    settle();
+    BOOST_CHECK( fsm->colliding.has_value() );
+
+    // our identifier is higher, so connection initiated by us wins
+    send_open( incoming, "10.0.0.1" );
+    expect( incoming, bgp_type::OPEN );
+    expect_collision_notification( incoming );
+    expect( outgoing, bgp_type::OPEN );
+    BOOST_CHECK( fsm->outbound );
+    BOOST_CHECK( !fsm->colliding.has_value() );
+    BOOST_CHECK( fsm->state == FSM_STATE::OPENSENT );
+}
+
+BOOST_FIXTURE_TEST_CASE( connection_of_peer_with_higher_identifier_is_kept, collision_fixture ) {
+    conf.bgp_router_id = address_v4::from_string( "10.0.0.1" );
+    auto incoming = connect( false );
+    auto outgoing = connect( true );
+    settle();
+
+    send_open( incoming, "10.0.0.2" );
+    // nothing else was sent over losing connection
+    expect_collision_notification( outgoing );
+    expect( incoming, bgp_type::OPEN );
+    expect( incoming, bgp_type::KEEPALIVE );
+    BOOST_CHECK( !fsm->outbound );
+    BOOST_CHECK( !fsm->colliding.has_value() );
+    BOOST_CHECK( fsm->state == FSM_STATE::OPENCONFIRM );
+}
+
+BOOST_FIXTURE_TEST_CASE( connect_after_established_session_is_closed, collision_fixture ) {
+    conf.bgp_router_id = address_v4::from_string( "10.0.0.2" );
+    auto incoming = connect( false );
+    settle();
+    send_open( incoming, "10.0.0.1" );
+    send_keepalive( incoming );
+    BOOST_REQUIRE( fsm->state == FSM_STATE::ESTABLISHED );
+
+    auto outgoing = connect( true );
+    settle();
+    expect_collision_notification( outgoing );
+    BOOST_CHECK( fsm->state == FSM_STATE::ESTABLISHED );
+    BOOST_CHECK( !fsm->outbound );
+    expect( incoming, bgp_type::OPEN );
+    expect( incoming, bgp_type::KEEPALIVE );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE( hold_timer )
+
+BOOST_FIXTURE_TEST_CASE( expired_hold_timer_does_not_keep_stale_paths, collision_fixture ) {
+    conf.bgp_router_id = address_v4::from_string( "10.0.0.2" );
+    conf.graceful_restart_time = 120;
+    auto incoming = connect( false );
+    settle();
+    send_open( incoming, "10.0.0.1", 120 );
+    send_keepalive( incoming );
+    BOOST_REQUIRE( fsm->state == FSM_STATE::ESTABLISHED );
+
+    std::vector<path_attr_t> attrs( 3 );
+    attrs[ 0 ].make_origin( ORIGIN::IGP );
+    attrs[ 1 ].make_as_path( { PEER_AS } );
+    attrs[ 2 ].make_nexthop( address_v4::loopback() );
+    NLRI prefix( BGP_AFI::IPv4, "198.51.100.0/24" );
+    for( auto const &pkt: build_updates( { { 0, prefix } }, attrs, {}, false ) ) {
+        boost::asio::write( incoming, boost::asio::buffer( *pkt ) );
+    }
+    settle();
+    BOOST_REQUIRE_EQUAL( runtime->table.table.count( prefix ), 1U );
+
+    // NOTIFICATION is sent, so session goes down without Graceful Restart
+    fsm->last_received -= std::chrono::seconds( 10 );
+    fsm->on_hold_timer( 3 );
+    settle();
+    std::optional<message> last;
+    while( auto msg = receive( incoming ) ) {
+        last = msg;
+    }
+    BOOST_REQUIRE( last.has_value() && last->type == bgp_type::NOTIFICATION );
+    BOOST_CHECK_EQUAL( last->body[ 0 ], static_cast<uint8_t>( BGP_ERR_CODE::HOLD_TIMER_EXPIRED ) );
+    BOOST_CHECK( fsm->state == FSM_STATE::IDLE );
+    BOOST_CHECK_EQUAL( runtime->table.table.count( prefix ), 0U );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
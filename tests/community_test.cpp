@@ -0,0 +1,102 @@
+#include <sstream>
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "community.hpp"
+#include "packet.hpp"
+#include "string_utils.hpp"
+
+static std::vector<uint32_t> words_of( std::initializer_list<const char*> list ) {
+    std::vector<uint32_t> words;
+    for( auto str: list ) {
+        auto c = community_t::parse( str );
+        words.insert( words.end(), c.words.begin(), c.words.begin() + community_list::width( c.type ) );
+    }
+    return words;
+}
+
+BOOST_AUTO_TEST_SUITE( community_storage )
+
+BOOST_AUTO_TEST_CASE( communities_are_parsed_by_form ) {
+    auto standard = community_t::parse( "65000:100" );
+    BOOST_CHECK( standard.type == PATH_ATTRIBUTE::COMMUNITIES );
+    BOOST_CHECK_EQUAL( standard.words[ 0 ], ( 65000U << 16 ) | 100 );
+    BOOST_CHECK_EQUAL( community_t::parse( "no-export" ).words[ 0 ], COMMUNITY_NO_EXPORT );
+
+    auto large = community_t::parse( "4200000000:1:2" );
+    BOOST_CHECK( large.type == PATH_ATTRIBUTE::LARGE_COMMUNITY );
+    BOOST_CHECK( large.words == ( std::array<uint32_t,3>{ 4200000000U, 1, 2 } ) );
+
+    // two-octet AS specific route target
+    auto rt = community_t::parse( "rt:65000:7" );
+    BOOST_CHECK( rt.type == PATH_ATTRIBUTE::EXTENDED_COMMUNITIES );
+    BOOST_CHECK_EQUAL( rt.words[ 0 ], ( 0x02U << 16 ) | 65000 );
+    BOOST_CHECK_EQUAL( rt.words[ 1 ], 7U );
+
+    for( auto bad: { "65536:1", "1:2:3:4", "rt:1", "abc", "" } ) {
+        BOOST_CHECK_THROW( community_t::parse( bad ), std::runtime_error );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( equal_lists_are_interned_once ) {
+    auto list = community_list::intern( PATH_ATTRIBUTE::COMMUNITIES, words_of( { "65000:2", "65000:1", "65000:2" } ) );
+    // order and duplicates don't matter
+    auto same = community_list::intern( PATH_ATTRIBUTE::COMMUNITIES, words_of( { "65000:1", "65000:2" } ) );
+    BOOST_CHECK( list == same );
+    BOOST_CHECK_EQUAL( list->size(), 2U );
+    BOOST_CHECK( list->get_words() == words_of( { "65000:1", "65000:2" } ) );
+
+    auto other = community_list::intern( PATH_ATTRIBUTE::COMMUNITIES, words_of( { "65000:1" } ) );
+    BOOST_CHECK( list != other );
+    BOOST_CHECK( !( *list == *other ) );
+    // the same words of other type are other list
+    auto large = community_list::intern( PATH_ATTRIBUTE::LARGE_COMMUNITY, { 1, 2, 3 } );
+    auto standard = community_list::intern( PATH_ATTRIBUTE::COMMUNITIES, { 1, 2, 3 } );
+    BOOST_CHECK( large != standard );
+    BOOST_CHECK_EQUAL( large->size(), 1U );
+    BOOST_CHECK_EQUAL( standard->size(), 3U );
+}
+
+BOOST_AUTO_TEST_CASE( wire_format_round_trip ) {
+    for( auto const &[ type, list ]: std::vector<std::pair<PATH_ATTRIBUTE,std::initializer_list<const char*>>> {
+        { PATH_ATTRIBUTE::COMMUNITIES, { "65000:1", "no-export", "1:65535" } },
+        { PATH_ATTRIBUTE::EXTENDED_COMMUNITIES, { "rt:65000:1", "soo:192.0.2.1:5", "rt:4200000000:9" } },
+        { PATH_ATTRIBUTE::LARGE_COMMUNITY, { "65000:1:2", "4200000000:0:4294967295" } }
+    } ) {
+        auto interned = community_list::intern( type, words_of( list ) );
+        auto bytes = interned->to_bytes();
+        BOOST_CHECK_EQUAL( bytes.size(), interned->size() * community_list::width( type ) * 4 );
+        BOOST_CHECK( community_list::intern( type, bytes.data(), bytes.size() ) == interned );
+
+        // path attribute keeps interned list and encodes it
+        path_attr_t attr;
+        attr.make_communities( interned );
+        auto encoded = attr.to_bytes();
+        auto header = reinterpret_cast<path_attr_header*>( encoded.data() );
+        path_attr_t decoded( header, false );
+        BOOST_CHECK( decoded.communities == interned );
+        BOOST_CHECK( decoded == attr );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( membership ) {
+    auto list = community_list::intern( PATH_ATTRIBUTE::COMMUNITIES, words_of( { "65000:1", "65000:3", "no-export" } ) );
+    BOOST_CHECK( list->contains( COMMUNITY_NO_EXPORT ) );
+    BOOST_CHECK( list->contains( community_t::parse( "65000:3" ) ) );
+    BOOST_CHECK( !list->contains( community_t::parse( "65000:2" ) ) );
+    // community of other type is never member
+    BOOST_CHECK( !list->contains( community_t::parse( "65000:1:0" ) ) );
+
+    auto large = community_list::intern( PATH_ATTRIBUTE::LARGE_COMMUNITY, words_of( { "65000:1:2", "65000:1:3" } ) );
+    BOOST_CHECK( large->contains( community_t::parse( "65000:1:3" ) ) );
+    BOOST_CHECK( !large->contains( community_t::parse( "65000:2:3" ) ) );
+
+    std::ostringstream out;
+    out << *list;
+    BOOST_CHECK( !out.str().empty() );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "config_diff.hpp"
+#include "config.hpp"
+#include "nlri.hpp"
+#include "packet.hpp"
+
+static bgp_neighbour_v4 neighbour( const std::string &address, uint32_t remote_as ) {
+    bgp_neighbour_v4 nei {};
+    nei.address = address_v4::from_string( address );
+    nei.remote_as = remote_as;
+    return nei;
+}
+
+static std::vector<address_v4> addresses( std::initializer_list<const char*> list ) {
+    std::vector<address_v4> out;
+    for( auto a: list ) {
+        out.push_back( address_v4::from_string( a ) );
+    }
+    return out;
+}
+
+// running configuration and its copy which tests modify
+struct diff_fixture {
+    diff_fixture():
+        running {}
+    {
+        running.my_as = 65000;
+        running.hold_time = 90;
+        running.neighbours.push_back( neighbour( "10.0.0.1", 65001 ) );
+        running.neighbours.push_back( neighbour( "10.0.0.2", 65002 ) );
+        running.neighbours.push_back( neighbour( "10.0.0.3", 65000 ) );
+
+        PrefixList lan;
+        lan.entries.push_back( { NLRI( BGP_AFI::IPv4, "10.0.0.0/8" ), std::nullopt, 24, RoutePolicyAction::ACCEPT } );
+        running.prefix_lists[ "lan" ] = lan;
+
+        RoutePolicyEntry by_list {};
+        by_list.match_prefix_list = "lan";
+        by_list.action = RoutePolicyAction::ACCEPT;
+        running.policies[ "uses_list" ].entries.push_back( by_list );
+        RoutePolicyEntry any {};
+        any.set_localpref = 200;
+        any.action = RoutePolicyAction::ACCEPT;
+        running.policies[ "plain" ].entries.push_back( any );
+
+        running.originate_routes.push_back( { NLRI( BGP_AFI::IPv4, "192.0.2.0/24" ), std::nullopt } );
+        running.originate_routes.push_back( { NLRI( BGP_AFI::IPv4, "198.51.100.0/24" ), std::string( "plain" ) } );
+        next = running;
+    }
+
+    bgp_neighbour_v4 &next_neighbour( const std::string &address ) {
+        auto it = std::find_if( next.neighbours.begin(), next.neighbours.end(), [ & ]( const bgp_neighbour_v4 &nei ) {
+            return nei.address == address_v4::from_string( address );
+        });
+        BOOST_REQUIRE( it != next.neighbours.end() );
+        return *it;
+    }
+
+    GlobalConf running;
+    GlobalConf next;
+};
+
+BOOST_AUTO_TEST_SUITE( configuration_diff )
+
+BOOST_FIXTURE_TEST_CASE( same_configuration_has_no_changes, diff_fixture ) {
+    auto diff = diff_config( running, next );
+    BOOST_CHECK( diff.added_neighbours.empty() );
+    BOOST_CHECK( diff.removed_neighbours.empty() );
+    BOOST_CHECK( diff.reset_neighbours.empty() );
+    BOOST_CHECK( diff.import_changed.empty() );
+    BOOST_CHECK( diff.export_changed.empty() );
+    BOOST_CHECK( diff.changed_policies.empty() );
+    BOOST_CHECK( !diff.prefix_lists_changed );
+    BOOST_CHECK( diff.changed_routes.empty() );
+    BOOST_CHECK( diff.restart_required.empty() );
+}
+
+BOOST_FIXTURE_TEST_CASE( neighbour_changes_are_classified, diff_fixture ) {
+    next.neighbours.remove_if( []( const bgp_neighbour_v4 &nei ) { return nei.address == address_v4::from_string( "10.0.0.2" ); } );
+    next.neighbours.push_back( neighbour( "10.0.0.4", 65004 ) );
+    // OPEN parameter and policies of the same neighbour, reset covers policy change
+    next_neighbour( "10.0.0.1" ).hold_time = 30;
+    next_neighbour( "10.0.0.1" ).import_policy = "plain";
+    next_neighbour( "10.0.0.3" ).import_policy = "plain";
+    next_neighbour( "10.0.0.3" ).route_reflector_client = true;
+
+    auto diff = diff_config( running, next );
+    BOOST_CHECK( diff.added_neighbours == addresses( { "10.0.0.4" } ) );
+    BOOST_CHECK( diff.removed_neighbours == addresses( { "10.0.0.2" } ) );
+    BOOST_CHECK( diff.reset_neighbours == addresses( { "10.0.0.1" } ) );
+    BOOST_CHECK( diff.import_changed == addresses( { "10.0.0.3" } ) );
+    BOOST_CHECK( diff.export_changed == addresses( { "10.0.0.3" } ) );
+    BOOST_CHECK( diff.restart_required.empty() );
+}
+
+BOOST_FIXTURE_TEST_CASE( duplicate_entries_are_rejected, diff_fixture ) {
+    auto neighbours = next;
+    neighbours.neighbours.push_back( neighbour( "10.0.0.1", 65009 ) );
+    BOOST_CHECK_THROW( diff_config( running, neighbours ), std::runtime_error );
+    next.originate_routes.push_back( { NLRI( BGP_AFI::IPv4, "192.0.2.0/24" ), std::string( "plain" ) } );
+    BOOST_CHECK_THROW( diff_config( running, next ), std::runtime_error );
+}
+
+BOOST_FIXTURE_TEST_CASE( prefix_list_change_marks_its_policies, diff_fixture ) {
+    next.prefix_lists[ "lan" ].entries.front().le = 32;
+    auto diff = diff_config( running, next );
+    BOOST_CHECK( diff.prefix_lists_changed );
+    BOOST_CHECK( diff.changed_policies == std::set<std::string>( { "uses_list" } ) );
+}
+
+BOOST_FIXTURE_TEST_CASE( added_removed_and_changed_policies, diff_fixture ) {
+    next.policies.erase( "uses_list" );
+    next.policies[ "plain" ].entries.front().set_localpref = 300;
+    next.policies[ "new" ];
+    auto diff = diff_config( running, next );
+    BOOST_CHECK( !diff.prefix_lists_changed );
+    BOOST_CHECK( diff.changed_policies == std::set<std::string>( { "new", "plain", "uses_list" } ) );
+}
+
+BOOST_FIXTURE_TEST_CASE( originated_route_changes, diff_fixture ) {
+    next.originate_routes.pop_front();
+    next.originate_routes.front().policy_name.reset();
+    next.originate_routes.push_back( { NLRI( BGP_AFI::IPv4, "203.0.113.0/24" ), std::nullopt } );
+    auto diff = diff_config( running, next );
+    BOOST_CHECK( diff.changed_routes == std::set<NLRI>( {
+        NLRI( BGP_AFI::IPv4, "192.0.2.0/24" ), NLRI( BGP_AFI::IPv4, "198.51.100.0/24" ), NLRI( BGP_AFI::IPv4, "203.0.113.0/24" )
+    } ) );
+}
+
+BOOST_FIXTURE_TEST_CASE( global_settings_require_restart, diff_fixture ) {
+    next.my_as = 65100;
+    next.max_paths = 4;
+    next.fib_backend = "recorder";
+    auto diff = diff_config( running, next );
+    BOOST_CHECK( diff.restart_required == std::vector<std::string>( { "my_as", "max_paths", "fib_backend" } ) );
+    BOOST_CHECK( diff.changed_policies.empty() );
+    BOOST_CHECK( diff.reset_neighbours.empty() );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
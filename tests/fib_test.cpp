@@ -0,0 +1,232 @@
+#include <list>
+#include <thread>
+#include <net/if.h>
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "evloop.hpp"
+#include "fib.hpp"
+#include "netlink.hpp"
+#include "table.hpp"
+#include "fsm.hpp"
+#include "config.hpp"
+#include "nlri.hpp"
+#include "packet.hpp"
+
+extern std::shared_ptr<EVLoop> runtime;
+
+static std::shared_ptr<bgp_nexthop_group> make_group( uint32_t id, std::vector<fib_nexthop> nexthops ) {
+    return std::make_shared<bgp_nexthop_group>( bgp_nexthop_group { id, std::move( nexthops ) } );
+}
+
+static fib_nexthop via( const std::string &gateway, uint32_t ifindex = 0 ) {
+    return { address_v4::from_string( gateway ), ifindex };
+}
+
+// pipeline with recorder instead of data plane, recorder is owned by pipeline
+struct recorder_fixture {
+    recorder_fixture():
+        conf {},
+        wheel( io ),
+        table( io, conf ),
+        pipeline( io, conf, table )
+    {}
+
+    void start() {
+        auto transport = std::make_unique<fib_recorder>();
+        recorder = transport.get();
+        pipeline.start( std::move( transport ) );
+    }
+
+    ~recorder_fixture() {
+        peer.reset();
+        runtime.reset();
+    }
+
+    // path of peer, session is never started
+    void add_path( const std::string &prefix, const std::string &nexthop ) {
+        if( !peer ) {
+            // updates of table are sent to neighbours of runtime, it has none
+            conf.listen_on_port = 0;
+            runtime = std::make_shared<EVLoop>( io, conf, "" );
+            auto &nei = neighbours.emplace_back();
+            nei.address = address_v4::from_string( "192.0.2.1" );
+            nei.remote_as = 65001;
+            peer = std::make_shared<bgp_fsm>( io, wheel, buffers, conf, table, nei );
+        }
+        std::vector<path_attr_t> attrs( 3 );
+        attrs[ 0 ].make_origin( ORIGIN::IGP );
+        attrs[ 1 ].make_as_path( { 65001 } );
+        attrs[ 2 ].make_nexthop( address_v4::from_string( nexthop ) );
+        table.add_path( NLRI( BGP_AFI::IPv4, prefix ), attrs, peer );
+    }
+
+    boost::asio::io_context io;
+    GlobalConf conf;
+    timer_wheel wheel;
+    buffer_pool buffers;
+    std::list<bgp_neighbour_v4> neighbours;
+    std::shared_ptr<bgp_fsm> peer;
+    bgp_table_v4 table;
+    fib_pipeline pipeline;
+    fib_recorder *recorder = nullptr;
+};
+
+BOOST_AUTO_TEST_SUITE( fib_programming )
+
+BOOST_FIXTURE_TEST_CASE( changes_are_coalesced_per_prefix, recorder_fixture ) {
+    start();
+    NLRI prefix( BGP_AFI::IPv4, "198.51.100.0/24" );
+    pipeline.on_route_change( prefix, make_group( 1, { via( "10.0.0.1" ) } ) );
+    pipeline.on_route_change( prefix, make_group( 2, { via( "10.0.0.2", 3 ) } ) );
+    io.run();
+
+    BOOST_REQUIRE_EQUAL( recorder->calls.size(), 1 );
+    BOOST_CHECK( recorder->calls[ 0 ].is_add );
+    BOOST_REQUIRE_EQUAL( recorder->routes[ prefix ].size(), 1 );
+    BOOST_CHECK( recorder->routes[ prefix ][ 0 ] == via( "10.0.0.2", 3 ) );
+}
+
+BOOST_FIXTURE_TEST_CASE( failed_request_is_retried, recorder_fixture ) {
+    start();
+    recorder->fail_next = 2;
+    NLRI prefix( BGP_AFI::IPv4, "198.51.100.0/24" );
+    pipeline.on_route_change( prefix, make_group( 1, { via( "10.0.0.1" ) } ) );
+    io.run();
+
+    BOOST_CHECK_EQUAL( recorder->calls.size(), 3 );
+    BOOST_CHECK_EQUAL( recorder->routes.count( prefix ), 1 );
+}
+
+BOOST_FIXTURE_TEST_CASE( full_request_queue_delays_submit, recorder_fixture ) {
+    start();
+    recorder->queue_size = 1;
+    for( int i = 0; i < 10; i++ ) {
+        NLRI prefix( BGP_AFI::IPv4, "198.51." + std::to_string( i ) + ".0/24" );
+        pipeline.on_route_change( prefix, make_group( 1, { via( "10.0.0.1" ) } ) );
+    }
+    io.run();
+
+    BOOST_CHECK_EQUAL( recorder->calls.size(), 10 );
+    BOOST_CHECK_EQUAL( recorder->routes.size(), 10 );
+}
+
+BOOST_FIXTURE_TEST_CASE( reconcile_removes_routes_missing_in_table, recorder_fixture ) {
+    conf.fib_reconcile = true;
+    auto transport = std::make_unique<fib_recorder>();
+    recorder = transport.get();
+    NLRI stale( BGP_AFI::IPv4, "198.51.100.0/24" );
+    recorder->routes[ stale ] = { via( "10.0.0.1" ) };
+    pipeline.start( std::move( transport ) );
+    io.run();
+
+    BOOST_REQUIRE_EQUAL( recorder->calls.size(), 1 );
+    BOOST_CHECK( !recorder->calls[ 0 ].is_add );
+    BOOST_CHECK( recorder->routes.empty() );
+}
+
+BOOST_FIXTURE_TEST_CASE( table_is_programmed_again_after_reconnect, recorder_fixture ) {
+    start();
+    add_path( "198.51.100.0/24", "10.0.0.1" );
+    add_path( "203.0.113.0/24", "10.0.0.2" );
+    io.run();
+    BOOST_REQUIRE_EQUAL( recorder->routes.size(), 2 );
+
+    // data plane restarts empty and is not ready for the first reconnect attempt
+    recorder->fail_connects = 1;
+    recorder->restart();
+    io.restart();
+    io.run();
+    BOOST_CHECK_EQUAL( recorder->connects, 3 );
+    BOOST_REQUIRE_EQUAL( recorder->routes.size(), 2 );
+    BOOST_CHECK( recorder->routes[ NLRI( BGP_AFI::IPv4, "203.0.113.0/24" ) ] == std::vector<fib_nexthop>( { via( "10.0.0.2" ) } ) );
+}
+
+BOOST_FIXTURE_TEST_CASE( reconnect_reconciles_with_table, recorder_fixture ) {
+    conf.fib_reconcile = true;
+    start();
+    add_path( "198.51.100.0/24", "10.0.0.1" );
+    io.run();
+    auto calls = recorder->calls.size();
+
+    // data plane kept its routes, one of them is stale
+    recorder->routes[ NLRI( BGP_AFI::IPv4, "203.0.113.0/24" ) ] = { via( "10.0.0.9" ) };
+    recorder->lose_connection();
+    io.restart();
+    io.run();
+    BOOST_CHECK_EQUAL( recorder->connects, 2 );
+    BOOST_REQUIRE_EQUAL( recorder->calls.size(), calls + 1 );
+    BOOST_CHECK( !recorder->calls.back().is_add );
+    BOOST_CHECK_EQUAL( recorder->routes.size(), 1 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+// Programs routes into separate kernel table, it needs CAP_NET_ADMIN,
+// so without it the test only checks that every request is answered.
+BOOST_AUTO_TEST_SUITE( netlink_transport )
+
+static constexpr uint32_t TEST_TABLE = 4242;
+
+static std::vector<fib_reply> wait_replies( netlink_api &api, std::size_t count ) {
+    std::vector<fib_reply> replies;
+    for( int i = 0; i < 100 && replies.size() < count; i++ ) {
+        api.poll( replies );
+        if( replies.size() < count ) {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        }
+    }
+    return replies;
+}
+
+static std::vector<fib_entry> dump_routes( netlink_api &api ) {
+    std::vector<fib_entry> routes;
+    BOOST_REQUIRE( api.dump( routes ) );
+    return routes;
+}
+
+BOOST_AUTO_TEST_CASE( gateway_and_interface_are_installed ) {
+    netlink_api api( TEST_TABLE );
+    BOOST_REQUIRE( api.connect() );
+    uint32_t lo = if_nametoindex( "lo" );
+    BOOST_REQUIRE( lo != 0 );
+    NLRI single( BGP_AFI::IPv4, "198.51.100.0/24" );
+    NLRI multi( BGP_AFI::IPv4, "203.0.113.0/24" );
+
+    BOOST_REQUIRE( api.submit( 1, { single, make_group( 1, { via( "127.0.0.1", lo ) } ) } ) );
+    BOOST_REQUIRE( api.submit( 2, { multi, make_group( 2, { via( "127.0.0.1", lo ), via( "127.0.0.2", lo ) } ) } ) );
+    auto replies = wait_replies( api, 2 );
+    BOOST_REQUIRE_EQUAL( replies.size(), 2 );
+    if( !replies[ 0 ].success ) {
+        BOOST_TEST_MESSAGE( "Cannot program kernel routes, installed state is not checked" );
+        return;
+    }
+    BOOST_CHECK( replies[ 1 ].success );
+
+    auto routes = dump_routes( api );
+    BOOST_REQUIRE_EQUAL( routes.size(), 2 );
+    std::sort( routes.begin(), routes.end(), []( const fib_entry &lhs, const fib_entry &rhs ) { return lhs.prefix < rhs.prefix; } );
+    BOOST_CHECK( routes[ 0 ].prefix == single );
+    BOOST_REQUIRE_EQUAL( routes[ 0 ].nexthops.size(), 1 );
+    BOOST_CHECK( routes[ 0 ].nexthops[ 0 ] == via( "127.0.0.1", lo ) );
+    BOOST_CHECK( routes[ 1 ].prefix == multi );
+    BOOST_REQUIRE_EQUAL( routes[ 1 ].nexthops.size(), 2 );
+    BOOST_CHECK( routes[ 1 ].nexthops[ 0 ] == via( "127.0.0.1", lo ) );
+    BOOST_CHECK( routes[ 1 ].nexthops[ 1 ] == via( "127.0.0.2", lo ) );
+
+    BOOST_REQUIRE( api.submit( 3, { single, nullptr } ) );
+    BOOST_REQUIRE( api.submit( 4, { multi, nullptr } ) );
+    // route which is already gone is removed successfully
+    BOOST_REQUIRE( api.submit( 5, { multi, nullptr } ) );
+    replies = wait_replies( api, 3 );
+    BOOST_REQUIRE_EQUAL( replies.size(), 3 );
+    for( auto const &reply: replies ) {
+        BOOST_CHECK( reply.success );
+    }
+    BOOST_CHECK( dump_routes( api ).empty() );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,20 @@
+#define BOOST_TEST_MODULE bgp++
+#include <boost/test/included/unit_test.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "log.hpp"
+#include "evloop.hpp"
+
+// globals of daemon, they are defined in its main
+Logger logger;
+std::shared_ptr<EVLoop> runtime;
+
+struct quiet_log {
+    quiet_log() {
+        logger.setLevel( LOGL::ALERT );
+    }
+};
+
+BOOST_TEST_GLOBAL_FIXTURE( quiet_log );
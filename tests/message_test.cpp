@@ -0,0 +1,114 @@
+#include <boost/test/unit_test.hpp>
+
+#include "message.hpp"
+
+// frame without its length, as cli_reader expects it
+static std::string_view body( const std::string &frame ) {
+    BOOST_REQUIRE_GE( frame.size(), CLI_FRAME_HEADER );
+    BOOST_REQUIRE_EQUAL( frame_length( reinterpret_cast<const uint8_t*>( frame.data() ) ), frame.size() - CLI_FRAME_HEADER );
+    return std::string_view( frame ).substr( CLI_FRAME_HEADER );
+}
+
+BOOST_AUTO_TEST_SUITE( cli_schema )
+
+BOOST_AUTO_TEST_CASE( table_request_round_trip ) {
+    Show_Table_Req req;
+    req.prefix = "10.0.0.0/8";
+    req.match = PREFIX_MATCH::MORE_SPECIFIC;
+    req.as = 4200000000U;
+    req.community = "65000:1";
+    req.limit = 100;
+    req.page = 3;
+    req.cursor = "10.1.0.0/16";
+    cli_writer writer( TYPE::REQ, CONTENT::SHOW_TABLE );
+    writer & req;
+    auto frame = writer.finish();
+
+    cli_reader reader( body( frame ) );
+    BOOST_CHECK( reader.type == TYPE::REQ );
+    BOOST_CHECK( reader.cont == CONTENT::SHOW_TABLE );
+    auto decoded = reader.read<Show_Table_Req>();
+    BOOST_CHECK( decoded.prefix == req.prefix );
+    BOOST_CHECK( decoded.match == req.match );
+    BOOST_CHECK( !decoded.neighbour.has_value() );
+    BOOST_CHECK( !decoded.nexthop.has_value() );
+    BOOST_CHECK( decoded.as == req.as );
+    BOOST_CHECK( decoded.community == req.community );
+    BOOST_CHECK_EQUAL( decoded.limit, req.limit );
+    BOOST_CHECK_EQUAL( decoded.page, req.page );
+    BOOST_CHECK( decoded.cursor == req.cursor );
+}
+
+BOOST_AUTO_TEST_CASE( table_response_records_are_read_in_place ) {
+    std::string entries;
+    for( uint8_t i = 0; i < 3; i++ ) {
+        cli_table_entry entry {};
+        entry.afi = 1;
+        entry.prefix = { 10, i };
+        entry.prefix_len = 16;
+        entry.flags = i == 0 ? CLI_ENTRY_BEST | CLI_ENTRY_VALID : CLI_ENTRY_VALID;
+        entry.attr_index = i;
+        entry.time = 1700000000 + i;
+        entries.append( reinterpret_cast<const char*>( &entry ), sizeof( entry ) );
+    }
+    Show_Table_Resp resp;
+    resp.last = false;
+    resp.entries = entries;
+    cli_writer writer( TYPE::RESP, CONTENT::SHOW_TABLE );
+    writer & resp;
+    auto frame = writer.finish();
+
+    cli_reader reader( body( frame ) );
+    BOOST_CHECK( reader.type == TYPE::RESP );
+    auto decoded = reader.read<Show_Table_Resp>();
+    BOOST_CHECK( !decoded.last );
+    BOOST_CHECK( !decoded.cursor.has_value() );
+    BOOST_CHECK( !decoded.error.has_value() );
+    BOOST_CHECK( decoded.attr_sets.empty() );
+    BOOST_REQUIRE_EQUAL( decoded.entries.size(), 3 * sizeof( cli_table_entry ) );
+    // entries point into frame, they aren't copied
+    BOOST_CHECK( decoded.entries.data() >= frame.data() && decoded.entries.data() < frame.data() + frame.size() );
+    auto records = reinterpret_cast<const cli_table_entry*>( decoded.entries.data() );
+    BOOST_CHECK_EQUAL( records[ 2 ].prefix[ 1 ], 2 );
+    BOOST_CHECK_EQUAL( records[ 2 ].attr_index, 2U );
+    BOOST_CHECK_EQUAL( records[ 2 ].time, 1700000002 );
+    BOOST_CHECK_EQUAL( records[ 0 ].flags, CLI_ENTRY_BEST | CLI_ENTRY_VALID );
+}
+
+BOOST_AUTO_TEST_CASE( nested_vectors_round_trip ) {
+    Show_Neighbour_Resp resp;
+    resp.entries.resize( 2 );
+    resp.entries[ 0 ] = { "192.0.2.1", 65001, 90, { "4-byte ASN", "route refresh" }, 7U };
+    resp.entries[ 1 ] = { "192.0.2.2", 65002, 180, {}, boost::none };
+    cli_writer writer( TYPE::RESP, CONTENT::SHOW_NEI );
+    writer & resp;
+    auto frame = writer.finish();
+
+    cli_reader reader( body( frame ) );
+    auto decoded = reader.read<Show_Neighbour_Resp>();
+    BOOST_REQUIRE_EQUAL( decoded.entries.size(), 2U );
+    BOOST_CHECK_EQUAL( decoded.entries[ 0 ].address, "192.0.2.1" );
+    BOOST_CHECK_EQUAL( decoded.entries[ 0 ].remote_as, 65001U );
+    BOOST_CHECK_EQUAL( decoded.entries[ 0 ].hold_time, 90 );
+    BOOST_CHECK( decoded.entries[ 0 ].caps == resp.entries[ 0 ].caps );
+    BOOST_CHECK( decoded.entries[ 0 ].socket == boost::optional<uint32_t>( 7U ) );
+    BOOST_CHECK_EQUAL( decoded.entries[ 1 ].address, "192.0.2.2" );
+    BOOST_CHECK( decoded.entries[ 1 ].caps.empty() );
+    BOOST_CHECK( !decoded.entries[ 1 ].socket.has_value() );
+}
+
+BOOST_AUTO_TEST_CASE( truncated_frame_is_rejected ) {
+    Reload_Resp resp;
+    resp.error = "neighbour 192.0.2.1 is invalid";
+    resp.changes = { "added 192.0.2.3" };
+    cli_writer writer( TYPE::RESP, CONTENT::RELOAD );
+    writer & resp;
+    auto frame = writer.finish();
+    auto full = body( frame );
+    BOOST_CHECK_NO_THROW( cli_reader( full ).read<Reload_Resp>() );
+    for( std::size_t len = 0; len < full.size(); len++ ) {
+        BOOST_CHECK_THROW( cli_reader( full.substr( 0, len ) ).read<Reload_Resp>(), std::runtime_error );
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,161 @@
+#include <set>
+#include <random>
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "neighbour_index.hpp"
+#include "buffer_pool.hpp"
+
+// the same mixing as neighbour_index::home, so tests can build clusters around end of table
+static std::size_t home_slot( const address_v4 &address, std::size_t slots ) {
+    uint32_t h = address.to_uint();
+    h ^= h >> 16;
+    h *= 0x85EBCA6BU;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35U;
+    h ^= h >> 16;
+    return h & ( slots - 1 );
+}
+
+// addresses from 10.0.0.0/8 with given home slot in table of 16 slots
+static std::vector<address_v4> homed_at( std::size_t slot, std::size_t count, std::set<address_v4> &used ) {
+    std::vector<address_v4> out;
+    for( uint32_t a = 0x0A000001; out.size() < count; a++ ) {
+        address_v4 address( a );
+        if( home_slot( address, 16 ) == slot && used.insert( address ).second ) {
+            out.push_back( address );
+        }
+    }
+    return out;
+}
+
+static void check_contents( const neighbour_index &index, const std::set<address_v4> &expected ) {
+    BOOST_REQUIRE_EQUAL( index.size(), expected.size() );
+    std::set<address_v4> iterated;
+    for( auto const &entry: index ) {
+        iterated.insert( entry.first );
+    }
+    BOOST_CHECK( iterated == expected );
+    for( auto const &address: expected ) {
+        auto it = index.find( address );
+        BOOST_REQUIRE( it != index.end() );
+        BOOST_CHECK( it->first == address );
+    }
+}
+
+BOOST_AUTO_TEST_SUITE( neighbour_index_table )
+
+BOOST_AUTO_TEST_CASE( insert_and_find ) {
+    neighbour_index index;
+    std::set<address_v4> expected;
+    for( uint32_t i = 1; i <= 1000; i++ ) {
+        address_v4 address( 0x0A000000 + i );
+        BOOST_CHECK( index.emplace( address, nullptr ).second );
+        expected.insert( address );
+    }
+    check_contents( index, expected );
+    BOOST_CHECK( index.find( address_v4::from_string( "192.0.2.1" ) ) == index.end() );
+    // existing entry is kept
+    auto [ it, inserted ] = index.emplace( address_v4( 0x0A000001 ), nullptr );
+    BOOST_CHECK( !inserted );
+    BOOST_CHECK( it->first == address_v4( 0x0A000001 ) );
+    BOOST_CHECK_EQUAL( index.size(), 1000 );
+}
+
+BOOST_AUTO_TEST_CASE( erase_shifts_back_cluster_wrapped_around_table_end ) {
+    std::set<address_v4> used;
+    // cluster in slots 15, 0, 1 and 2 of 16 slots, last entry belongs to slot 0
+    auto at_end = homed_at( 15, 3, used );
+    auto at_start = homed_at( 0, 1, used );
+    neighbour_index index;
+    std::set<address_v4> expected;
+    for( auto const &address: { at_end[ 0 ], at_end[ 1 ], at_end[ 2 ], at_start[ 0 ] } ) {
+        index.emplace( address, nullptr );
+        expected.insert( address );
+    }
+    check_contents( index, expected );
+
+    // each erase moves rest of cluster across end of table
+    for( auto const &address: { at_end[ 0 ], at_end[ 2 ], at_start[ 0 ], at_end[ 1 ] } ) {
+        auto it = index.find( address );
+        BOOST_REQUIRE( it != index.end() );
+        index.erase( it );
+        expected.erase( address );
+        check_contents( index, expected );
+        BOOST_CHECK( index.find( address ) == index.end() );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( erase_returns_entry_moved_into_place ) {
+    neighbour_index index;
+    for( uint32_t i = 1; i <= 3; i++ ) {
+        index.emplace( address_v4( i ), nullptr );
+    }
+    auto it = index.erase( index.find( address_v4( 1 ) ) );
+    BOOST_REQUIRE( it != index.end() );
+    BOOST_CHECK( index.find( it->first ) == it );
+    // erase of last entry returns end
+    it = index.erase( index.end() - 1 );
+    BOOST_CHECK( it == index.end() );
+    BOOST_CHECK_EQUAL( index.size(), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( random_operations_match_set ) {
+    std::mt19937 rng( 4271 );
+    // small address range, so inserts hit existing entries and clusters are long
+    std::uniform_int_distribution<uint32_t> pick( 1, 24 );
+    neighbour_index index;
+    std::set<address_v4> expected;
+    for( int op = 0; op < 20000; op++ ) {
+        address_v4 address( pick( rng ) );
+        auto it = index.find( address );
+        BOOST_REQUIRE_EQUAL( it != index.end(), expected.count( address ) == 1 );
+        if( rng() % 2 == 0 ) {
+            BOOST_REQUIRE_EQUAL( index.emplace( address, nullptr ).second, expected.insert( address ).second );
+        } else if( it != index.end() ) {
+            index.erase( it );
+            expected.erase( address );
+        }
+    }
+    check_contents( index, expected );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE( receive_buffer_pool )
+
+BOOST_AUTO_TEST_CASE( released_buffer_is_lent_again ) {
+    buffer_pool pool;
+    auto buf = pool.acquire();
+    BOOST_REQUIRE( buf );
+    auto raw = buf.get();
+    pool.release( std::move( buf ) );
+    BOOST_CHECK( pool.acquire().get() == raw );
+}
+
+BOOST_AUTO_TEST_CASE( only_few_spare_buffers_are_kept ) {
+    buffer_pool pool;
+    std::vector<std::unique_ptr<rx_buffer>> lent;
+    std::vector<rx_buffer*> raw;
+    for( int i = 0; i < 8; i++ ) {
+        lent.push_back( pool.acquire() );
+        raw.push_back( lent.back().get() );
+    }
+    for( auto &buf: lent ) {
+        pool.release( std::move( buf ) );
+    }
+    // session without buffer returns nothing
+    pool.release( nullptr );
+
+    // spare buffers are lent last released first, so buffers released after first four were freed
+    for( int i = 3; i >= 0; i-- ) {
+        auto buf = pool.acquire();
+        BOOST_CHECK( buf.get() == raw[ i ] );
+        lent[ i ] = std::move( buf );
+    }
+    BOOST_CHECK( pool.acquire() );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,84 @@
+#include <fstream>
+#include <unistd.h>
+#include <net/if.h>
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "nexthop.hpp"
+#include "config.hpp"
+#include "nlri.hpp"
+#include "packet.hpp"
+
+// IGP routes file, which is removed after test
+struct igp_file_fixture {
+    igp_file_fixture():
+        conf {},
+        tracker( io, conf )
+    {
+        char name[] = "/tmp/bgp_tests_igp_XXXXXX";
+        int fd = mkstemp( name );
+        BOOST_REQUIRE( fd >= 0 );
+        close( fd );
+        path = name;
+    }
+
+    ~igp_file_fixture() {
+        unlink( path.c_str() );
+    }
+
+    void start( const std::string &routes ) {
+        std::ofstream( path ) << routes;
+        conf.nexthop_resolution = "file";
+        conf.igp_routes_file = path;
+        tracker.start();
+    }
+
+    std::shared_ptr<bgp_nexthop> track( const std::string &address ) {
+        return tracker.track( address_v4::from_string( address ), NLRI( BGP_AFI::IPv4, "198.51.100.0/24" ) );
+    }
+
+    std::string path;
+    boost::asio::io_context io;
+    GlobalConf conf;
+    nexthop_tracker tracker;
+};
+
+BOOST_AUTO_TEST_SUITE( nexthop_resolution )
+
+BOOST_FIXTURE_TEST_CASE( next_hop_is_forwarded_as_is_without_tracking, igp_file_fixture ) {
+    tracker.start();
+    auto nh = track( "10.0.0.1" );
+    BOOST_CHECK( nh->reachable );
+    BOOST_CHECK( nh->forwarding.gateway == address_v4::from_string( "10.0.0.1" ) );
+    BOOST_CHECK_EQUAL( nh->forwarding.ifindex, 0 );
+}
+
+BOOST_FIXTURE_TEST_CASE( next_hop_is_resolved_to_igp_gateway, igp_file_fixture ) {
+    start(
+        "- prefix: 10.0.0.0/8\n"
+        "  metric: 20\n"
+        "  gateway: 192.0.2.1\n"
+        "  interface: lo\n"
+        "- prefix: 10.1.0.0/16\n"
+        "  metric: 10\n"
+    );
+    auto remote = track( "10.2.0.1" );
+    BOOST_CHECK( remote->reachable );
+    BOOST_CHECK_EQUAL( remote->metric, 20 );
+    BOOST_CHECK( remote->forwarding.gateway == address_v4::from_string( "192.0.2.1" ) );
+    BOOST_CHECK_EQUAL( remote->forwarding.ifindex, if_nametoindex( "lo" ) );
+
+    // longest match is connected route, so next hop itself is gateway
+    auto connected = track( "10.1.2.3" );
+    BOOST_CHECK( connected->reachable );
+    BOOST_CHECK_EQUAL( connected->metric, 10 );
+    BOOST_CHECK( connected->forwarding.gateway == address_v4::from_string( "10.1.2.3" ) );
+    BOOST_CHECK_EQUAL( connected->forwarding.ifindex, 0 );
+
+    BOOST_CHECK( !track( "172.16.0.1" )->reachable );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
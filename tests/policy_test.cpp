@@ -0,0 +1,368 @@
+#include <regex>
+#include <random>
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "route_policy.hpp"
+#include "attr_registry.hpp"
+#include "config.hpp"
+#include "nlri.hpp"
+#include "packet.hpp"
+
+// route as plain values, so reference evaluator doesn't touch attribute encoding
+struct route {
+    NLRI prefix;
+    uint32_t nexthop;
+    std::optional<uint32_t> localpref;
+    std::vector<uint32_t> as_path;
+    // standard communities in "asn:value" form
+    std::vector<std::string> communities;
+};
+
+static uint32_t community_word( const std::string &str ) {
+    auto sep = str.find( ':' );
+    return ( std::stoul( str.substr( 0, sep ) ) << 16 ) | std::stoul( str.substr( sep + 1 ) );
+}
+
+static std::vector<path_attr_t> to_attrs( const route &r ) {
+    std::vector<path_attr_t> attrs;
+    path_attr_t origin;
+    origin.make_origin( ORIGIN::IGP );
+    attrs.push_back( std::move( origin ) );
+    path_attr_t as_path;
+    as_path.make_as_path( r.as_path );
+    attrs.push_back( std::move( as_path ) );
+    path_attr_t nexthop;
+    nexthop.make_nexthop( address_v4( r.nexthop ) );
+    attrs.push_back( std::move( nexthop ) );
+    if( r.localpref ) {
+        path_attr_t localpref;
+        localpref.make_local_pref( *r.localpref );
+        attrs.push_back( std::move( localpref ) );
+    }
+    if( !r.communities.empty() ) {
+        std::vector<uint32_t> words;
+        for( auto const &c: r.communities ) {
+            words.push_back( community_word( c ) );
+        }
+        path_attr_t communities;
+        communities.make_communities( community_list::intern( PATH_ATTRIBUTE::COMMUNITIES, std::move( words ) ) );
+        attrs.push_back( std::move( communities ) );
+    }
+    return attrs;
+}
+
+static route from_attrs( const NLRI &prefix, const std::vector<path_attr_t> &attrs ) {
+    route r { prefix, 0, std::nullopt, {}, {} };
+    for( auto const &attr: attrs ) {
+        if( attr.type == PATH_ATTRIBUTE::NEXT_HOP ) {
+            r.nexthop = attr.get_u32();
+        } else if( attr.type == PATH_ATTRIBUTE::LOCAL_PREF ) {
+            r.localpref = attr.get_u32();
+        } else if( attr.type == PATH_ATTRIBUTE::COMMUNITIES ) {
+            for( auto word: attr.communities->get_words() ) {
+                r.communities.push_back( std::to_string( word >> 16 ) + ":" + std::to_string( word & 0xFFFF ) );
+            }
+        }
+    }
+    return r;
+}
+
+static bool reference_prefix_list( const PrefixList &list, const NLRI &prefix ) {
+    for( auto const &e: list.entries ) {
+        auto len = e.prefix.get_len();
+        auto ge = e.ge.value_or( len );
+        auto le = e.le.value_or( e.ge ? 32 : len );
+        if( e.prefix.covers( prefix ) && prefix.get_len() >= ge && prefix.get_len() <= le ) {
+            return e.action == RoutePolicyAction::ACCEPT;
+        }
+    }
+    return false;
+}
+
+// router CLI pattern as ECMAScript regex searched in space separated path
+static bool reference_as_path( const std::string &pattern, const std::vector<uint32_t> &path ) {
+    std::string re;
+    for( auto c: pattern ) {
+        re += c == '_' ? std::string( "(^| |$)" ) : std::string( 1, c );
+    }
+    std::string text;
+    for( auto asn: path ) {
+        text += ( text.empty() ? "" : " " ) + std::to_string( asn );
+    }
+    return std::regex_search( text, std::regex( re ) );
+}
+
+// Policy evaluated straight from configuration: entries in order, all conditions
+// of entry must match, sets accumulate over PASS, ACCEPT and DROP end evaluation
+// and route is rejected when no entry decides. Nexthop and local preference
+// conditions see values set by previous entries, other conditions see received path.
+static bool reference_apply( const RoutePolicy &pol, const GlobalConf &conf, route &r ) {
+    auto out = r;
+    auto localpref = r.localpref.value_or( 100 );
+    for( auto const &e: pol.entries ) {
+        if( e.match_prefix_v4 && *e.match_prefix_v4 != r.prefix ) {
+            continue;
+        }
+        if( e.match_prefix_list && !reference_prefix_list( conf.prefix_lists.at( *e.match_prefix_list ), r.prefix ) ) {
+            continue;
+        }
+        if( e.match_nexthop && e.match_nexthop->to_uint() != out.nexthop ) {
+            continue;
+        }
+        if( e.match_localpref && *e.match_localpref != localpref ) {
+            continue;
+        }
+        if( e.match_as_path && !reference_as_path( *e.match_as_path, r.as_path ) ) {
+            continue;
+        }
+        if( !e.match_community.empty() && std::none_of( e.match_community.begin(), e.match_community.end(), [ &r ]( const std::string &c ) {
+            return std::find( r.communities.begin(), r.communities.end(), c ) != r.communities.end();
+        }) ) {
+            continue;
+        }
+        if( e.set_nexthop ) {
+            out.nexthop = e.set_nexthop->to_uint();
+        }
+        if( e.set_localpref ) {
+            out.localpref = localpref = *e.set_localpref;
+        }
+        for( auto const &c: e.delete_community ) {
+            out.communities.erase( std::remove( out.communities.begin(), out.communities.end(), c ), out.communities.end() );
+        }
+        out.communities.insert( out.communities.end(), e.add_community.begin(), e.add_community.end() );
+        if( e.action == RoutePolicyAction::PASS ) {
+            continue;
+        }
+        if( e.action == RoutePolicyAction::ACCEPT ) {
+            r = out;
+            return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+static RoutePolicyEntry entry( RoutePolicyAction action ) {
+    RoutePolicyEntry e {};
+    e.action = action;
+    return e;
+}
+
+static NLRI prefix( const std::string &str ) {
+    return NLRI( BGP_AFI::IPv4, str );
+}
+
+static uint32_t addr( const std::string &str ) {
+    return address_v4::from_string( str ).to_uint();
+}
+
+struct policy_fixture {
+    policy_fixture():
+        conf {},
+        rng( 3517 )
+    {
+        PrefixList lan;
+        lan.entries.push_back( { prefix( "10.1.0.0/16" ), 24, std::nullopt, RoutePolicyAction::DROP } );
+        lan.entries.push_back( { prefix( "10.0.0.0/8" ), std::nullopt, 16, RoutePolicyAction::ACCEPT } );
+        lan.entries.push_back( { prefix( "198.51.100.0/24" ), std::nullopt, std::nullopt, RoutePolicyAction::ACCEPT } );
+        conf.prefix_lists[ "lan" ] = lan;
+
+        // prefix matches
+        auto &by_prefix = conf.policies[ "by_prefix" ];
+        auto e = entry( RoutePolicyAction::DROP );
+        e.match_prefix_v4 = prefix( "192.0.2.0/24" );
+        by_prefix.entries.push_back( e );
+        e = entry( RoutePolicyAction::ACCEPT );
+        e.match_prefix_list = "lan";
+        e.set_localpref = 300;
+        by_prefix.entries.push_back( e );
+        e = entry( RoutePolicyAction::ACCEPT );
+        e.match_nexthop = address_v4::from_string( "10.0.0.3" );
+        by_prefix.entries.push_back( e );
+
+        // sets of PASS entries are seen by following entries
+        auto &chained = conf.policies[ "chained" ];
+        e = entry( RoutePolicyAction::PASS );
+        e.match_localpref = 200;
+        e.set_nexthop = address_v4::from_string( "10.0.0.2" );
+        chained.entries.push_back( e );
+        e = entry( RoutePolicyAction::PASS );
+        e.match_nexthop = address_v4::from_string( "10.0.0.2" );
+        e.add_community = { "65000:9" };
+        e.delete_community = { "65000:1" };
+        chained.entries.push_back( e );
+        e = entry( RoutePolicyAction::ACCEPT );
+        e.match_as_path = "^65001_";
+        e.set_localpref = 150;
+        chained.entries.push_back( e );
+        e = entry( RoutePolicyAction::DROP );
+        e.match_community = { "65000:2", "65000:3" };
+        chained.entries.push_back( e );
+        chained.entries.push_back( entry( RoutePolicyAction::ACCEPT ) );
+
+        // path conditions combined with prefix list after dynamic next hop
+        auto &by_path = conf.policies[ "by_path" ];
+        e = entry( RoutePolicyAction::DROP );
+        e.match_as_path = "_64512$";
+        by_path.entries.push_back( e );
+        e = entry( RoutePolicyAction::ACCEPT );
+        e.match_community = { "65000:1" };
+        e.match_as_path = "_6500[12]_";
+        e.delete_community = { "65000:1" };
+        e.add_community = { "65000:5" };
+        by_path.entries.push_back( e );
+        e = entry( RoutePolicyAction::PASS );
+        e.match_localpref = 100;
+        e.set_nexthop = address_v4::from_string( "10.0.0.1" );
+        by_path.entries.push_back( e );
+        e = entry( RoutePolicyAction::ACCEPT );
+        e.match_nexthop = address_v4::from_string( "10.0.0.1" );
+        e.match_prefix_list = "lan";
+        by_path.entries.push_back( e );
+    }
+
+    route random_route() {
+        static const std::vector<std::string> prefixes {
+            "10.0.0.0/8", "10.1.0.0/16", "10.1.2.0/24", "10.1.2.128/25", "10.2.0.0/16",
+            "10.2.3.0/24", "192.0.2.0/24", "198.51.100.0/24", "198.51.100.0/25"
+        };
+        static const std::vector<std::vector<uint32_t>> paths {
+            {}, { 65001 }, { 65001, 65002 }, { 65002, 65001, 64512 }, { 64512 }, { 650011 }
+        };
+        static const std::vector<std::string> communities { "65000:1", "65000:2", "65000:3" };
+        route r { prefix( prefixes[ rng() % prefixes.size() ] ), static_cast<uint32_t>( addr( "10.0.0.1" ) + rng() % 3 ), std::nullopt, paths[ rng() % paths.size() ], {} };
+        switch( rng() % 3 ) {
+        case 0:
+            r.localpref = 100;
+            break;
+        case 1:
+            r.localpref = 200;
+            break;
+        default:
+            break;
+        }
+        for( auto const &c: communities ) {
+            if( rng() % 2 == 0 ) {
+                r.communities.push_back( c );
+            }
+        }
+        return r;
+    }
+
+    GlobalConf conf;
+    std::mt19937 rng;
+};
+
+static void check_route( const route &actual, const route &expected ) {
+    BOOST_CHECK_EQUAL( actual.nexthop, expected.nexthop );
+    BOOST_CHECK( actual.localpref == expected.localpref );
+    BOOST_CHECK( actual.communities == expected.communities );
+}
+
+BOOST_AUTO_TEST_SUITE( compiled_route_policy )
+
+BOOST_FIXTURE_TEST_CASE( route_without_decision_is_rejected, policy_fixture ) {
+    route_policy empty( RoutePolicy {}, conf );
+    auto attrs = to_attrs( random_route() );
+    BOOST_CHECK( !empty.apply( prefix( "10.0.0.0/8" ), attrs ) );
+
+    route_policy by_prefix( conf.policies[ "by_prefix" ], conf );
+    route r { prefix( "10.1.2.0/24" ), addr( "10.0.0.1" ), std::nullopt, {}, {} };
+    attrs = to_attrs( r );
+    BOOST_CHECK( !by_prefix.apply( r.prefix, attrs ) );
+}
+
+BOOST_FIXTURE_TEST_CASE( pass_entries_accumulate_sets, policy_fixture ) {
+    route_policy chained( conf.policies[ "chained" ], conf );
+    route r { prefix( "10.0.0.0/8" ), addr( "10.0.0.1" ), 200, { 65001, 65002 }, { "65000:1", "65000:2" } };
+    auto attrs = to_attrs( r );
+    BOOST_REQUIRE( chained.apply( r.prefix, attrs ) );
+    check_route( from_attrs( r.prefix, attrs ), { r.prefix, addr( "10.0.0.2" ), 150, {}, { "65000:2", "65000:9" } } );
+}
+
+BOOST_FIXTURE_TEST_CASE( configuration_errors_are_reported, policy_fixture ) {
+    auto compile = [ this ]( const RoutePolicy &pol ) { route_policy compiled( pol, conf ); };
+    RoutePolicy pol;
+    auto e = entry( RoutePolicyAction::ACCEPT );
+    e.match_prefix_list = "missing";
+    pol.entries.push_back( e );
+    BOOST_CHECK_THROW( compile( pol ), std::runtime_error );
+
+    pol.entries.front().match_prefix_list = "lan";
+    pol.entries.front().match_prefix_v4 = prefix( "10.0.0.0/8" );
+    BOOST_CHECK_THROW( compile( pol ), std::runtime_error );
+}
+
+BOOST_FIXTURE_TEST_CASE( results_match_reference_evaluator, policy_fixture ) {
+    for( auto const &[ name, pol ]: conf.policies ) {
+        BOOST_TEST_CONTEXT( "policy " << name ) {
+            route_policy compiled( pol, conf );
+            std::size_t accepted = 0;
+            for( int i = 0; i < 3000; i++ ) {
+                auto r = random_route();
+                auto attrs = to_attrs( r );
+                bool accept = compiled.apply( r.prefix, attrs );
+                BOOST_REQUIRE_EQUAL( accept, reference_apply( pol, conf, r ) );
+                if( accept ) {
+                    check_route( from_attrs( r.prefix, attrs ), r );
+                    accepted++;
+                }
+            }
+            // both outcomes are covered
+            BOOST_CHECK( accepted > 0 && accepted < 3000 );
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE( route_policy_cache )
+
+BOOST_FIXTURE_TEST_CASE( cached_results_match_direct_evaluation, policy_fixture ) {
+    attr_registry registry;
+    policy_cache cache( registry );
+    for( auto const &[ name, pol ]: conf.policies ) {
+        BOOST_TEST_CONTEXT( "policy " << name ) {
+            route_policy compiled( pol, conf );
+            for( int i = 0; i < 3000; i++ ) {
+                auto r = random_route();
+                auto interned = registry.intern( to_attrs( r ) );
+                auto cached = cache.apply( compiled, r.prefix, interned );
+                auto direct = *interned;
+                bool accept = compiled.apply( r.prefix, direct );
+                BOOST_REQUIRE_EQUAL( cached != nullptr, accept );
+                if( !accept ) {
+                    continue;
+                }
+                BOOST_CHECK( *cached == direct );
+                // result is interned, so equal results of other prefixes share it
+                BOOST_CHECK( cached == registry.intern( direct ) );
+                if( direct == *interned ) {
+                    BOOST_CHECK( cached == interned );
+                }
+            }
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE( cache_follows_recompiled_policy, policy_fixture ) {
+    attr_registry registry;
+    policy_cache cache( registry );
+    route r { prefix( "10.2.0.0/16" ), addr( "10.0.0.1" ), std::nullopt, { 65001 }, {} };
+    auto interned = registry.intern( to_attrs( r ) );
+    route_policy before( conf.policies[ "by_prefix" ], conf );
+    auto cached = cache.apply( before, r.prefix, interned );
+    BOOST_REQUIRE( cached );
+    BOOST_CHECK( from_attrs( r.prefix, *cached ).localpref == 300U );
+
+    conf.policies[ "by_prefix" ].entries.front().match_prefix_v4 = prefix( "10.2.0.0/16" );
+    route_policy after( conf.policies[ "by_prefix" ], conf );
+    BOOST_CHECK( !cache.apply( after, r.prefix, interned ) );
+    BOOST_CHECK( cache.apply( before, r.prefix, interned ) == cached );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
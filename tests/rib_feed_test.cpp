@@ -0,0 +1,183 @@
+#include <list>
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "rib_feed.hpp"
+#include "table.hpp"
+#include "table_v6.hpp"
+#include "fsm.hpp"
+#include "config.hpp"
+#include "packet.hpp"
+#include "message.hpp"
+#include "nlri.hpp"
+
+struct rib_event {
+    RIB_EVENT type;
+    std::string prefix;
+    // zero for withdraw and local routes
+    uint32_t neighbour;
+    std::vector<uint32_t> as_path;
+};
+
+// decodes concatenated IPv4 events in network byte order
+static std::vector<rib_event> decode( const std::string &events ) {
+    std::vector<rib_event> out;
+    std::size_t pos = 0;
+    auto get = [ & ]( std::size_t len ) {
+        BOOST_REQUIRE_LE( pos + len, events.size() );
+        uint32_t value = 0;
+        for( std::size_t i = 0; i < len; i++ ) {
+            value = ( value << 8 ) | static_cast<uint8_t>( events[ pos++ ] );
+        }
+        return value;
+    };
+    while( pos < events.size() ) {
+        auto &event = out.emplace_back( rib_event { static_cast<RIB_EVENT>( get( 1 ) ), {}, 0, {} } );
+        BOOST_REQUIRE_EQUAL( get( 1 ), static_cast<uint32_t>( BGP_AFI::IPv4 ) );
+        auto len = get( 1 );
+        address_v4::bytes_type bytes {};
+        for( std::size_t i = 0; i < ( len + 7 ) / 8; i++ ) {
+            bytes[ i ] = get( 1 );
+        }
+        event.prefix = address_v4( bytes ).to_string() + "/" + std::to_string( len );
+        if( event.type == RIB_EVENT::WITHDRAW ) {
+            continue;
+        }
+        event.neighbour = get( 4 );
+        pos += get( 1 ) + 8;
+        for( auto count = get( 2 ); count > 0; count-- ) {
+            event.as_path.push_back( get( 4 ) );
+        }
+    }
+    return out;
+}
+
+// tables with paths of two peers, sessions are never started
+struct feed_fixture {
+    feed_fixture():
+        conf {},
+        wheel( io ),
+        table( io, conf ),
+        table_v6( io, conf, table ),
+        feed( table, table_v6 )
+    {
+        conf.my_as = 65000;
+        conf.hold_time = 90;
+        for( auto const &[ address, as ]: { std::make_pair( "192.0.2.1", 65001 ), std::make_pair( "192.0.2.2", 65002 ) } ) {
+            auto &nei = neighbours.emplace_back();
+            nei.address = address_v4::from_string( address );
+            nei.remote_as = as;
+            peers.push_back( std::make_shared<bgp_fsm>( io, wheel, buffers, conf, table, nei ) );
+        }
+    }
+
+    void add_path( const std::string &prefix, std::size_t peer, std::vector<uint32_t> as_path ) {
+        std::vector<path_attr_t> attrs( 3 );
+        attrs[ 0 ].make_origin( ORIGIN::IGP );
+        attrs[ 1 ].make_as_path( std::move( as_path ) );
+        attrs[ 2 ].make_nexthop( peers[ peer ]->conf.address );
+        table.add_path( NLRI( BGP_AFI::IPv4, prefix ), attrs, peers[ peer ] );
+    }
+
+    std::shared_ptr<rib_subscription> subscribe( std::optional<NLRI> prefix, std::shared_ptr<bgp_fsm> peer = nullptr ) {
+        auto sub = std::make_shared<rib_subscription>( std::move( prefix ), std::move( peer ), [ this ]() { ready++; } );
+        feed.subscribe( sub );
+        return sub;
+    }
+
+    std::vector<rib_event> take( rib_subscription &sub, std::size_t max_events = 1000 ) {
+        return decode( sub.take( max_events, coalesced ) );
+    }
+
+    boost::asio::io_context io;
+    GlobalConf conf;
+    timer_wheel wheel;
+    buffer_pool buffers;
+    std::list<bgp_neighbour_v4> neighbours;
+    bgp_table_v4 table;
+    bgp_table_v6 table_v6;
+    rib_feed feed;
+    std::vector<std::shared_ptr<bgp_fsm>> peers;
+    int ready = 0;
+    uint64_t coalesced = 0;
+};
+
+BOOST_AUTO_TEST_SUITE( rib_subscriptions )
+
+BOOST_FIXTURE_TEST_CASE( current_best_paths_come_before_changes, feed_fixture ) {
+    add_path( "10.1.0.0/16", 0, { 65001 } );
+    add_path( "192.168.0.0/16", 0, { 65001 } );
+    auto sub = subscribe( NLRI( BGP_AFI::IPv4, "10.0.0.0/8" ) );
+    BOOST_CHECK_EQUAL( ready, 1 );
+    auto events = take( *sub );
+    BOOST_REQUIRE_EQUAL( events.size(), 1U );
+    BOOST_CHECK( events[ 0 ].type == RIB_EVENT::ANNOUNCE );
+    BOOST_CHECK_EQUAL( events[ 0 ].prefix, "10.1.0.0/16" );
+    BOOST_CHECK_EQUAL( events[ 0 ].neighbour, address_v4::from_string( "192.0.2.1" ).to_uint() );
+    BOOST_CHECK( events[ 0 ].as_path == std::vector<uint32_t>( { 65001 } ) );
+    BOOST_CHECK( sub->empty() );
+
+    // prefixes outside of subscription are not queued
+    add_path( "172.16.0.0/12", 0, { 65001 } );
+    BOOST_CHECK( sub->empty() );
+    add_path( "10.2.0.0/16", 0, { 65001 } );
+    BOOST_CHECK_EQUAL( ready, 2 );
+    events = take( *sub );
+    BOOST_REQUIRE_EQUAL( events.size(), 1U );
+    BOOST_CHECK_EQUAL( events[ 0 ].prefix, "10.2.0.0/16" );
+}
+
+BOOST_FIXTURE_TEST_CASE( pending_events_are_coalesced_per_prefix, feed_fixture ) {
+    auto sub = subscribe( std::nullopt );
+    add_path( "10.1.0.0/16", 0, { 65001, 65010 } );
+    add_path( "10.2.0.0/16", 0, { 65001 } );
+    add_path( "10.1.0.0/16", 0, { 65001 } );
+    // consumer is notified only when queue becomes non empty
+    BOOST_CHECK_EQUAL( ready, 1 );
+    auto first = take( *sub, 1 );
+    BOOST_REQUIRE_EQUAL( first.size(), 1U );
+    BOOST_CHECK_EQUAL( first[ 0 ].prefix, "10.1.0.0/16" );
+    BOOST_CHECK( first[ 0 ].as_path == std::vector<uint32_t>( { 65001 } ) );
+    BOOST_CHECK_EQUAL( coalesced, 1U );
+    BOOST_CHECK_EQUAL( take( *sub ).size(), 1U );
+    BOOST_CHECK_EQUAL( coalesced, 0U );
+
+    table.del_path( NLRI( BGP_AFI::IPv4, "10.2.0.0/16" ), peers[ 0 ] );
+    auto events = take( *sub );
+    BOOST_REQUIRE_EQUAL( events.size(), 1U );
+    BOOST_CHECK( events[ 0 ].type == RIB_EVENT::WITHDRAW );
+    BOOST_CHECK_EQUAL( events[ 0 ].prefix, "10.2.0.0/16" );
+}
+
+BOOST_FIXTURE_TEST_CASE( best_path_leaving_neighbour_is_withdrawn, feed_fixture ) {
+    auto sub = subscribe( std::nullopt, peers[ 0 ] );
+    add_path( "10.1.0.0/16", 0, { 65001 } );
+    add_path( "10.2.0.0/16", 1, { 65002 } );
+    // longer AS path, best path stays with first peer
+    add_path( "10.1.0.0/16", 1, { 65002, 65010 } );
+    auto events = take( *sub );
+    BOOST_REQUIRE_EQUAL( events.size(), 1U );
+    BOOST_CHECK( events[ 0 ].type == RIB_EVENT::ANNOUNCE );
+    BOOST_CHECK_EQUAL( events[ 0 ].prefix, "10.1.0.0/16" );
+
+    table.del_path( NLRI( BGP_AFI::IPv4, "10.1.0.0/16" ), peers[ 0 ] );
+    events = take( *sub );
+    BOOST_REQUIRE_EQUAL( events.size(), 1U );
+    BOOST_CHECK( events[ 0 ].type == RIB_EVENT::WITHDRAW );
+    BOOST_CHECK_EQUAL( events[ 0 ].prefix, "10.1.0.0/16" );
+    // changes of other peer's best path are not sent
+    table.del_path( NLRI( BGP_AFI::IPv4, "10.1.0.0/16" ), peers[ 1 ] );
+    BOOST_CHECK( sub->empty() );
+}
+
+BOOST_FIXTURE_TEST_CASE( released_subscription_is_dropped, feed_fixture ) {
+    auto sub = subscribe( std::nullopt );
+    sub.reset();
+    add_path( "10.1.0.0/16", 0, { 65001 } );
+    BOOST_CHECK_EQUAL( ready, 0 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
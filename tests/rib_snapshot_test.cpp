@@ -0,0 +1,140 @@
+#include <list>
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+#include <boost/asio/ip/address_v6.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "rib_snapshot.hpp"
+#include "table.hpp"
+#include "table_v6.hpp"
+#include "fsm.hpp"
+#include "config.hpp"
+#include "packet.hpp"
+#include "nlri.hpp"
+
+// tables with paths of one peer, session is never started
+struct rib_snapshot_fixture {
+    rib_snapshot_fixture():
+        conf {},
+        wheel( io ),
+        table( io, conf ),
+        table_v6( io, conf, table )
+    {
+        conf.my_as = 65000;
+        conf.hold_time = 90;
+        auto &nei = neighbours.emplace_back();
+        nei.address = address_v4::from_string( "192.0.2.1" );
+        nei.remote_as = 65001;
+        peer = std::make_shared<bgp_fsm>( io, wheel, buffers, conf, table, nei );
+    }
+
+    void add_path( const std::string &prefix, const std::string &nexthop, uint32_t path_id = 0 ) {
+        std::vector<path_attr_t> attrs( 3 );
+        attrs[ 0 ].make_origin( ORIGIN::IGP );
+        attrs[ 1 ].make_as_path( { 65001 } );
+        attrs[ 2 ].make_nexthop( address_v4::from_string( nexthop ) );
+        table.add_path( NLRI( BGP_AFI::IPv4, prefix ), attrs, peer, path_id );
+    }
+
+    void add_path_v6( const std::string &prefix ) {
+        auto nexthop = boost::asio::ip::make_address_v6( "2001:db8::1" ).to_bytes();
+        std::vector<path_attr_t> attrs( 3 );
+        attrs[ 0 ].make_origin( ORIGIN::IGP );
+        attrs[ 1 ].make_as_path( { 65001 } );
+        attrs[ 2 ].make_mp_reach( { nexthop.begin(), nexthop.end() }, {} );
+        table_v6.add_path( NLRI( BGP_AFI::IPv6, prefix ), table.intern_attrs( std::move( attrs ) ), peer );
+    }
+
+    static std::vector<std::string> prefixes_v4( const rib_snapshot &rib, const std::optional<NLRI> &after = std::nullopt ) {
+        std::vector<std::string> out;
+        rib.for_each_v4_after( after, [ &out ]( const NLRI &prefix, const std::vector<bgp_path> & ) {
+            out.push_back( prefix.to_string() );
+            return true;
+        });
+        return out;
+    }
+
+    static std::string nexthop_of( const rib_snapshot &rib, const std::string &prefix ) {
+        auto paths = rib.find_v4( NLRI( BGP_AFI::IPv4, prefix ) );
+        BOOST_REQUIRE( paths != nullptr && paths->size() == 1 );
+        return paths->front().get_nexthop_v4().to_string();
+    }
+
+    boost::asio::io_context io;
+    GlobalConf conf;
+    timer_wheel wheel;
+    buffer_pool buffers;
+    std::list<bgp_neighbour_v4> neighbours;
+    bgp_table_v4 table;
+    bgp_table_v6 table_v6;
+    std::shared_ptr<bgp_fsm> peer;
+};
+
+BOOST_AUTO_TEST_SUITE( rib_snapshots )
+
+BOOST_FIXTURE_TEST_CASE( snapshot_is_unchanged_by_table_changes, rib_snapshot_fixture ) {
+    add_path( "10.0.0.0/8", "192.0.2.10" );
+    add_path( "10.1.0.0/16", "192.0.2.10" );
+    add_path( "172.16.0.0/12", "192.0.2.10" );
+    add_path_v6( "2001:db8:1::/48" );
+    auto before = rib_snapshot::take( table, table_v6 );
+    BOOST_CHECK_EQUAL( before->size(), 4U );
+
+    // change, withdraw and add paths in the same and in other segments
+    add_path( "10.0.0.0/8", "192.0.2.20" );
+    table.del_path( NLRI( BGP_AFI::IPv4, "10.1.0.0/16" ), peer, 0 );
+    add_path( "10.2.0.0/16", "192.0.2.20" );
+    add_path( "192.168.0.0/16", "192.0.2.20" );
+    table_v6.del_path( NLRI( BGP_AFI::IPv6, "2001:db8:1::/48" ), peer );
+
+    BOOST_CHECK_EQUAL( before->size(), 4U );
+    BOOST_CHECK( prefixes_v4( *before ) == std::vector<std::string>( { "10.0.0.0/8", "10.1.0.0/16", "172.16.0.0/12" } ) );
+    BOOST_CHECK_EQUAL( nexthop_of( *before, "10.0.0.0/8" ), "192.0.2.10" );
+    BOOST_CHECK( before->find_v6( prefix_v6( NLRI( BGP_AFI::IPv6, "2001:db8:1::/48" ) ) ) != nullptr );
+
+    auto after = rib_snapshot::take( table, table_v6 );
+    BOOST_CHECK_EQUAL( after->size(), 4U );
+    BOOST_CHECK( prefixes_v4( *after ) == std::vector<std::string>( { "10.0.0.0/8", "10.2.0.0/16", "172.16.0.0/12", "192.168.0.0/16" } ) );
+    BOOST_CHECK_EQUAL( nexthop_of( *after, "10.0.0.0/8" ), "192.0.2.20" );
+    BOOST_CHECK( after->find_v6( prefix_v6( NLRI( BGP_AFI::IPv6, "2001:db8:1::/48" ) ) ) == nullptr );
+    // earlier snapshot is still the same after later one is taken
+    BOOST_CHECK_EQUAL( nexthop_of( *before, "10.0.0.0/8" ), "192.0.2.10" );
+}
+
+BOOST_FIXTURE_TEST_CASE( snapshot_outlives_peer_paths, rib_snapshot_fixture ) {
+    add_path( "10.0.0.0/8", "192.0.2.10", 1 );
+    add_path( "10.0.0.0/8", "192.0.2.11", 2 );
+    auto before = rib_snapshot::take( table, table_v6 );
+    table.purge_peer( peer );
+    BOOST_CHECK( table.table.empty() );
+    auto paths = before->find_v4( NLRI( BGP_AFI::IPv4, "10.0.0.0/8" ) );
+    BOOST_REQUIRE( paths != nullptr );
+    BOOST_CHECK_EQUAL( paths->size(), 2U );
+    BOOST_CHECK_EQUAL( rib_snapshot::take( table, table_v6 )->size(), 0U );
+}
+
+BOOST_FIXTURE_TEST_CASE( walk_continues_after_prefix_across_segments, rib_snapshot_fixture ) {
+    for( auto prefix: { "0.0.0.0/0", "10.0.0.0/8", "10.0.0.0/16", "10.16.0.0/12", "10.16.1.0/24", "11.0.0.0/8", "255.255.255.255/32" } ) {
+        add_path( prefix, "192.0.2.10" );
+    }
+    auto rib = rib_snapshot::take( table, table_v6 );
+    auto all = prefixes_v4( *rib );
+    BOOST_REQUIRE_EQUAL( all.size(), 7U );
+    std::vector<std::string> sorted;
+    for( auto const &[ prefix, paths ]: table.table ) {
+        sorted.push_back( prefix.to_string() );
+    }
+    sorted.erase( std::unique( sorted.begin(), sorted.end() ), sorted.end() );
+    // walk is in table order
+    BOOST_CHECK( all == sorted );
+    for( std::size_t i = 0; i < all.size(); i++ ) {
+        BOOST_CHECK( prefixes_v4( *rib, NLRI( BGP_AFI::IPv4, all[ i ] ) ) == std::vector<std::string>( all.begin() + i + 1, all.end() ) );
+    }
+    // prefix which isn't in snapshot
+    auto rest = prefixes_v4( *rib, NLRI( BGP_AFI::IPv4, "10.8.0.0/13" ) );
+    BOOST_CHECK( rest == std::vector<std::string>( std::find( all.begin(), all.end(), "10.16.0.0/12" ), all.end() ) );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
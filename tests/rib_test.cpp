@@ -0,0 +1,345 @@
+#include <list>
+#include <algorithm>
+#include <fstream>
+#include <unistd.h>
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "table.hpp"
+#include "fsm.hpp"
+#include "config.hpp"
+#include "packet.hpp"
+#include "nlri.hpp"
+
+static constexpr uint32_t MY_AS = 65000;
+
+static std::vector<path_attr_t> make_attrs( const std::string &nexthop, uint32_t local_pref = 100, std::size_t as_path_len = 1, std::optional<uint32_t> med = std::nullopt ) {
+    std::vector<path_attr_t> attrs( 4 );
+    attrs[ 0 ].make_origin( ORIGIN::IGP );
+    attrs[ 1 ].four_byte_asn = true;
+    attrs[ 1 ].make_as_path( std::vector<uint32_t>( as_path_len, 65100 ) );
+    attrs[ 2 ].make_nexthop( address_v4::from_string( nexthop ) );
+    attrs[ 3 ].make_local_pref( local_pref );
+    if( med.has_value() ) {
+        path_attr_t attr;
+        attr.optional = 1;
+        attr.type = PATH_ATTRIBUTE::MULTI_EXIT_DISC;
+        auto value = *med;
+        attr.bytes = { static_cast<uint8_t>( value >> 24 ), static_cast<uint8_t>( value >> 16 ), static_cast<uint8_t>( value >> 8 ), static_cast<uint8_t>( value ) };
+        attrs.push_back( std::move( attr ) );
+    }
+    return attrs;
+}
+
+// table with peers, sessions are never started
+struct rib_fixture {
+    rib_fixture():
+        conf {},
+        wheel( io ),
+        table( io, conf )
+    {
+        conf.my_as = MY_AS;
+        conf.hold_time = 90;
+    }
+
+    std::shared_ptr<bgp_fsm> peer( const std::string &address, uint32_t remote_as ) {
+        auto &nei = neighbours.emplace_back();
+        nei.address = address_v4::from_string( address );
+        nei.remote_as = remote_as;
+        return std::make_shared<bgp_fsm>( io, wheel, buffers, conf, table, nei );
+    }
+
+    const bgp_path *best( const NLRI &prefix ) const {
+        auto range = table.table.equal_range( prefix );
+        for( auto it = range.first; it != range.second; it++ ) {
+            if( it->second.isBest ) {
+                return &it->second;
+            }
+        }
+        return nullptr;
+    }
+
+    std::vector<address_v4> forwarding( const NLRI &prefix ) const {
+        std::vector<address_v4> out;
+        if( auto group = table.get_nexthop_group( prefix ) ) {
+            for( auto const &nh: group->nexthops ) {
+                out.push_back( nh.gateway );
+            }
+        }
+        return out;
+    }
+
+    boost::asio::io_context io;
+    GlobalConf conf;
+    timer_wheel wheel;
+    buffer_pool buffers;
+    std::list<bgp_neighbour_v4> neighbours;
+    bgp_table_v4 table;
+};
+
+static const NLRI PREFIX( BGP_AFI::IPv4, "198.51.100.0/24" );
+
+static address_v4 addr( const std::string &s ) {
+    return address_v4::from_string( s );
+}
+
+BOOST_AUTO_TEST_SUITE( best_path_selection )
+
+BOOST_FIXTURE_TEST_CASE( local_pref_is_compared_before_as_path, rib_fixture ) {
+    auto p1 = peer( "192.0.2.1", 65001 );
+    auto p2 = peer( "192.0.2.2", 65002 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.1", 100, 1 ), p1 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.2", 200, 5 ), p2 );
+    BOOST_REQUIRE( best( PREFIX ) );
+    BOOST_CHECK( best( PREFIX )->source == p2 );
+}
+
+BOOST_FIXTURE_TEST_CASE( shorter_as_path_and_lower_med_win, rib_fixture ) {
+    auto p1 = peer( "192.0.2.1", 65001 );
+    auto p2 = peer( "192.0.2.2", 65001 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.1", 100, 3 ), p1 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.2", 100, 2, 50 ), p2 );
+    BOOST_CHECK( best( PREFIX )->source == p2 );
+    // equal AS path, MED decides
+    table.add_path( PREFIX, make_attrs( "10.0.0.1", 100, 2, 10 ), p1 );
+    BOOST_CHECK( best( PREFIX )->source == p1 );
+}
+
+BOOST_FIXTURE_TEST_CASE( ebgp_is_preferred_over_ibgp, rib_fixture ) {
+    auto internal = peer( "192.0.2.1", MY_AS );
+    auto external = peer( "192.0.2.2", 65002 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.1" ), internal );
+    table.add_path( PREFIX, make_attrs( "10.0.0.2" ), external );
+    BOOST_CHECK( best( PREFIX )->source == external );
+}
+
+BOOST_FIXTURE_TEST_CASE( tie_is_broken_by_peer_address, rib_fixture ) {
+    auto high = peer( "192.0.2.9", 65001 );
+    auto low = peer( "192.0.2.1", 65002 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.9" ), high );
+    table.add_path( PREFIX, make_attrs( "10.0.0.1" ), low );
+    BOOST_CHECK( best( PREFIX )->source == low );
+    BOOST_CHECK( forwarding( PREFIX ) == std::vector<address_v4> { addr( "10.0.0.1" ) } );
+}
+
+BOOST_FIXTURE_TEST_CASE( removed_best_path_is_replaced, rib_fixture ) {
+    auto p1 = peer( "192.0.2.1", 65001 );
+    auto p2 = peer( "192.0.2.2", 65002 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.1", 200 ), p1 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.2", 100 ), p2 );
+    BOOST_CHECK( best( PREFIX )->source == p1 );
+    table.del_path( PREFIX, p1 );
+    BOOST_REQUIRE( best( PREFIX ) );
+    BOOST_CHECK( best( PREFIX )->source == p2 );
+    BOOST_CHECK( forwarding( PREFIX ) == std::vector<address_v4> { addr( "10.0.0.2" ) } );
+    table.del_path( PREFIX, p2 );
+    BOOST_CHECK( !best( PREFIX ) );
+    BOOST_CHECK( !table.get_nexthop_group( PREFIX ) );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE( multipath )
+
+BOOST_FIXTURE_TEST_CASE( single_path_without_max_paths, rib_fixture ) {
+    auto p1 = peer( "192.0.2.1", 65001 );
+    auto p2 = peer( "192.0.2.2", 65001 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.1" ), p1 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.2" ), p2 );
+    BOOST_CHECK_EQUAL( forwarding( PREFIX ).size(), 1 );
+}
+
+BOOST_FIXTURE_TEST_CASE( equal_paths_are_limited_by_max_paths, rib_fixture ) {
+    conf.max_paths = 2;
+    auto p1 = peer( "192.0.2.1", 65001 );
+    auto p2 = peer( "192.0.2.2", 65001 );
+    auto p3 = peer( "192.0.2.3", 65001 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.3" ), p3 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.2" ), p2 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.1" ), p1 );
+    // best path and the next one in tie break order, sorted
+    BOOST_CHECK( forwarding( PREFIX ) == ( std::vector<address_v4> { addr( "10.0.0.1" ), addr( "10.0.0.2" ) } ) );
+    std::size_t multipath = 0;
+    auto range = table.table.equal_range( PREFIX );
+    for( auto it = range.first; it != range.second; it++ ) {
+        multipath += it->second.isMultipath;
+    }
+    BOOST_CHECK_EQUAL( multipath, 2 );
+}
+
+BOOST_FIXTURE_TEST_CASE( unequal_paths_are_not_multipath, rib_fixture ) {
+    conf.max_paths = 4;
+    auto p1 = peer( "192.0.2.1", 65001 );
+    auto p2 = peer( "192.0.2.2", 65002 );
+    auto p3 = peer( "192.0.2.3", 65001 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.1" ), p1 );
+    // neighbour AS differs
+    table.add_path( PREFIX, make_attrs( "10.0.0.2" ), p2 );
+    // longer AS path
+    table.add_path( PREFIX, make_attrs( "10.0.0.3", 100, 2 ), p3 );
+    BOOST_CHECK( forwarding( PREFIX ) == std::vector<address_v4> { addr( "10.0.0.1" ) } );
+}
+
+BOOST_FIXTURE_TEST_CASE( paths_via_same_next_hop_are_counted_once, rib_fixture ) {
+    conf.max_paths = 4;
+    auto p1 = peer( "192.0.2.1", 65001 );
+    auto p2 = peer( "192.0.2.2", 65001 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.1" ), p1 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.1" ), p2 );
+    BOOST_CHECK( forwarding( PREFIX ) == std::vector<address_v4> { addr( "10.0.0.1" ) } );
+}
+
+BOOST_FIXTURE_TEST_CASE( prefixes_share_interned_group, rib_fixture ) {
+    conf.max_paths = 2;
+    NLRI other( BGP_AFI::IPv4, "203.0.113.0/24" );
+    auto p1 = peer( "192.0.2.1", 65001 );
+    auto p2 = peer( "192.0.2.2", 65001 );
+    for( auto const &prefix: { PREFIX, other } ) {
+        table.add_path( prefix, make_attrs( "10.0.0.1" ), p1 );
+        table.add_path( prefix, make_attrs( "10.0.0.2" ), p2 );
+    }
+    BOOST_CHECK( table.get_nexthop_group( PREFIX ) == table.get_nexthop_group( other ) );
+    BOOST_CHECK_EQUAL( table.nexthop_groups_count(), 1 );
+
+    table.del_path( other, p2 );
+    BOOST_CHECK( table.get_nexthop_group( PREFIX ) != table.get_nexthop_group( other ) );
+    BOOST_CHECK_EQUAL( table.nexthop_groups_count(), 2 );
+    table.del_path( other, p1 );
+    BOOST_CHECK_EQUAL( table.nexthop_groups_count(), 1 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+// next hops resolved via IGP routes file
+struct nht_fixture: public rib_fixture {
+    nht_fixture() {
+        char name[] = "/tmp/bgp_tests_igp_XXXXXX";
+        int fd = mkstemp( name );
+        BOOST_REQUIRE( fd >= 0 );
+        close( fd );
+        path = name;
+        std::ofstream( path ) <<
+            "- prefix: 10.1.0.0/16\n"
+            "  metric: 20\n"
+            "- prefix: 10.2.0.0/16\n"
+            "  metric: 10\n"
+            "  gateway: 192.0.2.254\n";
+        conf.nexthop_resolution = "file";
+        conf.igp_routes_file = path;
+        table.nht.start();
+    }
+
+    ~nht_fixture() {
+        unlink( path.c_str() );
+    }
+
+    std::string path;
+};
+
+BOOST_AUTO_TEST_SUITE( nexthop_tracking )
+
+BOOST_FIXTURE_TEST_CASE( lower_igp_metric_wins_and_unreachable_is_ignored, nht_fixture ) {
+    auto p1 = peer( "192.0.2.1", MY_AS );
+    auto p2 = peer( "192.0.2.2", MY_AS );
+    auto p3 = peer( "192.0.2.3", MY_AS );
+    table.add_path( PREFIX, make_attrs( "10.1.0.1" ), p1 );
+    table.add_path( PREFIX, make_attrs( "10.2.0.1" ), p2 );
+    // no IGP route, path would win by local preference
+    table.add_path( PREFIX, make_attrs( "10.3.0.1", 200 ), p3 );
+    BOOST_REQUIRE( best( PREFIX ) );
+    BOOST_CHECK( best( PREFIX )->source == p2 );
+    // IGP gateway of next hop is programmed
+    BOOST_CHECK( forwarding( PREFIX ) == std::vector<address_v4> { addr( "192.0.2.254" ) } );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE( graceful_restart )
+
+static std::size_t paths_of( const bgp_table_v4 &table, const NLRI &prefix, const std::shared_ptr<bgp_fsm> &peer ) {
+    auto range = table.table.equal_range( prefix );
+    return std::count_if( range.first, range.second, [ &peer ]( const auto &entry ) { return entry.second.source == peer; } );
+}
+
+BOOST_FIXTURE_TEST_CASE( all_restored_path_ids_are_swept, rib_fixture ) {
+    auto restarted = peer( "192.0.2.1", 65001 );
+    auto other = peer( "192.0.2.2", 65002 );
+    std::vector<std::pair<NLRI,bgp_path>> paths;
+    for( uint32_t id: { 1, 2 } ) {
+        paths.emplace_back( PREFIX, bgp_path( table.intern_attrs( make_attrs( "10.0.0." + std::to_string( id ) ) ), restarted, id ) );
+    }
+    table.restore_paths( std::move( paths ) );
+    table.add_path( PREFIX, make_attrs( "10.0.0.9", 50 ), other );
+    BOOST_CHECK_EQUAL( paths_of( table, PREFIX, restarted ), 2 );
+
+    table.sweep_stale( restarted );
+    BOOST_CHECK_EQUAL( paths_of( table, PREFIX, restarted ), 0 );
+    BOOST_REQUIRE( best( PREFIX ) );
+    BOOST_CHECK( best( PREFIX )->source == other );
+}
+
+BOOST_FIXTURE_TEST_CASE( all_marked_path_ids_are_swept, rib_fixture ) {
+    auto restarted = peer( "192.0.2.1", 65001 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.1" ), restarted, 1 );
+    table.add_path( PREFIX, make_attrs( "10.0.0.2" ), restarted, 2 );
+    table.mark_stale( restarted );
+    // path received again after restart is kept
+    table.add_path( PREFIX, make_attrs( "10.0.0.2" ), restarted, 2 );
+    table.sweep_stale( restarted );
+    BOOST_CHECK_EQUAL( paths_of( table, PREFIX, restarted ), 1 );
+    BOOST_REQUIRE( best( PREFIX ) );
+    BOOST_CHECK_EQUAL( best( PREFIX )->path_id, 2 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE( route_export )
+
+static address_v4 exported_nexthop( const std::map<NLRI,std::vector<bgp_export_path>> &exported, const NLRI &prefix ) {
+    auto it = exported.find( prefix );
+    BOOST_REQUIRE( it != exported.end() && !it->second.empty() );
+    for( auto const &attr: *it->second.front().attrs ) {
+        if( attr.type == PATH_ATTRIBUTE::NEXT_HOP ) {
+            return address_v4( attr.get_u32() );
+        }
+    }
+    BOOST_FAIL( "exported path has no NEXT_HOP" );
+    return {};
+}
+
+BOOST_FIXTURE_TEST_CASE( originated_prefix_is_sent_to_ibgp_with_our_next_hop, rib_fixture ) {
+    NLRI originated( BGP_AFI::IPv4, "203.0.113.0/24" );
+    table.originate( { originated, std::nullopt } );
+    bgp_update_group group { std::nullopt, true, false, false, addr( "192.0.2.254" ), {} };
+    auto exported = table.export_paths( group, { originated } );
+    BOOST_CHECK( exported_nexthop( exported, originated ) == addr( "192.0.2.254" ) );
+    // stored path keeps its placeholder, only exported copy is changed
+    BOOST_CHECK( best( originated )->get_nexthop_v4() == addr( "0.0.0.0" ) );
+
+    // shared packets of group carry the same next hop
+    auto pkts = build_group_updates( exported );
+    BOOST_REQUIRE_EQUAL( pkts.size(), 1 );
+    bgp_packet packet { pkts.front()->data(), pkts.front()->size() };
+    auto [ withdrawn, attrs, prefixes ] = packet.process_update( true, false );
+    BOOST_REQUIRE_EQUAL( prefixes.size(), 1 );
+    auto nexthop = std::find_if( attrs.begin(), attrs.end(), []( const path_attr_t &a ) { return a.type == PATH_ATTRIBUTE::NEXT_HOP; } );
+    BOOST_REQUIRE( nexthop != attrs.end() );
+    BOOST_CHECK( address_v4( nexthop->get_u32() ) == addr( "192.0.2.254" ) );
+}
+
+BOOST_FIXTURE_TEST_CASE( next_hop_set_by_origination_policy_is_kept, rib_fixture ) {
+    RoutePolicyEntry entry {};
+    entry.set_nexthop = addr( "192.0.2.10" );
+    entry.action = RoutePolicyAction::ACCEPT;
+    conf.policies[ "set_nexthop" ].entries.push_back( entry );
+    table.reload_policies( { "set_nexthop" }, false );
+    NLRI originated( BGP_AFI::IPv4, "203.0.113.0/24" );
+    table.originate( { originated, std::string( "set_nexthop" ) } );
+    bgp_update_group group { std::nullopt, true, false, false, addr( "192.0.2.254" ), {} };
+    BOOST_CHECK( exported_nexthop( table.export_paths( group, { originated } ), originated ) == addr( "192.0.2.10" ) );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
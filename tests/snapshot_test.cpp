@@ -0,0 +1,114 @@
+#include <list>
+#include <fstream>
+#include <unistd.h>
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "snapshot.hpp"
+#include "table.hpp"
+#include "table_v6.hpp"
+#include "neighbour_index.hpp"
+#include "fsm.hpp"
+#include "config.hpp"
+#include "packet.hpp"
+#include "nlri.hpp"
+
+static const NLRI PREFIX( BGP_AFI::IPv4, "198.51.100.0/24" );
+
+// table with routes of one peer saved to snapshot file, which is removed after test
+struct snapshot_fixture {
+    snapshot_fixture():
+        conf {},
+        wheel( io ),
+        table( io, conf ),
+        table_v6( io, conf, table ),
+        snapshot( io, conf, table, table_v6 )
+    {
+        char name[] = "/tmp/bgp_tests_snapshot_XXXXXX";
+        int fd = mkstemp( name );
+        BOOST_REQUIRE( fd >= 0 );
+        close( fd );
+        conf.my_as = 65000;
+        conf.hold_time = 90;
+        conf.snapshot_path = name;
+
+        auto &nei = neighbours.emplace_back();
+        nei.address = address_v4::from_string( "192.0.2.1" );
+        nei.remote_as = 65001;
+        peer = std::make_shared<bgp_fsm>( io, wheel, buffers, conf, table, nei );
+        index.emplace( nei.address, peer );
+
+        std::vector<path_attr_t> attrs( 3 );
+        attrs[ 0 ].make_origin( ORIGIN::IGP );
+        attrs[ 1 ].four_byte_asn = true;
+        attrs[ 1 ].make_as_path( { 65001, 65002 } );
+        attrs[ 2 ].make_nexthop( address_v4::from_string( "10.0.0.1" ) );
+        table.add_path( PREFIX, attrs, peer );
+        table.add_path( NLRI( BGP_AFI::IPv4, "203.0.113.0/24" ), attrs, peer );
+        BOOST_REQUIRE( snapshot.save() );
+        table.purge_peer( peer );
+        BOOST_REQUIRE( table.table.empty() );
+    }
+
+    ~snapshot_fixture() {
+        unlink( conf.snapshot_path->c_str() );
+    }
+
+    std::vector<uint8_t> read_file() {
+        std::ifstream in( *conf.snapshot_path, std::ios::binary );
+        return { std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() };
+    }
+
+    void write_file( const std::vector<uint8_t> &bytes ) {
+        std::ofstream out( *conf.snapshot_path, std::ios::binary | std::ios::trunc );
+        out.write( reinterpret_cast<const char*>( bytes.data() ), bytes.size() );
+    }
+
+    boost::asio::io_context io;
+    GlobalConf conf;
+    timer_wheel wheel;
+    buffer_pool buffers;
+    std::list<bgp_neighbour_v4> neighbours;
+    bgp_table_v4 table;
+    bgp_table_v6 table_v6;
+    bgp_snapshot snapshot;
+    neighbour_index index;
+    std::shared_ptr<bgp_fsm> peer;
+};
+
+BOOST_AUTO_TEST_SUITE( rib_snapshot_file )
+
+BOOST_FIXTURE_TEST_CASE( saved_paths_are_restored, snapshot_fixture ) {
+    BOOST_REQUIRE( snapshot.load( index ) );
+    BOOST_CHECK_EQUAL( table.table.size(), 2U );
+    auto it = table.table.find( PREFIX );
+    BOOST_REQUIRE( it != table.table.end() );
+    BOOST_CHECK( it->second.source == peer );
+    BOOST_CHECK( it->second.isStale );
+}
+
+BOOST_FIXTURE_TEST_CASE( attribute_longer_than_its_set_is_rejected, snapshot_fixture ) {
+    auto bytes = read_file();
+    // length of first attribute, ORIGIN, follows its flags and type
+    auto offset = sizeof( snapshot_header ) + sizeof( snapshot_attr_set ) + 2;
+    BOOST_REQUIRE_GT( bytes.size(), offset );
+    BOOST_REQUIRE_EQUAL( bytes[ offset ], 1 );
+    bytes[ offset ] = 0xFF;
+    write_file( bytes );
+    BOOST_CHECK( !snapshot.load( index ) );
+    BOOST_CHECK( table.table.empty() );
+}
+
+BOOST_FIXTURE_TEST_CASE( truncated_file_is_rejected, snapshot_fixture ) {
+    auto bytes = read_file();
+    for( auto size: { sizeof( snapshot_header ) + sizeof( snapshot_attr_set ) + 4, bytes.size() - sizeof( snapshot_path ) / 2 } ) {
+        write_file( { bytes.begin(), bytes.begin() + size } );
+        BOOST_CHECK( !snapshot.load( index ) );
+        BOOST_CHECK( table.table.empty() );
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
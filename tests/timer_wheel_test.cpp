@@ -0,0 +1,110 @@
+#include <memory>
+#include <thread>
+#include <boost/test/unit_test.hpp>
+
+#include "timer_wheel.hpp"
+
+using namespace std::chrono_literals;
+
+struct wheel_fixture {
+    wheel_fixture():
+        wheel( io )
+    {}
+
+    std::chrono::milliseconds elapsed() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - started );
+    }
+
+    boost::asio::io_context io;
+    timer_wheel wheel;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+};
+
+BOOST_AUTO_TEST_SUITE( session_timer_wheel )
+
+BOOST_FIXTURE_TEST_CASE( timers_expire_in_order_after_delay, wheel_fixture ) {
+    wheel_timer first( wheel );
+    wheel_timer second( wheel );
+    wheel_timer third( wheel );
+    std::vector<std::pair<int,std::chrono::milliseconds>> fired;
+    third.arm( 300ms, [ & ] { fired.emplace_back( 3, elapsed() ); } );
+    first.arm( 50ms, [ & ] { fired.emplace_back( 1, elapsed() ); } );
+    second.arm( 200ms, [ & ] { fired.emplace_back( 2, elapsed() ); } );
+    BOOST_CHECK_EQUAL( wheel.size(), 3 );
+    BOOST_CHECK( first.armed() );
+
+    // loop returns, because wheel stops its asio timer when nothing is armed
+    io.run();
+    BOOST_REQUIRE_EQUAL( fired.size(), 3 );
+    BOOST_CHECK_EQUAL( fired[ 0 ].first, 1 );
+    BOOST_CHECK_EQUAL( fired[ 1 ].first, 2 );
+    BOOST_CHECK_EQUAL( fired[ 2 ].first, 3 );
+    BOOST_CHECK( fired[ 0 ].second >= 50ms );
+    BOOST_CHECK( fired[ 1 ].second >= 200ms );
+    BOOST_CHECK( fired[ 2 ].second >= 300ms );
+    BOOST_CHECK_EQUAL( wheel.size(), 0 );
+    BOOST_CHECK( !first.armed() );
+}
+
+BOOST_FIXTURE_TEST_CASE( cancelled_and_rearmed_timers, wheel_fixture ) {
+    wheel_timer cancelled( wheel );
+    wheel_timer rearmed( wheel );
+    auto destroyed = std::make_unique<wheel_timer>( wheel );
+    int calls = 0;
+    int rearmed_calls = 0;
+    cancelled.arm( 100ms, [ & ] { calls++; } );
+    destroyed->arm( 100ms, [ & ] { calls++; } );
+    rearmed.arm( 100ms, [ & ] { calls++; } );
+    rearmed.arm( 200ms, [ & ] { rearmed_calls++; } );
+    BOOST_CHECK_EQUAL( wheel.size(), 3 );
+    cancelled.cancel();
+    destroyed.reset();
+    BOOST_CHECK_EQUAL( wheel.size(), 1 );
+
+    io.run();
+    BOOST_CHECK_EQUAL( calls, 0 );
+    BOOST_CHECK_EQUAL( rearmed_calls, 1 );
+    BOOST_CHECK( elapsed() >= 200ms );
+}
+
+BOOST_FIXTURE_TEST_CASE( callback_changes_expired_timers, wheel_fixture ) {
+    wheel_timer a( wheel );
+    wheel_timer b( wheel );
+    wheel_timer periodic( wheel );
+    int expired = 0;
+    // both expire in the same tick, the one called first cancels the other
+    a.arm( 100ms, [ & ] { expired++; b.cancel(); } );
+    b.arm( 100ms, [ & ] { expired++; a.cancel(); } );
+    int rounds = 0;
+    std::function<void()> again = [ & ] {
+        if( ++rounds < 3 ) {
+            periodic.arm( 100ms, again );
+        }
+    };
+    periodic.arm( 100ms, again );
+
+    io.run();
+    BOOST_CHECK_EQUAL( expired, 1 );
+    BOOST_CHECK_EQUAL( rounds, 3 );
+    BOOST_CHECK( elapsed() >= 300ms );
+    BOOST_CHECK_EQUAL( wheel.size(), 0 );
+}
+
+BOOST_FIXTURE_TEST_CASE( wheel_starts_again_after_idle, wheel_fixture ) {
+    wheel_timer t( wheel );
+    int calls = 0;
+    t.arm( 100ms, [ & ] { calls++; } );
+    io.run();
+    BOOST_CHECK_EQUAL( calls, 1 );
+
+    // ticks while wheel was stopped don't shorten next delay
+    std::this_thread::sleep_for( 250ms );
+    io.restart();
+    auto armed_at = std::chrono::steady_clock::now();
+    t.arm( 200ms, [ & ] { calls++; } );
+    io.run();
+    BOOST_CHECK_EQUAL( calls, 2 );
+    BOOST_CHECK( std::chrono::steady_clock::now() - armed_at >= 200ms );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
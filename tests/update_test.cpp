@@ -0,0 +1,236 @@
+#include <sstream>
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+#include <boost/asio/ip/address_v6.hpp>
+
+using address_v4 = boost::asio::ip::address_v4;
+
+#include "packet.hpp"
+#include "nlri.hpp"
+#include "fsm.hpp"
+#include "community.hpp"
+
+static std::vector<path_attr_t> std_attrs( std::size_t as_path_len = 1 ) {
+    std::vector<path_attr_t> attrs( 3 );
+    attrs[ 0 ].make_origin( ORIGIN::IGP );
+    attrs[ 1 ].four_byte_asn = true;
+    attrs[ 1 ].make_as_path( std::vector<uint32_t>( as_path_len, 65001 ) );
+    attrs[ 2 ].make_nexthop( address_v4::from_string( "10.0.0.1" ) );
+    return attrs;
+}
+
+// /24 prefixes in first_octet/8, path identifiers are consecutive from first_id
+static std::vector<path_nlri_t> prefixes_v4( std::size_t count, uint32_t first_id = 0, int first_octet = 20 ) {
+    std::vector<path_nlri_t> out;
+    for( std::size_t i = 0; i < count; i++ ) {
+        auto prefix = std::to_string( first_octet ) + "." + std::to_string( i / 256 ) + "." + std::to_string( i % 256 ) + ".0/24";
+        out.push_back( { first_id != 0 ? static_cast<uint32_t>( first_id + i ) : 0, NLRI( BGP_AFI::IPv4, prefix ) } );
+    }
+    return out;
+}
+
+// /48 prefixes in 2001:db8::/32
+static std::vector<path_nlri_t> prefixes_v6( std::size_t count, int first = 0 ) {
+    std::vector<path_nlri_t> out;
+    for( std::size_t i = 0; i < count; i++ ) {
+        std::ostringstream prefix;
+        prefix << "2001:db8:" << std::hex << first + i << "::/48";
+        out.push_back( { 0, NLRI( BGP_AFI::IPv6, prefix.str() ) } );
+    }
+    return out;
+}
+
+struct decoded_update {
+    std::vector<path_nlri_t> withdrawn;
+    std::vector<path_attr_t> attrs;
+    std::vector<path_nlri_t> prefixes;
+};
+
+static decoded_update decode( std::vector<uint8_t> &pkt, bool add_path ) {
+    bgp_packet packet { pkt.data(), pkt.size() };
+    BOOST_REQUIRE( packet.get_header()->type == bgp_type::UPDATE );
+    BOOST_REQUIRE_EQUAL( packet.get_header()->length.native(), pkt.size() );
+    auto [ withdrawn, attrs, prefixes ] = packet.process_update( true, add_path );
+    return { withdrawn, attrs, prefixes };
+}
+
+static void check_same( const std::vector<path_nlri_t> &lhs, const std::vector<path_nlri_t> &rhs ) {
+    BOOST_REQUIRE_EQUAL( lhs.size(), rhs.size() );
+    for( std::size_t i = 0; i < lhs.size(); i++ ) {
+        BOOST_CHECK( lhs[ i ].prefix == rhs[ i ].prefix );
+        BOOST_CHECK_EQUAL( lhs[ i ].path_id, rhs[ i ].path_id );
+    }
+}
+
+BOOST_AUTO_TEST_SUITE( update_encoding )
+
+BOOST_AUTO_TEST_CASE( small_update_is_one_message ) {
+    auto attrs = std_attrs();
+    auto prefixes = prefixes_v4( 3 );
+    auto withdrawn = std::vector<path_nlri_t>{ { 0, NLRI( BGP_AFI::IPv4, "30.0.0.0/8" ) } };
+    auto pkts = build_updates( prefixes, attrs, withdrawn, false );
+    BOOST_REQUIRE_EQUAL( pkts.size(), 1U );
+    auto update = decode( *pkts.front(), false );
+    check_same( update.withdrawn, withdrawn );
+    check_same( update.prefixes, prefixes );
+    BOOST_REQUIRE_EQUAL( update.attrs.size(), attrs.size() );
+    for( std::size_t i = 0; i < attrs.size(); i++ ) {
+        BOOST_CHECK( update.attrs[ i ] == attrs[ i ] );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( full_table_is_split_at_message_size ) {
+    auto attrs = std_attrs();
+    auto prefixes = prefixes_v4( 5000 );
+    auto pkts = build_updates( prefixes, attrs, {}, false );
+    BOOST_CHECK_GT( pkts.size(), 1U );
+    std::vector<path_nlri_t> received;
+    for( auto &pkt: pkts ) {
+        BOOST_CHECK_LE( pkt->size(), BGP_MAX_MSG_SIZE );
+        auto update = decode( *pkt, false );
+        BOOST_CHECK( update.withdrawn.empty() );
+        BOOST_CHECK_EQUAL( update.attrs.size(), attrs.size() );
+        received.insert( received.end(), update.prefixes.begin(), update.prefixes.end() );
+    }
+    check_same( received, prefixes );
+    // every message but last is filled
+    std::size_t attrs_len = 0;
+    for( auto const &attr: attrs ) {
+        attrs_len += attr.to_bytes().size();
+    }
+    auto per_message = ( BGP_MAX_MSG_SIZE - sizeof( bgp_header ) - 2 * sizeof( uint16_t ) - attrs_len ) / 4;
+    BOOST_CHECK_EQUAL( pkts.size(), ( prefixes.size() + per_message - 1 ) / per_message );
+}
+
+BOOST_AUTO_TEST_CASE( withdrawn_routes_go_first_without_attributes ) {
+    auto attrs = std_attrs();
+    auto withdrawn = prefixes_v4( 2000 );
+    auto prefixes = std::vector<path_nlri_t>{ { 0, NLRI( BGP_AFI::IPv4, "40.0.0.0/16" ) } };
+    auto pkts = build_updates( prefixes, attrs, withdrawn, false );
+    BOOST_REQUIRE_GT( pkts.size(), 1U );
+    std::vector<path_nlri_t> received_withdrawn;
+    std::vector<path_nlri_t> received;
+    for( std::size_t i = 0; i < pkts.size(); i++ ) {
+        BOOST_CHECK_LE( pkts[ i ]->size(), BGP_MAX_MSG_SIZE );
+        auto update = decode( *pkts[ i ], false );
+        // attributes are sent only together with prefixes
+        BOOST_CHECK_EQUAL( update.attrs.empty(), update.prefixes.empty() );
+        if( !update.withdrawn.empty() ) {
+            BOOST_CHECK( received.empty() );
+        }
+        received_withdrawn.insert( received_withdrawn.end(), update.withdrawn.begin(), update.withdrawn.end() );
+        received.insert( received.end(), update.prefixes.begin(), update.prefixes.end() );
+    }
+    check_same( received_withdrawn, withdrawn );
+    check_same( received, prefixes );
+}
+
+BOOST_AUTO_TEST_CASE( oversized_attributes_drop_prefixes ) {
+    auto attrs = std_attrs();
+    path_attr_t big;
+    big.optional = 1;
+    big.transitive = 1;
+    big.type = static_cast<PATH_ATTRIBUTE>( 250 );
+    big.bytes.resize( BGP_MAX_MSG_SIZE );
+    attrs.push_back( big );
+    auto withdrawn = prefixes_v4( 2 );
+    auto pkts = build_updates( prefixes_v4( 10 ), attrs, withdrawn, false );
+    // withdrawn routes are still sent
+    BOOST_REQUIRE_EQUAL( pkts.size(), 1U );
+    auto update = decode( *pkts.front(), false );
+    check_same( update.withdrawn, withdrawn );
+    BOOST_CHECK( update.prefixes.empty() );
+    BOOST_CHECK( update.attrs.empty() );
+}
+
+BOOST_AUTO_TEST_CASE( add_path_identifiers_count_towards_size ) {
+    auto attrs = std_attrs();
+    auto prefixes = prefixes_v4( 3000, 1 );
+    auto withdrawn = prefixes_v4( 1000, 5000 );
+    auto pkts = build_updates( prefixes, attrs, withdrawn, true );
+    std::vector<path_nlri_t> received_withdrawn;
+    std::vector<path_nlri_t> received;
+    for( auto &pkt: pkts ) {
+        BOOST_CHECK_LE( pkt->size(), BGP_MAX_MSG_SIZE );
+        auto update = decode( *pkt, true );
+        received_withdrawn.insert( received_withdrawn.end(), update.withdrawn.begin(), update.withdrawn.end() );
+        received.insert( received.end(), update.prefixes.begin(), update.prefixes.end() );
+    }
+    check_same( received_withdrawn, withdrawn );
+    check_same( received, prefixes );
+    // path identifier and /24 prefix take 8 bytes, so more messages are needed than without ADD-PATH
+    BOOST_CHECK_GT( pkts.size(), build_updates( prefixes, attrs, withdrawn, false ).size() );
+}
+
+BOOST_AUTO_TEST_CASE( shared_group_packets_are_bounded ) {
+    auto attrs = std::make_shared<std::vector<path_attr_t>>( std_attrs() );
+    std::map<NLRI,std::vector<bgp_export_path>> exported;
+    for( auto const &p: prefixes_v4( 4000 ) ) {
+        exported[ p.prefix ].push_back( { nullptr, attrs } );
+    }
+    for( auto const &p: prefixes_v4( 1500, 0, 30 ) ) {
+        // prefix without exportable paths is withdrawn
+        exported[ p.prefix ];
+    }
+    std::size_t announced = 0;
+    std::size_t withdrawn = 0;
+    for( auto &pkt: build_group_updates( exported ) ) {
+        BOOST_CHECK_LE( pkt->size(), BGP_MAX_MSG_SIZE );
+        auto update = decode( *pkt, false );
+        announced += update.prefixes.size();
+        withdrawn += update.withdrawn.size();
+    }
+    BOOST_CHECK_EQUAL( announced, 4000U );
+    BOOST_CHECK_EQUAL( withdrawn, 1500U );
+}
+
+BOOST_AUTO_TEST_CASE( nothing_to_send ) {
+    BOOST_CHECK( build_updates( {}, std_attrs(), {}, false ).empty() );
+}
+
+BOOST_AUTO_TEST_CASE( ipv6_updates_with_large_attributes_are_bounded ) {
+    // longest AS_PATH segment and many large communities leave little room for prefixes
+    auto attrs = std_attrs( 255 );
+    std::vector<uint32_t> words;
+    for( uint32_t i = 0; i < 100 * 3; i++ ) {
+        words.push_back( 65001 + i );
+    }
+    path_attr_t large;
+    large.make_communities( community_list::intern( PATH_ATTRIBUTE::LARGE_COMMUNITY, words ) );
+    attrs.push_back( large );
+    auto nexthop = boost::asio::ip::make_address_v6( "2001:db8::1" ).to_bytes();
+    auto prefixes = prefixes_v6( 1000 );
+    auto withdrawn = prefixes_v6( 500, 0x8000 );
+    auto pkts = build_updates_v6( prefixes, attrs, { nexthop.begin(), nexthop.end() }, withdrawn );
+    BOOST_CHECK_GT( pkts.size(), 1U );
+    std::vector<path_nlri_t> received_withdrawn;
+    std::vector<path_nlri_t> received;
+    for( auto &pkt: pkts ) {
+        BOOST_CHECK_LE( pkt->size(), BGP_MAX_MSG_SIZE );
+        auto update = decode( *pkt, false );
+        BOOST_CHECK( update.withdrawn.empty() );
+        BOOST_CHECK( update.prefixes.empty() );
+        auto mp = take_mp_nlri( update.attrs );
+        if( mp.has_reach ) {
+            // attributes go with every MP_REACH_NLRI, IPv4 next hop is not sent
+            BOOST_CHECK_EQUAL( update.attrs.size(), attrs.size() );
+        }
+        received_withdrawn.insert( received_withdrawn.end(), mp.withdrawn.begin(), mp.withdrawn.end() );
+        received.insert( received.end(), mp.routes.begin(), mp.routes.end() );
+    }
+    check_same( received_withdrawn, withdrawn );
+    check_same( received, prefixes );
+}
+
+BOOST_AUTO_TEST_CASE( ipv6_end_of_rib ) {
+    auto pkts = build_updates_v6( {}, {}, {}, {} );
+    BOOST_REQUIRE_EQUAL( pkts.size(), 1U );
+    auto update = decode( *pkts.front(), false );
+    auto mp = take_mp_nlri( update.attrs );
+    BOOST_CHECK( mp.has_unreach );
+    BOOST_CHECK( mp.withdrawn.empty() );
+    BOOST_CHECK( update.attrs.empty() );
+}
+
+BOOST_AUTO_TEST_SUITE_END()